@@ -3,6 +3,31 @@ import 'dart:async';
 import 'package:flutter/services.dart';
 import 'package:record_platform_interface/record_platform_interface.dart';
 
+import 'src/linux_audio_packet.dart';
+import 'src/linux_capture_error.dart';
+import 'src/linux_capture_stats.dart';
+import 'src/linux_dropout.dart';
+import 'src/linux_dsp_stats.dart';
+import 'src/linux_pool_benchmark.dart';
+import 'src/linux_vad_event.dart';
+import 'src/linux_vox_take.dart';
+import 'src/linux_waveform.dart';
+
+export 'src/linux_audio_chunk.dart';
+export 'src/linux_audio_packet.dart';
+export 'src/linux_capture_error.dart';
+export 'src/linux_capture_recovery.dart';
+export 'src/linux_capture_stats.dart';
+export 'src/linux_dropout.dart';
+export 'src/linux_dsp_stats.dart';
+export 'src/linux_format_benchmark.dart';
+export 'src/linux_pool_benchmark.dart';
+export 'src/linux_realtime_stats.dart';
+export 'src/linux_resampler_benchmark.dart';
+export 'src/linux_vad_event.dart';
+export 'src/linux_vox_take.dart';
+export 'src/linux_waveform.dart';
+
 /// The Linux implementation of the Record plugin.
 /// Communicates with native (C++ or other) code via a [MethodChannel].
 class RecordLinux extends RecordPlatform {
@@ -21,6 +46,33 @@ class RecordLinux extends RecordPlatform {
   /// Broadcasts PCM bytes when recording in stream mode
   StreamController<Uint8List>? _audioCtrl;
 
+  /// Broadcasts encoded packets with their timestamps in stream mode
+  StreamController<LinuxAudioPacket>? _packetCtrl;
+
+  /// Broadcasts PCM chunks with their capture timing in stream mode
+  StreamController<LinuxAudioChunk>? _chunkCtrl;
+
+  /// Broadcasts waveform peaks while recording
+  StreamController<LinuxWaveformUpdate>? _waveformCtrl;
+
+  /// Broadcasts speech start/end events while recording
+  StreamController<LinuxVadEvent>? _vadCtrl;
+
+  /// Broadcasts VOX take start/end
+  StreamController<LinuxVoxTake>? _voxCtrl;
+
+  /// Broadcasts audio lost by the capture
+  StreamController<LinuxDropout>? _dropoutCtrl;
+
+  /// Broadcasts failures of the capture stream
+  StreamController<LinuxCaptureError>? _captureErrorCtrl;
+
+  /// Broadcasts reconnections of a lost capture
+  StreamController<LinuxCaptureRecovery>? _captureRecoveredCtrl;
+
+  /// Whether takes are currently driven by [startVox]
+  bool _voxActive = false;
+
   /// Keep track of the file path passed in [start], so we can return it in [stop].
   String? _recordedFilePath;
 
@@ -28,10 +80,14 @@ class RecordLinux extends RecordPlatform {
   ///  create(...)
   ///
   ///  Called before starting a recorder session, if it isn't already created.
+  ///
+  ///  Connects a corked capture stream with the default [RecordConfig] and
+  ///  parks the capture thread on it, so that a start with the same device,
+  ///  rate, channels and formats only uncorks it. The connection is kept
+  ///  between sessions, until [dispose].
   @override
   Future<void> create(String recorderId) async {
-    // On Linux, there might be no special "create" logic needed,
-    // but we keep this so it parallels other platform implementations.
+    await _channel.invokeMethod('create');
   }
 
   /// --------------------------------------------------------------------------
@@ -48,8 +104,13 @@ class RecordLinux extends RecordPlatform {
       // Store the path so we can return it later in stop()
       _recordedFilePath = path;
 
+      _listenNativeCalls();
+
       // Invoke platform logic to start a file-based recording
-      await _channel.invokeMethod('startRecordingFile', path);
+      await _channel.invokeMethod('startRecordingFile', {
+        'path': path,
+        'config': config.toMap(),
+      });
 
       _updateState(RecordState.record);
     } on PlatformException catch (e) {
@@ -61,6 +122,12 @@ class RecordLinux extends RecordPlatform {
   ///  startStream(...)
   ///
   ///  Starts a new recording session and returns a [Stream] of raw PCM [Uint8List].
+  ///
+  ///  With `AudioEncoder.opus`, the stream carries Opus packets (or Ogg pages,
+  ///  see [LinuxRecordConfig.streamOggFraming]) instead, encoded natively.
+  ///  Likewise with a [LinuxRecordConfig.codec], it carries the codec data.
+  ///  Their timestamps are available from [onAudioPacket], those of PCM
+  ///  chunks from [onAudioChunk].
   @override
   Future<Stream<Uint8List>> startStream(
     String recorderId,
@@ -69,19 +136,13 @@ class RecordLinux extends RecordPlatform {
     // Create a broadcast stream controller for PCM data
     _audioCtrl = StreamController<Uint8List>.broadcast();
 
-    // Handle native -> Dart callbacks
-    _channel.setMethodCallHandler((MethodCall call) async {
-      if (call.method == 'audioData') {
-        final bytes = call.arguments as Uint8List?;
-        if (bytes != null && !_audioCtrl!.isClosed) {
-          _audioCtrl!.add(bytes);
-        }
-      }
-    });
+    _listenNativeCalls();
 
     try {
       // Tell native code to start capturing audio data
-      await _channel.invokeMethod('startRecording');
+      await _channel.invokeMethod('startRecording', {
+        'config': config.toMap(),
+      });
       _updateState(RecordState.record);
     } on PlatformException catch (e) {
       throw Exception('Failed to start stream-based recording: ${e.message}');
@@ -96,13 +157,15 @@ class RecordLinux extends RecordPlatform {
   ///  Stops the current recording session and returns the file path (if any).
   @override
   Future<String?> stop(String recorderId) async {
-    // If we're not actively recording, just return whatever our last path was
-    if (_state != RecordState.record) {
+    // If there is no session (recording or paused), just return whatever
+    // our last path was
+    if (_state == RecordState.stop) {
       return _recordedFilePath;
     }
 
     try {
-      await _channel.invokeMethod('stopRecordingFile');
+      // Dispatched natively: a stream session emits its encoder tail first.
+      await _channel.invokeMethod('stopRecording');
       _updateState(RecordState.stop);
     } on PlatformException catch (e) {
       throw Exception('Failed to stop recording: ${e.message}');
@@ -117,19 +180,32 @@ class RecordLinux extends RecordPlatform {
   ///  Stops and discards/deletes the file (if needed).
   @override
   Future<void> cancel(String recorderId) async {
-    // If you want to literally delete the file, you can call a separate
-    // method on the native side. For now, we just call [stop].
-    await stop(recorderId);
+    if (_state == RecordState.stop) return;
+
+    try {
+      // The file is deleted natively once closed.
+      await _channel.invokeMethod('cancelRecording');
+      _updateState(RecordState.stop);
+    } on PlatformException catch (e) {
+      throw Exception('Failed to cancel recording: ${e.message}');
+    }
   }
 
   /// --------------------------------------------------------------------------
   ///  pause(...)
   ///
   ///  Pauses recording session.
+  ///  The capture stream is corked on the server until [resume].
   @override
   Future<void> pause(String recorderId) async {
-    // Not implemented on Linux
-    throw UnsupportedError('Pause is not implemented on Linux.');
+    if (_state != RecordState.record) return;
+
+    try {
+      await _channel.invokeMethod('pauseRecording');
+      _updateState(RecordState.pause);
+    } on PlatformException catch (e) {
+      throw Exception('Failed to pause recording: ${e.message}');
+    }
   }
 
   /// --------------------------------------------------------------------------
@@ -138,8 +214,14 @@ class RecordLinux extends RecordPlatform {
   ///  Resumes recording session after [pause].
   @override
   Future<void> resume(String recorderId) async {
-    // Not implemented on Linux
-    throw UnsupportedError('Resume is not implemented on Linux.');
+    if (_state != RecordState.pause) return;
+
+    try {
+      await _channel.invokeMethod('resumeRecording');
+      _updateState(RecordState.record);
+    } on PlatformException catch (e) {
+      throw Exception('Failed to resume recording: ${e.message}');
+    }
   }
 
   /// --------------------------------------------------------------------------
@@ -148,7 +230,7 @@ class RecordLinux extends RecordPlatform {
   ///  Checks if there's a valid recording session (even if paused).
   @override
   Future<bool> isRecording(String recorderId) async {
-    return _state == RecordState.record;
+    return _state != RecordState.stop;
   }
 
   /// --------------------------------------------------------------------------
@@ -183,11 +265,15 @@ class RecordLinux extends RecordPlatform {
   /// --------------------------------------------------------------------------
   ///  getAmplitude(...)
   ///
-  ///  Gets current average & max amplitudes (dBFS).
-  ///  Linux implementation is stubbed out => returns -160 dBFS for both.
+  ///  Gets current & max amplitudes (dBFS).
+  ///  Peak of the last captured chunk, and the highest since the start.
   @override
   Future<Amplitude> getAmplitude(String recorderId) async {
-    return Amplitude(current: -160.0, max: -160.0);
+    final result = await _channel.invokeMethod<Map>('getAmplitude');
+    return Amplitude(
+      current: (result?['current'] as num?)?.toDouble() ?? -160.0,
+      max: (result?['max'] as num?)?.toDouble() ?? -160.0,
+    );
   }
 
   /// --------------------------------------------------------------------------
@@ -199,8 +285,244 @@ class RecordLinux extends RecordPlatform {
     String recorderId,
     AudioEncoder encoder,
   ) async {
-    // For the sake of example, let's say only WAV is "supported"
-    return encoder == AudioEncoder.wav;
+    final supported = await _channel.invokeMethod<bool>(
+      'isEncoderSupported',
+      encoder.name,
+    );
+    return supported ?? false;
+  }
+
+  /// --------------------------------------------------------------------------
+  ///  startPreRoll(...)
+  ///
+  ///  Arms capture: audio is continuously captured into a history buffer of
+  ///  [LinuxRecordConfig.preRollBufferMs] so that [start] and [startStream]
+  ///  can begin [LinuxRecordConfig.preRollMs] in the past, without the
+  ///  latency of connecting to the audio server.
+  ///
+  ///  While armed, the format, device and processing given here are used by
+  ///  every recording; only [LinuxRecordConfig.preRollMs] is read from the
+  ///  recording config.
+  Future<void> startPreRoll(String recorderId, RecordConfig config) async {
+    // Capture errors and dropouts are raised while only armed too.
+    _listenNativeCalls();
+
+    try {
+      await _channel.invokeMethod('startPreRoll', {
+        'config': config.toMap(),
+      });
+    } on PlatformException catch (e) {
+      throw Exception('Failed to start pre-roll capture: ${e.message}');
+    }
+  }
+
+  /// --------------------------------------------------------------------------
+  ///  stopPreRoll(...)
+  ///
+  ///  Disarms capture. A recording in progress is not affected.
+  Future<void> stopPreRoll(String recorderId) async {
+    await _channel.invokeMethod('stopPreRoll');
+  }
+
+  /// --------------------------------------------------------------------------
+  ///  startVox(...)
+  ///
+  ///  Records level-triggered takes: a take starts when the level exceeds
+  ///  [LinuxRecordConfig.voxThresholdDb] for
+  ///  [LinuxRecordConfig.voxMinDurationMs] and ends after
+  ///  [LinuxRecordConfig.voxHangMs] below it. Decisions are made in the
+  ///  capture loop, so the onset is never clipped.
+  ///
+  ///  Each take is its own file named after [path] (`take.wav` gives
+  ///  `take_001.wav`, `take_002.wav`...), starting with
+  ///  [LinuxRecordConfig.preRollMs] of pre-roll. See [onVoxTake].
+  Future<void> startVox(
+    String recorderId,
+    RecordConfig config, {
+    required String path,
+  }) async {
+    _listenNativeCalls();
+
+    try {
+      await _channel.invokeMethod('startVox', {
+        'path': path,
+        'config': config.toMap(),
+      });
+      _voxActive = true;
+    } on PlatformException catch (e) {
+      throw Exception('Failed to start VOX recording: ${e.message}');
+    }
+  }
+
+  /// --------------------------------------------------------------------------
+  ///  stopVox(...)
+  ///
+  ///  Stops VOX, completing the take in progress.
+  ///  Returns the number of takes recorded.
+  Future<int> stopVox(String recorderId) async {
+    final takes = await _channel.invokeMethod<int>('stopVox');
+    _voxActive = false;
+    return takes ?? 0;
+  }
+
+  /// --------------------------------------------------------------------------
+  ///  onVoxTake(...)
+  ///
+  ///  Streams start/end of VOX takes.
+  Stream<LinuxVoxTake> onVoxTake(String recorderId) {
+    _voxCtrl ??= StreamController<LinuxVoxTake>.broadcast();
+    return _voxCtrl!.stream;
+  }
+
+  /// --------------------------------------------------------------------------
+  ///  onAudioPacket(...)
+  ///
+  ///  Streams the encoded payloads of a compressed stream (see [startStream])
+  ///  with their timestamps.
+  Stream<LinuxAudioPacket> onAudioPacket(String recorderId) {
+    _packetCtrl ??= StreamController<LinuxAudioPacket>.broadcast();
+    return _packetCtrl!.stream;
+  }
+
+  /// --------------------------------------------------------------------------
+  ///  onAudioChunk(...)
+  ///
+  ///  Streams the PCM chunks of an uncompressed stream (see [startStream])
+  ///  with their capture time, frame index and the device clock drift.
+  Stream<LinuxAudioChunk> onAudioChunk(String recorderId) {
+    _chunkCtrl ??= StreamController<LinuxAudioChunk>.broadcast();
+    return _chunkCtrl!.stream;
+  }
+
+  /// --------------------------------------------------------------------------
+  ///  getDspStats(...)
+  ///
+  ///  Gets the CPU cost of each capture DSP stage (echo cancellation, noise
+  ///  suppression, auto gain) for the current or last session.
+  Future<LinuxDspStats> getDspStats(String recorderId) async {
+    final result = await _channel.invokeMethod<Map>('getDspStats');
+    return LinuxDspStats.fromMap(result!);
+  }
+
+  /// --------------------------------------------------------------------------
+  ///  getCaptureStats(...)
+  ///
+  ///  Gets the capture timing of the current or last session, such as the
+  ///  latency from the start call to the first recorded frame.
+  Future<LinuxCaptureStats> getCaptureStats(String recorderId) async {
+    final result = await _channel.invokeMethod<Map>('getCaptureStats');
+    return LinuxCaptureStats.fromMap(result!);
+  }
+
+  /// --------------------------------------------------------------------------
+  ///  benchmarkWorkerPool(...)
+  ///
+  ///  Measures how audio processing scales with cores: [sessions] recordings
+  ///  of [audioSeconds] each (2 per worker by default) run a fixed mix of
+  ///  DSP and FLAC encoding on pools of 1 to [maxWorkers] workers (all cores
+  ///  by default). Uses pools of its own, recording is unaffected.
+  Future<List<LinuxPoolBenchmarkRun>> benchmarkWorkerPool(
+    String recorderId, {
+    int? maxWorkers,
+    int? sessions,
+    int audioSeconds = 10,
+  }) async {
+    final result = await _channel.invokeMethod<List>('benchmarkWorkerPool', {
+      if (maxWorkers != null) 'maxWorkers': maxWorkers,
+      if (sessions != null) 'sessions': sessions,
+      'audioSeconds': audioSeconds,
+    });
+    return result!.map((run) => LinuxPoolBenchmarkRun.fromMap(run as Map)).toList();
+  }
+
+  /// --------------------------------------------------------------------------
+  ///  benchmarkResampler(...)
+  ///
+  ///  Measures each resampler preset, 48 kHz to 16 kHz and to 44.1 kHz: a
+  ///  stepped sine sweep gives the passband ripple and the stopband
+  ///  attenuation, reported next to the preset design. Then times the
+  ///  conversion of [audioSeconds] of stereo audio. Recording is unaffected.
+  Future<List<LinuxResamplerBenchmarkRun>> benchmarkResampler(
+    String recorderId, {
+    int audioSeconds = 10,
+  }) async {
+    final result = await _channel.invokeMethod<List>('benchmarkResampler', {
+      'audioSeconds': audioSeconds,
+    });
+    return result!
+        .map((run) => LinuxResamplerBenchmarkRun.fromMap(run as Map))
+        .toList();
+  }
+
+  /// --------------------------------------------------------------------------
+  ///  benchmarkFormats(...)
+  ///
+  ///  Times each sample format conversion kernel over [audioSeconds] of
+  ///  48 kHz stereo, with the scalar version and each vector version the
+  ///  CPU runs, the latter checked against the scalar output.
+  ///  Recording is unaffected.
+  Future<List<LinuxFormatBenchmarkRun>> benchmarkFormats(
+    String recorderId, {
+    int audioSeconds = 60,
+  }) async {
+    final result = await _channel.invokeMethod<List>('benchmarkFormats', {
+      'audioSeconds': audioSeconds,
+    });
+    return result!
+        .map((run) => LinuxFormatBenchmarkRun.fromMap(run as Map))
+        .toList();
+  }
+
+  /// --------------------------------------------------------------------------
+  ///  onWaveform(...)
+  ///
+  ///  Streams waveform peaks as they are computed while recording.
+  ///  Requires [LinuxRecordConfig.waveformPeaks].
+  Stream<LinuxWaveformUpdate> onWaveform(String recorderId) {
+    _waveformCtrl ??= StreamController<LinuxWaveformUpdate>.broadcast();
+    return _waveformCtrl!.stream;
+  }
+
+  /// --------------------------------------------------------------------------
+  ///  onVoiceActivity(...)
+  ///
+  ///  Streams speech start/end events.
+  ///  Requires [LinuxRecordConfig.vadMode].
+  Stream<LinuxVadEvent> onVoiceActivity(String recorderId) {
+    _vadCtrl ??= StreamController<LinuxVadEvent>.broadcast();
+    return _vadCtrl!.stream;
+  }
+
+  /// --------------------------------------------------------------------------
+  ///  onDropout(...)
+  ///
+  ///  Streams each loss of captured audio, as it reaches the recording.
+  ///  See [LinuxRecordConfig.fillDropouts].
+  Stream<LinuxDropout> onDropout(String recorderId) {
+    _dropoutCtrl ??= StreamController<LinuxDropout>.broadcast();
+    return _dropoutCtrl!.stream;
+  }
+
+  /// --------------------------------------------------------------------------
+  ///  onCaptureError(...)
+  ///
+  ///  Streams failures of the capture stream. What was capturing (session,
+  ///  pre-roll or VOX) is then stopped, the recording kept up to the
+  ///  failure. With [LinuxRecordConfig.reconnect], a capture lost
+  ///  mid-session is reconnected instead, see [onCaptureRecovered].
+  Stream<LinuxCaptureError> onCaptureError(String recorderId) {
+    _captureErrorCtrl ??= StreamController<LinuxCaptureError>.broadcast();
+    return _captureErrorCtrl!.stream;
+  }
+
+  /// --------------------------------------------------------------------------
+  ///  onCaptureRecovered(...)
+  ///
+  ///  Streams each reconnection of a capture lost mid-session, with the
+  ///  duration of the outage. Requires [LinuxRecordConfig.reconnect].
+  Stream<LinuxCaptureRecovery> onCaptureRecovered(String recorderId) {
+    _captureRecoveredCtrl ??= StreamController<LinuxCaptureRecovery>.broadcast();
+    return _captureRecoveredCtrl!.stream;
   }
 
   /// --------------------------------------------------------------------------
@@ -211,11 +533,35 @@ class RecordLinux extends RecordPlatform {
   Future<void> dispose(String recorderId) async {
     // Stop recording if still active
     await stop(recorderId);
+    if (_voxActive) {
+      await stopVox(recorderId);
+    } else {
+      await stopPreRoll(recorderId);
+    }
+
+    // Release the connection kept warm since create
+    await _channel.invokeMethod('dispose');
 
     // Close stream controllers
     _stateStreamCtrl?.close();
     _audioCtrl?.close();
     _audioCtrl = null;
+    _waveformCtrl?.close();
+    _waveformCtrl = null;
+    _vadCtrl?.close();
+    _vadCtrl = null;
+    _voxCtrl?.close();
+    _voxCtrl = null;
+    _packetCtrl?.close();
+    _packetCtrl = null;
+    _chunkCtrl?.close();
+    _chunkCtrl = null;
+    _dropoutCtrl?.close();
+    _dropoutCtrl = null;
+    _captureErrorCtrl?.close();
+    _captureErrorCtrl = null;
+    _captureRecoveredCtrl?.close();
+    _captureRecoveredCtrl = null;
   }
 
   /// --------------------------------------------------------------------------
@@ -228,6 +574,90 @@ class RecordLinux extends RecordPlatform {
     return _stateStreamCtrl!.stream;
   }
 
+  /// Handles native -> Dart callbacks.
+  void _listenNativeCalls() {
+    _channel.setMethodCallHandler((MethodCall call) async {
+      switch (call.method) {
+        case 'audioData':
+          final bytes = call.arguments as Uint8List?;
+          if (bytes == null) break;
+          final chunk = LinuxAudioChunk.fromBytes(bytes);
+          final audioCtrl = _audioCtrl;
+          if (audioCtrl != null && !audioCtrl.isClosed) {
+            audioCtrl.add(chunk.data);
+          }
+          final chunkCtrl = _chunkCtrl;
+          if (chunkCtrl != null && !chunkCtrl.isClosed) {
+            chunkCtrl.add(chunk);
+          }
+          break;
+        case 'audioPacket':
+          final packet = LinuxAudioPacket.fromMap(call.arguments as Map);
+          final audioCtrl = _audioCtrl;
+          if (audioCtrl != null && !audioCtrl.isClosed) {
+            audioCtrl.add(packet.data);
+          }
+          final packetCtrl = _packetCtrl;
+          if (packetCtrl != null && !packetCtrl.isClosed) {
+            packetCtrl.add(packet);
+          }
+          break;
+        case 'waveformData':
+          final waveformCtrl = _waveformCtrl;
+          if (waveformCtrl != null && !waveformCtrl.isClosed) {
+            waveformCtrl.add(LinuxWaveformUpdate.fromMap(call.arguments as Map));
+          }
+          break;
+        case 'vadEvent':
+          final vadCtrl = _vadCtrl;
+          if (vadCtrl != null && !vadCtrl.isClosed) {
+            vadCtrl.add(LinuxVadEvent.fromMap(call.arguments as Map));
+          }
+          break;
+        case 'voxTake':
+          final voxCtrl = _voxCtrl;
+          if (voxCtrl != null && !voxCtrl.isClosed) {
+            voxCtrl.add(LinuxVoxTake.fromMap(call.arguments as Map));
+          }
+          break;
+        case 'dropout':
+          final dropoutCtrl = _dropoutCtrl;
+          if (dropoutCtrl != null && !dropoutCtrl.isClosed) {
+            dropoutCtrl.add(LinuxDropout.fromMap(call.arguments as Map));
+          }
+          break;
+        case 'captureError':
+          final captureErrorCtrl = _captureErrorCtrl;
+          if (captureErrorCtrl != null && !captureErrorCtrl.isClosed) {
+            captureErrorCtrl.add(LinuxCaptureError.fromMap(call.arguments as Map));
+          }
+          await _stopFailedCapture();
+          break;
+        case 'captureRecovered':
+          final captureRecoveredCtrl = _captureRecoveredCtrl;
+          if (captureRecoveredCtrl != null && !captureRecoveredCtrl.isClosed) {
+            captureRecoveredCtrl.add(LinuxCaptureRecovery.fromMap(call.arguments as Map));
+          }
+          break;
+      }
+    });
+  }
+
+  /// Ends what the failed capture was feeding, keeping what was recorded.
+  Future<void> _stopFailedCapture() async {
+    if (_voxActive) {
+      _voxActive = false;
+      await _channel.invokeMethod('stopVox');
+      return;
+    }
+    if (_state != RecordState.stop) {
+      // Dispatched natively: a stream session emits its encoder tail first.
+      await _channel.invokeMethod('stopRecording');
+      _updateState(RecordState.stop);
+    }
+    await _channel.invokeMethod('stopPreRoll');
+  }
+
   /// Updates our current [_state] and notifies any listeners on [_stateStreamCtrl].
   void _updateState(RecordState newState) {
     if (_state != newState) {
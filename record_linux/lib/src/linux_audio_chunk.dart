@@ -0,0 +1,65 @@
+import 'dart:typed_data';
+
+/// PCM chunk of a stream on Linux, with its capture timing.
+///
+/// Delivered by [RecordLinux.onAudioChunk] when [RecordLinux.startStream]
+/// is called with a PCM encoder. Its [data] is also added to the stream
+/// returned by [RecordLinux.startStream].
+class LinuxAudioChunk {
+  static const int _settled = 1;
+  static const int _preRoll = 2;
+  static const int _gap = 4;
+
+  /// Interleaved samples, in the configured PCM format.
+  final Uint8List data;
+
+  /// Number of frames in [data].
+  final int frames;
+
+  /// Index of the first frame among those streamed since the start.
+  final int firstFrame;
+
+  /// When the first frame was captured, on the monotonic clock
+  /// (`CLOCK_MONOTONIC`), in nanoseconds. 0 when not known yet.
+  final int timeNanos;
+
+  /// Drift of the capture device clock against the monotonic clock, in
+  /// parts per million (positive when the device runs fast).
+  final double driftPpm;
+
+  final int _flags;
+
+  const LinuxAudioChunk({
+    required this.data,
+    required this.frames,
+    required this.firstFrame,
+    required this.timeNanos,
+    required this.driftPpm,
+    int flags = 0,
+  }) : _flags = flags;
+
+  /// Parses the header the native side puts in front of the samples.
+  factory LinuxAudioChunk.fromBytes(Uint8List bytes) {
+    final header = ByteData.sublistView(bytes);
+    final size = header.getUint16(0, Endian.little);
+    return LinuxAudioChunk(
+      data: Uint8List.sublistView(bytes, size),
+      frames: header.getUint32(4, Endian.little),
+      firstFrame: header.getInt64(8, Endian.little),
+      timeNanos: header.getInt64(16, Endian.little),
+      driftPpm: header.getFloat64(24, Endian.little),
+      flags: header.getUint16(2, Endian.little),
+    );
+  }
+
+  /// Whether [timeNanos] and [driftPpm] come from a settled estimate of
+  /// the device clock (after about 10 seconds of capture).
+  bool get settled => _flags & _settled != 0;
+
+  /// Whether the chunk holds pre-roll history captured before the start.
+  bool get preRoll => _flags & _preRoll != 0;
+
+  /// Whether audio was lost before this chunk
+  /// (see [LinuxRecordConfig.fillDropouts]); [timeNanos] then jumps.
+  bool get gap => _flags & _gap != 0;
+}
@@ -0,0 +1,34 @@
+import 'dart:typed_data';
+
+/// Encoded payload of a compressed stream on Linux.
+///
+/// Delivered by [RecordLinux.onAudioPacket] when [RecordLinux.startStream]
+/// is called with `AudioEncoder.opus`: one Opus packet per event, or Ogg
+/// pages when [LinuxRecordConfig.streamOggFraming] is set. The same bytes
+/// are also added to the stream returned by [RecordLinux.startStream].
+class LinuxAudioPacket {
+  /// Packet (or pages) bytes.
+  final Uint8List data;
+
+  /// Time of the first sample since the start of the session, in
+  /// microseconds.
+  ///
+  /// The first packet starts slightly before 0 by the encoder delay.
+  /// Ogg header pages have 0.
+  final int ptsUs;
+
+  /// Duration of the audio, in microseconds.
+  final int durationUs;
+
+  const LinuxAudioPacket({
+    required this.data,
+    required this.ptsUs,
+    required this.durationUs,
+  });
+
+  factory LinuxAudioPacket.fromMap(Map map) => LinuxAudioPacket(
+        data: map['data'] as Uint8List,
+        ptsUs: map['ptsUs'] as int,
+        durationUs: map['durationUs'] as int,
+      );
+}
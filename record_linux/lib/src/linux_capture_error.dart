@@ -0,0 +1,22 @@
+/// Failure of the capture stream on Linux, such as the device or the sound
+/// server going away.
+///
+/// Streamed by [RecordLinux.onCaptureError]. The session, pre-roll or VOX
+/// capturing is then stopped, keeping what was recorded until the failure.
+class LinuxCaptureError {
+  /// PulseAudio error code (`PA_ERR_*`).
+  final int code;
+
+  /// Description of [code].
+  final String message;
+
+  const LinuxCaptureError({
+    required this.code,
+    required this.message,
+  });
+
+  factory LinuxCaptureError.fromMap(Map map) => LinuxCaptureError(
+        code: map['code'] as int,
+        message: map['message'] as String,
+      );
+}
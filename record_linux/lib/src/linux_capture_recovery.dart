@@ -0,0 +1,35 @@
+/// Capture reconnected on Linux after it was lost mid-session (sound server
+/// restarted, device unplugged), with [LinuxRecordConfig.reconnect].
+///
+/// Streamed by [RecordLinux.onCaptureRecovered]. The file or stream stayed
+/// open; the outage is also reported by [RecordLinux.onDropout] as it
+/// reaches the recording, filled with silence when
+/// [LinuxRecordConfig.fillDropouts] is set.
+class LinuxCaptureRecovery {
+  /// Duration of the outage, in microseconds, time paused excluded.
+  final int gapMicros;
+
+  /// Connection attempts it took.
+  final int attempts;
+
+  /// Device reconnected to, empty for the default source.
+  final String deviceId;
+
+  /// Whether that is [LinuxRecordConfig.fallbackDeviceId] rather than the
+  /// session device.
+  final bool fallback;
+
+  const LinuxCaptureRecovery({
+    required this.gapMicros,
+    required this.attempts,
+    required this.deviceId,
+    required this.fallback,
+  });
+
+  factory LinuxCaptureRecovery.fromMap(Map map) => LinuxCaptureRecovery(
+        gapMicros: map['gapUs'] as int,
+        attempts: map['attempts'] as int,
+        deviceId: map['deviceId'] as String,
+        fallback: map['fallback'] as bool,
+      );
+}
@@ -0,0 +1,143 @@
+import 'package:record_platform_interface/record_platform_interface.dart';
+
+import 'linux_realtime_stats.dart';
+
+/// Capture timing and cost report on Linux.
+///
+/// Returned by [RecordLinux.getCaptureStats].
+class LinuxCaptureStats {
+  /// Time from the last start call to its first frame reaching the
+  /// recording, in microseconds. `null` until that frame arrives.
+  final int? startLatencyMicros;
+
+  /// Whether the last start reused the connection opened by `create`
+  /// (or kept from the previous session), only uncorking it.
+  final bool warmStart;
+
+  /// Whether a connected, corked capture stream is currently held for the
+  /// next start.
+  final bool warm;
+
+  /// Capture model of the current or last session.
+  ///
+  /// The cost below is that of this recorder's capture thread with
+  /// [LinuxCaptureEngine.thread], and of the whole event loop (loop thread
+  /// and workers, shared by every recorder) with
+  /// [LinuxCaptureEngine.eventLoop]. Either way, it includes the shared
+  /// worker pool processing the audio of every recorder.
+  final LinuxCaptureEngine engine;
+
+  /// CPU time used over [elapsedMicros], in microseconds.
+  final int cpuMicros;
+
+  /// Times the capture woke up to wait for audio over [elapsedMicros].
+  final int wakeups;
+
+  /// Time since the capture thread or the event loop started.
+  final int elapsedMicros;
+
+  /// Capture streams served: 1 or 0 for a thread, every open stream of the
+  /// process for the event loop.
+  final int sessions;
+
+  /// Threads of the worker pool processing the audio (DSP, encoding),
+  /// shared by every recorder of the process.
+  final int workers;
+
+  /// CPU time used by the worker pool since it started, in microseconds.
+  final int workerCpuMicros;
+
+  /// Tasks a pool worker took from another's queue since the pool started.
+  final int steals;
+
+  /// Audio dropped because processing was too far behind the capture, in
+  /// bytes.
+  final int droppedBytes;
+
+  /// Losses of audio since the capture connected, whether the server
+  /// overran or processing fell behind. See [RecordLinux.onDropout].
+  final int overruns;
+
+  /// Frames lost over those [overruns], at the capture rate.
+  final int droppedFrames;
+
+  /// Of [droppedFrames], those replaced with silence
+  /// ([LinuxRecordConfig.fillDropouts]).
+  final int filledFrames;
+
+  /// Frames the source failed to deliver since the capture connected
+  /// (holes in the stream), recorded as silence.
+  final int underrunFrames;
+
+  /// Whether the capture stream failed, see [RecordLinux.onCaptureError].
+  final bool failed;
+
+  /// Drift of the capture device clock against the monotonic clock, in
+  /// parts per million, as stamped on [LinuxAudioChunk]s.
+  final double clockDriftPpm;
+
+  /// Reconnections of the capture since it connected
+  /// ([LinuxRecordConfig.reconnect]), see [RecordLinux.onCaptureRecovered].
+  final int reconnects;
+
+  /// Outages over those [reconnects], in microseconds.
+  final int reconnectGapMicros;
+
+  /// Scheduling of the capture thread.
+  final LinuxRealtimeStats realtime;
+
+  const LinuxCaptureStats({
+    required this.startLatencyMicros,
+    required this.warmStart,
+    required this.warm,
+    required this.engine,
+    required this.cpuMicros,
+    required this.wakeups,
+    required this.elapsedMicros,
+    required this.sessions,
+    required this.workers,
+    required this.workerCpuMicros,
+    required this.steals,
+    required this.droppedBytes,
+    required this.overruns,
+    required this.droppedFrames,
+    required this.filledFrames,
+    required this.underrunFrames,
+    required this.failed,
+    required this.clockDriftPpm,
+    required this.reconnects,
+    required this.reconnectGapMicros,
+    required this.realtime,
+  });
+
+  /// Wakeups per second over [elapsedMicros].
+  double get wakeupsPerSecond =>
+      elapsedMicros > 0 ? wakeups * 1e6 / elapsedMicros : 0;
+
+  /// CPU use over [elapsedMicros], 1.0 being one core.
+  double get cpuLoad => elapsedMicros > 0 ? cpuMicros / elapsedMicros : 0;
+
+  factory LinuxCaptureStats.fromMap(Map map) => LinuxCaptureStats(
+        startLatencyMicros: map['startLatencyUs'] as int?,
+        warmStart: map['warmStart'] as bool,
+        warm: map['warm'] as bool,
+        engine: LinuxCaptureEngine.values.byName(map['engine'] as String),
+        cpuMicros: map['cpuUs'] as int,
+        wakeups: map['wakeups'] as int,
+        elapsedMicros: map['elapsedUs'] as int,
+        sessions: map['sessions'] as int,
+        workers: map['workers'] as int,
+        workerCpuMicros: map['workerCpuUs'] as int,
+        steals: map['steals'] as int,
+        droppedBytes: map['droppedBytes'] as int,
+        overruns: map['overruns'] as int,
+        droppedFrames: map['droppedFrames'] as int,
+        filledFrames: map['filledFrames'] as int,
+        underrunFrames: map['underrunFrames'] as int,
+        failed: map['failed'] as bool,
+        clockDriftPpm: (map['clockDriftPpm'] as num).toDouble(),
+        reconnects: map['reconnects'] as int,
+        reconnectGapMicros: map['reconnectGapUs'] as int,
+        realtime: LinuxRealtimeStats.fromMap(map['realtime'] as Map),
+      );
+}
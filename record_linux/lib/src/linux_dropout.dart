@@ -0,0 +1,27 @@
+/// Audio lost by the capture on Linux: the server overran because the
+/// capture read too late, or processing fell too far behind.
+///
+/// Streamed by [RecordLinux.onDropout], counted in [LinuxCaptureStats].
+class LinuxDropout {
+  /// Frames lost, at the capture rate.
+  final int droppedFrames;
+
+  /// Duration of the audio lost, in microseconds.
+  final int durationMicros;
+
+  /// Whether the loss was replaced with as much silence
+  /// ([LinuxRecordConfig.fillDropouts]).
+  final bool filled;
+
+  const LinuxDropout({
+    required this.droppedFrames,
+    required this.durationMicros,
+    required this.filled,
+  });
+
+  factory LinuxDropout.fromMap(Map map) => LinuxDropout(
+        droppedFrames: map['droppedFrames'] as int,
+        durationMicros: map['durationUs'] as int,
+        filled: map['filled'] as bool,
+      );
+}
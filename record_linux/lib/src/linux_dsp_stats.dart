@@ -0,0 +1,73 @@
+/// CPU cost of one stage of the Linux capture DSP chain.
+class LinuxDspStageStats {
+  /// Stage name (`echoCancel`, `noiseSuppress` or `autoGain`).
+  final String name;
+
+  /// Whether the stage is part of the current session.
+  final bool enabled;
+
+  /// Number of blocks processed since the session started.
+  final int blocks;
+
+  /// Average processing time of one block, in microseconds.
+  final double avgMicros;
+
+  /// Worst processing time of one block, in microseconds.
+  final double maxMicros;
+
+  /// Processing time relative to the duration of the audio processed.
+  ///
+  /// 0.05 means the stage uses 5% of one core in real time.
+  final double load;
+
+  const LinuxDspStageStats({
+    required this.name,
+    required this.enabled,
+    required this.blocks,
+    required this.avgMicros,
+    required this.maxMicros,
+    required this.load,
+  });
+
+  factory LinuxDspStageStats.fromMap(String name, Map map) =>
+      LinuxDspStageStats(
+        name: name,
+        enabled: map['enabled'] as bool,
+        blocks: map['blocks'] as int,
+        avgMicros: (map['avgUs'] as num).toDouble(),
+        maxMicros: (map['maxUs'] as num).toDouble(),
+        load: (map['load'] as num).toDouble(),
+      );
+}
+
+/// CPU cost report of the Linux capture DSP chain.
+class LinuxDspStats {
+  /// Frames per processing block.
+  final int blockFrames;
+
+  /// Delay added by the chain, in frames.
+  final int latencyFrames;
+
+  /// Per stage report, in processing order.
+  final List<LinuxDspStageStats> stages;
+
+  const LinuxDspStats({
+    required this.blockFrames,
+    required this.latencyFrames,
+    required this.stages,
+  });
+
+  factory LinuxDspStats.fromMap(Map map) {
+    final stages = map['stages'] as Map;
+
+    return LinuxDspStats(
+      blockFrames: map['blockFrames'] as int,
+      latencyFrames: map['latencyFrames'] as int,
+      stages: [
+        for (final name in ['echoCancel', 'noiseSuppress', 'autoGain'])
+          if (stages[name] != null)
+            LinuxDspStageStats.fromMap(name, stages[name] as Map),
+      ],
+    );
+  }
+}
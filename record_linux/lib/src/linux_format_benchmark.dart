@@ -0,0 +1,48 @@
+/// One kernel of the sample format benchmark on Linux.
+///
+/// Returned by [RecordLinux.benchmarkFormats], one per kernel and
+/// instruction set it has a version for.
+class LinuxFormatBenchmarkRun {
+  /// `convert`, or `deinterleave` / `interleave` (stereo, to and from the
+  /// float planes of the resampler).
+  final String kernel;
+
+  /// Sample formats, as [LinuxSampleFormat].
+  final String from;
+  final String to;
+
+  /// `avx2`, `sse4.1`, `neon` or `scalar`.
+  final String isa;
+
+  final double msamplesPerSecond;
+
+  /// Bytes read and written.
+  final double gbytesPerSecond;
+
+  /// Vector kernels only: samples differing from the scalar kernel's for
+  /// the same input, and by how much at most (full scale 1).
+  final int mismatches;
+  final double maxError;
+
+  const LinuxFormatBenchmarkRun({
+    required this.kernel,
+    required this.from,
+    required this.to,
+    required this.isa,
+    required this.msamplesPerSecond,
+    required this.gbytesPerSecond,
+    required this.mismatches,
+    required this.maxError,
+  });
+
+  factory LinuxFormatBenchmarkRun.fromMap(Map map) => LinuxFormatBenchmarkRun(
+        kernel: map['kernel'] as String,
+        from: map['from'] as String,
+        to: map['to'] as String,
+        isa: map['isa'] as String,
+        msamplesPerSecond: (map['msamplesPerSecond'] as num).toDouble(),
+        gbytesPerSecond: (map['gbytesPerSecond'] as num).toDouble(),
+        mismatches: map['mismatches'] as int,
+        maxError: (map['maxError'] as num).toDouble(),
+      );
+}
@@ -0,0 +1,42 @@
+/// One pool size of the worker pool benchmark on Linux.
+///
+/// Returned by [RecordLinux.benchmarkWorkerPool], one per pool size from 1
+/// worker up.
+class LinuxPoolBenchmarkRun {
+  /// Worker threads of the pool.
+  final int workers;
+
+  /// Chunks of 4096 frames processed (noise suppression, auto gain, then
+  /// FLAC encoding), over all sessions.
+  final int chunks;
+
+  /// Wall time of the run, in seconds.
+  final double seconds;
+
+  final double chunksPerSecond;
+
+  /// Seconds of 48 kHz stereo audio processed per second, all sessions
+  /// together.
+  final double realtimeFactor;
+
+  /// Tasks a worker took from another's queue.
+  final int steals;
+
+  const LinuxPoolBenchmarkRun({
+    required this.workers,
+    required this.chunks,
+    required this.seconds,
+    required this.chunksPerSecond,
+    required this.realtimeFactor,
+    required this.steals,
+  });
+
+  factory LinuxPoolBenchmarkRun.fromMap(Map map) => LinuxPoolBenchmarkRun(
+        workers: map['workers'] as int,
+        chunks: map['chunks'] as int,
+        seconds: (map['seconds'] as num).toDouble(),
+        chunksPerSecond: (map['chunksPerSecond'] as num).toDouble(),
+        realtimeFactor: (map['realtimeFactor'] as num).toDouble(),
+        steals: map['steals'] as int,
+      );
+}
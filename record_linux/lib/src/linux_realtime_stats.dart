@@ -0,0 +1,72 @@
+import 'package:record_platform_interface/record_platform_interface.dart';
+
+/// Scheduling of the capture thread on Linux, for its last or current run.
+///
+/// Part of [LinuxCaptureStats]. The latency is measured whether or not
+/// real-time scheduling was asked for, so that both can be compared.
+class LinuxRealtimeStats {
+  /// Policy obtained, [LinuxRealtimePolicy.off] when not asked for or
+  /// refused.
+  final LinuxRealtimePolicy policy;
+
+  final int priority;
+
+  /// Whether RealtimeKit granted it.
+  final bool rtkit;
+
+  /// Whether [LinuxRecordConfig.cpuAffinity] was applied.
+  final bool pinned;
+
+  /// Capture buffers and stack locked in RAM.
+  final int lockedBytes;
+
+  /// Reads measured.
+  final int reads;
+
+  /// Audio already waiting when a read completed, on average and at most,
+  /// in microseconds: how late the thread was scheduled.
+  final int avgLatencyMicros;
+  final int maxLatencyMicros;
+
+  /// Reads with more than a chunk of audio waiting.
+  final int lateReads;
+
+  /// Involuntary context switches.
+  final int preemptions;
+
+  /// Times the thread blocked on something else than audio, such as a
+  /// lock held by a lower priority thread.
+  final int strayBlocks;
+
+  final int majorFaults;
+
+  const LinuxRealtimeStats({
+    required this.policy,
+    required this.priority,
+    required this.rtkit,
+    required this.pinned,
+    required this.lockedBytes,
+    required this.reads,
+    required this.avgLatencyMicros,
+    required this.maxLatencyMicros,
+    required this.lateReads,
+    required this.preemptions,
+    required this.strayBlocks,
+    required this.majorFaults,
+  });
+
+  factory LinuxRealtimeStats.fromMap(Map map) => LinuxRealtimeStats(
+        policy: LinuxRealtimePolicy.values.byName(map['policy'] as String),
+        priority: map['priority'] as int,
+        rtkit: map['rtkit'] as bool,
+        pinned: map['pinned'] as bool,
+        lockedBytes: map['lockedBytes'] as int,
+        reads: map['reads'] as int,
+        avgLatencyMicros: map['avgLatencyUs'] as int,
+        maxLatencyMicros: map['maxLatencyUs'] as int,
+        lateReads: map['lateReads'] as int,
+        preemptions: map['preemptions'] as int,
+        strayBlocks: map['strayBlocks'] as int,
+        majorFaults: map['majorFaults'] as int,
+      );
+}
@@ -0,0 +1,72 @@
+/// One resampler preset and rate pair of the resampler benchmark on Linux.
+///
+/// Returned by [RecordLinux.benchmarkResampler]. Band edges are fractions of
+/// the lower Nyquist frequency of the pair.
+class LinuxResamplerBenchmarkRun {
+  final int inRate;
+  final int outRate;
+
+  /// Preset name, as [LinuxResamplerQuality].
+  final String quality;
+
+  /// Filter taps per output sample and channel.
+  final int taps;
+
+  /// Designed flat up to there.
+  final double passband;
+
+  /// Designed attenuated from there on.
+  final double stopband;
+
+  final double designRippleDb;
+  final double designAttenuationDb;
+
+  /// Largest deviation from unity gain measured in the passband.
+  final double rippleDb;
+
+  /// Smallest attenuation measured from the stopband edge to the input
+  /// Nyquist frequency.
+  final double attenuationDb;
+
+  /// Whether the measured response is within tolerance of the design.
+  final bool withinDesign;
+
+  /// Filter throughput, multiply-adds counted as 2 operations.
+  final double mflops;
+
+  /// Seconds of stereo audio converted per second.
+  final double realtimeFactor;
+
+  const LinuxResamplerBenchmarkRun({
+    required this.inRate,
+    required this.outRate,
+    required this.quality,
+    required this.taps,
+    required this.passband,
+    required this.stopband,
+    required this.designRippleDb,
+    required this.designAttenuationDb,
+    required this.rippleDb,
+    required this.attenuationDb,
+    required this.withinDesign,
+    required this.mflops,
+    required this.realtimeFactor,
+  });
+
+  factory LinuxResamplerBenchmarkRun.fromMap(Map map) =>
+      LinuxResamplerBenchmarkRun(
+        inRate: map['inRate'] as int,
+        outRate: map['outRate'] as int,
+        quality: map['quality'] as String,
+        taps: map['taps'] as int,
+        passband: (map['passband'] as num).toDouble(),
+        stopband: (map['stopband'] as num).toDouble(),
+        designRippleDb: (map['designRippleDb'] as num).toDouble(),
+        designAttenuationDb: (map['designAttenuationDb'] as num).toDouble(),
+        rippleDb: (map['rippleDb'] as num).toDouble(),
+        attenuationDb: (map['attenuationDb'] as num).toDouble(),
+        withinDesign: map['withinDesign'] as bool,
+        mflops: (map['mflops'] as num).toDouble(),
+        realtimeFactor: (map['realtimeFactor'] as num).toDouble(),
+      );
+}
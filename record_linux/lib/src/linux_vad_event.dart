@@ -0,0 +1,35 @@
+/// Speech start or end detected while recording on Linux.
+///
+/// Enabled with [LinuxRecordConfig.vadMode].
+class LinuxVadEvent {
+  /// `true` when speech starts, `false` when it ends (after hangover).
+  final bool speech;
+
+  /// Position of the event in the captured audio, in frames.
+  final int captureFrame;
+
+  /// Position of the event in the recorded output, in frames.
+  ///
+  /// Differs from [captureFrame] when silence is trimmed.
+  final int outputFrame;
+
+  /// Wall clock time of the event, in microseconds since epoch.
+  final int timeUs;
+
+  const LinuxVadEvent({
+    required this.speech,
+    required this.captureFrame,
+    required this.outputFrame,
+    required this.timeUs,
+  });
+
+  /// Wall clock time of the event.
+  DateTime get time => DateTime.fromMicrosecondsSinceEpoch(timeUs);
+
+  factory LinuxVadEvent.fromMap(Map map) => LinuxVadEvent(
+        speech: map['speech'] as bool,
+        captureFrame: map['captureFrame'] as int,
+        outputFrame: map['outputFrame'] as int,
+        timeUs: map['timeUs'] as int,
+      );
+}
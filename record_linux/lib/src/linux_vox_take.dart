@@ -0,0 +1,25 @@
+/// Start or end of a level-triggered (VOX) take on Linux.
+///
+/// Started with [RecordLinux.startVox].
+class LinuxVoxTake {
+  /// Index of the take, starting at 1.
+  final int index;
+
+  /// File of the take, named after the VOX path with the index appended.
+  final String path;
+
+  /// `true` when the take starts, `false` when its file is complete.
+  final bool started;
+
+  const LinuxVoxTake({
+    required this.index,
+    required this.path,
+    required this.started,
+  });
+
+  factory LinuxVoxTake.fromMap(Map map) => LinuxVoxTake(
+        index: map['index'] as int,
+        path: map['path'] as String,
+        started: map['started'] as bool,
+      );
+}
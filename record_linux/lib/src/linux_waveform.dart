@@ -0,0 +1,45 @@
+import 'dart:typed_data';
+
+/// Waveform buckets completed while recording on Linux.
+///
+/// Enabled with [LinuxRecordConfig.waveformPeaks].
+class LinuxWaveformUpdate {
+  /// Pyramid level, 0 being the finest.
+  final int level;
+
+  /// Number of frames summarized by each bucket of this level
+  /// (256, 4096 or 65536).
+  final int framesPerBucket;
+
+  /// Index of the first bucket of [data] within the level.
+  final int firstBucket;
+
+  /// Number of channels of the recording.
+  final int numChannels;
+
+  /// `min`, `max`, `rms` triplets of 16 bits samples, channels interleaved.
+  final Int16List data;
+
+  const LinuxWaveformUpdate({
+    required this.level,
+    required this.framesPerBucket,
+    required this.firstBucket,
+    required this.numChannels,
+    required this.data,
+  });
+
+  /// Number of buckets in this update.
+  int get bucketCount => data.length ~/ (3 * numChannels);
+
+  factory LinuxWaveformUpdate.fromMap(Map map) {
+    final bytes = map['data'] as Uint8List;
+
+    return LinuxWaveformUpdate(
+      level: map['level'] as int,
+      framesPerBucket: map['framesPerBucket'] as int,
+      firstBucket: map['firstBucket'] as int,
+      numChannels: map['numChannels'] as int,
+      data: bytes.buffer.asInt16List(bytes.offsetInBytes, bytes.lengthInBytes ~/ 2),
+    );
+  }
+}
@@ -3,35 +3,38 @@
 
 #include <flutter_linux/flutter_linux.h>
 #include <glib-object.h>
-#include <pulse/simple.h>
+#include <pulse/sample.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <string> // for std::string usage
+#include <vector>
+
+class CaptureClock;
+class CaptureEngine;
+class ChannelMatrix;
+class Ditherer;
+class DspChain;
+class EngineCapture;
+class FileWriter;
+class LevelMeter;
+class PoolSource;
+class PreRollRing;
+class PulseCapture;
+class RealtimeThread;
+class RecorderState;
+class Resampler;
+class SerialQueue;
+class SlotRing;
+class StreamEncoder;
+class VoiceGate;
+class VoxTrigger;
+class WaveformPyramid;
+class WorkerPool;
+class XrunDetector;
+struct RecordConfig;
 
 G_BEGIN_DECLS
 
-////////////////////////////////////////////////////////////////////////////////
-//  WAV header struct used by both .h & .cc
-////////////////////////////////////////////////////////////////////////////////
-#pragma pack(push, 1)
-typedef struct
-{
-  char riff[4];
-  uint32_t overall_size;
-  char wave[4];
-  char fmt_chunk_marker[4];
-  uint32_t length_of_fmt;
-  uint16_t format_type;
-  uint16_t channels;
-  uint32_t sample_rate;
-  uint32_t byterate;
-  uint16_t block_align;
-  uint16_t bits_per_sample;
-  char data_chunk_header[4];
-  uint32_t data_size;
-} WavHeader;
-#pragma pack(pop)
-
 ////////////////////////////////////////////////////////////////////////////////
 //  Forward declarations of our GObject struct and class
 ////////////////////////////////////////////////////////////////////////////////
@@ -46,34 +49,129 @@ struct _RecordLinuxPlugin
 {
   GObject parent_instance; // MUST be first
 
-  // PulseAudio
-  pa_simple *pa_handle;
-  pa_sample_spec pa_spec;
+  // PulseAudio, read and corked by the capture thread
+  PulseCapture *pa_handle;
+  pa_sample_spec pa_spec; // session format, the device may run at another rate
+
+  // Device rate -> pa_spec.rate when they differ (captureSampleRate), or null
+  Resampler *resampler;
+  std::vector<float> *resampled; // one chunk of resampler output
+
+  // Device channels -> pa_spec.channels (channelMatrix), or null
+  ChannelMatrix *matrix;
+
+  // Requantization of the capture to S16, and of PCM streams to outputFormat
+  Ditherer *capture_dither;
+  Ditherer *output_dither;
+
+  // Far-end reference for echo cancellation (monitor source), may be null
+  PulseCapture *ref_pa_handle;
+
+  // Capture on the shared event loop (captureEngine: eventLoop) instead of
+  // pa_handle and a capture thread, chunks processed on engine_queue
+  CaptureEngine *engine;             // acquired on first use, process wide
+  SerialQueue *engine_queue;         // this plugin's processing, in order
+  EngineCapture *engine_capture;     // null unless connected so
+  EngineCapture *engine_ref_capture; // echo reference, may be null
+  PreRollRing *ref_pending;          // reference audio not consumed yet
 
-  // Recording state
-  bool is_recording;
-  bool is_paused;
-  bool is_stream_mode;
+  // Session configuration, parsed from the Dart RecordConfig
+  RecordConfig *config;
+  RecordConfig *warm_config; // the connection kept warm (state kWarm) was opened for it
+
+  // Capture DSP (echo cancel, noise suppress, auto gain)
+  DspChain *dsp;
+
+  // Waveform peaks, built while recording when enabled
+  WaveformPyramid *waveform;
+
+  // Voice activity detection / silence trimming, null when disabled
+  VoiceGate *vad;
+
+  // Capture history kept while armed (see start_pre_roll)
+  PreRollRing *pre_roll;
+
+  // Level of the captured audio (getAmplitude)
+  LevelMeter *meter;
+
+  // Level-triggered takes (see start_vox)
+  VoxTrigger *vox;
+  std::string vox_path; // takes are named after it
+  int vox_take;         // index of the last take
+
+  // Recording state and capture flags, read lock-free by the capture thread
+  RecorderState *state;
 
   // Thread & synchronization
   GThread *record_thread_handle;
-  GMutex state_mutex;
-  GCond pause_cond;
+  // The capture thread only reads: it publishes each chunk to capture_ring
+  // and signals capture_source, processed in order on the shared pool
+  WorkerPool *pool;           // process wide, acquired at init
+  PoolSource *capture_source;
+  SlotRing *capture_ring;
+  uint64_t ring_dropped_bytes; // read while the ring was full (atomic)
+  // Overruns of the capture thread, found from its reads
+  XrunDetector *xrun;
+  // Capture time of the frames processed, on the pool (see process_capture)
+  CaptureClock *capture_clock;
+  uint64_t converted_frames; // at the session rate, since the connection
+  // Scheduling of the capture thread (realtimePolicy) and its latency
+  RealtimeThread *realtime;
+  GThread *stop_thread_handle; // finalization of the last stopped session
+
+  // Sink hand-off with the capture thread, guarded by sink_mutex
+  GMutex sink_mutex;
+  bool sink_active;
+  size_t pre_roll_pending; // history frames to flush before the next chunk
+  int64_t stream_frames;   // streamed to Dart in the session ("audioData")
+  bool stream_gap;         // audio lost, not filled, since the last chunk streamed
+
+  // Start latency (getCaptureStats), the times guarded by sink_mutex
+  int64_t start_call_us;    // monotonic time of the last start call
+  int64_t start_latency_us; // call to first frame delivered, -1 until then
+  bool warm_start;          // the last start reused the warm connection (main thread)
+
+  // Cost of the capture thread (getCaptureStats), the start guarded by
+  // sink_mutex, the counters updated atomically by the thread
+  int64_t thread_started_us; // monotonic
+  int64_t thread_cpu_us;
+  uint64_t thread_wakeups;
+  uint64_t thread_hole_bytes;
+
+  // Audio lost since the capture connected (getCaptureStats), counted
+  // atomically by the pool as the gaps reach it
+  uint64_t dropouts;
+  uint64_t dropout_frames; // at the capture rate
+  uint64_t filled_frames;  // of those, replaced with silence (fillDropouts)
+
+  // Reconnections after the capture was lost mid-session (reconnect). The
+  // event-loop engine reconnects on recover_thread_handle, guarded by
+  // sink_mutex; the capture thread does it in place
+  GThread *recover_thread_handle;
+  uint64_t recovered_gap_frames; // outage to pass with the next chunk (atomic)
+  uint64_t reconnects;           // atomic
+  int64_t reconnect_gap_us;      // outages in total (atomic)
 
   // Audio buffer
   static const size_t K_BUFFER_SIZE = 4096;
+  static const size_t K_CAPTURE_SLOTS = 16; // capture_ring, ~0.4 s at 44.1 kHz
   uint8_t buffer[K_BUFFER_SIZE];
+  size_t chunk_bytes;    // whole frames fitting in buffer
+  size_t capture_frames; // frames read per chunk
+  uint8_t capture_buffer[K_BUFFER_SIZE * 2]; // chunk in the capture format
+  uint8_t silence_buffer[K_BUFFER_SIZE * 2]; // filling dropouts, on the pool
+  uint8_t ref_buffer[K_BUFFER_SIZE];         // reference of the chunk processed, on the pool
+  uint8_t ref_capture_buffer[K_BUFFER_SIZE]; // reference of a dropped chunk
 
   // Flutter method channel
   FlMethodChannel *channel;
 
   // File-based recording
-  FILE *file_handle;
-  size_t total_data_bytes;
-  std::string file_path; // can call file_path.clear() safely
+  FileWriter *file_writer; // encoder of the session (WAV, FLAC)
+  std::string file_path;   // can call file_path.clear() safely
 
-  // WAV header
-  WavHeader wav_header;
+  // Stream-based recording, nullptr for raw PCM
+  StreamEncoder *stream_encoder;
 };
 
 struct _RecordLinuxPluginClass
@@ -105,13 +203,21 @@ extern "C"
   FlMethodResponse *create_recorder(RecordLinuxPlugin *self);
   FlMethodResponse *dispose_recorder(RecordLinuxPlugin *self);
 
-  FlMethodResponse *start_recording_file(RecordLinuxPlugin *self, const gchar *path);
-  FlMethodResponse *stop_recording_file(RecordLinuxPlugin *self);
+  FlMethodResponse *start_recording_file(RecordLinuxPlugin *self, const gchar *path, FlValue *config);
+  // Stop and cancel respond to [method_call] once finalized, off the main
+  // thread, and return nullptr unless failing at once.
+  FlMethodResponse *stop_recording_file(RecordLinuxPlugin *self, FlMethodCall *method_call);
+
+  FlMethodResponse *start_recording_stream(RecordLinuxPlugin *self, FlValue *config);
+  FlMethodResponse *stop_recording_stream(RecordLinuxPlugin *self, FlMethodCall *method_call);
+
+  FlMethodResponse *start_pre_roll(RecordLinuxPlugin *self, FlValue *config);
+  FlMethodResponse *stop_pre_roll(RecordLinuxPlugin *self, FlMethodCall *method_call);
 
-  FlMethodResponse *start_recording_stream(RecordLinuxPlugin *self);
-  FlMethodResponse *stop_recording_stream(RecordLinuxPlugin *self);
+  FlMethodResponse *start_vox(RecordLinuxPlugin *self, const gchar *path, FlValue *config);
+  FlMethodResponse *stop_vox(RecordLinuxPlugin *self, FlMethodCall *method_call);
 
-  FlMethodResponse *cancel_recording(RecordLinuxPlugin *self);
+  FlMethodResponse *cancel_recording(RecordLinuxPlugin *self, FlMethodCall *method_call);
   FlMethodResponse *pause_recording(RecordLinuxPlugin *self);
   FlMethodResponse *resume_recording(RecordLinuxPlugin *self);
 
@@ -121,6 +227,11 @@ extern "C"
   FlMethodResponse *has_permission(RecordLinuxPlugin *self);
   FlMethodResponse *is_paused_fn(RecordLinuxPlugin *self);
   FlMethodResponse *is_recording_fn(RecordLinuxPlugin *self);
+  FlMethodResponse *get_dsp_stats(RecordLinuxPlugin *self);
+  FlMethodResponse *get_capture_stats(RecordLinuxPlugin *self);
+  FlMethodResponse *benchmark_worker_pool(RecordLinuxPlugin *self, FlMethodCall *method_call);
+  FlMethodResponse *benchmark_resampler(RecordLinuxPlugin *self, FlMethodCall *method_call);
+  FlMethodResponse *benchmark_formats(RecordLinuxPlugin *self, FlMethodCall *method_call);
 
   G_END_DECLS
 #ifdef __cplusplus
@@ -0,0 +1,166 @@
+#include "record_adpcm.h"
+
+#include <algorithm>
+
+namespace
+{
+  const int16_t kStepSizes[89] = {
+      7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+      50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+      253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+      1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+      3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442,
+      11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+      32767};
+
+  const int8_t kIndexAdjust[8] = {-1, -1, -1, -1, 2, 4, 6, 8};
+
+  // Header of each channel in a block: first sample, step index, reserved.
+  const size_t kChannelHeaderBytes = 4;
+  // Nibbles of a channel are grouped by 8 samples.
+  const size_t kGroupFrames = 8;
+}
+
+void ImaAdpcmCodec::configure(uint32_t sample_rate, uint16_t channels)
+{
+  sample_rate_ = sample_rate;
+  channels_ = channels;
+
+  const size_t channel_bytes = sample_rate <= 11025 ? 256 : sample_rate <= 22050 ? 512 : 1024;
+  block_bytes_ = channel_bytes * channels;
+  // The header holds the first sample, each data byte two more.
+  block_frames_ = (channel_bytes - kChannelHeaderBytes) * 2 + 1;
+
+  state_.assign(channels, Channel());
+  pending_.clear();
+  pending_.reserve(block_frames_ * channels);
+}
+
+WavCodecFormat ImaAdpcmCodec::format() const
+{
+  WavCodecFormat format;
+  format.format_tag = 0x11; // WAVE_FORMAT_IMA_ADPCM
+  format.block_align = (uint16_t)block_bytes_;
+  format.bits_per_sample = 4;
+  format.byte_rate = (uint32_t)((uint64_t)sample_rate_ * block_bytes_ / block_frames_);
+  // cbSize, then samples per block.
+  format.extra = {2, 0, (uint8_t)(block_frames_ & 0xFF), (uint8_t)(block_frames_ >> 8)};
+  return format;
+}
+
+uint8_t ImaAdpcmCodec::encode_nibble(Channel *channel, int16_t sample)
+{
+  int32_t step = kStepSizes[channel->index];
+  int32_t diff = sample - channel->predictor;
+  uint8_t nibble = 0;
+  if (diff < 0)
+  {
+    nibble = 8;
+    diff = -diff;
+  }
+
+  // Quantize the difference in three bits, accumulating the decoder's
+  // reconstruction of it.
+  int32_t delta = step >> 3;
+  if (diff >= step)
+  {
+    nibble |= 4;
+    diff -= step;
+    delta += step;
+  }
+  step >>= 1;
+  if (diff >= step)
+  {
+    nibble |= 2;
+    diff -= step;
+    delta += step;
+  }
+  step >>= 1;
+  if (diff >= step)
+  {
+    nibble |= 1;
+    delta += step;
+  }
+
+  channel->predictor += (nibble & 8) ? -delta : delta;
+  channel->predictor = std::max(-32768, std::min(32767, channel->predictor));
+  channel->index = std::max(0, std::min(88, channel->index + kIndexAdjust[nibble & 7]));
+  return nibble;
+}
+
+void ImaAdpcmCodec::encode_block(const int16_t *samples, std::vector<uint8_t> *out)
+{
+  const size_t C = channels_;
+  const size_t start = out->size();
+  out->resize(start + block_bytes_);
+  uint8_t *dst = out->data() + start;
+
+  for (size_t c = 0; c < C; c++)
+  {
+    Channel &channel = state_[c];
+    channel.predictor = samples[c];
+    dst[0] = (uint8_t)(samples[c] & 0xFF);
+    dst[1] = (uint8_t)((uint16_t)samples[c] >> 8);
+    dst[2] = (uint8_t)channel.index;
+    dst[3] = 0;
+    dst += kChannelHeaderBytes;
+  }
+
+  for (size_t frame = 1; frame < block_frames_; frame += kGroupFrames)
+  {
+    for (size_t c = 0; c < C; c++)
+    {
+      const int16_t *in = samples + frame * C + c;
+      for (size_t k = 0; k < kGroupFrames; k += 2)
+      {
+        const uint8_t low = encode_nibble(&state_[c], in[k * C]);
+        const uint8_t high = encode_nibble(&state_[c], in[(k + 1) * C]);
+        *dst++ = (uint8_t)(low | (high << 4));
+      }
+    }
+  }
+}
+
+size_t ImaAdpcmCodec::encode(const int16_t *samples, size_t frames, std::vector<uint8_t> *out)
+{
+  const size_t C = channels_;
+  const size_t block_samples = block_frames_ * C;
+  size_t encoded = 0;
+
+  // Complete the pending block first, then encode straight from the input.
+  if (!pending_.empty())
+  {
+    const size_t take = std::min(frames * C, block_samples - pending_.size());
+    pending_.insert(pending_.end(), samples, samples + take);
+    samples += take;
+    frames -= take / C;
+    if (pending_.size() < block_samples)
+      return 0;
+    encode_block(pending_.data(), out);
+    pending_.clear();
+    encoded += block_frames_;
+  }
+
+  while (frames >= block_frames_)
+  {
+    encode_block(samples, out);
+    samples += block_samples;
+    frames -= block_frames_;
+    encoded += block_frames_;
+  }
+
+  pending_.insert(pending_.end(), samples, samples + frames * C);
+  return encoded;
+}
+
+size_t ImaAdpcmCodec::flush(std::vector<uint8_t> *out)
+{
+  if (pending_.empty())
+    return 0;
+
+  const size_t frames = pending_.size() / channels_;
+  pending_.resize(block_frames_ * channels_, 0);
+  encode_block(pending_.data(), out);
+  pending_.clear();
+  return frames;
+}
@@ -0,0 +1,47 @@
+#ifndef RECORD_LINUX_ADPCM_H_
+#define RECORD_LINUX_ADPCM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "record_writer.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//  IMA ADPCM (Microsoft WAV flavour, WAVE_FORMAT_IMA_ADPCM), 4 bits per sample
+//
+//  Frames are coded in blocks, each starting with one header per channel
+//  (first sample and step index) so that every block decodes on its own.
+//  Nibbles are interleaved per channel in groups of 8 samples (4 bytes).
+//  Blocks hold 256 bytes per channel up to 11 kHz, 512 up to 22 kHz and
+//  1024 above, like other encoders pick.
+////////////////////////////////////////////////////////////////////////////////
+class ImaAdpcmCodec : public WavCodec
+{
+public:
+  void configure(uint32_t sample_rate, uint16_t channels) override;
+  WavCodecFormat format() const override;
+  size_t encode(const int16_t *samples, size_t frames, std::vector<uint8_t> *out) override;
+  size_t flush(std::vector<uint8_t> *out) override;
+
+  size_t block_frames() const { return block_frames_; }
+
+private:
+  struct Channel
+  {
+    int32_t predictor = 0;
+    int32_t index = 0;
+  };
+
+  uint8_t encode_nibble(Channel *channel, int16_t sample);
+  void encode_block(const int16_t *samples, std::vector<uint8_t> *out);
+
+  uint32_t sample_rate_ = 0;
+  uint16_t channels_ = 0;
+  size_t block_bytes_ = 0;  // all channels
+  size_t block_frames_ = 0;
+  std::vector<Channel> state_;
+  std::vector<int16_t> pending_; // frames of the incomplete block
+};
+
+#endif // RECORD_LINUX_ADPCM_H_
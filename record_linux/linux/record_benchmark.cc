@@ -0,0 +1,373 @@
+#include "record_benchmark.h"
+#include "record_dsp.h"
+#include "record_flac.h"
+#include "record_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstring>
+#include <limits>
+#include <memory>
+
+namespace
+{
+  const uint32_t kSampleRate = 48000;
+  const size_t kChannels = 2;
+  const size_t kChunkFrames = FlacEncoder::kBlockSize;
+  // Distinct chunks of the synthetic signal, cycled through.
+  const size_t kSignalChunks = 8;
+
+  struct Session
+  {
+    DspChain dsp;
+    FlacEncoder encoder;
+    std::vector<int16_t> chunk;
+    std::vector<uint8_t> frame;
+    uint64_t frame_number = 0;
+  };
+
+  // A tone sweeping through speech frequencies, over a noise floor.
+  std::vector<int16_t> make_signal(size_t frames)
+  {
+    std::vector<int16_t> signal(frames * kChannels);
+    uint32_t seed = 0x2545f491;
+    double phase = 0.0;
+    for (size_t i = 0; i < frames; i++)
+    {
+      const double frequency = 200.0 + 800.0 * (double)(i % kSampleRate) / kSampleRate;
+      phase += 2.0 * M_PI * frequency / kSampleRate;
+      const double tone = 6000.0 * std::sin(phase);
+      for (size_t c = 0; c < kChannels; c++)
+      {
+        seed = seed * 1664525u + 1013904223u;
+        const double noise = (double)(int32_t)(seed >> 16 & 0xffff) - 32768.0;
+        signal[i * kChannels + c] = (int16_t)(tone + noise / 64.0);
+      }
+    }
+    return signal;
+  }
+
+  PoolBenchmarkRun run(size_t workers, size_t sessions, size_t chunks,
+                       const std::vector<int16_t> &signal)
+  {
+    std::vector<std::unique_ptr<Session>> states;
+    for (size_t i = 0; i < sessions; i++)
+    {
+      states.emplace_back(new Session());
+      Session &session = *states.back();
+      session.dsp.configure(kSampleRate, kChannels, true, false, true);
+      session.encoder.configure(kSampleRate, kChannels, FlacEncoder::kDefaultLevel);
+      session.chunk.resize(kChunkFrames * kChannels);
+      session.frame.reserve(kChunkFrames * kChannels * sizeof(int16_t) * 2);
+    }
+
+    WorkerPool pool(workers);
+    std::vector<std::unique_ptr<SerialQueue>> queues;
+    for (size_t i = 0; i < sessions; i++)
+      queues.emplace_back(new SerialQueue(&pool));
+
+    const auto started = std::chrono::steady_clock::now();
+    for (size_t c = 0; c < chunks; c++)
+    {
+      const int16_t *source = &signal[(c % kSignalChunks) * kChunkFrames * kChannels];
+      for (size_t i = 0; i < sessions; i++)
+      {
+        Session *session = states[i].get();
+        queues[i]->submit([session, source]
+                          {
+                            memcpy(session->chunk.data(), source, session->chunk.size() * sizeof(int16_t));
+                            session->dsp.process_s16(session->chunk.data(), nullptr, kChunkFrames);
+                            session->frame.clear();
+                            session->encoder.encode_frame(session->chunk.data(), kChunkFrames,
+                                                          session->frame_number++, &session->frame); });
+      }
+    }
+    for (std::unique_ptr<SerialQueue> &queue : queues)
+      queue->drain();
+    const double seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    PoolBenchmarkRun result;
+    result.workers = workers;
+    result.chunks = (uint64_t)chunks * sessions;
+    result.seconds = seconds;
+    result.chunks_per_second = seconds > 0.0 ? result.chunks / seconds : 0.0;
+    result.realtime_factor = result.chunks_per_second * kChunkFrames / kSampleRate;
+    result.steals = pool.steals();
+    return result;
+  }
+
+  // Stepped sweep, each tone measured over one second of output.
+  const size_t kPassbandTones = 64;
+  const size_t kStopbandTones = 32;
+  const double kToneAmplitude = 0.5;
+  const size_t kResamplerChunkFrames = 1024;
+  // Kaiser's estimates hold within these of the measured response.
+  const double kAttenuationToleranceDb = 3.0;
+  const double kRippleTolerance = 2.0; // times the design ripple
+
+  // Gain in dB of a tone at [frequency] Hz: at the tone itself, or of the
+  // whole output for a [stopband] tone, whatever frequency it aliased to.
+  double tone_gain_db(uint32_t in_rate, uint32_t out_rate, ResamplerQuality quality,
+                      double frequency, bool stopband)
+  {
+    Resampler resampler;
+    resampler.configure(in_rate, out_rate, 1, quality);
+
+    // Clear of the filter run-in and run-out on both sides.
+    const size_t measured = out_rate;
+    const size_t lead = 2 * resampler.taps() + 64;
+    const size_t frames = (size_t)((double)(measured + 2 * lead) * in_rate / out_rate) + 1;
+    std::vector<float> in(frames);
+    for (size_t i = 0; i < frames; i++)
+      in[i] = (float)(kToneAmplitude * std::sin(2.0 * M_PI * frequency * (double)i / in_rate));
+    std::vector<float> out;
+    resampler.process(in.data(), frames, &out);
+    resampler.flush(&out);
+
+    double power = 0.0;
+    std::complex<double> bin = 0.0;
+    for (size_t n = 0; n < measured; n++)
+    {
+      const double y = out[lead + n];
+      power += y * y;
+      bin += y * std::polar(1.0, -2.0 * M_PI * frequency * (double)n / out_rate);
+    }
+    const double amplitude =
+        stopband ? std::sqrt(2.0 * power / measured) : 2.0 * std::abs(bin) / measured;
+    return 20.0 * std::log10(amplitude / kToneAmplitude + 1e-30);
+  }
+
+  ResamplerBenchmarkRun run_resampler(uint32_t in_rate, uint32_t out_rate,
+                                      ResamplerQuality quality, double audio_seconds)
+  {
+    ResamplerBenchmarkRun result;
+    result.in_rate = in_rate;
+    result.out_rate = out_rate;
+    result.quality = quality;
+    result.design = resampler_design(quality);
+    const double nyquist = std::min(in_rate, out_rate) / 2.0;
+
+    // Whole hertz: a whole number of periods in the second measured.
+    result.ripple_db = 0.0;
+    for (size_t i = 1; i <= kPassbandTones; i++)
+    {
+      const double frequency = std::round(result.design.passband * nyquist * i / kPassbandTones);
+      result.ripple_db = std::max(result.ripple_db,
+                                  std::fabs(tone_gain_db(in_rate, out_rate, quality, frequency, false)));
+    }
+    const double stop_from = result.design.stopband * nyquist;
+    const double stop_to = in_rate / 2.0 - 1.0;
+    result.attenuation_db = INFINITY;
+    for (size_t i = 0; i < kStopbandTones && stop_from < stop_to; i++)
+    {
+      const double frequency = stop_from + (stop_to - stop_from) * i / (kStopbandTones - 1);
+      result.attenuation_db = std::min(result.attenuation_db,
+                                       -tone_gain_db(in_rate, out_rate, quality, frequency, true));
+    }
+    result.within_design =
+        result.ripple_db <= kRippleTolerance * result.design.ripple_db &&
+        result.attenuation_db >= result.design.attenuation_db - kAttenuationToleranceDb;
+
+    // Throughput, in chunks as a capture delivers them.
+    const size_t channels = 2;
+    Resampler resampler;
+    resampler.configure(in_rate, out_rate, channels, quality);
+    result.taps = resampler.taps();
+    std::vector<float> chunk(kResamplerChunkFrames * channels);
+    for (size_t i = 0; i < kResamplerChunkFrames; i++)
+    {
+      const float sample = (float)(kToneAmplitude * std::sin(2.0 * M_PI * 1000.0 * i / in_rate));
+      chunk[i * channels] = sample;
+      chunk[i * channels + 1] = -sample;
+    }
+    const size_t chunks =
+        std::max<size_t>(1, (size_t)(audio_seconds * in_rate / kResamplerChunkFrames));
+    std::vector<float> out;
+    out.reserve(kResamplerChunkFrames * channels * out_rate / in_rate + 2 * channels);
+    uint64_t output_frames = 0;
+
+    const auto started = std::chrono::steady_clock::now();
+    for (size_t c = 0; c < chunks; c++)
+    {
+      out.clear();
+      resampler.process(chunk.data(), kResamplerChunkFrames, &out);
+      output_frames += out.size() / channels;
+    }
+    const double seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    const double flops = 2.0 * (double)result.taps * channels * (double)output_frames;
+    result.mflops = seconds > 0.0 ? flops / seconds / 1e6 : 0.0;
+    result.realtime_factor =
+        seconds > 0.0 ? (double)chunks * kResamplerChunkFrames / in_rate / seconds : 0.0;
+    return result;
+  }
+
+  // Samples per call, odd so that the vector kernels leave a tail.
+  const size_t kFormatChunkSamples = 4096 + 7;
+  const SampleFormat kFormats[] = {SampleFormat::kU8, SampleFormat::kS16, SampleFormat::kS24,
+                                   SampleFormat::kS32, SampleFormat::kF32};
+
+  // Random samples in [format]; floats also out of range, at full scale
+  // and halfway between two S16 or S32 steps.
+  std::vector<uint8_t> make_format_input(SampleFormat format, size_t samples)
+  {
+    std::vector<uint8_t> input(samples * sample_format_bytes(format));
+    uint32_t seed = 0x9e3779b9;
+    if (format != SampleFormat::kF32)
+    {
+      for (uint8_t &byte : input)
+      {
+        seed = seed * 1664525u + 1013904223u;
+        byte = (uint8_t)(seed >> 24);
+      }
+      return input;
+    }
+
+    const float kEdges[] = {0.0f, -0.0f, 1.0f, -1.0f, 1.5f, -1.5f, 0.99999994f,
+                            0.5f / 32768.0f, 1.5f / 32768.0f, -0.5f / 32768.0f,
+                            0.5f / 8388608.0f, 1.0f - 0.5f / 32768.0f,
+                            std::numeric_limits<float>::quiet_NaN(),
+                            std::numeric_limits<float>::infinity(),
+                            -std::numeric_limits<float>::infinity()};
+    const size_t edges = sizeof(kEdges) / sizeof(kEdges[0]);
+    float *floats = (float *)input.data();
+    for (size_t i = 0; i < samples; i++)
+    {
+      seed = seed * 1664525u + 1013904223u;
+      floats[i] = i % 4 == 0 ? kEdges[i / 4 % edges]
+                             : ((float)(seed >> 8) / 8388608.0f - 1.0f) * 1.25f;
+    }
+    return input;
+  }
+
+  // Sample [i] of [data] in full scale units, exactly.
+  double sample_value(const uint8_t *data, SampleFormat format, size_t i)
+  {
+    if (format == SampleFormat::kF32)
+      return ((const float *)data)[i];
+    int32_t value;
+    convert_samples_with("scalar", data + i * sample_format_bytes(format), format, &value,
+                         SampleFormat::kS32, 1);
+    return value / 2147483648.0;
+  }
+
+  template <class Kernel>
+  double time_kernel(size_t calls, Kernel kernel)
+  {
+    const auto started = std::chrono::steady_clock::now();
+    for (size_t c = 0; c < calls; c++)
+      kernel();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+  }
+
+  FormatBenchmarkRun format_run(const char *kernel, SampleFormat from, SampleFormat to,
+                                const char *isa, size_t calls, double seconds)
+  {
+    FormatBenchmarkRun result;
+    result.kernel = kernel;
+    result.from = from;
+    result.to = to;
+    result.isa = isa;
+    const double samples = (double)calls * kFormatChunkSamples;
+    const double bytes = samples * (sample_format_bytes(from) + sample_format_bytes(to));
+    result.msamples_per_second = seconds > 0.0 ? samples / seconds / 1e6 : 0.0;
+    result.gbytes_per_second = seconds > 0.0 ? bytes / seconds / 1e9 : 0.0;
+    result.mismatches = 0;
+    result.max_error = 0.0;
+    return result;
+  }
+}
+
+std::vector<PoolBenchmarkRun> run_pool_benchmark(size_t max_workers, size_t sessions,
+                                                 double audio_seconds)
+{
+  const std::vector<int16_t> signal = make_signal(kSignalChunks * kChunkFrames);
+  const size_t chunks = std::max<size_t>(1, (size_t)(audio_seconds * kSampleRate / kChunkFrames));
+
+  std::vector<PoolBenchmarkRun> runs;
+  for (size_t workers = 1; workers <= max_workers; workers++)
+    runs.push_back(run(workers, std::max<size_t>(1, sessions), chunks, signal));
+  return runs;
+}
+
+std::vector<ResamplerBenchmarkRun> run_resampler_benchmark(double audio_seconds)
+{
+  const uint32_t kRates[][2] = {{48000, 16000}, {48000, 44100}};
+  const ResamplerQuality kQualities[] = {ResamplerQuality::kLow, ResamplerQuality::kMedium,
+                                         ResamplerQuality::kHigh, ResamplerQuality::kBest};
+
+  std::vector<ResamplerBenchmarkRun> runs;
+  for (const uint32_t *rates : kRates)
+  {
+    for (ResamplerQuality quality : kQualities)
+      runs.push_back(run_resampler(rates[0], rates[1], quality, audio_seconds));
+  }
+  return runs;
+}
+
+std::vector<FormatBenchmarkRun> run_format_benchmark(double audio_seconds)
+{
+  const size_t calls = std::max<size_t>(
+      1, (size_t)(audio_seconds * kSampleRate * kChannels / kFormatChunkSamples));
+  const std::vector<const char *> isas = sample_format_isas();
+
+  std::vector<FormatBenchmarkRun> runs;
+  std::vector<uint8_t> reference(kFormatChunkSamples * 4);
+  std::vector<uint8_t> output(kFormatChunkSamples * 4);
+  for (SampleFormat from : kFormats)
+  {
+    const std::vector<uint8_t> input = make_format_input(from, kFormatChunkSamples);
+    for (SampleFormat to : kFormats)
+    {
+      if (from == to)
+        continue;
+      convert_samples_with("scalar", input.data(), from, reference.data(), to,
+                           kFormatChunkSamples);
+
+      // Scalar last in isas, run first: the others are checked against it.
+      for (size_t i = isas.size(); i-- > 0;)
+      {
+        const char *isa = isas[i];
+        if (!sample_format_has_kernel(isa, from, to))
+          continue;
+        const double seconds = time_kernel(calls, [&]
+                                           { convert_samples_with(isa, input.data(), from,
+                                                                  output.data(), to,
+                                                                  kFormatChunkSamples); });
+        FormatBenchmarkRun run = format_run("convert", from, to, isa, calls, seconds);
+        for (size_t s = 0; s < kFormatChunkSamples; s++)
+        {
+          const double a = sample_value(output.data(), to, s);
+          const double b = sample_value(reference.data(), to, s);
+          if (a != b)
+          {
+            run.mismatches++;
+            run.max_error = std::max(run.max_error, std::fabs(a - b));
+          }
+        }
+        runs.push_back(run);
+      }
+    }
+  }
+
+  // Planar, stereo, as the resampler reads and writes.
+  const size_t frames = kFormatChunkSamples / kChannels;
+  std::vector<float> left(frames), right(frames);
+  float *planes[] = {left.data(), right.data()};
+  for (SampleFormat format : kFormats)
+  {
+    const std::vector<uint8_t> input = make_format_input(format, frames * kChannels);
+    double seconds = time_kernel(calls, [&]
+                                 { deinterleave_to_f32(input.data(), format, kChannels, planes,
+                                                       frames); });
+    runs.push_back(format_run("deinterleave", format, SampleFormat::kF32, "scalar", calls, seconds));
+    seconds = time_kernel(calls, [&]
+                          { interleave_from_f32(planes, kChannels, output.data(), format, frames); });
+    runs.push_back(format_run("interleave", SampleFormat::kF32, format, "scalar", calls, seconds));
+  }
+  return runs;
+}
@@ -0,0 +1,97 @@
+#ifndef RECORD_LINUX_BENCHMARK_H_
+#define RECORD_LINUX_BENCHMARK_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "record_format.h"
+#include "record_resampler.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//  Worker pool scaling benchmark
+//
+//  Runs a fixed mix of work per chunk, the DSP chain (noise suppression and
+//  auto gain) then one FLAC frame, on synthetic 48 kHz stereo audio. Each
+//  session processes its chunks in order on its own SerialQueue, like a
+//  recording, and every session shares one WorkerPool; the run is repeated
+//  with pools of 1 to N workers to show how throughput scales with cores.
+////////////////////////////////////////////////////////////////////////////////
+
+struct PoolBenchmarkRun
+{
+  size_t workers;
+  uint64_t chunks; // over all sessions
+  double seconds;  // wall time
+  double chunks_per_second;
+  // Seconds of audio processed per second of wall time, all sessions.
+  double realtime_factor;
+  uint64_t steals;
+};
+
+// One run per pool size from 1 to [max_workers], each processing
+// [audio_seconds] of audio for each of [sessions] sessions. Blocks.
+std::vector<PoolBenchmarkRun> run_pool_benchmark(size_t max_workers, size_t sessions,
+                                                 double audio_seconds);
+
+////////////////////////////////////////////////////////////////////////////////
+//  Resampler response and throughput benchmark
+//
+//  For each quality preset, 48 kHz to 16 kHz and to 44.1 kHz: a stepped
+//  sine sweep measures the gain of each tone in the passband (DFT at the
+//  tone, over a whole number of periods) and what leaks out of each tone in
+//  the stopband (output power), against the preset design. Then stereo
+//  audio is converted as fast as it goes, for the throughput.
+////////////////////////////////////////////////////////////////////////////////
+
+struct ResamplerBenchmarkRun
+{
+  uint32_t in_rate;
+  uint32_t out_rate;
+  ResamplerQuality quality;
+  size_t taps;
+  ResamplerDesign design;
+  // Largest deviation from unity gain up to design.passband.
+  double ripple_db;
+  // Smallest attenuation from design.stopband to the input Nyquist.
+  double attenuation_db;
+  // Measured within tolerance of the design.
+  bool within_design;
+  // Filter multiply-adds, counted as 2 floating point operations.
+  double mflops;
+  // Seconds of stereo audio converted per second.
+  double realtime_factor;
+};
+
+// One run per preset and rate pair, converting [audio_seconds] of stereo
+// audio for the throughput. Blocks.
+std::vector<ResamplerBenchmarkRun> run_resampler_benchmark(double audio_seconds);
+
+////////////////////////////////////////////////////////////////////////////////
+//  Sample format conversion benchmark
+//
+//  Times every conversion kernel: each format pair with the scalar kernels,
+//  then with each instruction set that has its own kernel for the pair,
+//  whose output is compared with the scalar one for the same input (random
+//  samples, full scale, out of range and non finite floats, rounding ties,
+//  and a length leaving a tail). Then the planar kernels the resampler uses, in stereo.
+////////////////////////////////////////////////////////////////////////////////
+
+struct FormatBenchmarkRun
+{
+  const char *kernel; // "convert", "deinterleave" or "interleave"
+  SampleFormat from;
+  SampleFormat to;
+  const char *isa;
+  double msamples_per_second;
+  double gbytes_per_second; // read and written
+  // Vector kernels, against the scalar one: samples differing, and by how
+  // much at most (full scale 1).
+  uint64_t mismatches;
+  double max_error;
+};
+
+// Converts [audio_seconds] of 48 kHz stereo with each kernel. Blocks.
+std::vector<FormatBenchmarkRun> run_format_benchmark(double audio_seconds);
+
+#endif // RECORD_LINUX_BENCHMARK_H_
@@ -0,0 +1,128 @@
+#include "record_channel_matrix.h"
+
+#include <cstring>
+
+namespace
+{
+  // Gathers one input sample of B bytes per output channel and frame.
+  template <size_t B>
+  void gather_samples(const uint8_t *src, size_t inputs, const size_t *source, size_t outputs,
+                      uint8_t *dst, size_t frames)
+  {
+    for (size_t i = 0; i < frames; i++)
+    {
+      for (size_t c = 0; c < outputs; c++)
+        memcpy(dst + c * B, src + source[c] * B, B);
+      src += inputs * B;
+      dst += outputs * B;
+    }
+  }
+
+  // dst[i] += gain * src[i]
+  void accumulate(float *__restrict dst, const float *__restrict src, float gain, size_t n)
+  {
+    for (size_t i = 0; i < n; i++)
+      dst[i] += gain * src[i];
+  }
+}
+
+bool ChannelMatrix::configure(size_t in_channels, const std::vector<std::vector<double>> &rows,
+                              size_t max_frames)
+{
+  inputs_ = in_channels;
+  outputs_ = rows.size();
+  max_frames_ = max_frames;
+  selection_ = true;
+  source_.assign(outputs_, 0);
+  gains_.assign(outputs_ * inputs_, 0.0f);
+
+  for (size_t o = 0; o < outputs_; o++)
+  {
+    if (rows[o].size() != inputs_)
+      return false;
+
+    size_t picked = 0;
+    bool unity = true;
+    for (size_t i = 0; i < inputs_; i++)
+    {
+      const float gain = (float)rows[o][i];
+      gains_[o * inputs_ + i] = gain;
+      if (gain != 0.0f)
+      {
+        picked++;
+        source_[o] = i;
+        unity = unity && gain == 1.0f;
+      }
+    }
+    selection_ = selection_ && picked == 1 && unity;
+  }
+
+  if (selection_)
+  {
+    planar_.clear();
+    output_.resize(max_frames_ * outputs_ * sizeof(int32_t)); // widest sample
+    return true;
+  }
+
+  planar_.assign((inputs_ + outputs_) * max_frames_, 0.0f);
+  in_planes_.resize(inputs_);
+  out_planes_.resize(outputs_);
+  for (size_t i = 0; i < inputs_; i++)
+    in_planes_[i] = &planar_[i * max_frames_];
+  for (size_t o = 0; o < outputs_; o++)
+    out_planes_[o] = &planar_[(inputs_ + o) * max_frames_];
+  output_.resize(max_frames_ * outputs_ * sizeof(float));
+  return true;
+}
+
+const uint8_t *ChannelMatrix::process(const void *src, SampleFormat format, size_t frames)
+{
+  if (frames > max_frames_)
+    frames = max_frames_;
+
+  if (selection_)
+    gather((const uint8_t *)src, sample_format_bytes(format), frames);
+  else
+    mix(src, format, frames);
+  return output_.data();
+}
+
+void ChannelMatrix::gather(const uint8_t *src, size_t sample_bytes, size_t frames)
+{
+  const size_t *source = source_.data();
+  uint8_t *dst = output_.data();
+  switch (sample_bytes)
+  {
+  case 1:
+    gather_samples<1>(src, inputs_, source, outputs_, dst, frames);
+    break;
+  case 2:
+    gather_samples<2>(src, inputs_, source, outputs_, dst, frames);
+    break;
+  case 3:
+    gather_samples<3>(src, inputs_, source, outputs_, dst, frames);
+    break;
+  default:
+    gather_samples<4>(src, inputs_, source, outputs_, dst, frames);
+    break;
+  }
+}
+
+void ChannelMatrix::mix(const void *src, SampleFormat format, size_t frames)
+{
+  deinterleave_to_f32(src, format, inputs_, in_planes_.data(), frames);
+
+  for (size_t o = 0; o < outputs_; o++)
+  {
+    float *out = &planar_[(inputs_ + o) * max_frames_];
+    memset(out, 0, frames * sizeof(float));
+    const float *gains = &gains_[o * inputs_];
+    for (size_t i = 0; i < inputs_; i++)
+    {
+      if (gains[i] != 0.0f)
+        accumulate(out, in_planes_[i], gains[i], frames);
+    }
+  }
+
+  interleave_from_f32(out_planes_.data(), outputs_, output_.data(), SampleFormat::kF32, frames);
+}
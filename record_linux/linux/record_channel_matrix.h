@@ -0,0 +1,58 @@
+#ifndef RECORD_LINUX_CHANNEL_MATRIX_H_
+#define RECORD_LINUX_CHANNEL_MATRIX_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "record_format.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//  Channel selection, reordering and mixing
+//
+//  Maps the device channels to the session channels with a gain matrix of
+//  one row per output channel. When every row picks one input at unity
+//  gain, samples are only gathered, in the capture format. Otherwise the
+//  input is converted to planar float and each output is a weighted sum of
+//  whole channel buffers, delivered as interleaved F32.
+//  Buffers are allocated by configure(); process() does not allocate.
+////////////////////////////////////////////////////////////////////////////////
+class ChannelMatrix
+{
+public:
+  // Rows of [in_channels] gains. Returns false if a row has another size.
+  bool configure(size_t in_channels, const std::vector<std::vector<double>> &rows,
+                 size_t max_frames);
+
+  size_t inputs() const { return inputs_; }
+  size_t outputs() const { return outputs_; }
+  bool selection() const { return selection_; }
+
+  // Format of the output for input in [format].
+  SampleFormat output_format(SampleFormat format) const
+  {
+    return selection_ ? format : SampleFormat::kF32;
+  }
+
+  // Maps [frames] (at most max_frames) interleaved frames. The result is
+  // valid until the next call.
+  const uint8_t *process(const void *src, SampleFormat format, size_t frames);
+
+private:
+  void gather(const uint8_t *src, size_t sample_bytes, size_t frames);
+  void mix(const void *src, SampleFormat format, size_t frames);
+
+  size_t inputs_ = 0;
+  size_t outputs_ = 0;
+  size_t max_frames_ = 0;
+  bool selection_ = false;
+  std::vector<size_t> source_; // input of each output, when selecting
+  std::vector<float> gains_;   // outputs_ rows of inputs_
+
+  std::vector<float> planar_;  // inputs_ + outputs_ channels of max_frames_
+  std::vector<float *> in_planes_;
+  std::vector<const float *> out_planes_;
+  std::vector<uint8_t> output_;
+};
+
+#endif // RECORD_LINUX_CHANNEL_MATRIX_H_
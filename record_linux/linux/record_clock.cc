@@ -0,0 +1,86 @@
+#include "record_clock.h"
+
+#include <cmath>
+
+namespace
+{
+  // Measures fade out over about this long.
+  const double kMemorySeconds = 60;
+  // A measure further off the line than this starts a new one.
+  const double kRestartNs = 50e6;
+}
+
+void CaptureClock::configure(uint32_t rate)
+{
+  rate_ = rate;
+  frames_ = 0;
+  started_ = false;
+  locked_ns_ = 0;
+}
+
+void CaptureClock::restart(int64_t time_ns)
+{
+  started_ = true;
+  locked_ns_ = 0;
+  origin_frame_ = frames_;
+  origin_ns_ = time_ns;
+  skipped_ns_ = 0;
+  sw_ = sx_ = sy_ = sxx_ = sxy_ = 0;
+}
+
+double CaptureClock::period_ns() const
+{
+  const double nominal = rate_ > 0 ? 1e9 / rate_ : 0;
+  const double det = sw_ * sxx_ - sx_ * sx_;
+  if (sw_ <= 0 || det <= 1e-9 * sw_ * sxx_)
+    return nominal;
+  return (sw_ * sxy_ - sx_ * sy_) / det;
+}
+
+void CaptureClock::update(int64_t time_ns, size_t frames)
+{
+  if (time_ns != 0)
+  {
+    if (!started_ || std::fabs((double)(time_ns - time_of((double)frames_))) > kRestartNs)
+      restart(time_ns);
+
+    // The losses not filled are taken out, the line spans the frames.
+    const double x = (double)(frames_ - origin_frame_);
+    const double y = (double)(time_ns - origin_ns_) - skipped_ns_;
+    const double fade = rate_ > 0 ? std::exp(-(double)frames / (rate_ * kMemorySeconds)) : 0;
+    sw_ = sw_ * fade + 1;
+    sx_ = sx_ * fade + x;
+    sy_ = sy_ * fade + y;
+    sxx_ = sxx_ * fade + x * x;
+    sxy_ = sxy_ * fade + x * y;
+    locked_ns_ = (int64_t)y;
+  }
+  frames_ += frames;
+}
+
+void CaptureClock::skip(uint64_t frames)
+{
+  skipped_ns_ += frames * period_ns();
+}
+
+int64_t CaptureClock::time_of(double frame) const
+{
+  if (!started_)
+    return 0;
+  const double x = frame - (double)origin_frame_;
+  if (sw_ <= 0)
+    return origin_ns_;
+  // Through the weighted mean, with the fitted slope.
+  const double period = period_ns();
+  const double mean_x = sx_ / sw_;
+  const double mean_y = sy_ / sw_;
+  return origin_ns_ + (int64_t)(mean_y + (x - mean_x) * period + skipped_ns_);
+}
+
+double CaptureClock::drift_ppm() const
+{
+  const double period = period_ns();
+  if (period <= 0 || rate_ == 0)
+    return 0;
+  return (1e9 / (period * rate_) - 1) * 1e6;
+}
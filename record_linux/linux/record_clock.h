@@ -0,0 +1,89 @@
+#ifndef RECORD_LINUX_CLOCK_H_
+#define RECORD_LINUX_CLOCK_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+////////////////////////////////////////////////////////////////////////////////
+//  Capture clock
+//
+//  Each chunk comes with a measure of when its first frame was captured:
+//  the read time minus the latency the server reports for the stream. The
+//  measures jitter with the scheduling and the server's timing updates by
+//  a few milliseconds, the device clock drifts by tens of ppm: a line
+//  fitted to the measures of the last minute or so (least squares, older
+//  ones fading out) gives the capture time of every frame processed, and
+//  its slope the drift of the device clock against CLOCK_MONOTONIC.
+//
+//  Frames are counted as processed, silence filling a loss included.
+//  A measure far off the line (a pause, a loss not filled) starts a new
+//  one from it.
+////////////////////////////////////////////////////////////////////////////////
+class CaptureClock
+{
+public:
+  // Frames at [rate]. Forgets everything.
+  void configure(uint32_t rate);
+
+  // [frames] more processed, the first measured captured at [time_ns]
+  // (CLOCK_MONOTONIC), or 0 when not measured.
+  void update(int64_t time_ns, size_t frames);
+  // [frames] lost before the next update: the time moves on, the count
+  // of frames processed does not.
+  void skip(uint64_t frames);
+
+  // Frames processed so far.
+  uint64_t frames() const { return frames_; }
+  // Capture time of processed frame [frame] (possibly fractional, and
+  // best near the last update), 0 before any measure.
+  int64_t time_of(double frame) const;
+
+  // Device clock rate against CLOCK_MONOTONIC, in parts per million above 1.
+  double drift_ppm() const;
+  // Fitted over long enough for drift_ppm() to be meaningful.
+  bool settled() const { return locked_ns_ >= kSettleNs; }
+
+private:
+  static const int64_t kSettleNs = 10000000000LL;
+
+  void restart(int64_t time_ns);
+  // Nanoseconds per frame of the line, nominal until two measures.
+  double period_ns() const;
+
+  uint32_t rate_ = 0;
+  uint64_t frames_ = 0;
+  bool started_ = false;
+  int64_t locked_ns_ = 0; // time measured since the line started
+
+  // Weighted sums of the measures since the line started, frames and
+  // times relative to its first measure
+  uint64_t origin_frame_ = 0;
+  int64_t origin_ns_ = 0;
+  double skipped_ns_ = 0; // losses not filled, since the origin
+  double sw_ = 0;
+  double sx_ = 0;
+  double sy_ = 0;
+  double sxx_ = 0;
+  double sxy_ = 0;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//  Header of each raw PCM chunk streamed to Dart ("audioData"), packed in
+//  front of its samples: no allocation of its own. Little endian.
+////////////////////////////////////////////////////////////////////////////////
+struct AudioChunkHeader
+{
+  static const uint16_t kSettled = 1 << 0; // drift_ppm measured long enough
+  static const uint16_t kPreRoll = 1 << 1; // history from before the start
+  static const uint16_t kGap = 1 << 2;     // audio lost just before, not filled
+
+  uint16_t size;       // of the header, the samples follow
+  uint16_t flags;
+  uint32_t frames;
+  int64_t first_frame; // frames streamed before it in the session
+  int64_t time_ns;     // CLOCK_MONOTONIC capture time of the first frame, 0 if unknown
+  double drift_ppm;    // device clock against CLOCK_MONOTONIC
+};
+static_assert(sizeof(AudioChunkHeader) == 32, "AudioChunkHeader is a wire format");
+
+#endif // RECORD_LINUX_CLOCK_H_
@@ -0,0 +1,253 @@
+#include "record_config.h"
+
+// Most channels a PulseAudio stream can have (PA_CHANNELS_MAX).
+static const size_t kMaxDeviceChannels = 32;
+
+static FlValue *lookup(FlValue *map, const char *key, FlValueType type)
+{
+  if (!map || fl_value_get_type(map) != FL_VALUE_TYPE_MAP)
+    return nullptr;
+  FlValue *value = fl_value_lookup_string(map, key);
+  if (!value || fl_value_get_type(value) != type)
+    return nullptr;
+  return value;
+}
+
+static void read_int(FlValue *map, const char *key, int *out)
+{
+  FlValue *value = lookup(map, key, FL_VALUE_TYPE_INT);
+  if (value)
+    *out = (int)fl_value_get_int(value);
+}
+
+static void read_double(FlValue *map, const char *key, double *out)
+{
+  FlValue *value = lookup(map, key, FL_VALUE_TYPE_FLOAT);
+  if (value)
+    *out = fl_value_get_float(value);
+}
+
+static void read_bool(FlValue *map, const char *key, bool *out)
+{
+  FlValue *value = lookup(map, key, FL_VALUE_TYPE_BOOL);
+  if (value)
+    *out = fl_value_get_bool(value);
+}
+
+static void read_string(FlValue *map, const char *key, std::string *out)
+{
+  FlValue *value = lookup(map, key, FL_VALUE_TYPE_STRING);
+  if (value)
+    *out = fl_value_get_string(value);
+}
+
+static void read_sample_format(FlValue *map, const char *key, SampleFormat *out)
+{
+  std::string name;
+  read_string(map, key, &name);
+  if (!name.empty() && !sample_format_from_name(name, out))
+    g_warning("Unknown sample format '%s'", name.c_str());
+}
+
+// Reads a list of rows of numbers. Leaves [out] empty unless every row
+// has the same, non zero, length.
+static void read_matrix(FlValue *map, const char *key, std::vector<std::vector<double>> *out)
+{
+  FlValue *value = lookup(map, key, FL_VALUE_TYPE_LIST);
+  if (!value)
+    return;
+
+  std::vector<std::vector<double>> rows;
+  for (size_t r = 0; r < fl_value_get_length(value); r++)
+  {
+    FlValue *row = fl_value_get_list_value(value, r);
+    if (fl_value_get_type(row) != FL_VALUE_TYPE_LIST || fl_value_get_length(row) == 0)
+      return;
+
+    std::vector<double> gains;
+    for (size_t i = 0; i < fl_value_get_length(row); i++)
+    {
+      FlValue *gain = fl_value_get_list_value(row, i);
+      if (fl_value_get_type(gain) == FL_VALUE_TYPE_FLOAT)
+        gains.push_back(fl_value_get_float(gain));
+      else if (fl_value_get_type(gain) == FL_VALUE_TYPE_INT)
+        gains.push_back((double)fl_value_get_int(gain));
+      else
+        return;
+    }
+    if (!rows.empty() && gains.size() != rows[0].size())
+      return;
+    rows.push_back(gains);
+  }
+  *out = rows;
+}
+
+// Reads a list of integers, leaving [out] as is unless all of them are.
+static void read_int_list(FlValue *map, const char *key, std::vector<int> *out)
+{
+  FlValue *value = lookup(map, key, FL_VALUE_TYPE_LIST);
+  if (!value)
+    return;
+
+  std::vector<int> items;
+  for (size_t i = 0; i < fl_value_get_length(value); i++)
+  {
+    FlValue *item = fl_value_get_list_value(value, i);
+    if (fl_value_get_type(item) != FL_VALUE_TYPE_INT)
+      return;
+    items.push_back((int)fl_value_get_int(item));
+  }
+  *out = items;
+}
+
+// Reads the list of LinuxRecordOutput maps, skipping those without path.
+static void read_outputs(FlValue *map, const char *key, std::vector<RecordOutput> *out)
+{
+  FlValue *value = lookup(map, key, FL_VALUE_TYPE_LIST);
+  if (!value)
+    return;
+
+  out->clear();
+  for (size_t i = 0; i < fl_value_get_length(value); i++)
+  {
+    FlValue *item = fl_value_get_list_value(value, i);
+    RecordOutput output;
+    read_string(item, "path", &output.path);
+    read_string(item, "encoder", &output.encoder);
+    read_int(item, "bitRate", &output.bit_rate);
+
+    std::string codec;
+    read_string(item, "codec", &codec);
+    if (!codec.empty())
+      output.encoder = codec;
+
+    if (!output.path.empty())
+      out->push_back(output);
+  }
+}
+
+void record_config_from_value(FlValue *value, RecordConfig *config)
+{
+  read_string(value, "encoder", &config->encoder);
+  read_int(value, "bitRate", &config->bit_rate);
+  read_int(value, "sampleRate", &config->sample_rate);
+  read_int(value, "numChannels", &config->num_channels);
+  read_bool(value, "autoGain", &config->auto_gain);
+  read_bool(value, "echoCancel", &config->echo_cancel);
+  read_bool(value, "noiseSuppress", &config->noise_suppress);
+
+  FlValue *device = lookup(value, "device", FL_VALUE_TYPE_MAP);
+  read_string(device, "id", &config->device_id);
+
+  FlValue *linux_config = lookup(value, "linuxConfig", FL_VALUE_TYPE_MAP);
+  read_string(linux_config, "echoReference", &config->echo_reference);
+  read_bool(linux_config, "waveformPeaks", &config->waveform_peaks);
+  read_string(linux_config, "vadMode", &config->vad_mode);
+  read_int(linux_config, "vadHangoverMs", &config->vad_hangover_ms);
+  read_int(linux_config, "vadPreRollMs", &config->vad_pre_roll_ms);
+  read_int(linux_config, "preRollBufferMs", &config->pre_roll_buffer_ms);
+  read_int(linux_config, "preRollMs", &config->pre_roll_ms);
+  read_double(linux_config, "voxThresholdDb", &config->vox_threshold_db);
+  read_int(linux_config, "voxMinDurationMs", &config->vox_min_duration_ms);
+  read_int(linux_config, "voxHangMs", &config->vox_hang_ms);
+  read_int(linux_config, "flacLevel", &config->flac_level);
+  read_bool(linux_config, "streamOggFraming", &config->stream_ogg_framing);
+
+  // Linux only codecs replace the encoder.
+  std::string codec;
+  read_string(linux_config, "codec", &codec);
+  if (!codec.empty())
+    config->encoder = codec;
+  read_sample_format(linux_config, "captureFormat", &config->capture_format);
+  read_sample_format(linux_config, "outputFormat", &config->output_format);
+  read_int(linux_config, "captureSampleRate", &config->capture_sample_rate);
+  read_matrix(linux_config, "channelMatrix", &config->channel_matrix);
+  read_outputs(linux_config, "outputs", &config->outputs);
+  read_string(linux_config, "captureEngine", &config->capture_engine);
+  read_int(linux_config, "realtimePriority", &config->realtime_priority);
+  read_int_list(linux_config, "cpuAffinity", &config->cpu_affinity);
+  read_bool(linux_config, "fillDropouts", &config->fill_dropouts);
+  read_bool(linux_config, "reconnect", &config->reconnect);
+  read_string(linux_config, "fallbackDeviceId", &config->fallback_device_id);
+
+  std::string quality;
+  read_string(linux_config, "resamplerQuality", &quality);
+  if (!quality.empty() && !resampler_quality_from_name(quality, &config->resampler_quality))
+    g_warning("Unknown resampler quality '%s'", quality.c_str());
+
+  std::string dither;
+  read_string(linux_config, "dither", &dither);
+  if (!dither.empty() && !dither_mode_from_name(dither, &config->dither))
+    g_warning("Unknown dither mode '%s'", dither.c_str());
+
+  std::string realtime;
+  read_string(linux_config, "realtimePolicy", &realtime);
+  if (!realtime.empty() && !realtime_policy_from_name(realtime, &config->realtime_policy))
+    g_warning("Unknown realtime policy '%s'", realtime.c_str());
+
+  if (config->sample_rate <= 0)
+    config->sample_rate = 44100;
+  if (config->capture_sample_rate <= 0)
+    config->capture_sample_rate = config->sample_rate;
+  if (config->num_channels <= 0)
+    config->num_channels = 1;
+  if (config->num_channels > 8)
+    config->num_channels = 8;
+  if (!config->channel_matrix.empty())
+  {
+    // Device channels are the columns, up to the PulseAudio limit.
+    const size_t columns = config->channel_matrix[0].size();
+    if (config->channel_matrix.size() > 8 || columns > kMaxDeviceChannels)
+    {
+      g_warning("Unsupported channelMatrix (%zu x %zu), ignored",
+                config->channel_matrix.size(), columns);
+      config->channel_matrix.clear();
+    }
+    else
+    {
+      config->num_channels = (int)config->channel_matrix.size();
+      config->device_channels = (int)columns;
+    }
+  }
+  if (config->device_channels <= 0)
+    config->device_channels = config->num_channels;
+  if (config->vad_hangover_ms < 0)
+    config->vad_hangover_ms = 0;
+  if (config->vad_pre_roll_ms < 0)
+    config->vad_pre_roll_ms = 0;
+  if (config->pre_roll_buffer_ms < 0)
+    config->pre_roll_buffer_ms = 0;
+  if (config->pre_roll_ms < 0)
+    config->pre_roll_ms = 0;
+  if (config->vox_min_duration_ms < 0)
+    config->vox_min_duration_ms = 0;
+  if (config->vox_hang_ms < 0)
+    config->vox_hang_ms = 0;
+  if (config->flac_level < 0)
+    config->flac_level = 0;
+  if (config->flac_level > 8)
+    config->flac_level = 8;
+  if (config->realtime_priority < 1)
+    config->realtime_priority = 1;
+  if (config->realtime_priority > 99)
+    config->realtime_priority = 99;
+}
+
+bool record_config_same_capture(const RecordConfig &a, const RecordConfig &b)
+{
+  return a.device_id == b.device_id &&
+         a.sample_rate == b.sample_rate &&
+         a.num_channels == b.num_channels &&
+         a.capture_format == b.capture_format &&
+         a.capture_sample_rate == b.capture_sample_rate &&
+         a.resampler_quality == b.resampler_quality &&
+         a.device_channels == b.device_channels &&
+         a.channel_matrix == b.channel_matrix &&
+         a.dither == b.dither &&
+         a.capture_engine == b.capture_engine &&
+         a.realtime_policy == b.realtime_policy &&
+         a.realtime_priority == b.realtime_priority &&
+         a.cpu_affinity == b.cpu_affinity &&
+         a.echo_cancel == b.echo_cancel &&
+         (!a.echo_cancel || a.echo_reference == b.echo_reference);
+}
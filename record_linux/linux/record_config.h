@@ -0,0 +1,80 @@
+#ifndef RECORD_LINUX_CONFIG_H_
+#define RECORD_LINUX_CONFIG_H_
+
+#include <flutter_linux/flutter_linux.h>
+#include <string>
+#include <vector>
+
+#include "record_dither.h"
+#include "record_format.h"
+#include "record_realtime.h"
+#include "record_resampler.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//  Native mirror of the Dart RecordConfig (and its LinuxRecordConfig part)
+////////////////////////////////////////////////////////////////////////////////
+
+// LinuxRecordOutput: another file written from the same capture.
+struct RecordOutput
+{
+  std::string path;
+  std::string encoder = "wav"; // AudioEncoder or LinuxCodec name
+  int bit_rate = 128000;
+};
+
+struct RecordConfig
+{
+  std::string encoder = "wav";
+  std::string device_id; // empty => default source
+  int bit_rate = 128000;
+  int sample_rate = 44100;
+  int num_channels = 2;
+  bool auto_gain = false;
+  bool echo_cancel = false;
+  bool noise_suppress = false;
+
+  // LinuxRecordConfig
+  std::string echo_reference = "@DEFAULT_MONITOR@";
+  bool waveform_peaks = false;
+  std::string vad_mode = "disabled"; // disabled, events, gate
+  int vad_hangover_ms = 300;
+  int vad_pre_roll_ms = 200;
+  int pre_roll_buffer_ms = 10000; // history kept while armed
+  int pre_roll_ms = 0;            // history prepended when a session starts
+  double vox_threshold_db = -35.0;
+  int vox_min_duration_ms = 150;
+  int vox_hang_ms = 2000;
+  int flac_level = 5;
+  bool stream_ogg_framing = false;
+  SampleFormat capture_format = SampleFormat::kS16;
+  SampleFormat output_format = SampleFormat::kS16; // WAV and PCM streams
+  DitherMode dither = DitherMode::kTpdf;           // when reducing bit depth
+  int capture_sample_rate = 0;                     // 0 => sample_rate
+  ResamplerQuality resampler_quality = ResamplerQuality::kMedium;
+  // Session channel o is the sum of device channel i times
+  // channel_matrix[o][i]; empty => device channels as is.
+  std::vector<std::vector<double>> channel_matrix;
+  int device_channels = 0; // 0 => num_channels
+  std::vector<RecordOutput> outputs;
+  std::string capture_engine = "thread"; // thread, eventLoop
+  // Capture thread scheduling (thread engine only)
+  RealtimePolicy realtime_policy = RealtimePolicy::kOff;
+  int realtime_priority = 10;
+  std::vector<int> cpu_affinity; // empty => any CPU
+  // Audio lost to overruns replaced with as much silence
+  bool fill_dropouts = false;
+  // A capture lost mid-session (server restart, device unplugged) is
+  // reconnected, to device_id then fallback_device_id, the session going on
+  bool reconnect = false;
+  std::string fallback_device_id; // empty => default source
+};
+
+// Fills [config] from the map produced by RecordConfig.toMap().
+// Missing or mistyped entries keep their default value.
+void record_config_from_value(FlValue *value, RecordConfig *config);
+
+// Whether a capture connection opened for [a] serves [b] as is: same
+// device, formats, rates, channel mapping, echo reference and scheduling.
+bool record_config_same_capture(const RecordConfig &a, const RecordConfig &b);
+
+#endif // RECORD_LINUX_CONFIG_H_
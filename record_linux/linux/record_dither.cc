@@ -0,0 +1,177 @@
+#include "record_dither.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__)
+#define RECORD_DITHER_SSE2 1
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#define RECORD_DITHER_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+  // E-weighted error feedback filter (Lipshitz, Vanderkooy, Wannamaker).
+  const float kShaping[3] = {1.623f, -0.982f, 0.109f};
+
+  // uint32 to [0, 1) from the top 24 bits.
+  const float kUniformScale = 1.0f / 16777216.0f;
+}
+
+bool dither_mode_from_name(const std::string &name, DitherMode *mode)
+{
+  static const char *const kNames[] = {"none", "tpdf", "highpass", "shaped"};
+  for (size_t i = 0; i < sizeof(kNames) / sizeof(kNames[0]); i++)
+  {
+    if (name == kNames[i])
+    {
+      *mode = (DitherMode)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+void Ditherer::configure(DitherMode mode, size_t channels)
+{
+  mode_ = mode;
+  channels_ = std::max<size_t>(channels, 1);
+  block_.assign(kBlockSamples, 0.0f);
+  // Room for two values per sample, plus one frame of history.
+  noise_.assign(2 * kBlockSamples + channels_ + kLanes, 0.0f);
+  error_.assign(channels_ * kShapingOrder, 0.0f);
+  reset();
+}
+
+void Ditherer::reset()
+{
+  // Any non-zero seeds, distinct per lane.
+  for (size_t l = 0; l < kLanes; l++)
+    state_[l] = 0x9e3779b9u * (uint32_t)(l + 1);
+  std::fill(noise_.begin(), noise_.end(), 0.5f);
+  std::fill(error_.begin(), error_.end(), 0.0f);
+  phase_ = 0;
+}
+
+void Ditherer::uniform(float *out, size_t count)
+{
+#if RECORD_DITHER_SSE2
+  __m128i s0 = _mm_load_si128((const __m128i *)state_);
+  __m128i s1 = _mm_load_si128((const __m128i *)(state_ + 4));
+  const __m128 scale = _mm_set1_ps(kUniformScale);
+  for (size_t i = 0; i < count; i += kLanes)
+  {
+    s0 = _mm_xor_si128(s0, _mm_slli_epi32(s0, 13));
+    s1 = _mm_xor_si128(s1, _mm_slli_epi32(s1, 13));
+    s0 = _mm_xor_si128(s0, _mm_srli_epi32(s0, 17));
+    s1 = _mm_xor_si128(s1, _mm_srli_epi32(s1, 17));
+    s0 = _mm_xor_si128(s0, _mm_slli_epi32(s0, 5));
+    s1 = _mm_xor_si128(s1, _mm_slli_epi32(s1, 5));
+    _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(s0, 8)), scale));
+    _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(s1, 8)), scale));
+  }
+  _mm_store_si128((__m128i *)state_, s0);
+  _mm_store_si128((__m128i *)(state_ + 4), s1);
+#elif RECORD_DITHER_NEON
+  uint32x4_t s0 = vld1q_u32(state_);
+  uint32x4_t s1 = vld1q_u32(state_ + 4);
+  for (size_t i = 0; i < count; i += kLanes)
+  {
+    s0 = veorq_u32(s0, vshlq_n_u32(s0, 13));
+    s1 = veorq_u32(s1, vshlq_n_u32(s1, 13));
+    s0 = veorq_u32(s0, vshrq_n_u32(s0, 17));
+    s1 = veorq_u32(s1, vshrq_n_u32(s1, 17));
+    s0 = veorq_u32(s0, vshlq_n_u32(s0, 5));
+    s1 = veorq_u32(s1, vshlq_n_u32(s1, 5));
+    vst1q_f32(out + i, vmulq_n_f32(vcvtq_f32_u32(vshrq_n_u32(s0, 8)), kUniformScale));
+    vst1q_f32(out + i + 4, vmulq_n_f32(vcvtq_f32_u32(vshrq_n_u32(s1, 8)), kUniformScale));
+  }
+  vst1q_u32(state_, s0);
+  vst1q_u32(state_ + 4, s1);
+#else
+  for (size_t i = 0; i < count; i += kLanes)
+  {
+    for (size_t l = 0; l < kLanes; l++)
+    {
+      uint32_t s = state_[l];
+      s ^= s << 13;
+      s ^= s >> 17;
+      s ^= s << 5;
+      state_[l] = s;
+      out[i + l] = (float)(s >> 8) * kUniformScale;
+    }
+  }
+#endif
+}
+
+void Ditherer::add_noise(float *samples, size_t count, float lsb)
+{
+  const size_t rounded = (count + kLanes - 1) / kLanes * kLanes;
+  const size_t C = channels_;
+
+  if (mode_ == DitherMode::kHighpass)
+  {
+    // noise_[0, C) holds the last value of each channel.
+    float *u = noise_.data();
+    uniform(u + C, rounded);
+    for (size_t i = 0; i < count; i++)
+      samples[i] += (u[C + i] - u[i]) * lsb;
+    memmove(u, u + count, C * sizeof(float));
+    return;
+  }
+
+  float *u = noise_.data();
+  uniform(u, 2 * rounded);
+  if (mode_ == DitherMode::kTpdf)
+  {
+    for (size_t i = 0; i < count; i++)
+      samples[i] += (u[2 * i] - u[2 * i + 1]) * lsb;
+    return;
+  }
+
+  // Shaped: quantize here, feeding each channel's error back.
+  const float scale = 1.0f / lsb;
+  for (size_t i = 0; i < count; i++)
+  {
+    float *e = &error_[phase_ * kShapingOrder];
+    const float wanted = samples[i] * scale - (kShaping[0] * e[0] + kShaping[1] * e[1] + kShaping[2] * e[2]);
+    float q = nearbyintf(wanted + u[2 * i] - u[2 * i + 1]);
+    q = std::max(-scale, std::min(scale - 1.0f, q));
+    e[2] = e[1];
+    e[1] = e[0];
+    e[0] = q - wanted;
+    samples[i] = q * lsb;
+    if (++phase_ == C)
+      phase_ = 0;
+  }
+}
+
+void Ditherer::convert(const void *src, SampleFormat from, void *dst, SampleFormat to, size_t samples)
+{
+  const unsigned bits = sample_format_bits(to);
+  if (mode_ == DitherMode::kNone || to == SampleFormat::kF32 ||
+      bits >= sample_format_bits(from) || block_.empty())
+  {
+    convert_samples(src, from, dst, to, samples);
+    return;
+  }
+
+  const float lsb = 1.0f / (float)(1u << (bits - 1));
+  const uint8_t *in = (const uint8_t *)src;
+  uint8_t *out = (uint8_t *)dst;
+  const size_t in_bytes = sample_format_bytes(from);
+  const size_t out_bytes = sample_format_bytes(to);
+  while (samples > 0)
+  {
+    const size_t n = std::min(samples, kBlockSamples);
+    convert_samples(in, from, block_.data(), SampleFormat::kF32, n);
+    add_noise(block_.data(), n, lsb);
+    convert_samples(block_.data(), SampleFormat::kF32, out, to, n);
+    in += n * in_bytes;
+    out += n * out_bytes;
+    samples -= n;
+  }
+}
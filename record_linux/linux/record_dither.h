@@ -0,0 +1,64 @@
+#ifndef RECORD_LINUX_DITHER_H_
+#define RECORD_LINUX_DITHER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "record_format.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//  Requantization with dither
+//
+//  Ditherer::convert() is convert_samples() that adds dither whenever the
+//  destination has fewer significant bits than the source (e.g. S32 or F32
+//  to S16, S16 to U8). The noise is TPDF, +-1 LSB of the destination:
+//  flat (two uniform values per sample), high-pass (difference of
+//  consecutive uniform values, pushing the noise up the spectrum), or flat
+//  with 3rd order E-weighted error feedback shaping (Lipshitz et al.,
+//  designed for 44.1 kHz). Uniform values come from eight interleaved
+//  xorshift32 generators, stepped with SSE2 or NEON.
+//  Buffers are allocated by configure(); convert() does not allocate.
+////////////////////////////////////////////////////////////////////////////////
+enum class DitherMode
+{
+  kNone,
+  kTpdf,
+  kHighpass,
+  kShaped,
+};
+
+// "none", "tpdf", "highpass" or "shaped".
+bool dither_mode_from_name(const std::string &name, DitherMode *mode);
+
+class Ditherer
+{
+public:
+  static const size_t kBlockSamples = 1024;
+
+  void configure(DitherMode mode, size_t channels);
+  void reset();
+
+  // Converts [samples] interleaved samples, dithered when reducing depth.
+  void convert(const void *src, SampleFormat from, void *dst, SampleFormat to, size_t samples);
+
+private:
+  static const size_t kLanes = 8;
+  static const size_t kShapingOrder = 3;
+
+  // Fills [out] with [count] uniform values in [0, 1), count a multiple of
+  // kLanes.
+  void uniform(float *out, size_t count);
+  void add_noise(float *samples, size_t count, float lsb);
+
+  DitherMode mode_ = DitherMode::kNone;
+  size_t channels_ = 1;
+  alignas(16) uint32_t state_[kLanes];
+  std::vector<float> block_;    // samples being requantized
+  std::vector<float> noise_;    // uniform values, previous ones first (high-pass)
+  std::vector<float> error_;    // channels * kShapingOrder quantization errors
+  size_t phase_ = 0;            // channel of the next sample
+};
+
+#endif // RECORD_LINUX_DITHER_H_
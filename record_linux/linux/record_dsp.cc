@@ -0,0 +1,561 @@
+#include "record_dsp.h"
+
+#include <algorithm>
+#include <cmath>
+#include <time.h>
+
+namespace
+{
+  // Reference spectra are normalized by this floor so that silence on the
+  // far end does not blow up the adaptation step.
+  const float kEchoPowerFloor = 1e-6f;
+  const float kEchoStep = 0.5f;
+  const float kEchoTailMs = 150.0f;
+
+  // Wiener gain floor (-20 dB) and decision-directed smoothing.
+  const float kNoiseGainFloor = 0.1f;
+  const float kNoiseDecisionDirected = 0.98f;
+  const float kNoisePowerSmoothing = 0.8f;
+  // Maximum noise floor rise, in dB per second.
+  const float kNoiseRiseDbPerSec = 3.0f;
+
+  // Auto gain target level and allowed gain range.
+  const float kGainTargetDb = -18.0f;
+  const float kGainGateDb = -55.0f;
+  const float kGainMinDb = -6.0f;
+  const float kGainMaxDb = 24.0f;
+  const float kGainAttackDbPerSec = 30.0f;
+  const float kGainReleaseDbPerSec = 6.0f;
+
+  // Look-ahead limiter.
+  const float kLimiterCeiling = 0.891f; // -1 dBFS
+  const float kLimiterLookaheadMs = 5.0f;
+  const float kLimiterReleaseMs = 80.0f;
+
+  inline uint64_t now_ns()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+  }
+
+  inline float db_to_linear(float db)
+  {
+    return powf(10.0f, db / 20.0f);
+  }
+}
+
+// ---------------------------------------------------------------------------
+// EchoCanceller
+// ---------------------------------------------------------------------------
+void EchoCanceller::configure(size_t block, size_t channels, size_t partitions)
+{
+  block_ = block;
+  bins_ = block + 1;
+  channels_ = channels;
+  partitions_ = partitions > 0 ? partitions : 1;
+
+  fft_.configure(2 * block);
+  ref_prev_.assign(block_, 0.0f);
+  x_re_.assign(partitions_ * bins_, 0.0f);
+  x_im_.assign(partitions_ * bins_, 0.0f);
+  x_pow_.assign(bins_, 0.0f);
+  w_re_.assign(channels_ * partitions_ * bins_, 0.0f);
+  w_im_.assign(channels_ * partitions_ * bins_, 0.0f);
+  y_re_.assign(bins_, 0.0f);
+  y_im_.assign(bins_, 0.0f);
+  frame_.assign(2 * block_, 0.0f);
+  reset();
+}
+
+void EchoCanceller::reset()
+{
+  std::fill(ref_prev_.begin(), ref_prev_.end(), 0.0f);
+  std::fill(x_re_.begin(), x_re_.end(), 0.0f);
+  std::fill(x_im_.begin(), x_im_.end(), 0.0f);
+  std::fill(x_pow_.begin(), x_pow_.end(), 0.0f);
+  std::fill(w_re_.begin(), w_re_.end(), 0.0f);
+  std::fill(w_im_.begin(), w_im_.end(), 0.0f);
+  head_ = 0;
+  constrain_ = 0;
+}
+
+void EchoCanceller::process(float *const *channels, const float *reference)
+{
+  const size_t B = block_;
+  const size_t K = bins_;
+  const size_t P = partitions_;
+
+  // Newest reference spectrum over [previous block, current block].
+  head_ = (head_ + P - 1) % P;
+  std::copy(ref_prev_.begin(), ref_prev_.end(), frame_.begin());
+  std::copy(reference, reference + B, frame_.begin() + B);
+  std::copy(reference, reference + B, ref_prev_.begin());
+
+  float *__restrict xr0 = &x_re_[head_ * K];
+  float *__restrict xi0 = &x_im_[head_ * K];
+  fft_.forward(frame_.data(), xr0, xi0);
+
+  float *__restrict xp = x_pow_.data();
+  for (size_t k = 0; k < K; k++)
+  {
+    xp[k] = 0.9f * xp[k] + 0.1f * (float)P * (xr0[k] * xr0[k] + xi0[k] * xi0[k]);
+  }
+
+  for (size_t c = 0; c < channels_; c++)
+  {
+    float *mic = channels[c];
+    float *wr_base = &w_re_[c * P * K];
+    float *wi_base = &w_im_[c * P * K];
+
+    // Echo estimate: sum over partitions of W_p * X_{k-p}.
+    float *__restrict yr = y_re_.data();
+    float *__restrict yi = y_im_.data();
+    std::fill(y_re_.begin(), y_re_.end(), 0.0f);
+    std::fill(y_im_.begin(), y_im_.end(), 0.0f);
+    for (size_t p = 0; p < P; p++)
+    {
+      const size_t slot = (head_ + p) % P;
+      const float *__restrict xr = &x_re_[slot * K];
+      const float *__restrict xi = &x_im_[slot * K];
+      const float *__restrict wr = wr_base + p * K;
+      const float *__restrict wi = wi_base + p * K;
+      for (size_t k = 0; k < K; k++)
+      {
+        yr[k] += wr[k] * xr[k] - wi[k] * xi[k];
+        yi[k] += wr[k] * xi[k] + wi[k] * xr[k];
+      }
+    }
+    fft_.inverse(yr, yi, frame_.data());
+
+    // Error = mic - echo estimate (last half of the circular convolution).
+    float mic_energy = 0.0f;
+    float err_energy = 0.0f;
+    float *__restrict e = frame_.data();
+    for (size_t n = 0; n < B; n++)
+    {
+      const float err = mic[n] - e[B + n];
+      mic_energy += mic[n] * mic[n];
+      err_energy += err * err;
+      e[B + n] = err;
+    }
+    std::fill(frame_.begin(), frame_.begin() + B, 0.0f);
+
+    // A diverged filter must never make things worse: pass the mic through.
+    if (err_energy <= mic_energy * 2.0f)
+    {
+      std::copy(frame_.begin() + B, frame_.end(), mic);
+    }
+
+    // Normalized gradient: W_p += mu * conj(X_{k-p}) * E / power.
+    fft_.forward(frame_.data(), yr, yi);
+    for (size_t k = 0; k < K; k++)
+    {
+      const float norm = kEchoStep / (xp[k] + kEchoPowerFloor);
+      yr[k] *= norm;
+      yi[k] *= norm;
+    }
+    for (size_t p = 0; p < P; p++)
+    {
+      const size_t slot = (head_ + p) % P;
+      const float *__restrict xr = &x_re_[slot * K];
+      const float *__restrict xi = &x_im_[slot * K];
+      float *__restrict wr = wr_base + p * K;
+      float *__restrict wi = wi_base + p * K;
+      for (size_t k = 0; k < K; k++)
+      {
+        wr[k] += xr[k] * yr[k] + xi[k] * yi[k];
+        wi[k] += xr[k] * yi[k] - xi[k] * yr[k];
+      }
+    }
+
+    // Gradient constraint on one partition per block keeps the cost flat.
+    float *wr = wr_base + constrain_ * K;
+    float *wi = wi_base + constrain_ * K;
+    fft_.inverse(wr, wi, frame_.data());
+    std::fill(frame_.begin() + B, frame_.end(), 0.0f);
+    fft_.forward(frame_.data(), wr, wi);
+  }
+
+  constrain_ = (constrain_ + 1) % P;
+}
+
+// ---------------------------------------------------------------------------
+// NoiseSuppressor
+// ---------------------------------------------------------------------------
+void NoiseSuppressor::configure(size_t block, size_t channels, uint32_t sample_rate)
+{
+  block_ = block;
+  bins_ = block + 1;
+  channels_ = channels;
+
+  const float frames_per_sec = (float)sample_rate / (float)block;
+  noise_rise_ = powf(10.0f, kNoiseRiseDbPerSec / 10.0f / frames_per_sec);
+
+  fft_.configure(2 * block);
+  window_.resize(2 * block);
+  for (size_t n = 0; n < 2 * block; n++)
+  {
+    // Periodic sqrt-Hann: analysis * synthesis sums to one at 50% overlap.
+    window_[n] = (float)sqrt(0.5 - 0.5 * cos(2.0 * M_PI * (double)n / (double)(2 * block)));
+  }
+
+  prev_.assign(channels_ * block_, 0.0f);
+  ola_.assign(channels_ * block_, 0.0f);
+  power_.assign(channels_ * bins_, 0.0f);
+  noise_.assign(channels_ * bins_, 0.0f);
+  clean_.assign(channels_ * bins_, 0.0f);
+  re_.assign(bins_, 0.0f);
+  im_.assign(bins_, 0.0f);
+  frame_.assign(2 * block_, 0.0f);
+  reset();
+}
+
+void NoiseSuppressor::reset()
+{
+  std::fill(prev_.begin(), prev_.end(), 0.0f);
+  std::fill(ola_.begin(), ola_.end(), 0.0f);
+  std::fill(power_.begin(), power_.end(), 0.0f);
+  std::fill(clean_.begin(), clean_.end(), 0.0f);
+  // Start from a high floor, it will drop to the real minimum quickly.
+  std::fill(noise_.begin(), noise_.end(), 1.0f);
+}
+
+void NoiseSuppressor::process(float *const *channels)
+{
+  const size_t B = block_;
+  const size_t K = bins_;
+  const float *__restrict win = window_.data();
+
+  for (size_t c = 0; c < channels_; c++)
+  {
+    float *io = channels[c];
+    float *__restrict prev = &prev_[c * B];
+    float *__restrict ola = &ola_[c * B];
+    float *__restrict power = &power_[c * K];
+    float *__restrict noise = &noise_[c * K];
+    float *__restrict clean = &clean_[c * K];
+    float *__restrict fr = frame_.data();
+    float *__restrict re = re_.data();
+    float *__restrict im = im_.data();
+
+    for (size_t n = 0; n < B; n++)
+    {
+      fr[n] = prev[n] * win[n];
+      fr[B + n] = io[n] * win[B + n];
+    }
+    std::copy(io, io + B, prev);
+
+    fft_.forward(fr, re, im);
+
+    for (size_t k = 0; k < K; k++)
+    {
+      const float p = re[k] * re[k] + im[k] * im[k];
+      power[k] = kNoisePowerSmoothing * power[k] + (1.0f - kNoisePowerSmoothing) * p;
+      noise[k] = std::min(noise[k] * noise_rise_, power[k]) + 1e-12f;
+
+      const float post = p / noise[k];
+      const float prio = kNoiseDecisionDirected * clean[k] / noise[k] +
+                         (1.0f - kNoiseDecisionDirected) * std::max(post - 1.0f, 0.0f);
+      const float gain = std::max(prio / (1.0f + prio), kNoiseGainFloor);
+
+      clean[k] = gain * gain * p;
+      re[k] *= gain;
+      im[k] *= gain;
+    }
+
+    fft_.inverse(re, im, fr);
+
+    for (size_t n = 0; n < B; n++)
+    {
+      io[n] = ola[n] + fr[n] * win[n];
+      ola[n] = fr[B + n] * win[B + n];
+    }
+  }
+}
+
+// ---------------------------------------------------------------------------
+// AutoGain
+// ---------------------------------------------------------------------------
+void AutoGain::configure(size_t block, size_t channels, uint32_t sample_rate)
+{
+  block_ = block;
+  channels_ = channels;
+  lookahead_ = std::max<size_t>(1, (size_t)(kLimiterLookaheadMs * sample_rate / 1000.0f));
+
+  const float block_sec = (float)block / (float)sample_rate;
+  attack_db_ = kGainAttackDbPerSec * block_sec;
+  release_db_ = kGainReleaseDbPerSec * block_sec;
+  limiter_release_ = 1.0f - expf(-1.0f / (kLimiterReleaseMs * sample_rate / 1000.0f));
+
+  delay_.assign(channels_ * (lookahead_ + 1), 0.0f);
+  min_value_.assign(lookahead_ + 1, 1.0f);
+  min_pos_.assign(lookahead_ + 1, 0);
+  avg_ring_.assign(lookahead_, 1.0f);
+  gain_ramp_.assign(block_, 1.0f);
+  reset();
+}
+
+void AutoGain::reset()
+{
+  gain_db_ = 0.0f;
+  limiter_gain_ = 1.0f;
+  std::fill(delay_.begin(), delay_.end(), 0.0f);
+  std::fill(avg_ring_.begin(), avg_ring_.end(), 1.0f);
+  avg_sum_ = (double)lookahead_;
+  min_head_ = 0;
+  min_count_ = 0;
+  pos_ = 0;
+}
+
+void AutoGain::process(float *const *channels)
+{
+  const size_t B = block_;
+  const size_t L = lookahead_;
+  const size_t ring = L + 1;
+
+  // 1) Level detection on the linked block.
+  float energy = 0.0f;
+  for (size_t c = 0; c < channels_; c++)
+  {
+    const float *__restrict x = channels[c];
+    for (size_t n = 0; n < B; n++)
+      energy += x[n] * x[n];
+  }
+  const float rms = sqrtf(energy / (float)(B * channels_));
+  const float rms_db = 20.0f * log10f(rms + 1e-9f);
+
+  const float start_gain = db_to_linear(gain_db_);
+  if (rms_db > kGainGateDb)
+  {
+    const float wanted = std::min(std::max(kGainTargetDb - rms_db, kGainMinDb), kGainMaxDb);
+    const float delta = wanted - gain_db_;
+    gain_db_ += std::min(std::max(delta, -attack_db_), release_db_);
+  }
+  const float end_gain = db_to_linear(gain_db_);
+
+  // Ramp across the block to avoid zipper noise.
+  float *__restrict ramp = gain_ramp_.data();
+  const float step = (end_gain - start_gain) / (float)B;
+  for (size_t n = 0; n < B; n++)
+    ramp[n] = start_gain + step * (float)(n + 1);
+
+  for (size_t c = 0; c < channels_; c++)
+  {
+    float *__restrict x = channels[c];
+    for (size_t n = 0; n < B; n++)
+      x[n] *= ramp[n];
+  }
+
+  // 2) Look-ahead limiter: the gain applied to a delayed sample is the
+  //    moving average, over L samples, of the minimum required gain over the
+  //    next L samples. This reaches the required gain exactly at the peak.
+  for (size_t n = 0; n < B; n++, pos_++)
+  {
+    float peak = 0.0f;
+    for (size_t c = 0; c < channels_; c++)
+      peak = std::max(peak, fabsf(channels[c][n]));
+    const float required = peak > kLimiterCeiling ? kLimiterCeiling / peak : 1.0f;
+
+    // Sliding window minimum over the last L + 1 required gains.
+    if (min_count_ > 0 && min_pos_[min_head_] + L < pos_)
+    {
+      min_head_ = (min_head_ + 1) % ring;
+      min_count_--;
+    }
+    while (min_count_ > 0)
+    {
+      size_t back = (min_head_ + min_count_ - 1) % ring;
+      if (min_value_[back] < required)
+        break;
+      min_count_--;
+    }
+    size_t slot = (min_head_ + min_count_) % ring;
+    min_value_[slot] = required;
+    min_pos_[slot] = pos_;
+    min_count_++;
+    const float window_min = min_value_[min_head_];
+
+    const size_t avg_slot = pos_ % L;
+    avg_sum_ += window_min - avg_ring_[avg_slot];
+    avg_ring_[avg_slot] = window_min;
+    const float target = (float)(avg_sum_ / (double)L);
+
+    if (target < limiter_gain_)
+      limiter_gain_ = target;
+    else
+      limiter_gain_ += (target - limiter_gain_) * limiter_release_;
+
+    const size_t write = pos_ % ring;
+    const size_t read = (pos_ + 1) % ring; // sample written L frames ago
+    for (size_t c = 0; c < channels_; c++)
+    {
+      float *d = &delay_[c * ring];
+      d[write] = channels[c][n];
+      channels[c][n] = d[read] * limiter_gain_;
+    }
+  }
+}
+
+// ---------------------------------------------------------------------------
+// DspChain
+// ---------------------------------------------------------------------------
+void DspChain::configure(uint32_t sample_rate, size_t channels,
+                         bool auto_gain, bool echo_cancel, bool noise_suppress)
+{
+  sample_rate_ = sample_rate;
+  channels_ = channels;
+  block_ = sample_rate >= 32000 ? 256 : 128;
+  fill_ = 0;
+
+  enabled_[kEchoCancel] = echo_cancel;
+  enabled_[kNoiseSuppress] = noise_suppress;
+  enabled_[kAutoGain] = auto_gain;
+
+  in_.assign(channels_ * block_, 0.0f);
+  out_.assign(channels_ * block_, 0.0f);
+  planes_.assign(channels_, nullptr);
+  reference_.assign(block_, 0.0f);
+
+  if (echo_cancel)
+  {
+    size_t tail = (size_t)(kEchoTailMs * sample_rate / 1000.0f);
+    echo_.configure(block_, channels_, (tail + block_ - 1) / block_);
+  }
+  if (noise_suppress)
+    noise_.configure(block_, channels_, sample_rate);
+  if (auto_gain)
+    gain_.configure(block_, channels_, sample_rate);
+
+  reset();
+}
+
+void DspChain::reset()
+{
+  fill_ = 0;
+  std::fill(in_.begin(), in_.end(), 0.0f);
+  std::fill(out_.begin(), out_.end(), 0.0f);
+
+  if (enabled_[kEchoCancel])
+    echo_.reset();
+  if (enabled_[kNoiseSuppress])
+    noise_.reset();
+  if (enabled_[kAutoGain])
+    gain_.reset();
+
+  for (size_t i = 0; i < kStageCount; i++)
+  {
+    counters_[i].blocks.store(0, std::memory_order_relaxed);
+    counters_[i].total_ns.store(0, std::memory_order_relaxed);
+    counters_[i].max_ns.store(0, std::memory_order_relaxed);
+  }
+}
+
+void DspChain::process_s16(int16_t *samples, const int16_t *reference, size_t frames)
+{
+  const size_t C = channels_;
+  has_reference_ = reference != nullptr;
+
+  size_t done = 0;
+  while (done < frames)
+  {
+    const size_t n = std::min(block_ - fill_, frames - done);
+
+    for (size_t c = 0; c < C; c++)
+    {
+      float *__restrict in = &in_[c * block_ + fill_];
+      const float *__restrict out = &out_[c * block_ + fill_];
+      int16_t *s = samples + done * C + c;
+      for (size_t f = 0; f < n; f++)
+      {
+        in[f] = (float)s[f * C] * (1.0f / 32768.0f);
+        float v = out[f] * 32768.0f;
+        v = std::min(std::max(v, -32768.0f), 32767.0f);
+        s[f * C] = (int16_t)lrintf(v);
+      }
+    }
+
+    if (reference)
+    {
+      float *__restrict ref = &reference_[fill_];
+      for (size_t f = 0; f < n; f++)
+        ref[f] = (float)reference[done + f] * (1.0f / 32768.0f);
+    }
+
+    fill_ += n;
+    done += n;
+
+    if (fill_ == block_)
+    {
+      process_block();
+      in_.swap(out_);
+      fill_ = 0;
+    }
+  }
+}
+
+void DspChain::process_block()
+{
+  for (size_t c = 0; c < channels_; c++)
+    planes_[c] = &in_[c * block_];
+
+  for (size_t i = 0; i < kStageCount; i++)
+  {
+    if (!enabled_[i])
+      continue;
+    if (i == kEchoCancel && !has_reference_)
+      continue;
+
+    const uint64_t start = now_ns();
+    switch (i)
+    {
+    case kEchoCancel:
+      echo_.process(planes_.data(), reference_.data());
+      break;
+    case kNoiseSuppress:
+      noise_.process(planes_.data());
+      break;
+    case kAutoGain:
+      gain_.process(planes_.data());
+      break;
+    }
+    const uint64_t elapsed = now_ns() - start;
+
+    StageCounters &cnt = counters_[i];
+    cnt.blocks.fetch_add(1, std::memory_order_relaxed);
+    cnt.total_ns.fetch_add(elapsed, std::memory_order_relaxed);
+    if (elapsed > cnt.max_ns.load(std::memory_order_relaxed))
+      cnt.max_ns.store(elapsed, std::memory_order_relaxed);
+  }
+}
+
+size_t DspChain::latency_frames() const
+{
+  size_t latency = block_;
+  if (enabled_[kNoiseSuppress])
+    latency += block_;
+  if (enabled_[kAutoGain])
+    latency += gain_.lookahead();
+  return latency;
+}
+
+size_t DspChain::report(DspStageReport *out) const
+{
+  static const char *const kNames[kStageCount] = {"echoCancel", "noiseSuppress", "autoGain"};
+  const double block_ns = sample_rate_ > 0 ? 1e9 * (double)block_ / (double)sample_rate_ : 0.0;
+
+  for (size_t i = 0; i < kStageCount; i++)
+  {
+    const uint64_t blocks = counters_[i].blocks.load(std::memory_order_relaxed);
+    const uint64_t total = counters_[i].total_ns.load(std::memory_order_relaxed);
+    const uint64_t max = counters_[i].max_ns.load(std::memory_order_relaxed);
+
+    out[i].name = kNames[i];
+    out[i].enabled = enabled_[i];
+    out[i].blocks = blocks;
+    out[i].avg_us = blocks ? (double)total / (double)blocks / 1000.0 : 0.0;
+    out[i].max_us = (double)max / 1000.0;
+    out[i].load = (blocks && block_ns > 0.0) ? (double)total / ((double)blocks * block_ns) : 0.0;
+  }
+  return kStageCount;
+}
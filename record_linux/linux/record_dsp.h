@@ -0,0 +1,184 @@
+#ifndef RECORD_LINUX_DSP_H_
+#define RECORD_LINUX_DSP_H_
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "record_fft.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//  Capture DSP chain: echo cancellation -> noise suppression -> auto gain
+//
+//  Audio is processed in fixed blocks of block_frames() frames, in planar
+//  float. Every buffer is allocated by configure(); process() is real-time
+//  safe (no allocation, no lock, no syscall besides clock_gettime).
+////////////////////////////////////////////////////////////////////////////////
+
+// Partitioned-block frequency-domain NLMS echo canceller.
+// One adaptive filter per capture channel, all fed by a mono reference.
+class EchoCanceller
+{
+public:
+  void configure(size_t block, size_t channels, size_t partitions);
+  void reset();
+
+  // Consumes one reference block, then cancels it from each channel.
+  void process(float *const *channels, const float *reference);
+
+private:
+  size_t block_ = 0;
+  size_t bins_ = 0;
+  size_t channels_ = 0;
+  size_t partitions_ = 0;
+  size_t head_ = 0;       // ring slot of the newest reference spectrum
+  size_t constrain_ = 0;  // partition constrained on next block
+
+  RealFft fft_;
+  std::vector<float> ref_prev_;     // previous reference block
+  std::vector<float> x_re_, x_im_;  // partitions * bins reference spectra
+  std::vector<float> x_pow_;        // smoothed reference power per bin
+  std::vector<float> w_re_, w_im_;  // channels * partitions * bins
+  std::vector<float> y_re_, y_im_;  // scratch spectrum
+  std::vector<float> frame_;        // 2 * block scratch
+};
+
+// STFT Wiener filter with minimum-statistics noise tracking.
+class NoiseSuppressor
+{
+public:
+  void configure(size_t block, size_t channels, uint32_t sample_rate);
+  void reset();
+
+  // Output is delayed by one block (overlap-add).
+  void process(float *const *channels);
+
+private:
+  size_t block_ = 0;
+  size_t bins_ = 0;
+  size_t channels_ = 0;
+  float noise_rise_ = 1.0f;
+
+  RealFft fft_;
+  std::vector<float> window_;   // sqrt-Hann, 2 * block
+  std::vector<float> prev_;     // channels * block
+  std::vector<float> ola_;      // channels * block
+  std::vector<float> power_;    // channels * bins, smoothed |X|^2
+  std::vector<float> noise_;    // channels * bins
+  std::vector<float> clean_;    // channels * bins, previous clean power
+  std::vector<float> re_, im_;  // scratch spectrum
+  std::vector<float> frame_;    // 2 * block scratch
+};
+
+// Level-driven gain in a limited range followed by a look-ahead peak limiter.
+// Channels are linked so that the stereo image is preserved.
+class AutoGain
+{
+public:
+  void configure(size_t block, size_t channels, uint32_t sample_rate);
+  void reset();
+
+  // Output is delayed by lookahead() frames.
+  void process(float *const *channels);
+
+  size_t lookahead() const { return lookahead_; }
+
+private:
+  size_t block_ = 0;
+  size_t channels_ = 0;
+  size_t lookahead_ = 0;
+
+  float gain_db_ = 0.0f;
+  float attack_db_ = 0.0f;   // max gain decrease per block
+  float release_db_ = 0.0f;  // max gain increase per block
+  float limiter_release_ = 0.0f;
+  float limiter_gain_ = 1.0f;
+
+  // Look-ahead limiter state, all rings of size lookahead + 1.
+  std::vector<float> delay_;      // channels * (lookahead + 1)
+  std::vector<float> min_value_;  // monotonic deque of required gains
+  std::vector<size_t> min_pos_;
+  size_t min_head_ = 0;
+  size_t min_count_ = 0;
+  std::vector<float> avg_ring_;   // window minimum history for averaging
+  double avg_sum_ = 0.0;
+  size_t pos_ = 0;                // running sample index
+  std::vector<float> gain_ramp_;  // block scratch
+};
+
+// Snapshot of the CPU cost of one stage.
+struct DspStageReport
+{
+  const char *name;
+  bool enabled;
+  uint64_t blocks;
+  double avg_us;
+  double max_us;
+  // Processing time relative to the duration of the audio processed.
+  double load;
+};
+
+class DspChain
+{
+public:
+  enum Stage
+  {
+    kEchoCancel = 0,
+    kNoiseSuppress,
+    kAutoGain,
+    kStageCount,
+  };
+
+  // Allocates all buffers. Not real-time safe.
+  void configure(uint32_t sample_rate, size_t channels,
+                 bool auto_gain, bool echo_cancel, bool noise_suppress);
+
+  bool enabled() const { return enabled_[kEchoCancel] || enabled_[kNoiseSuppress] || enabled_[kAutoGain]; }
+  bool wants_reference() const { return enabled_[kEchoCancel]; }
+
+  // Clears filter states and timing counters.
+  void reset();
+
+  // In-place processing of interleaved S16 frames.
+  // reference: mono S16 frames aligned with samples, or nullptr.
+  void process_s16(int16_t *samples, const int16_t *reference, size_t frames);
+
+  size_t block_frames() const { return block_; }
+
+  // Total delay added by the chain, in frames.
+  size_t latency_frames() const;
+
+  // Fills up to kStageCount reports, returns the count written.
+  size_t report(DspStageReport *out) const;
+
+private:
+  void process_block();
+
+  struct StageCounters
+  {
+    std::atomic<uint64_t> blocks{0};
+    std::atomic<uint64_t> total_ns{0};
+    std::atomic<uint64_t> max_ns{0};
+  };
+
+  uint32_t sample_rate_ = 0;
+  size_t channels_ = 0;
+  size_t block_ = 0;
+  size_t fill_ = 0;
+  bool enabled_[kStageCount] = {false, false, false};
+  bool has_reference_ = false;
+
+  EchoCanceller echo_;
+  NoiseSuppressor noise_;
+  AutoGain gain_;
+
+  std::vector<float> in_;         // channels * block, being filled
+  std::vector<float> out_;        // channels * block, being drained
+  std::vector<float *> planes_;   // channel pointers into in_
+  std::vector<float> reference_;  // block
+
+  StageCounters counters_[kStageCount];
+};
+
+#endif // RECORD_LINUX_DSP_H_
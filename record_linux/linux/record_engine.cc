@@ -0,0 +1,846 @@
+#include "record_engine.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <future>
+#include <pthread.h>
+#include <pulse/def.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+struct pa_io_event
+{
+  CaptureEngine *engine;
+  int fd;        // as given by PulseAudio, passed back to the callback
+  int polled_fd; // registered with epoll: fd, or a dup when fd already is
+  pa_io_event_flags_t events;
+  pa_io_event_cb_t cb;
+  pa_io_event_destroy_cb_t destroy;
+  void *userdata;
+  bool dead;
+};
+
+struct pa_time_event
+{
+  CaptureEngine *engine;
+  struct timeval tv;   // as given by PulseAudio, passed back to the callback
+  int64_t deadline_us; // monotonic, -1 when disabled
+  pa_time_event_cb_t cb;
+  pa_time_event_destroy_cb_t destroy;
+  void *userdata;
+  bool dead;
+};
+
+struct pa_defer_event
+{
+  CaptureEngine *engine;
+  bool enabled;
+  pa_defer_event_cb_t cb;
+  pa_defer_event_destroy_cb_t destroy;
+  void *userdata;
+  bool dead;
+};
+
+namespace
+{
+  const int kMaxEvents = 64;
+
+  // Set in tv_usec by PulseAudio for times on the monotonic clock
+  // (pa_context_rttime_new), other times are on the wall clock.
+  const suseconds_t kRtClockFlag = (suseconds_t)1 << 30;
+
+  std::mutex engine_mutex;
+  CaptureEngine *engine_instance = nullptr;
+  int engine_refs = 0;
+
+  int64_t clock_us(clockid_t clock)
+  {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+  }
+
+  int64_t deadline_us(const struct timeval *tv)
+  {
+    if (!tv)
+      return -1;
+    if (tv->tv_usec & kRtClockFlag)
+      return (int64_t)tv->tv_sec * 1000000 + (tv->tv_usec & ~kRtClockFlag);
+    const int64_t wall_us = (int64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+    return clock_us(CLOCK_MONOTONIC) + (wall_us - clock_us(CLOCK_REALTIME));
+  }
+
+  uint32_t epoll_events(pa_io_event_flags_t events)
+  {
+    return ((events & PA_IO_EVENT_INPUT) ? (uint32_t)EPOLLIN : 0) |
+           ((events & PA_IO_EVENT_OUTPUT) ? (uint32_t)EPOLLOUT : 0);
+  }
+
+  pa_io_event_flags_t io_flags(uint32_t events)
+  {
+    return (pa_io_event_flags_t)(((events & EPOLLIN) ? PA_IO_EVENT_INPUT : 0) |
+                                 ((events & EPOLLOUT) ? PA_IO_EVENT_OUTPUT : 0) |
+                                 ((events & EPOLLHUP) ? PA_IO_EVENT_HANGUP : 0) |
+                                 ((events & EPOLLERR) ? PA_IO_EVENT_ERROR : 0));
+  }
+}
+
+// -----------------------------------------------------------------------------
+// CaptureEngine
+// -----------------------------------------------------------------------------
+CaptureEngine *CaptureEngine::acquire()
+{
+  std::lock_guard<std::mutex> lock(engine_mutex);
+  if (!engine_instance)
+    engine_instance = new CaptureEngine();
+  engine_refs++;
+  return engine_instance;
+}
+
+void CaptureEngine::release(CaptureEngine *engine)
+{
+  std::lock_guard<std::mutex> lock(engine_mutex);
+  if (!engine || engine != engine_instance)
+    return;
+  if (--engine_refs == 0)
+  {
+    delete engine_instance;
+    engine_instance = nullptr;
+  }
+}
+
+CaptureEngine::CaptureEngine() : pool_(WorkerPool::acquire())
+{
+  api_.userdata = this;
+  api_.io_new = io_new;
+  api_.io_enable = io_enable;
+  api_.io_free = io_free;
+  api_.io_set_destroy = io_set_destroy;
+  api_.time_new = time_new;
+  api_.time_restart = time_restart;
+  api_.time_free = time_free;
+  api_.time_set_destroy = time_set_destroy;
+  api_.defer_new = defer_new;
+  api_.defer_enable = defer_enable;
+  api_.defer_free = defer_free;
+  api_.defer_set_destroy = defer_set_destroy;
+  api_.quit = quit;
+
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  command_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+  // The two fds are told apart from io events by their data pointer.
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  event.data.ptr = &timer_fd_;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, timer_fd_, &event);
+  event.data.ptr = &command_fd_;
+  epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, command_fd_, &event);
+
+  started_us_ = clock_us(CLOCK_MONOTONIC);
+  thread_ = std::thread(&CaptureEngine::run, this);
+}
+
+CaptureEngine::~CaptureEngine()
+{
+  post([this]
+       { quit_ = true; });
+  thread_.join();
+
+  // Left by connections not closed, which PulseAudio no longer uses.
+  for (pa_io_event *e : io_events_)
+  {
+    if (e->polled_fd != e->fd)
+      ::close(e->polled_fd);
+    delete e;
+  }
+  for (pa_time_event *e : time_events_)
+    delete e;
+  for (pa_defer_event *e : defer_events_)
+    delete e;
+
+  ::close(command_fd_);
+  ::close(timer_fd_);
+  ::close(epoll_fd_);
+  WorkerPool::release(pool_);
+}
+
+void CaptureEngine::post(Command command)
+{
+  {
+    std::lock_guard<std::mutex> lock(command_mutex_);
+    commands_.push_back(std::move(command));
+  }
+  // Fails only with the counter saturated, the loop is then awake anyway.
+  const uint64_t one = 1;
+  const ssize_t written = write(command_fd_, &one, sizeof(one));
+  (void)written;
+}
+
+void CaptureEngine::call(Command command)
+{
+  if (std::this_thread::get_id() == thread_.get_id())
+  {
+    command();
+    return;
+  }
+
+  std::promise<void> done;
+  std::future<void> finished = done.get_future();
+  post([&command, &done]
+       {
+         command();
+         done.set_value(); });
+  finished.wait();
+}
+
+CaptureEngine::Stats CaptureEngine::stats() const
+{
+  Stats stats;
+  stats.wakeups = wakeups_.load(std::memory_order_relaxed);
+  stats.worker_cpu_us = pool_->cpu_us();
+  stats.workers = pool_->size();
+  stats.captures = (size_t)captures_.load(std::memory_order_relaxed);
+  stats.uptime_us = clock_us(CLOCK_MONOTONIC) - started_us_;
+
+  clockid_t clock;
+  if (pthread_getcpuclockid(const_cast<std::thread &>(thread_).native_handle(), &clock) == 0)
+    stats.loop_cpu_us = clock_us(clock);
+  return stats;
+}
+
+void CaptureEngine::run()
+{
+  struct epoll_event events[kMaxEvents];
+
+  while (!quit_)
+  {
+    run_deferred();
+    collect();
+    arm_timer();
+
+    // Deferred events still enabled run again without sleeping.
+    const bool pending = std::any_of(defer_events_.begin(), defer_events_.end(),
+                                     [](const pa_defer_event *e)
+                                     { return e->enabled && !e->dead; });
+    const int count = epoll_wait(epoll_fd_, events, kMaxEvents, pending ? 0 : -1);
+    if (count < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    if (count > 0)
+      wakeups_.fetch_add(1, std::memory_order_relaxed);
+
+    for (int i = 0; i < count; i++)
+    {
+      void *ptr = events[i].data.ptr;
+      if (ptr == &command_fd_)
+      {
+        uint64_t value;
+        while (read(command_fd_, &value, sizeof(value)) > 0)
+        {
+        }
+        run_commands();
+      }
+      else if (ptr == &timer_fd_)
+      {
+        uint64_t value;
+        while (read(timer_fd_, &value, sizeof(value)) > 0)
+        {
+        }
+        armed_us_ = -1;
+      }
+      else
+      {
+        // Freed by an earlier callback of this batch: dead, not yet deleted.
+        pa_io_event *e = static_cast<pa_io_event *>(ptr);
+        if (!e->dead)
+          e->cb(&api_, e, e->fd, io_flags(events[i].events), e->userdata);
+      }
+    }
+
+    run_timers();
+    collect();
+  }
+}
+
+void CaptureEngine::run_commands()
+{
+  std::deque<Command> commands;
+  {
+    std::lock_guard<std::mutex> lock(command_mutex_);
+    commands.swap(commands_);
+  }
+  for (Command &command : commands)
+    command();
+}
+
+void CaptureEngine::run_deferred()
+{
+  // Callbacks may add events, hence the index.
+  for (size_t i = 0; i < defer_events_.size(); i++)
+  {
+    pa_defer_event *e = defer_events_[i];
+    if (e->enabled && !e->dead)
+      e->cb(&api_, e, e->userdata);
+  }
+}
+
+void CaptureEngine::run_timers()
+{
+  const int64_t now_us = clock_us(CLOCK_MONOTONIC);
+  for (size_t i = 0; i < time_events_.size(); i++)
+  {
+    pa_time_event *e = time_events_[i];
+    if (e->dead || e->deadline_us < 0 || e->deadline_us > now_us)
+      continue;
+    e->deadline_us = -1;
+    e->cb(&api_, e, &e->tv, e->userdata);
+  }
+}
+
+void CaptureEngine::arm_timer()
+{
+  int64_t next_us = -1;
+  for (const pa_time_event *e : time_events_)
+  {
+    if (!e->dead && e->deadline_us >= 0 && (next_us < 0 || e->deadline_us < next_us))
+      next_us = e->deadline_us;
+  }
+  if (next_us == armed_us_)
+    return;
+
+  // A zero it_value disarms; past deadlines fire at once.
+  struct itimerspec spec;
+  memset(&spec, 0, sizeof(spec));
+  if (next_us >= 0)
+  {
+    const int64_t at_us = std::max<int64_t>(next_us, 1);
+    spec.it_value.tv_sec = at_us / 1000000;
+    spec.it_value.tv_nsec = (at_us % 1000000) * 1000;
+  }
+  timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &spec, nullptr);
+  armed_us_ = next_us;
+}
+
+void CaptureEngine::collect()
+{
+  if (!dead_events_)
+    return;
+  dead_events_ = false;
+
+  auto sweep = [](auto &events)
+  {
+    auto end = std::remove_if(events.begin(), events.end(), [](auto *e)
+                              {
+                                if (!e->dead)
+                                  return false;
+                                delete e;
+                                return true; });
+    events.erase(end, events.end());
+  };
+  sweep(io_events_);
+  sweep(time_events_);
+  sweep(defer_events_);
+}
+
+pa_io_event *CaptureEngine::io_new(pa_mainloop_api *api, int fd, pa_io_event_flags_t events,
+                                   pa_io_event_cb_t cb, void *userdata)
+{
+  CaptureEngine *engine = static_cast<CaptureEngine *>(api->userdata);
+  pa_io_event *e = new pa_io_event{engine, fd, fd, events, cb, nullptr, userdata, false};
+
+  struct epoll_event event;
+  event.events = epoll_events(events);
+  event.data.ptr = e;
+  if (epoll_ctl(engine->epoll_fd_, EPOLL_CTL_ADD, fd, &event) < 0 && errno == EEXIST)
+  {
+    // epoll keys on the file, watched twice through a duplicate.
+    e->polled_fd = dup(fd);
+    epoll_ctl(engine->epoll_fd_, EPOLL_CTL_ADD, e->polled_fd, &event);
+  }
+  engine->io_events_.push_back(e);
+  return e;
+}
+
+void CaptureEngine::io_enable(pa_io_event *e, pa_io_event_flags_t events)
+{
+  e->events = events;
+  struct epoll_event event;
+  event.events = epoll_events(events);
+  event.data.ptr = e;
+  epoll_ctl(e->engine->epoll_fd_, EPOLL_CTL_MOD, e->polled_fd, &event);
+}
+
+void CaptureEngine::io_free(pa_io_event *e)
+{
+  // Unregistered now, the fd may be closed right after.
+  epoll_ctl(e->engine->epoll_fd_, EPOLL_CTL_DEL, e->polled_fd, nullptr);
+  if (e->polled_fd != e->fd)
+    ::close(e->polled_fd);
+  e->polled_fd = e->fd;
+  e->dead = true;
+  e->engine->dead_events_ = true;
+  if (e->destroy)
+    e->destroy(&e->engine->api_, e, e->userdata);
+}
+
+void CaptureEngine::io_set_destroy(pa_io_event *e, pa_io_event_destroy_cb_t cb)
+{
+  e->destroy = cb;
+}
+
+pa_time_event *CaptureEngine::time_new(pa_mainloop_api *api, const struct timeval *tv,
+                                       pa_time_event_cb_t cb, void *userdata)
+{
+  CaptureEngine *engine = static_cast<CaptureEngine *>(api->userdata);
+  pa_time_event *e = new pa_time_event{engine, {0, 0}, -1, cb, nullptr, userdata, false};
+  time_restart(e, tv);
+  engine->time_events_.push_back(e);
+  return e;
+}
+
+void CaptureEngine::time_restart(pa_time_event *e, const struct timeval *tv)
+{
+  if (tv)
+    e->tv = *tv;
+  e->deadline_us = deadline_us(tv);
+}
+
+void CaptureEngine::time_free(pa_time_event *e)
+{
+  e->dead = true;
+  e->engine->dead_events_ = true;
+  if (e->destroy)
+    e->destroy(&e->engine->api_, e, e->userdata);
+}
+
+void CaptureEngine::time_set_destroy(pa_time_event *e, pa_time_event_destroy_cb_t cb)
+{
+  e->destroy = cb;
+}
+
+pa_defer_event *CaptureEngine::defer_new(pa_mainloop_api *api, pa_defer_event_cb_t cb, void *userdata)
+{
+  CaptureEngine *engine = static_cast<CaptureEngine *>(api->userdata);
+  pa_defer_event *e = new pa_defer_event{engine, true, cb, nullptr, userdata, false};
+  engine->defer_events_.push_back(e);
+  return e;
+}
+
+void CaptureEngine::defer_enable(pa_defer_event *e, int b)
+{
+  e->enabled = b != 0;
+}
+
+void CaptureEngine::defer_free(pa_defer_event *e)
+{
+  e->dead = true;
+  e->engine->dead_events_ = true;
+  if (e->destroy)
+    e->destroy(&e->engine->api_, e, e->userdata);
+}
+
+void CaptureEngine::defer_set_destroy(pa_defer_event *e, pa_defer_event_destroy_cb_t cb)
+{
+  e->destroy = cb;
+}
+
+void CaptureEngine::quit(pa_mainloop_api *api, int retval)
+{
+  // Shared by every session: only the destructor ends the loop.
+  (void)api;
+  (void)retval;
+}
+
+// -----------------------------------------------------------------------------
+// EngineCapture
+// -----------------------------------------------------------------------------
+struct EngineCapture::Operation
+{
+  enum Kind
+  {
+    kCorked,
+    kFlushed,
+    kUncorked,
+  };
+
+  EngineCapture *capture;
+  Kind kind;
+  std::function<void()> done;
+};
+
+EngineCapture::EngineCapture(CaptureEngine *engine, SerialQueue *queue)
+    : engine_(engine), queue_(queue)
+{
+}
+
+EngineCapture::~EngineCapture()
+{
+  close();
+}
+
+bool EngineCapture::open(const char *device, const char *stream_name, const pa_sample_spec &spec,
+                         size_t chunk_bytes, ChunkCallback on_chunk, ErrorCallback on_error,
+                         int *error)
+{
+  close();
+
+  on_chunk_ = std::move(on_chunk);
+  on_error_ = std::move(on_error);
+  device_ = device;
+  stream_name_ = stream_name;
+  spec_ = spec;
+  chunk_bytes_ = chunk_bytes;
+  chunks_.reset(new Chunk[kChunkCount]);
+  for (size_t i = 0; i < kChunkCount; i++)
+    chunks_[i].data.resize(chunk_bytes);
+  current_ = 0;
+  filled_ = 0;
+  gap_frames_ = 0;
+  next_time_ns_ = 0;
+  // A fragment of one chunk is the usual jitter, with 20 ms to spare.
+  const size_t frame_bytes = pa_frame_size(&spec);
+  xrun_.configure(spec.rate, 2 * chunk_bytes / frame_bytes + spec.rate / 50);
+  discarding_ = false;
+  reported_ = false;
+  corked_.store(false, std::memory_order_release);
+  dropped_bytes_.store(0, std::memory_order_relaxed);
+  hole_bytes_.store(0, std::memory_order_relaxed);
+  {
+    std::lock_guard<std::mutex> lock(open_mutex_);
+    open_done_ = false;
+    open_error_ = 0;
+  }
+
+  engine_->post([this]
+                {
+                  context_ = pa_context_new(engine_->api(), "record_linux_plugin");
+                  if (!context_)
+                  {
+                    finish_open(PA_ERR_INTERNAL);
+                    return;
+                  }
+                  pa_context_set_state_callback(context_, context_state_cb, this);
+                  if (pa_context_connect(context_, nullptr, PA_CONTEXT_NOFLAGS, nullptr) < 0)
+                    finish_open(pa_context_errno(context_)); });
+
+  std::unique_lock<std::mutex> lock(open_mutex_);
+  open_cond_.wait(lock, [this]
+                  { return open_done_; });
+  const int result = open_error_;
+  lock.unlock();
+
+  // The strings of the caller are not kept.
+  device_ = nullptr;
+  stream_name_ = nullptr;
+  if (result != PA_OK)
+  {
+    *error = result;
+    close();
+    return false;
+  }
+  return true;
+}
+
+void EngineCapture::close()
+{
+  if (!chunks_)
+    return;
+
+  engine_->call([this]
+                { disconnect(); });
+  // Nothing is queued any more once these ran.
+  queue_->drain();
+  chunks_.reset();
+  on_chunk_ = nullptr;
+  on_error_ = nullptr;
+}
+
+bool EngineCapture::finish_open(int error)
+{
+  std::lock_guard<std::mutex> lock(open_mutex_);
+  if (open_done_)
+    return false;
+  open_done_ = true;
+  open_error_ = error;
+  open_cond_.notify_all();
+  return true;
+}
+
+void EngineCapture::fail(int error)
+{
+  if (error == PA_OK)
+    error = PA_ERR_CONNECTIONTERMINATED;
+  if (finish_open(error) || reported_)
+    return;
+  reported_ = true;
+  if (on_error_)
+  {
+    ErrorCallback on_error = on_error_;
+    queue_->submit([on_error, error]
+                   { on_error(error); });
+  }
+}
+
+void EngineCapture::context_state_cb(pa_context *context, void *userdata)
+{
+  EngineCapture *self = static_cast<EngineCapture *>(userdata);
+  const pa_context_state_t state = pa_context_get_state(context);
+  if (state == PA_CONTEXT_READY && !self->stream_)
+    self->connect_stream();
+  else if (!PA_CONTEXT_IS_GOOD(state))
+    self->fail(pa_context_errno(context));
+}
+
+void EngineCapture::connect_stream()
+{
+  stream_ = pa_stream_new(context_, stream_name_, &spec_, nullptr);
+  if (!stream_)
+  {
+    fail(pa_context_errno(context_));
+    return;
+  }
+  pa_stream_set_state_callback(stream_, stream_state_cb, this);
+  pa_stream_set_read_callback(stream_, stream_read_cb, this);
+
+  // Fragments of one chunk keep the latency at one chunk.
+  pa_buffer_attr attr;
+  attr.maxlength = (uint32_t)-1;
+  attr.tlength = (uint32_t)-1;
+  attr.prebuf = (uint32_t)-1;
+  attr.minreq = (uint32_t)-1;
+  attr.fragsize = (uint32_t)chunk_bytes_;
+  // Timing kept up to date for the capture time of the chunks.
+  if (pa_stream_connect_record(stream_, device_, &attr,
+                               (pa_stream_flags_t)(PA_STREAM_ADJUST_LATENCY | PA_STREAM_INTERPOLATE_TIMING |
+                                                   PA_STREAM_AUTO_TIMING_UPDATE)) < 0)
+    fail(pa_context_errno(context_));
+}
+
+void EngineCapture::stream_state_cb(pa_stream *stream, void *userdata)
+{
+  EngineCapture *self = static_cast<EngineCapture *>(userdata);
+  const pa_stream_state_t state = pa_stream_get_state(stream);
+  if (state == PA_STREAM_READY)
+  {
+    if (self->finish_open(PA_OK))
+    {
+      self->counted_ = true;
+      self->engine_->add_capture(1);
+    }
+  }
+  else if (!PA_STREAM_IS_GOOD(state))
+  {
+    self->fail(pa_context_errno(self->context_));
+  }
+}
+
+void EngineCapture::stream_read_cb(pa_stream *stream, size_t bytes, void *userdata)
+{
+  EngineCapture *self = static_cast<EngineCapture *>(userdata);
+  (void)bytes;
+
+  // All that is readable is read now: no backlog. The first frame of it
+  // was captured as long ago as the stream latency.
+  const size_t readable = pa_stream_readable_size(stream);
+  if (!self->discarding_ && readable != (size_t)-1 && readable > 0)
+  {
+    const int64_t now_ns = clock_us(CLOCK_MONOTONIC) * 1000;
+    self->gap_frames_ += self->xrun_.update(now_ns / 1000, readable / pa_frame_size(&self->spec_), 0);
+
+    pa_usec_t latency = 0;
+    int negative = 0;
+    self->next_time_ns_ = 0;
+    if (pa_stream_get_latency(stream, &latency, &negative) == 0)
+      self->next_time_ns_ = now_ns - (negative ? -(int64_t)latency : (int64_t)latency) * 1000;
+  }
+
+  while (pa_stream_readable_size(stream) > 0)
+  {
+    const void *data = nullptr;
+    size_t size = 0;
+    if (pa_stream_peek(stream, &data, &size) < 0)
+    {
+      self->fail(pa_context_errno(self->context_));
+      return;
+    }
+    if (size == 0)
+      break;
+
+    // Holes (lost fragments) read as silence.
+    if (!self->discarding_)
+    {
+      if (!data)
+        self->hole_bytes_.fetch_add(size, std::memory_order_relaxed);
+      self->append((const uint8_t *)data, size);
+    }
+    pa_stream_drop(stream);
+  }
+}
+
+void EngineCapture::append(const uint8_t *data, size_t bytes)
+{
+  while (bytes > 0)
+  {
+    Chunk &chunk = chunks_[current_];
+    if (filled_ == 0 && chunk.busy.load(std::memory_order_acquire))
+    {
+      // Every chunk is still queued: the session is behind.
+      dropped_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+      gap_frames_ += bytes / pa_frame_size(&spec_);
+      if (next_time_ns_ != 0)
+        next_time_ns_ += (int64_t)(bytes / pa_frame_size(&spec_)) * 1000000000 / spec_.rate;
+      return;
+    }
+    if (filled_ == 0)
+    {
+      chunk.gap = gap_frames_;
+      chunk.time_ns = next_time_ns_;
+      gap_frames_ = 0;
+    }
+
+    const size_t n = std::min(bytes, chunk_bytes_ - filled_);
+    if (next_time_ns_ != 0)
+      next_time_ns_ += (int64_t)(n / pa_frame_size(&spec_)) * 1000000000 / spec_.rate;
+    if (data)
+    {
+      memcpy(chunk.data.data() + filled_, data, n);
+      data += n;
+    }
+    else
+    {
+      memset(chunk.data.data() + filled_, 0, n);
+    }
+    filled_ += n;
+    bytes -= n;
+
+    if (filled_ == chunk_bytes_)
+    {
+      chunk.busy.store(true, std::memory_order_relaxed);
+      Chunk *full = &chunk;
+      queue_->submit([this, full]
+                     {
+                       on_chunk_(full->data.data(), chunk_bytes_, full->gap, full->time_ns);
+                       full->busy.store(false, std::memory_order_release); });
+      current_ = (current_ + 1) % kChunkCount;
+      filled_ = 0;
+    }
+  }
+}
+
+void EngineCapture::discard_readable()
+{
+  const void *data = nullptr;
+  size_t size = 0;
+  while (pa_stream_peek(stream_, &data, &size) == 0 && size > 0)
+    pa_stream_drop(stream_);
+}
+
+void EngineCapture::track(pa_operation *operation, Operation *pending)
+{
+  operations_.push_back(pending);
+  if (operation)
+    pa_operation_unref(operation);
+  else
+    operation_cb(stream_, 0, pending); // not sent: completed at once
+}
+
+void EngineCapture::operation_cb(pa_stream *stream, int success, void *userdata)
+{
+  (void)stream;
+  (void)success;
+  Operation *operation = static_cast<Operation *>(userdata);
+  EngineCapture *self = operation->capture;
+
+  switch (operation->kind)
+  {
+  case Operation::kFlushed:
+    // Corked and flushed: what arrives next is captured after the uncork,
+    // the time in between was no loss.
+    self->discarding_ = false;
+    self->xrun_.restart();
+    break;
+  case Operation::kUncorked:
+    self->corked_.store(false, std::memory_order_release);
+    break;
+  default:
+    break;
+  }
+  if (operation->done)
+    self->queue_->submit(std::move(operation->done));
+
+  self->operations_.erase(std::remove(self->operations_.begin(), self->operations_.end(), operation),
+                          self->operations_.end());
+  delete operation;
+}
+
+void EngineCapture::set_corked(bool corked, std::function<void()> done)
+{
+  engine_->post([this, corked, done]
+                {
+                  if (!stream_)
+                  {
+                    if (done)
+                      queue_->submit(done);
+                    return;
+                  }
+
+                  if (corked)
+                  {
+                    // The partial chunk goes with the audio after it.
+                    discarding_ = true;
+                    filled_ = 0;
+                    gap_frames_ = 0;
+                    corked_.store(true, std::memory_order_release);
+                    Operation *cork = new Operation{this, Operation::kCorked, nullptr};
+                    track(pa_stream_cork(stream_, 1, operation_cb, cork), cork);
+                    Operation *flush = new Operation{this, Operation::kCorked, done};
+                    track(pa_stream_flush(stream_, operation_cb, flush), flush);
+                    return;
+                  }
+
+                  discard_readable();
+                  Operation *flush = new Operation{this, Operation::kFlushed, nullptr};
+                  track(pa_stream_flush(stream_, operation_cb, flush), flush);
+                  Operation *uncork = new Operation{this, Operation::kUncorked, done};
+                  track(pa_stream_cork(stream_, 0, operation_cb, uncork), uncork); });
+}
+
+void EngineCapture::disconnect()
+{
+  if (stream_)
+  {
+    pa_stream_set_state_callback(stream_, nullptr, nullptr);
+    pa_stream_set_read_callback(stream_, nullptr, nullptr);
+    pa_stream_disconnect(stream_);
+    pa_stream_unref(stream_);
+    stream_ = nullptr;
+  }
+  if (context_)
+  {
+    pa_context_set_state_callback(context_, nullptr, nullptr);
+    pa_context_disconnect(context_);
+    pa_context_unref(context_);
+    context_ = nullptr;
+  }
+
+  // Cancelled with the connection, their callbacks never come.
+  for (Operation *operation : operations_)
+    delete operation;
+  operations_.clear();
+
+  if (counted_)
+  {
+    counted_ = false;
+    engine_->add_capture(-1);
+  }
+  corked_.store(false, std::memory_order_release);
+}
@@ -0,0 +1,221 @@
+#ifndef RECORD_LINUX_ENGINE_H_
+#define RECORD_LINUX_ENGINE_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <pulse/context.h>
+#include <pulse/mainloop-api.h>
+#include <pulse/stream.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#include "record_pool.h"
+#include "record_xrun.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//  Event-loop capture engine
+//
+//  One epoll thread serves the PulseAudio connections of every session in
+//  the process: it implements pa_mainloop_api, with the timers multiplexed
+//  on a single timerfd and commands from other threads posted through an
+//  eventfd. The loop only moves bytes. Each filled chunk is handed to the
+//  SerialQueue of its session and processed on the shared WorkerPool,
+//  which also runs what the sinks do (encoding, file writes) on the way.
+//
+//  Compared to a capture thread blocked in each session, the process has
+//  a fixed number of threads and wakes up once per poll for all of them;
+//  stats() reports the wakeups and CPU time for a comparison.
+////////////////////////////////////////////////////////////////////////////////
+class CaptureEngine
+{
+public:
+  typedef std::function<void()> Command;
+
+  struct Stats
+  {
+    uint64_t wakeups = 0;      // epoll_wait returns
+    int64_t loop_cpu_us = 0;   // CPU time of the loop thread
+    int64_t worker_cpu_us = 0; // CPU time of the workers
+    int64_t uptime_us = 0;
+    size_t workers = 0;
+    size_t captures = 0; // streams open
+  };
+
+  // The process wide engine, started on first use. Every acquire() is
+  // paired with a release(); the last one stops the engine.
+  static CaptureEngine *acquire();
+  static void release(CaptureEngine *engine);
+
+  // Runs [command] on the loop thread, without waiting.
+  void post(Command command);
+  // Runs [command] on the loop thread and waits for it (inline when
+  // called from the loop thread).
+  void call(Command command);
+
+  pa_mainloop_api *api() { return &api_; }
+  WorkerPool *pool() { return pool_; }
+  Stats stats() const;
+
+  void add_capture(int delta) { captures_.fetch_add(delta, std::memory_order_relaxed); }
+
+private:
+  CaptureEngine();
+  ~CaptureEngine();
+
+  void run();
+  void run_commands();
+  void run_deferred();
+  void run_timers();
+  void arm_timer();
+  void collect();
+
+  static pa_io_event *io_new(pa_mainloop_api *api, int fd, pa_io_event_flags_t events,
+                             pa_io_event_cb_t cb, void *userdata);
+  static void io_enable(pa_io_event *e, pa_io_event_flags_t events);
+  static void io_free(pa_io_event *e);
+  static void io_set_destroy(pa_io_event *e, pa_io_event_destroy_cb_t cb);
+  static pa_time_event *time_new(pa_mainloop_api *api, const struct timeval *tv,
+                                 pa_time_event_cb_t cb, void *userdata);
+  static void time_restart(pa_time_event *e, const struct timeval *tv);
+  static void time_free(pa_time_event *e);
+  static void time_set_destroy(pa_time_event *e, pa_time_event_destroy_cb_t cb);
+  static pa_defer_event *defer_new(pa_mainloop_api *api, pa_defer_event_cb_t cb, void *userdata);
+  static void defer_enable(pa_defer_event *e, int b);
+  static void defer_free(pa_defer_event *e);
+  static void defer_set_destroy(pa_defer_event *e, pa_defer_event_destroy_cb_t cb);
+  static void quit(pa_mainloop_api *api, int retval);
+
+  pa_mainloop_api api_;
+  int epoll_fd_ = -1;
+  int timer_fd_ = -1;
+  int command_fd_ = -1;
+  bool quit_ = false;
+  int64_t armed_us_ = -1; // deadline the timerfd is set to
+
+  // Owned by the loop thread, defined in record_engine.cc
+  std::vector<pa_io_event *> io_events_;
+  std::vector<pa_time_event *> time_events_;
+  std::vector<pa_defer_event *> defer_events_;
+  bool dead_events_ = false;
+
+  std::mutex command_mutex_;
+  std::deque<Command> commands_;
+
+  std::atomic<uint64_t> wakeups_{0};
+  std::atomic<int> captures_{0};
+  int64_t started_us_ = 0;
+  std::thread thread_;
+  WorkerPool *pool_; // the process wide one, acquired
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//  Record stream on the capture engine
+//
+//  The stream is read on the loop thread into a few preallocated chunks of
+//  [chunk_bytes]; each full chunk is processed by [on_chunk] on the session
+//  queue, in capture order. When the session falls so far behind that no
+//  chunk is free, the audio is dropped and counted. Dropped audio, and
+//  audio the server overran (see XrunDetector), is passed as the gap
+//  before the next chunk, with the time its first frame was captured,
+//  from the latency the server reports.
+////////////////////////////////////////////////////////////////////////////////
+class EngineCapture
+{
+public:
+  // Chunk data, valid for the duration of the call, the frames lost just
+  // before it and the CLOCK_MONOTONIC capture time of its first frame (0
+  // when unknown).
+  typedef std::function<void(const uint8_t *data, size_t bytes, uint64_t gap_frames, int64_t time_ns)>
+      ChunkCallback;
+  // A PA_ERR_ code; the stream delivers nothing more.
+  typedef std::function<void(int error)> ErrorCallback;
+
+  EngineCapture(CaptureEngine *engine, SerialQueue *queue);
+  ~EngineCapture();
+
+  // Connects a record stream to [device] (nullptr for the default source)
+  // and waits for it to be ready. Returns false with *error set on failure.
+  bool open(const char *device, const char *stream_name, const pa_sample_spec &spec,
+            size_t chunk_bytes, ChunkCallback on_chunk, ErrorCallback on_error, int *error);
+  // Disconnects, then waits for the chunks queued to be processed.
+  void close();
+  bool is_open() const { return stream_ != nullptr; }
+
+  // Corks or uncorks without waiting. Like PulseCapture, the audio between
+  // the last chunk and the cork, and anything left at the uncork, is
+  // discarded. [done] (may be empty) runs on the session queue once the
+  // server acknowledged, after the chunks captured before.
+  void set_corked(bool corked, std::function<void()> done);
+  bool corked() const { return corked_.load(std::memory_order_acquire); }
+
+  uint64_t dropped_bytes() const { return dropped_bytes_.load(std::memory_order_relaxed); }
+  // Holes in the stream, read as silence.
+  uint64_t hole_bytes() const { return hole_bytes_.load(std::memory_order_relaxed); }
+
+private:
+  static const size_t kChunkCount = 8;
+
+  struct Chunk
+  {
+    std::vector<uint8_t> data;
+    uint64_t gap = 0;              // frames lost before it
+    int64_t time_ns = 0;           // capture time of its first frame
+    std::atomic<bool> busy{false}; // queued or being processed
+  };
+
+  struct Operation;
+
+  static void context_state_cb(pa_context *context, void *userdata);
+  static void stream_state_cb(pa_stream *stream, void *userdata);
+  static void stream_read_cb(pa_stream *stream, size_t bytes, void *userdata);
+  static void operation_cb(pa_stream *stream, int success, void *userdata);
+
+  void connect_stream();
+  bool finish_open(int error);
+  void track(pa_operation *operation, Operation *pending);
+  void fail(int error);
+  void disconnect();
+  void append(const uint8_t *data, size_t bytes);
+  void discard_readable();
+
+  CaptureEngine *engine_;
+  SerialQueue *queue_;
+  ChunkCallback on_chunk_;
+  ErrorCallback on_error_;
+
+  // Loop thread only, once open() posted the connection
+  pa_context *context_ = nullptr;
+  pa_stream *stream_ = nullptr;
+  const char *device_ = nullptr;
+  const char *stream_name_ = nullptr;
+  pa_sample_spec spec_;
+  size_t chunk_bytes_ = 0;
+  std::unique_ptr<Chunk[]> chunks_;
+  size_t current_ = 0;      // chunk being filled
+  size_t filled_ = 0;       // bytes in it
+  uint64_t gap_frames_ = 0; // lost, to pass with the next chunk started
+  int64_t next_time_ns_ = 0; // capture time of the next byte read, 0 if unknown
+  XrunDetector xrun_;
+  bool discarding_ = false; // from a cork to the flush before the uncork
+  bool reported_ = false;   // failure passed to on_error
+  bool counted_ = false;    // in the engine stats
+  std::vector<Operation *> operations_; // cork and flush in flight
+
+  std::atomic<bool> corked_{false};
+  std::atomic<uint64_t> dropped_bytes_{0};
+  std::atomic<uint64_t> hole_bytes_{0};
+
+  // open() waits for the connection
+  std::mutex open_mutex_;
+  std::condition_variable open_cond_;
+  bool open_done_ = false;
+  int open_error_ = 0;
+};
+
+#endif // RECORD_LINUX_ENGINE_H_
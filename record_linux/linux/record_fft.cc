@@ -0,0 +1,157 @@
+#include "record_fft.h"
+
+#include <cmath>
+
+bool RealFft::configure(size_t n)
+{
+  if (n < 4 || (n & (n - 1)) != 0)
+    return false;
+
+  n_ = n;
+  half_ = n / 2;
+
+  bitrev_.assign(half_, 0);
+  unsigned bits = 0;
+  while ((1u << bits) < half_)
+    bits++;
+  for (unsigned i = 0; i < half_; i++)
+  {
+    unsigned r = 0;
+    for (unsigned b = 0; b < bits; b++)
+    {
+      if (i & (1u << b))
+        r |= 1u << (bits - 1 - b);
+    }
+    bitrev_[i] = r;
+  }
+
+  cos_.resize(half_ / 2 > 0 ? half_ / 2 : 1);
+  sin_.resize(cos_.size());
+  for (size_t k = 0; k < cos_.size(); k++)
+  {
+    double a = -2.0 * M_PI * (double)k / (double)half_;
+    cos_[k] = (float)cos(a);
+    sin_[k] = (float)sin(a);
+  }
+
+  post_cos_.resize(half_);
+  post_sin_.resize(half_);
+  for (size_t k = 0; k < half_; k++)
+  {
+    double a = -2.0 * M_PI * (double)k / (double)n_;
+    post_cos_[k] = (float)cos(a);
+    post_sin_[k] = (float)sin(a);
+  }
+
+  work_re_.assign(half_, 0.0f);
+  work_im_.assign(half_, 0.0f);
+  return true;
+}
+
+void RealFft::complex_fft(float *re, float *im, bool inverse)
+{
+  const size_t n = half_;
+
+  for (size_t i = 0; i < n; i++)
+  {
+    size_t j = bitrev_[i];
+    if (j > i)
+    {
+      float tr = re[i];
+      re[i] = re[j];
+      re[j] = tr;
+      float ti = im[i];
+      im[i] = im[j];
+      im[j] = ti;
+    }
+  }
+
+  const float sign = inverse ? -1.0f : 1.0f;
+  for (size_t len = 2; len <= n; len <<= 1)
+  {
+    const size_t h = len / 2;
+    const size_t step = n / len;
+    for (size_t base = 0; base < n; base += len)
+    {
+      float *__restrict ar = re + base;
+      float *__restrict ai = im + base;
+      float *__restrict br = re + base + h;
+      float *__restrict bi = im + base + h;
+      for (size_t k = 0; k < h; k++)
+      {
+        const float wr = cos_[k * step];
+        const float wi = sign * sin_[k * step];
+        const float tr = br[k] * wr - bi[k] * wi;
+        const float ti = br[k] * wi + bi[k] * wr;
+        br[k] = ar[k] - tr;
+        bi[k] = ai[k] - ti;
+        ar[k] += tr;
+        ai[k] += ti;
+      }
+    }
+  }
+}
+
+void RealFft::forward(const float *in, float *re, float *im)
+{
+  float *zr = work_re_.data();
+  float *zi = work_im_.data();
+  for (size_t k = 0; k < half_; k++)
+  {
+    zr[k] = in[2 * k];
+    zi[k] = in[2 * k + 1];
+  }
+
+  complex_fft(zr, zi, false);
+
+  // Split the packed even/odd transform into the real spectrum.
+  re[0] = zr[0] + zi[0];
+  im[0] = 0.0f;
+  re[half_] = zr[0] - zi[0];
+  im[half_] = 0.0f;
+  for (size_t k = 1; k < half_; k++)
+  {
+    const size_t m = half_ - k;
+    const float er = 0.5f * (zr[k] + zr[m]);
+    const float ei = 0.5f * (zi[k] - zi[m]);
+    const float orr = 0.5f * (zi[k] + zi[m]);
+    const float oi = -0.5f * (zr[k] - zr[m]);
+    const float wr = post_cos_[k];
+    const float wi = post_sin_[k];
+    re[k] = er + orr * wr - oi * wi;
+    im[k] = ei + orr * wi + oi * wr;
+  }
+}
+
+void RealFft::inverse(const float *re, const float *im, float *out)
+{
+  float *zr = work_re_.data();
+  float *zi = work_im_.data();
+
+  for (size_t k = 0; k < half_; k++)
+  {
+    const size_t m = half_ - k;
+    // Fe = (X[k] + conj(X[N/2 - k])) / 2
+    const float er = 0.5f * (re[k] + re[m]);
+    const float ei = 0.5f * (im[k] - im[m]);
+    // Fo = (X[k] - conj(X[N/2 - k])) / (2 W^k)
+    const float dr = 0.5f * (re[k] - re[m]);
+    const float di = 0.5f * (im[k] + im[m]);
+    const float wr = post_cos_[k];
+    const float wi = -post_sin_[k];
+    const float orr = dr * wr - di * wi;
+    const float oi = dr * wi + di * wr;
+    // Z = Fe + i Fo
+    zr[k] = er - oi;
+    zi[k] = ei + orr;
+  }
+
+  complex_fft(zr, zi, true);
+
+  const float scale = 1.0f / (float)half_;
+  for (size_t k = 0; k < half_; k++)
+  {
+    out[2 * k] = zr[k] * scale;
+    out[2 * k + 1] = zi[k] * scale;
+  }
+}
@@ -0,0 +1,45 @@
+#ifndef RECORD_LINUX_FFT_H_
+#define RECORD_LINUX_FFT_H_
+
+#include <stddef.h>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+//  Real-input FFT (radix-2, split real/imaginary arrays)
+//
+//  A real transform of size N is computed through a complex transform of
+//  size N/2. Spectra are stored as two separate arrays of N/2 + 1 bins so
+//  that per-bin loops in the callers stay contiguous and vectorizable.
+//  All tables are built by configure(); forward()/inverse() never allocate.
+////////////////////////////////////////////////////////////////////////////////
+class RealFft
+{
+public:
+  // N must be a power of two, >= 4.
+  bool configure(size_t n);
+
+  size_t size() const { return n_; }
+  size_t bins() const { return n_ / 2 + 1; }
+
+  // in: N samples. re/im: N/2 + 1 bins.
+  void forward(const float *in, float *re, float *im);
+
+  // re/im: N/2 + 1 bins. out: N samples, scaled by 1/N.
+  void inverse(const float *re, const float *im, float *out);
+
+private:
+  void complex_fft(float *re, float *im, bool inverse);
+
+  size_t n_ = 0;
+  size_t half_ = 0;
+
+  std::vector<unsigned> bitrev_;
+  std::vector<float> cos_;  // complex FFT twiddles, size N/4
+  std::vector<float> sin_;
+  std::vector<float> post_cos_; // real split twiddles, size N/2
+  std::vector<float> post_sin_;
+  std::vector<float> work_re_;
+  std::vector<float> work_im_;
+};
+
+#endif // RECORD_LINUX_FFT_H_
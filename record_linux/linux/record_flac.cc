@@ -0,0 +1,902 @@
+#include "record_flac.h"
+#include "record_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+  const uint32_t kMaxRiceParam = 30; // 31 is the escape code
+
+  uint8_t crc8(const uint8_t *data, size_t size)
+  {
+    uint8_t crc = 0;
+    for (size_t i = 0; i < size; i++)
+    {
+      crc ^= data[i];
+      for (int b = 0; b < 8; b++)
+        crc = (uint8_t)((crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1);
+    }
+    return crc;
+  }
+
+  uint16_t crc16(const uint8_t *data, size_t size)
+  {
+    uint16_t crc = 0;
+    for (size_t i = 0; i < size; i++)
+    {
+      crc ^= (uint16_t)(data[i] << 8);
+      for (int b = 0; b < 8; b++)
+        crc = (uint16_t)((crc & 0x8000) ? (crc << 1) ^ 0x8005 : crc << 1);
+    }
+    return crc;
+  }
+
+  unsigned sample_rate_code(uint32_t rate)
+  {
+    switch (rate)
+    {
+    case 88200: return 1;
+    case 176400: return 2;
+    case 192000: return 3;
+    case 8000: return 4;
+    case 16000: return 5;
+    case 22050: return 6;
+    case 24000: return 7;
+    case 32000: return 8;
+    case 44100: return 9;
+    case 48000: return 10;
+    case 96000: return 11;
+    default: return 0; // from STREAMINFO
+    }
+  }
+
+  unsigned qlp_precision(size_t n)
+  {
+    if (n <= 192) return 7;
+    if (n <= 384) return 8;
+    if (n <= 576) return 9;
+    if (n <= 1152) return 10;
+    if (n <= 2304) return 11;
+    if (n <= 4608) return 12;
+    return 13;
+  }
+
+  inline uint32_t fold(int32_t r)
+  {
+    return ((uint32_t)r << 1) ^ (uint32_t)(r >> 31);
+  }
+
+  unsigned floor_log2(uint64_t v)
+  {
+    unsigned l = 0;
+    while (v >>= 1)
+      l++;
+    return l;
+  }
+
+  // Per compression level: highest LPC order (0 = FIXED only) and Rice
+  // partition order, after libFLAC's presets.
+  const struct
+  {
+    unsigned lpc_order;
+    unsigned partition_order;
+  } kLevels[] = {
+      {0, 3}, {0, 4}, {0, 5}, {6, 4}, {8, 4}, {8, 5}, {8, 6}, {12, 6}, {12, 8},
+  };
+
+  const size_t kSeekPointBytes = 18;
+  const uint64_t kSeekPlaceholder = UINT64_MAX;
+}
+
+// ---------------------------------------------------------------------------
+// Bit packing, MSB first
+// ---------------------------------------------------------------------------
+class FlacEncoder::BitWriter
+{
+public:
+  explicit BitWriter(std::vector<uint8_t> *out) : out_(out) {}
+
+  void put(uint32_t value, unsigned bits)
+  {
+    if (bits == 0)
+      return;
+    const uint64_t mask = bits == 32 ? 0xFFFFFFFFull : ((1ull << bits) - 1);
+    acc_ = (acc_ << bits) | (value & mask);
+    count_ += bits;
+    while (count_ >= 8)
+    {
+      count_ -= 8;
+      out_->push_back((uint8_t)(acc_ >> count_));
+    }
+  }
+
+  void put_signed(int32_t value, unsigned bits) { put((uint32_t)value, bits); }
+
+  void put_rice(uint32_t u, unsigned k)
+  {
+    uint32_t q = u >> k;
+    while (q >= 31)
+    {
+      put(0, 31);
+      q -= 31;
+    }
+    put(1, q + 1);
+    put(u, k);
+  }
+
+  void align()
+  {
+    if (count_ > 0)
+      put(0, 8 - count_);
+  }
+
+private:
+  std::vector<uint8_t> *out_;
+  uint64_t acc_ = 0;
+  unsigned count_ = 0;
+};
+
+// ---------------------------------------------------------------------------
+// FlacEncoder
+// ---------------------------------------------------------------------------
+void FlacEncoder::configure(uint32_t sample_rate, size_t channels, int level)
+{
+  sample_rate_ = sample_rate;
+  channels_ = std::min<size_t>(channels, 8);
+
+  level = std::max(0, std::min(level, (int)(sizeof(kLevels) / sizeof(kLevels[0])) - 1));
+  max_lpc_order_ = kLevels[level].lpc_order;
+  max_partition_order_ = kLevels[level].partition_order;
+
+  for (size_t c = 0; c < channels_; c++)
+    channel_[c].assign(kBlockSize, 0);
+  mid_.assign(kBlockSize, 0);
+  side_.assign(kBlockSize, 0);
+  folded_.assign(kBlockSize, 0);
+  windowed_.assign(kBlockSize, 0.0);
+  window_.clear();
+}
+
+void FlacEncoder::stream_info(uint8_t out[kStreamInfoBytes], uint32_t sample_rate, size_t channels,
+                              uint32_t min_frame_bytes, uint32_t max_frame_bytes,
+                              uint64_t total_frames, const uint8_t md5[16], bool last_block)
+{
+  std::vector<uint8_t> bytes;
+  bytes.reserve(kStreamInfoBytes);
+  BitWriter bw(&bytes);
+
+  bw.put(0x664C6143, 32); // "fLaC"
+  bw.put(last_block ? 1 : 0, 1);
+  bw.put(0, 7); // STREAMINFO
+  bw.put(34, 24);
+
+  bw.put(kBlockSize, 16);
+  bw.put(kBlockSize, 16);
+  bw.put(min_frame_bytes, 24);
+  bw.put(max_frame_bytes, 24);
+  bw.put(sample_rate, 20);
+  bw.put((uint32_t)channels - 1, 3);
+  bw.put(16 - 1, 5);
+  bw.put((uint32_t)(total_frames >> 32), 4);
+  bw.put((uint32_t)total_frames, 32);
+  for (int i = 0; i < 16; i++)
+    bw.put(md5[i], 8);
+
+  memcpy(out, bytes.data(), kStreamInfoBytes);
+}
+
+// Best partitioned Rice coding of folded_[order, n), returns its size in bits.
+uint64_t FlacEncoder::rice_cost(size_t n, unsigned order, Rice *rice)
+{
+  unsigned max_order = max_partition_order_;
+  while (max_order > 0 && ((n & ((1u << max_order) - 1)) != 0 || (n >> max_order) <= order))
+    max_order--;
+
+  uint64_t sums[1 << kMaxPartitionOrder];
+  const size_t len = n >> max_order;
+  for (size_t p = 0; p < ((size_t)1 << max_order); p++)
+  {
+    const size_t start = p == 0 ? order : p * len;
+    const size_t end = (p + 1) * len;
+    uint64_t sum = 0;
+    for (size_t i = start; i < end; i++)
+      sum += folded_[i];
+    sums[p] = sum;
+  }
+
+  uint64_t best = UINT64_MAX;
+  for (int p_order = (int)max_order; p_order >= 0; p_order--)
+  {
+    const size_t parts = (size_t)1 << p_order;
+    const size_t part_len = n >> p_order;
+
+    uint8_t params[1 << kMaxPartitionOrder];
+    uint64_t bits = 0;
+    bool wide = false;
+    for (size_t p = 0; p < parts; p++)
+    {
+      const uint64_t count = p == 0 ? part_len - order : part_len;
+      const uint64_t sum = sums[p];
+
+      unsigned k = 0;
+      uint64_t cost = count;
+      if (sum > 0 && count > 0)
+      {
+        const unsigned guess = floor_log2(std::max<uint64_t>(1, sum / count));
+        cost = UINT64_MAX;
+        for (unsigned c = guess > 0 ? guess - 1 : 0; c <= std::min(guess + 1, kMaxRiceParam); c++)
+        {
+          const uint64_t cc = count * (c + 1) + (sum >> c);
+          if (cc < cost)
+          {
+            cost = cc;
+            k = c;
+          }
+        }
+      }
+      params[p] = (uint8_t)k;
+      wide = wide || k > 14;
+      bits += cost;
+    }
+    bits += 2 + 4 + parts * (wide ? 5 : 4);
+
+    if (bits < best)
+    {
+      best = bits;
+      rice->order = (unsigned)p_order;
+      rice->wide = wide;
+      memcpy(rice->params, params, parts);
+    }
+
+    // Merge pairs for the next (coarser) order.
+    for (size_t p = 0; p < parts / 2; p++)
+      sums[p] = sums[2 * p] + sums[2 * p + 1];
+  }
+  return best;
+}
+
+// LPC coefficients of every order up to max_lpc_order_ into lpc_, from the
+// autocorrelation of the Tukey(0.5) windowed block (Levinson-Durbin).
+void FlacEncoder::lpc_coefficients(const int32_t *x, size_t n)
+{
+  if (window_.size() != n)
+  {
+    window_.assign(n, 1.0);
+    const size_t taper = n / 4;
+    for (size_t i = 0; i < taper; i++)
+    {
+      const double w = 0.5 - 0.5 * cos(M_PI * (double)i / (double)taper);
+      window_[i] = w;
+      window_[n - 1 - i] = w;
+    }
+  }
+
+  double *__restrict d = windowed_.data();
+  const double *__restrict w = window_.data();
+  for (size_t i = 0; i < n; i++)
+    d[i] = (double)x[i] * w[i];
+
+  // Lags are accumulated side by side so that the inner loop vectorizes.
+  const size_t lags = max_lpc_order_ + 1;
+  double autoc[kMaxLpcOrder + 1] = {0.0};
+  for (size_t i = 0; i < n; i++)
+  {
+    const double di = d[i];
+    const size_t m = std::min(lags, i + 1);
+    for (size_t l = 0; l < m; l++)
+      autoc[l] += di * d[i - l];
+  }
+
+  memset(lpc_, 0, sizeof(lpc_));
+  if (autoc[0] <= 0.0)
+    return;
+
+  double a[kMaxLpcOrder + 1] = {0.0};
+  double prev[kMaxLpcOrder + 1];
+  double err = autoc[0];
+  for (size_t m = 1; m <= max_lpc_order_; m++)
+  {
+    double k = autoc[m];
+    for (size_t j = 1; j < m; j++)
+      k -= a[j] * autoc[m - j];
+    k /= err;
+
+    memcpy(prev, a, sizeof(a));
+    a[m] = k;
+    for (size_t j = 1; j < m; j++)
+      a[j] = prev[j] - k * prev[m - j];
+
+    for (size_t j = 1; j <= m; j++)
+      lpc_[m][j - 1] = a[j];
+
+    err *= (1.0 - k * k);
+    if (err <= 0.0)
+      break;
+  }
+}
+
+void FlacEncoder::analyze(const int32_t *x, size_t n, unsigned bps, Subframe *best)
+{
+  bool constant = true;
+  for (size_t i = 1; i < n && constant; i++)
+    constant = x[i] == x[0];
+  if (constant)
+  {
+    best->type = Subframe::kConstant;
+    best->bits = bps;
+    return;
+  }
+
+  best->type = Subframe::kVerbatim;
+  best->bits = (uint64_t)n * bps;
+
+  uint32_t *__restrict u = folded_.data();
+  Subframe cand;
+
+  // FIXED predictors
+  for (unsigned order = 0; order <= 4 && order < n; order++)
+  {
+    for (size_t i = order; i < n; i++)
+    {
+      int32_t r;
+      switch (order)
+      {
+      case 0: r = x[i]; break;
+      case 1: r = x[i] - x[i - 1]; break;
+      case 2: r = x[i] - 2 * x[i - 1] + x[i - 2]; break;
+      case 3: r = x[i] - 3 * x[i - 1] + 3 * x[i - 2] - x[i - 3]; break;
+      default: r = x[i] - 4 * x[i - 1] + 6 * x[i - 2] - 4 * x[i - 3] + x[i - 4]; break;
+      }
+      u[i] = fold(r);
+    }
+
+    const uint64_t bits = (uint64_t)order * bps + rice_cost(n, order, &cand.rice);
+    if (bits < best->bits)
+    {
+      cand.type = Subframe::kFixed;
+      cand.order = order;
+      cand.bits = bits;
+      *best = cand;
+    }
+  }
+
+  // LPC
+  if (max_lpc_order_ == 0 || n <= 4 * max_lpc_order_)
+    return;
+
+  lpc_coefficients(x, n);
+  const unsigned precision = qlp_precision(n);
+
+  for (unsigned order = 1; order <= max_lpc_order_; order++)
+  {
+    // Quantize with error feedback; the shift keeps the largest
+    // coefficient within [precision] signed bits.
+    double cmax = 0.0;
+    for (unsigned j = 0; j < order; j++)
+      cmax = std::max(cmax, fabs(lpc_[order][j]));
+    if (cmax <= 0.0)
+      continue;
+
+    int log2cmax;
+    frexp(cmax, &log2cmax);
+    int shift = (int)precision - 1 - log2cmax;
+    if (shift < 0)
+      continue;
+    shift = std::min(shift, 15);
+
+    const int32_t qmax = (1 << (precision - 1)) - 1;
+    const int32_t qmin = -(1 << (precision - 1));
+    double error = 0.0;
+    for (unsigned j = 0; j < order; j++)
+    {
+      error += lpc_[order][j] * (double)(1 << shift);
+      int32_t q = (int32_t)lround(error);
+      q = std::max(qmin, std::min(qmax, q));
+      error -= q;
+      cand.coefs[j] = q;
+    }
+
+    bool overflow = false;
+    for (size_t i = order; i < n; i++)
+    {
+      int64_t sum = 0;
+      for (unsigned j = 0; j < order; j++)
+        sum += (int64_t)cand.coefs[j] * x[i - j - 1];
+      const int64_t r = (int64_t)x[i] - (sum >> shift);
+      if (r > (1 << 30) || r < -(1 << 30))
+      {
+        overflow = true;
+        break;
+      }
+      u[i] = fold((int32_t)r);
+    }
+    if (overflow)
+      continue;
+
+    const uint64_t bits = (uint64_t)order * bps + 4 + 5 + order * precision +
+                          rice_cost(n, order, &cand.rice);
+    if (bits < best->bits)
+    {
+      cand.type = Subframe::kLpc;
+      cand.order = order;
+      cand.precision = precision;
+      cand.shift = shift;
+      cand.bits = bits;
+      *best = cand;
+    }
+  }
+}
+
+void FlacEncoder::write_subframe(BitWriter &bw, const int32_t *x, size_t n, unsigned bps,
+                                 const Subframe &sf)
+{
+  bw.put(0, 1);
+
+  switch (sf.type)
+  {
+  case Subframe::kConstant:
+    bw.put(0x00, 6);
+    bw.put(0, 1);
+    bw.put_signed(x[0], bps);
+    return;
+
+  case Subframe::kVerbatim:
+    bw.put(0x01, 6);
+    bw.put(0, 1);
+    for (size_t i = 0; i < n; i++)
+      bw.put_signed(x[i], bps);
+    return;
+
+  case Subframe::kFixed:
+    bw.put(0x08 | sf.order, 6);
+    bw.put(0, 1);
+    for (unsigned i = 0; i < sf.order; i++)
+      bw.put_signed(x[i], bps);
+    break;
+
+  case Subframe::kLpc:
+    bw.put(0x20 | (sf.order - 1), 6);
+    bw.put(0, 1);
+    for (unsigned i = 0; i < sf.order; i++)
+      bw.put_signed(x[i], bps);
+    bw.put(sf.precision - 1, 4);
+    bw.put_signed(sf.shift, 5);
+    for (unsigned j = 0; j < sf.order; j++)
+      bw.put_signed(sf.coefs[j], sf.precision);
+    break;
+  }
+
+  // Residual (recomputed, analysis reused the scratch for other candidates)
+  uint32_t *__restrict u = folded_.data();
+  for (size_t i = sf.order; i < n; i++)
+  {
+    int32_t r;
+    if (sf.type == Subframe::kLpc)
+    {
+      int64_t sum = 0;
+      for (unsigned j = 0; j < sf.order; j++)
+        sum += (int64_t)sf.coefs[j] * x[i - j - 1];
+      r = (int32_t)((int64_t)x[i] - (sum >> sf.shift));
+    }
+    else
+    {
+      switch (sf.order)
+      {
+      case 0: r = x[i]; break;
+      case 1: r = x[i] - x[i - 1]; break;
+      case 2: r = x[i] - 2 * x[i - 1] + x[i - 2]; break;
+      case 3: r = x[i] - 3 * x[i - 1] + 3 * x[i - 2] - x[i - 3]; break;
+      default: r = x[i] - 4 * x[i - 1] + 6 * x[i - 2] - 4 * x[i - 3] + x[i - 4]; break;
+      }
+    }
+    u[i] = fold(r);
+  }
+
+  const Rice &rice = sf.rice;
+  const unsigned param_bits = rice.wide ? 5 : 4;
+  bw.put(rice.wide ? 1 : 0, 2);
+  bw.put(rice.order, 4);
+
+  const size_t parts = (size_t)1 << rice.order;
+  const size_t len = n >> rice.order;
+  for (size_t p = 0; p < parts; p++)
+  {
+    const unsigned k = rice.params[p];
+    bw.put(k, param_bits);
+    const size_t start = p == 0 ? sf.order : p * len;
+    const size_t end = (p + 1) * len;
+    for (size_t i = start; i < end; i++)
+      bw.put_rice(u[i], k);
+  }
+}
+
+void FlacEncoder::encode_frame(const int16_t *samples, size_t frames, uint64_t frame_number,
+                               std::vector<uint8_t> *out)
+{
+  const size_t n = std::min(frames, kBlockSize);
+  const size_t C = channels_;
+
+  for (size_t c = 0; c < C; c++)
+  {
+    int32_t *__restrict dst = channel_[c].data();
+    for (size_t i = 0; i < n; i++)
+      dst[i] = samples[i * C + c];
+  }
+
+  // Channel assignment: 0-7 independent, 8 left/side, 9 side/right,
+  // 10 mid/side. Stereo analyzes the four signals and keeps the cheapest
+  // pair.
+  unsigned assignment = (unsigned)C - 1;
+  const int32_t *signal[8];
+  unsigned bps[8];
+  Subframe subframe[8];
+  for (size_t c = 0; c < C; c++)
+  {
+    signal[c] = channel_[c].data();
+    bps[c] = 16;
+  }
+
+  if (C == 2)
+  {
+    const int32_t *l = channel_[0].data();
+    const int32_t *r = channel_[1].data();
+    int32_t *__restrict m = mid_.data();
+    int32_t *__restrict s = side_.data();
+    for (size_t i = 0; i < n; i++)
+    {
+      m[i] = (l[i] + r[i]) >> 1;
+      s[i] = l[i] - r[i];
+    }
+
+    Subframe sl, sr, sm, ss;
+    analyze(l, n, 16, &sl);
+    analyze(r, n, 16, &sr);
+    analyze(m, n, 16, &sm);
+    analyze(s, n, 17, &ss);
+
+    const uint64_t independent = sl.bits + sr.bits;
+    const uint64_t left_side = sl.bits + ss.bits;
+    const uint64_t side_right = ss.bits + sr.bits;
+    const uint64_t mid_side = sm.bits + ss.bits;
+    const uint64_t least = std::min(std::min(independent, left_side), std::min(side_right, mid_side));
+
+    subframe[0] = sl;
+    subframe[1] = sr;
+    if (least == independent)
+    {
+      // Keep left/right.
+    }
+    else if (least == mid_side)
+    {
+      assignment = 10;
+      signal[0] = m;
+      signal[1] = s;
+      bps[1] = 17;
+      subframe[0] = sm;
+      subframe[1] = ss;
+    }
+    else if (least == left_side)
+    {
+      assignment = 8;
+      signal[1] = s;
+      bps[1] = 17;
+      subframe[1] = ss;
+    }
+    else
+    {
+      assignment = 9;
+      signal[0] = s;
+      bps[0] = 17;
+      subframe[0] = ss;
+    }
+  }
+  else
+  {
+    for (size_t c = 0; c < C; c++)
+      analyze(signal[c], n, bps[c], &subframe[c]);
+  }
+
+  const size_t start = out->size();
+  BitWriter bw(out);
+
+  // Frame header
+  unsigned block_code;
+  if (n == kBlockSize)
+    block_code = 12; // 256 * 2^4
+  else if (n <= 256)
+    block_code = 6;
+  else
+    block_code = 7;
+
+  bw.put(0xFFF8, 16); // sync, fixed block size
+  bw.put(block_code, 4);
+  bw.put(sample_rate_code(sample_rate_), 4);
+  bw.put(assignment, 4);
+  bw.put(4, 3); // 16 bits per sample
+  bw.put(0, 1);
+
+  // Frame number, UTF-8 style
+  const uint64_t v = frame_number;
+  if (v < 0x80)
+  {
+    bw.put((uint32_t)v, 8);
+  }
+  else
+  {
+    unsigned extra = v < 0x800 ? 1 : v < 0x10000 ? 2 : v < 0x200000 ? 3 : v < 0x4000000 ? 4 : v < 0x80000000ull ? 5 : 6;
+    const uint32_t lead = extra == 6 ? 0xFE : (0xFF00u >> (extra + 1)) & 0xFF;
+    bw.put(lead | (uint32_t)(v >> (6 * extra)), 8);
+    while (extra-- > 0)
+      bw.put(0x80 | (uint32_t)((v >> (6 * extra)) & 0x3F), 8);
+  }
+
+  if (block_code == 6)
+    bw.put((uint32_t)(n - 1), 8);
+  else if (block_code == 7)
+    bw.put((uint32_t)(n - 1), 16);
+
+  bw.put(crc8(out->data() + start, out->size() - start), 8);
+
+  for (size_t c = 0; c < C; c++)
+    write_subframe(bw, signal[c], n, bps[c], subframe[c]);
+
+  bw.align();
+  const uint16_t crc = crc16(out->data() + start, out->size() - start);
+  bw.put(crc, 16);
+}
+
+// ---------------------------------------------------------------------------
+// FlacWriter
+// ---------------------------------------------------------------------------
+FlacWriter::FlacWriter(int level) : level_(level) {}
+
+FlacWriter::~FlacWriter()
+{
+  close();
+}
+
+bool FlacWriter::open(const char *path, uint32_t sample_rate, uint16_t channels)
+{
+  file_ = fopen(path, "wb");
+  if (!file_)
+    return false;
+
+  sample_rate_ = sample_rate;
+  channels_ = channels;
+  frames_ = 0;
+
+  md5_.reset();
+  written_bytes_ = 0;
+  written_frames_ = 0;
+  min_frame_bytes_ = UINT32_MAX;
+  max_frame_bytes_ = 0;
+  seek_points_.clear();
+  seek_points_.reserve(kSeekPoints);
+  seek_step_ = std::max<uint64_t>(1, (uint64_t)sample_rate * kSeekIntervalSeconds / FlacEncoder::kBlockSize);
+  io_error_ = false;
+
+  // Placeholders, completed on close().
+  write_metadata(false);
+
+  pool_ = WorkerPool::acquire();
+  const size_t workers = std::max<size_t>(1, std::min(pool_->size(), kMaxWorkers));
+
+  // A few blocks per worker up front; the capture thread only allocates
+  // when the workers fall that far behind.
+  const size_t block_samples = FlacEncoder::kBlockSize * channels;
+  free_.clear();
+  for (size_t i = 0; i < 2 * workers + 4; i++)
+  {
+    std::unique_ptr<Block> block(new Block());
+    block->samples.resize(block_samples);
+    block->encoded.reserve(block_samples * sizeof(int16_t) + 64);
+    free_.push_back(std::move(block));
+  }
+  current_ = std::move(free_.back());
+  free_.pop_back();
+  current_->frames = 0;
+  next_index_ = 0;
+  next_write_ = 0;
+  writing_ = false;
+  active_ = 0;
+  max_active_ = workers;
+
+  encoders_.clear();
+  for (size_t i = 0; i < workers; i++)
+  {
+    encoders_.emplace_back(new FlacEncoder());
+    encoders_.back()->configure(sample_rate, channels, level_);
+  }
+  return true;
+}
+
+void FlacWriter::submit_block()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  current_->index = next_index_++;
+  queue_.push_back(std::move(current_));
+  if (!free_.empty())
+  {
+    current_ = std::move(free_.back());
+    free_.pop_back();
+  }
+  else
+  {
+    current_.reset(new Block());
+    current_->samples.resize(FlacEncoder::kBlockSize * channels_);
+  }
+  current_->frames = 0;
+
+  // A task drains the queue before it ends: one more only while under
+  // the limit.
+  if (active_ == max_active_)
+    return;
+  active_++;
+  lock.unlock();
+  pool_->submit([this]
+                { run_worker(); });
+}
+
+void FlacWriter::write_s16(const int16_t *samples, size_t frames)
+{
+  if (!file_)
+    return;
+
+  frames_ += frames;
+  while (frames > 0)
+  {
+    const size_t n = std::min(frames, FlacEncoder::kBlockSize - current_->frames);
+    memcpy(&current_->samples[current_->frames * channels_], samples,
+           n * channels_ * sizeof(int16_t));
+    current_->frames += n;
+    samples += n * channels_;
+    frames -= n;
+
+    if (current_->frames == FlacEncoder::kBlockSize)
+      submit_block();
+  }
+}
+
+void FlacWriter::run_worker()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  std::unique_ptr<FlacEncoder> encoder = std::move(encoders_.back());
+  encoders_.pop_back();
+  while (!queue_.empty())
+  {
+    std::unique_ptr<Block> block = std::move(queue_.front());
+    queue_.pop_front();
+
+    lock.unlock();
+    block->encoded.clear();
+    encoder->encode_frame(block->samples.data(), block->frames, block->index, &block->encoded);
+    lock.lock();
+
+    done_[block->index] = std::move(block);
+    if (writing_)
+      continue;
+
+    // Write the run of frames that is now complete; blocks finished by
+    // other workers meanwhile are picked up by the same loop.
+    writing_ = true;
+    while (!done_.empty() && done_.begin()->first == next_write_)
+    {
+      std::unique_ptr<Block> next = std::move(done_.begin()->second);
+      done_.erase(done_.begin());
+      lock.unlock();
+      write_frame(*next);
+      lock.lock();
+      next_write_++;
+      free_.push_back(std::move(next));
+    }
+    writing_ = false;
+  }
+
+  encoders_.push_back(std::move(encoder));
+  active_--;
+  cond_.notify_all();
+}
+
+void FlacWriter::write_frame(const Block &block)
+{
+  md5_.update(block.samples.data(), block.frames * channels_ * sizeof(int16_t));
+
+  if (block.index % seek_step_ == 0)
+  {
+    if (seek_points_.size() == kSeekPoints)
+    {
+      // Keep every other point and space the next ones twice as far.
+      for (size_t i = 0; i < kSeekPoints / 2; i++)
+        seek_points_[i] = seek_points_[2 * i];
+      seek_points_.resize(kSeekPoints / 2);
+      seek_step_ *= 2;
+    }
+    if (block.index % seek_step_ == 0)
+      seek_points_.push_back({block.index * FlacEncoder::kBlockSize, written_bytes_, (uint16_t)block.frames});
+  }
+
+  const std::vector<uint8_t> &frame = block.encoded;
+  if (fwrite(frame.data(), 1, frame.size(), file_) != frame.size())
+    io_error_ = true;
+
+  written_bytes_ += frame.size();
+  written_frames_ += block.frames;
+  min_frame_bytes_ = std::min(min_frame_bytes_, (uint32_t)frame.size());
+  max_frame_bytes_ = std::max(max_frame_bytes_, (uint32_t)frame.size());
+}
+
+// STREAMINFO followed by a SEEKTABLE of kSeekPoints entries, unused ones
+// being placeholders.
+void FlacWriter::write_metadata(bool final)
+{
+  uint8_t md5[16] = {0};
+  if (final)
+    md5_.finish(md5);
+
+  std::vector<uint8_t> bytes(FlacEncoder::kStreamInfoBytes);
+  FlacEncoder::stream_info(bytes.data(), sample_rate_, channels_,
+                           written_frames_ > 0 ? min_frame_bytes_ : 0, max_frame_bytes_,
+                           written_frames_, md5, false);
+
+  const size_t length = kSeekPoints * kSeekPointBytes;
+  bytes.push_back(0x80 | 3); // last block, SEEKTABLE
+  bytes.push_back((uint8_t)(length >> 16));
+  bytes.push_back((uint8_t)(length >> 8));
+  bytes.push_back((uint8_t)length);
+
+  for (size_t i = 0; i < kSeekPoints; i++)
+  {
+    const bool used = i < seek_points_.size();
+    const uint64_t sample = used ? seek_points_[i].sample : kSeekPlaceholder;
+    const uint64_t offset = used ? seek_points_[i].offset : 0;
+    const uint16_t frames = used ? seek_points_[i].frames : 0;
+    for (int b = 56; b >= 0; b -= 8)
+      bytes.push_back((uint8_t)(sample >> b));
+    for (int b = 56; b >= 0; b -= 8)
+      bytes.push_back((uint8_t)(offset >> b));
+    bytes.push_back((uint8_t)(frames >> 8));
+    bytes.push_back((uint8_t)frames);
+  }
+
+  fseek(file_, 0, SEEK_SET);
+  if (fwrite(bytes.data(), 1, bytes.size(), file_) != bytes.size())
+    io_error_ = true;
+}
+
+bool FlacWriter::close()
+{
+  if (!file_)
+    return false;
+
+  if (current_ && current_->frames > 0)
+    submit_block();
+
+  {
+    // Closed on a worker (a VOX take ended by the capture processing), the
+    // encoding tasks may sit behind this one on its own deque: run them
+    // here. Once nothing is queued, the rest run on other workers.
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (active_ != 0)
+    {
+      lock.unlock();
+      const bool ran = pool_->run_queued();
+      lock.lock();
+      if (!ran)
+        cond_.wait(lock, [this]
+                   { return active_ == 0; });
+    }
+  }
+  encoders_.clear();
+  WorkerPool::release(pool_);
+  pool_ = nullptr;
+
+  write_metadata(true);
+
+  const bool ok = fclose(file_) == 0 && !io_error_;
+  file_ = nullptr;
+  current_.reset();
+  free_.clear();
+  return ok;
+}
@@ -0,0 +1,177 @@
+#ifndef RECORD_LINUX_FLAC_H_
+#define RECORD_LINUX_FLAC_H_
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+#include "record_md5.h"
+#include "record_writer.h"
+
+class WorkerPool;
+
+////////////////////////////////////////////////////////////////////////////////
+//  FLAC encoding (16 bit, fixed block size)
+//
+//  FlacEncoder turns a block of interleaved S16 frames into one FLAC frame.
+//  Each channel gets the cheapest of CONSTANT, VERBATIM, FIXED (order 0-4)
+//  and LPC subframes, stereo is decorrelated (left/side, right/side or
+//  mid/side) and residuals use partitioned Rice coding. The compression
+//  level (0-8) bounds the LPC order and Rice partitioning like libFLAC's.
+//
+//  FlacWriter buffers captured frames into blocks. Frames being
+//  independent, blocks are encoded on the shared WorkerPool, by up to
+//  kMaxWorkers tasks at once; whichever task completes the next frame in
+//  sequence writes the contiguous run of finished frames, so the file and
+//  the MD5 stay in order.
+//  STREAMINFO (sizes, sample count, MD5) and SEEKTABLE are written as
+//  placeholders and completed on close().
+////////////////////////////////////////////////////////////////////////////////
+
+class FlacEncoder
+{
+public:
+  static const size_t kBlockSize = 4096;
+  static const size_t kMaxLpcOrder = 12;
+  static const size_t kMaxPartitionOrder = 8;
+  static const int kDefaultLevel = 5;
+
+  void configure(uint32_t sample_rate, size_t channels, int level);
+
+  // Encodes [frames] (at most kBlockSize) interleaved frames as frame
+  // [frame_number] and appends it to [out].
+  void encode_frame(const int16_t *samples, size_t frames, uint64_t frame_number,
+                    std::vector<uint8_t> *out);
+
+  // "fLaC" followed by the STREAMINFO block (34 bytes of data).
+  static const size_t kStreamInfoBytes = 4 + 4 + 34;
+  static void stream_info(uint8_t out[kStreamInfoBytes], uint32_t sample_rate, size_t channels,
+                          uint32_t min_frame_bytes, uint32_t max_frame_bytes,
+                          uint64_t total_frames, const uint8_t md5[16], bool last_block);
+
+private:
+  class BitWriter;
+
+  struct Rice
+  {
+    unsigned order;
+    bool wide; // 5 bit parameters
+    uint8_t params[1 << kMaxPartitionOrder];
+  };
+
+  struct Subframe
+  {
+    enum Type
+    {
+      kConstant,
+      kVerbatim,
+      kFixed,
+      kLpc,
+    } type;
+    unsigned order;
+    unsigned precision;
+    int shift;
+    int32_t coefs[kMaxLpcOrder];
+    Rice rice;
+    uint64_t bits;
+  };
+
+  void analyze(const int32_t *x, size_t n, unsigned bps, Subframe *best);
+  uint64_t rice_cost(size_t n, unsigned order, Rice *rice);
+  void lpc_coefficients(const int32_t *x, size_t n);
+  void write_subframe(BitWriter &bw, const int32_t *x, size_t n, unsigned bps, const Subframe &sf);
+
+  uint32_t sample_rate_ = 0;
+  size_t channels_ = 0;
+  unsigned max_lpc_order_ = 0;
+  unsigned max_partition_order_ = 0;
+
+  // Scratch, sized for kBlockSize.
+  std::vector<int32_t> channel_[8];
+  std::vector<int32_t> mid_, side_;
+  std::vector<uint32_t> folded_;
+  std::vector<double> window_;
+  std::vector<double> windowed_;
+  double lpc_[kMaxLpcOrder + 1][kMaxLpcOrder]; // coefficients per order
+};
+
+class FlacWriter : public FileWriter
+{
+public:
+  static const size_t kMaxWorkers = 4;
+  // Seek points reserved in the SEEKTABLE; their spacing doubles whenever
+  // the recording outgrows them.
+  static const size_t kSeekPoints = 128;
+  static const uint32_t kSeekIntervalSeconds = 10;
+
+  explicit FlacWriter(int level = FlacEncoder::kDefaultLevel);
+  ~FlacWriter() override;
+
+  bool open(const char *path, uint32_t sample_rate, uint16_t channels) override;
+  void write_s16(const int16_t *samples, size_t frames) override;
+  bool close() override;
+  uint64_t frames() const override { return frames_; }
+
+private:
+  struct Block
+  {
+    std::vector<int16_t> samples;
+    size_t frames = 0;
+    uint64_t index = 0;           // FLAC frame number
+    std::vector<uint8_t> encoded; // FLAC frame
+  };
+
+  struct SeekPoint
+  {
+    uint64_t sample;
+    uint64_t offset; // from the first frame
+    uint16_t frames;
+  };
+
+  void submit_block();
+  void run_worker();
+  void write_frame(const Block &block);
+  void write_metadata(bool final);
+
+  int level_;
+  FILE *file_ = nullptr;
+  uint32_t sample_rate_ = 0;
+  size_t channels_ = 0;
+  uint64_t frames_ = 0;
+
+  // Capture side
+  std::unique_ptr<Block> current_;
+  uint64_t next_index_ = 0;
+
+  // Hand-off, guarded by mutex_
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::deque<std::unique_ptr<Block>> queue_;
+  std::map<uint64_t, std::unique_ptr<Block>> done_; // encoded, not yet written
+  std::vector<std::unique_ptr<Block>> free_;
+  uint64_t next_write_ = 0;
+  bool writing_ = false; // a task is writing the in-order run
+  size_t active_ = 0;    // encoding tasks submitted and not done
+  size_t max_active_ = 0;
+
+  WorkerPool *pool_ = nullptr; // acquired while open
+  std::vector<std::unique_ptr<FlacEncoder>> encoders_; // not in use by a task
+
+  // In-order writing, by one worker at a time
+  Md5 md5_;
+  uint64_t written_bytes_ = 0;
+  uint64_t written_frames_ = 0;
+  uint32_t min_frame_bytes_ = 0;
+  uint32_t max_frame_bytes_ = 0;
+  std::vector<SeekPoint> seek_points_;
+  uint64_t seek_step_ = 1; // frames between seek points
+  bool io_error_ = false;
+};
+
+#endif // RECORD_LINUX_FLAC_H_
@@ -0,0 +1,663 @@
+#include "record_format.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define RECORD_FORMAT_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define RECORD_FORMAT_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+  // Largest float below 2^31, the upper clamp for S32 (the vector
+  // conversions cannot represent 2^31 - 1).
+  const float kS32Max = 2147483520.0f;
+
+  // [f] times [scale], clamped to [lower, upper] and rounded to nearest
+  // even like the vector conversions. NaN gives 0, as in those.
+  long scale_to_int(float f, float scale, float lower, float upper)
+  {
+    if (std::isnan(f))
+      return 0;
+    return lrintf(std::max(lower, std::min(upper, f * scale)));
+  }
+
+  // ---------------------------------------------------------------------------
+  // Per format sample access. Integer samples go through a left-justified
+  // int32, floats through float.
+  // ---------------------------------------------------------------------------
+  struct U8
+  {
+    static const size_t kBytes = 1;
+    static const bool kFloat = false;
+
+    static int32_t to_s32(const uint8_t *p) { return (int32_t)((uint32_t)((int32_t)p[0] - 128) << 24); }
+    static void from_s32(int32_t v, uint8_t *p) { p[0] = (uint8_t)((v >> 24) + 128); }
+    static float to_float(const uint8_t *p) { return (float)((int32_t)p[0] - 128) * (1.0f / 128.0f); }
+    static void from_float(float f, uint8_t *p)
+    {
+      p[0] = (uint8_t)(scale_to_int(f, 128.0f, -128.0f, 127.0f) + 128);
+    }
+  };
+
+  struct S16
+  {
+    static const size_t kBytes = 2;
+    static const bool kFloat = false;
+
+    static int16_t load(const uint8_t *p)
+    {
+      int16_t v;
+      memcpy(&v, p, sizeof(v));
+      return v;
+    }
+    static void store(int16_t v, uint8_t *p) { memcpy(p, &v, sizeof(v)); }
+
+    static int32_t to_s32(const uint8_t *p) { return (int32_t)((uint32_t)(int32_t)load(p) << 16); }
+    static void from_s32(int32_t v, uint8_t *p) { store((int16_t)(v >> 16), p); }
+    static float to_float(const uint8_t *p) { return (float)load(p) * (1.0f / 32768.0f); }
+    static void from_float(float f, uint8_t *p)
+    {
+      store((int16_t)scale_to_int(f, 32768.0f, -32768.0f, 32767.0f), p);
+    }
+  };
+
+  struct S24
+  {
+    static const size_t kBytes = 3;
+    static const bool kFloat = false;
+
+    static int32_t to_s32(const uint8_t *p)
+    {
+      return (int32_t)(((uint32_t)p[0] << 8) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 24));
+    }
+    static void from_s32(int32_t v, uint8_t *p)
+    {
+      p[0] = (uint8_t)(v >> 8);
+      p[1] = (uint8_t)(v >> 16);
+      p[2] = (uint8_t)(v >> 24);
+    }
+    static float to_float(const uint8_t *p) { return (float)(to_s32(p) >> 8) * (1.0f / 8388608.0f); }
+    static void from_float(float f, uint8_t *p)
+    {
+      const long v = scale_to_int(f, 8388608.0f, -8388608.0f, 8388607.0f);
+      from_s32((int32_t)((uint32_t)v << 8), p);
+    }
+  };
+
+  struct S32
+  {
+    static const size_t kBytes = 4;
+    static const bool kFloat = false;
+
+    static int32_t to_s32(const uint8_t *p)
+    {
+      int32_t v;
+      memcpy(&v, p, sizeof(v));
+      return v;
+    }
+    static void from_s32(int32_t v, uint8_t *p) { memcpy(p, &v, sizeof(v)); }
+    static float to_float(const uint8_t *p) { return (float)to_s32(p) * (1.0f / 2147483648.0f); }
+    static void from_float(float f, uint8_t *p)
+    {
+      from_s32((int32_t)scale_to_int(f, 2147483648.0f, -2147483648.0f, kS32Max), p);
+    }
+  };
+
+  struct F32
+  {
+    static const size_t kBytes = 4;
+    static const bool kFloat = true;
+
+    static float to_float(const uint8_t *p)
+    {
+      float f;
+      memcpy(&f, p, sizeof(f));
+      return f;
+    }
+    static void from_float(float f, uint8_t *p) { memcpy(p, &f, sizeof(f)); }
+    static int32_t to_s32(const uint8_t *p)
+    {
+      int32_t v;
+      S32::from_float(to_float(p), (uint8_t *)&v);
+      return v;
+    }
+    static void from_s32(int32_t v, uint8_t *p) { from_float((float)v * (1.0f / 2147483648.0f), p); }
+  };
+
+  typedef void (*ConvertKernel)(const uint8_t *src, uint8_t *dst, size_t samples);
+  typedef void (*DeinterleaveKernel)(const uint8_t *src, size_t channels, float *const *dst, size_t frames);
+  typedef void (*InterleaveKernel)(const float *const *src, size_t channels, uint8_t *dst, size_t frames);
+
+  const size_t kFormats = 5;
+
+  // ---------------------------------------------------------------------------
+  // Portable kernels
+  // ---------------------------------------------------------------------------
+  template <class From, class To>
+  void convert_scalar(const uint8_t *src, uint8_t *dst, size_t samples)
+  {
+    for (size_t i = 0; i < samples; i++, src += From::kBytes, dst += To::kBytes)
+    {
+      if (From::kFloat || To::kFloat)
+        To::from_float(From::to_float(src), dst);
+      else
+        To::from_s32(From::to_s32(src), dst);
+    }
+  }
+
+  // [C] channels, or any number when 0.
+  template <class From, size_t C>
+  void deinterleave_scalar(const uint8_t *src, size_t channels, float *const *dst, size_t frames)
+  {
+    const size_t ch = C != 0 ? C : channels;
+    for (size_t c = 0; c < ch; c++)
+    {
+      const uint8_t *s = src + c * From::kBytes;
+      float *__restrict d = dst[c];
+      for (size_t i = 0; i < frames; i++, s += ch * From::kBytes)
+        d[i] = From::to_float(s);
+    }
+  }
+
+  template <class To, size_t C>
+  void interleave_scalar(const float *const *src, size_t channels, uint8_t *dst, size_t frames)
+  {
+    const size_t ch = C != 0 ? C : channels;
+    for (size_t c = 0; c < ch; c++)
+    {
+      const float *__restrict s = src[c];
+      uint8_t *d = dst + c * To::kBytes;
+      for (size_t i = 0; i < frames; i++, d += ch * To::kBytes)
+        To::from_float(s[i], d);
+    }
+  }
+
+#define RECORD_FORMAT_ROW(From) \
+  {convert_scalar<From, U8>, convert_scalar<From, S16>, convert_scalar<From, S24>, convert_scalar<From, S32>, convert_scalar<From, F32>}
+  const ConvertKernel kScalarConvert[kFormats][kFormats] = {
+      RECORD_FORMAT_ROW(U8), RECORD_FORMAT_ROW(S16), RECORD_FORMAT_ROW(S24),
+      RECORD_FORMAT_ROW(S32), RECORD_FORMAT_ROW(F32),
+  };
+#undef RECORD_FORMAT_ROW
+
+#define RECORD_FORMAT_PLANAR(Kernel, Format) {Kernel<Format, 1>, Kernel<Format, 2>, Kernel<Format, 0>}
+  const DeinterleaveKernel kDeinterleave[kFormats][3] = {
+      RECORD_FORMAT_PLANAR(deinterleave_scalar, U8), RECORD_FORMAT_PLANAR(deinterleave_scalar, S16),
+      RECORD_FORMAT_PLANAR(deinterleave_scalar, S24), RECORD_FORMAT_PLANAR(deinterleave_scalar, S32),
+      RECORD_FORMAT_PLANAR(deinterleave_scalar, F32),
+  };
+  const InterleaveKernel kInterleave[kFormats][3] = {
+      RECORD_FORMAT_PLANAR(interleave_scalar, U8), RECORD_FORMAT_PLANAR(interleave_scalar, S16),
+      RECORD_FORMAT_PLANAR(interleave_scalar, S24), RECORD_FORMAT_PLANAR(interleave_scalar, S32),
+      RECORD_FORMAT_PLANAR(interleave_scalar, F32),
+  };
+#undef RECORD_FORMAT_PLANAR
+
+#if RECORD_FORMAT_X86
+  // ---------------------------------------------------------------------------
+  // SSE4.1
+  // ---------------------------------------------------------------------------
+  __attribute__((target("sse4.1"))) void s16_to_f32_sse41(const uint8_t *src, uint8_t *dst, size_t n)
+  {
+    const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+      const __m128i v = _mm_loadu_si128((const __m128i *)(src + i * 2));
+      const __m128i lo = _mm_cvtepi16_epi32(v);
+      const __m128i hi = _mm_cvtepi16_epi32(_mm_srli_si128(v, 8));
+      _mm_storeu_ps((float *)(dst + i * 4), _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+      _mm_storeu_ps((float *)(dst + i * 4 + 16), _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+    }
+    convert_scalar<S16, F32>(src + i * 2, dst + i * 4, n - i);
+  }
+
+  __attribute__((target("sse4.1"))) void f32_to_s16_sse41(const uint8_t *src, uint8_t *dst, size_t n)
+  {
+    const __m128 scale = _mm_set1_ps(32768.0f);
+    const __m128 lower = _mm_set1_ps(-32768.0f);
+    const __m128 upper = _mm_set1_ps(32767.0f);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+      __m128 a = _mm_mul_ps(_mm_loadu_ps((const float *)(src + i * 4)), scale);
+      __m128 b = _mm_mul_ps(_mm_loadu_ps((const float *)(src + i * 4 + 16)), scale);
+      a = _mm_and_ps(a, _mm_cmpord_ps(a, a)); // NaN to 0
+      b = _mm_and_ps(b, _mm_cmpord_ps(b, b));
+      a = _mm_min_ps(_mm_max_ps(a, lower), upper);
+      b = _mm_min_ps(_mm_max_ps(b, lower), upper);
+      const __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+      _mm_storeu_si128((__m128i *)(dst + i * 2), packed);
+    }
+    convert_scalar<F32, S16>(src + i * 4, dst + i * 2, n - i);
+  }
+
+  __attribute__((target("sse4.1"))) void s32_to_f32_sse41(const uint8_t *src, uint8_t *dst, size_t n)
+  {
+    const __m128 scale = _mm_set1_ps(1.0f / 2147483648.0f);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+      const __m128i v = _mm_loadu_si128((const __m128i *)(src + i * 4));
+      _mm_storeu_ps((float *)(dst + i * 4), _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+    }
+    convert_scalar<S32, F32>(src + i * 4, dst + i * 4, n - i);
+  }
+
+  __attribute__((target("sse4.1"))) void f32_to_s32_sse41(const uint8_t *src, uint8_t *dst, size_t n)
+  {
+    const __m128 scale = _mm_set1_ps(2147483648.0f);
+    const __m128 lower = _mm_set1_ps(-2147483648.0f);
+    const __m128 upper = _mm_set1_ps(kS32Max);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+      __m128 v = _mm_mul_ps(_mm_loadu_ps((const float *)(src + i * 4)), scale);
+      v = _mm_and_ps(v, _mm_cmpord_ps(v, v)); // NaN to 0
+      v = _mm_min_ps(_mm_max_ps(v, lower), upper);
+      _mm_storeu_si128((__m128i *)(dst + i * 4), _mm_cvtps_epi32(v));
+    }
+    convert_scalar<F32, S32>(src + i * 4, dst + i * 4, n - i);
+  }
+
+  __attribute__((target("sse4.1"))) void s16_to_s32_sse41(const uint8_t *src, uint8_t *dst, size_t n)
+  {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+      const __m128i v = _mm_loadu_si128((const __m128i *)(src + i * 2));
+      _mm_storeu_si128((__m128i *)(dst + i * 4), _mm_slli_epi32(_mm_cvtepi16_epi32(v), 16));
+      _mm_storeu_si128((__m128i *)(dst + i * 4 + 16),
+                       _mm_slli_epi32(_mm_cvtepi16_epi32(_mm_srli_si128(v, 8)), 16));
+    }
+    convert_scalar<S16, S32>(src + i * 2, dst + i * 4, n - i);
+  }
+
+  __attribute__((target("sse4.1"))) void s32_to_s16_sse41(const uint8_t *src, uint8_t *dst, size_t n)
+  {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+      const __m128i a = _mm_srai_epi32(_mm_loadu_si128((const __m128i *)(src + i * 4)), 16);
+      const __m128i b = _mm_srai_epi32(_mm_loadu_si128((const __m128i *)(src + i * 4 + 16)), 16);
+      _mm_storeu_si128((__m128i *)(dst + i * 2), _mm_packs_epi32(a, b));
+    }
+    convert_scalar<S32, S16>(src + i * 4, dst + i * 2, n - i);
+  }
+
+  // ---------------------------------------------------------------------------
+  // AVX2 (packs work per 128-bit lane, hence the permutes)
+  // ---------------------------------------------------------------------------
+  __attribute__((target("avx2"))) void s16_to_f32_avx2(const uint8_t *src, uint8_t *dst, size_t n)
+  {
+    const __m256 scale = _mm256_set1_ps(1.0f / 32768.0f);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+      const __m256i lo = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(src + i * 2)));
+      const __m256i hi = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(src + i * 2 + 16)));
+      _mm256_storeu_ps((float *)(dst + i * 4), _mm256_mul_ps(_mm256_cvtepi32_ps(lo), scale));
+      _mm256_storeu_ps((float *)(dst + i * 4 + 32), _mm256_mul_ps(_mm256_cvtepi32_ps(hi), scale));
+    }
+    s16_to_f32_sse41(src + i * 2, dst + i * 4, n - i);
+  }
+
+  __attribute__((target("avx2"))) void f32_to_s16_avx2(const uint8_t *src, uint8_t *dst, size_t n)
+  {
+    const __m256 scale = _mm256_set1_ps(32768.0f);
+    const __m256 lower = _mm256_set1_ps(-32768.0f);
+    const __m256 upper = _mm256_set1_ps(32767.0f);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+      __m256 a = _mm256_mul_ps(_mm256_loadu_ps((const float *)(src + i * 4)), scale);
+      __m256 b = _mm256_mul_ps(_mm256_loadu_ps((const float *)(src + i * 4 + 32)), scale);
+      a = _mm256_and_ps(a, _mm256_cmp_ps(a, a, _CMP_ORD_Q)); // NaN to 0
+      b = _mm256_and_ps(b, _mm256_cmp_ps(b, b, _CMP_ORD_Q));
+      a = _mm256_min_ps(_mm256_max_ps(a, lower), upper);
+      b = _mm256_min_ps(_mm256_max_ps(b, lower), upper);
+      const __m256i packed = _mm256_packs_epi32(_mm256_cvtps_epi32(a), _mm256_cvtps_epi32(b));
+      _mm256_storeu_si256((__m256i *)(dst + i * 2), _mm256_permute4x64_epi64(packed, 0xD8));
+    }
+    f32_to_s16_sse41(src + i * 4, dst + i * 2, n - i);
+  }
+
+  __attribute__((target("avx2"))) void s32_to_f32_avx2(const uint8_t *src, uint8_t *dst, size_t n)
+  {
+    const __m256 scale = _mm256_set1_ps(1.0f / 2147483648.0f);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+      const __m256i v = _mm256_loadu_si256((const __m256i *)(src + i * 4));
+      _mm256_storeu_ps((float *)(dst + i * 4), _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+    }
+    s32_to_f32_sse41(src + i * 4, dst + i * 4, n - i);
+  }
+
+  __attribute__((target("avx2"))) void f32_to_s32_avx2(const uint8_t *src, uint8_t *dst, size_t n)
+  {
+    const __m256 scale = _mm256_set1_ps(2147483648.0f);
+    const __m256 lower = _mm256_set1_ps(-2147483648.0f);
+    const __m256 upper = _mm256_set1_ps(kS32Max);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+      __m256 v = _mm256_mul_ps(_mm256_loadu_ps((const float *)(src + i * 4)), scale);
+      v = _mm256_and_ps(v, _mm256_cmp_ps(v, v, _CMP_ORD_Q)); // NaN to 0
+      v = _mm256_min_ps(_mm256_max_ps(v, lower), upper);
+      _mm256_storeu_si256((__m256i *)(dst + i * 4), _mm256_cvtps_epi32(v));
+    }
+    f32_to_s32_sse41(src + i * 4, dst + i * 4, n - i);
+  }
+
+  __attribute__((target("avx2"))) void s16_to_s32_avx2(const uint8_t *src, uint8_t *dst, size_t n)
+  {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+      const __m256i v = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(src + i * 2)));
+      _mm256_storeu_si256((__m256i *)(dst + i * 4), _mm256_slli_epi32(v, 16));
+    }
+    s16_to_s32_sse41(src + i * 2, dst + i * 4, n - i);
+  }
+
+  __attribute__((target("avx2"))) void s32_to_s16_avx2(const uint8_t *src, uint8_t *dst, size_t n)
+  {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+      const __m256i a = _mm256_srai_epi32(_mm256_loadu_si256((const __m256i *)(src + i * 4)), 16);
+      const __m256i b = _mm256_srai_epi32(_mm256_loadu_si256((const __m256i *)(src + i * 4 + 32)), 16);
+      _mm256_storeu_si256((__m256i *)(dst + i * 2),
+                          _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8));
+    }
+    s32_to_s16_sse41(src + i * 4, dst + i * 2, n - i);
+  }
+#endif // RECORD_FORMAT_X86
+
+#if RECORD_FORMAT_NEON
+  // ---------------------------------------------------------------------------
+  // NEON (conversions to integer saturate, no clamping needed)
+  // ---------------------------------------------------------------------------
+  void s16_to_f32_neon(const uint8_t *src, uint8_t *dst, size_t n)
+  {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+      const int16x8_t v = vld1q_s16((const int16_t *)(src + i * 2));
+      vst1q_f32((float *)(dst + i * 4), vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), 1.0f / 32768.0f));
+      vst1q_f32((float *)(dst + i * 4 + 16), vmulq_n_f32(vcvtq_f32_s32(vmovl_high_s16(v)), 1.0f / 32768.0f));
+    }
+    convert_scalar<S16, F32>(src + i * 2, dst + i * 4, n - i);
+  }
+
+  // vcvtnq gives 0 for NaN, and saturates.
+  void f32_to_s16_neon(const uint8_t *src, uint8_t *dst, size_t n)
+  {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+      const int32x4_t a = vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32((const float *)(src + i * 4)), 32768.0f));
+      const int32x4_t b = vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32((const float *)(src + i * 4 + 16)), 32768.0f));
+      vst1q_s16((int16_t *)(dst + i * 2), vcombine_s16(vqmovn_s32(a), vqmovn_s32(b)));
+    }
+    convert_scalar<F32, S16>(src + i * 4, dst + i * 2, n - i);
+  }
+
+  void s32_to_f32_neon(const uint8_t *src, uint8_t *dst, size_t n)
+  {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+      const int32x4_t v = vld1q_s32((const int32_t *)(src + i * 4));
+      vst1q_f32((float *)(dst + i * 4), vmulq_n_f32(vcvtq_f32_s32(v), 1.0f / 2147483648.0f));
+    }
+    convert_scalar<S32, F32>(src + i * 4, dst + i * 4, n - i);
+  }
+
+  void f32_to_s32_neon(const uint8_t *src, uint8_t *dst, size_t n)
+  {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+      const float32x4_t v = vmulq_n_f32(vld1q_f32((const float *)(src + i * 4)), 2147483648.0f);
+      // Same upper clamp as the scalar conversion (NaN stays NaN)
+      vst1q_s32((int32_t *)(dst + i * 4), vcvtnq_s32_f32(vminq_f32(v, vdupq_n_f32(kS32Max))));
+    }
+    convert_scalar<F32, S32>(src + i * 4, dst + i * 4, n - i);
+  }
+
+  void s16_to_s32_neon(const uint8_t *src, uint8_t *dst, size_t n)
+  {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+      const int16x8_t v = vld1q_s16((const int16_t *)(src + i * 2));
+      vst1q_s32((int32_t *)(dst + i * 4), vshll_n_s16(vget_low_s16(v), 16));
+      vst1q_s32((int32_t *)(dst + i * 4 + 16), vshll_high_n_s16(v, 16));
+    }
+    convert_scalar<S16, S32>(src + i * 2, dst + i * 4, n - i);
+  }
+
+  void s32_to_s16_neon(const uint8_t *src, uint8_t *dst, size_t n)
+  {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+      const int32x4_t a = vld1q_s32((const int32_t *)(src + i * 4));
+      const int32x4_t b = vld1q_s32((const int32_t *)(src + i * 4 + 16));
+      vst1q_s16((int16_t *)(dst + i * 2), vcombine_s16(vshrn_n_s32(a, 16), vshrn_n_s32(b, 16)));
+    }
+    convert_scalar<S32, S16>(src + i * 4, dst + i * 2, n - i);
+  }
+#endif // RECORD_FORMAT_NEON
+
+  struct Kernels
+  {
+    ConvertKernel convert[kFormats][kFormats];
+    const char *isa;
+
+    // The best the running CPU supports, or only [want] when given; isa is
+    // then nullptr if the CPU does not support it.
+    explicit Kernels(const char *want = nullptr)
+    {
+      memcpy(convert, kScalarConvert, sizeof(convert));
+      isa = "scalar";
+      if (want && strcmp(want, isa) == 0)
+        return;
+
+      const size_t s16 = (size_t)SampleFormat::kS16;
+      const size_t s32 = (size_t)SampleFormat::kS32;
+      const size_t f32 = (size_t)SampleFormat::kF32;
+#if RECORD_FORMAT_X86
+      __builtin_cpu_init();
+      if (__builtin_cpu_supports("avx2") && (!want || strcmp(want, "avx2") == 0))
+      {
+        convert[s16][f32] = s16_to_f32_avx2;
+        convert[f32][s16] = f32_to_s16_avx2;
+        convert[s32][f32] = s32_to_f32_avx2;
+        convert[f32][s32] = f32_to_s32_avx2;
+        convert[s16][s32] = s16_to_s32_avx2;
+        convert[s32][s16] = s32_to_s16_avx2;
+        isa = "avx2";
+      }
+      else if (__builtin_cpu_supports("sse4.1") && (!want || strcmp(want, "sse4.1") == 0))
+      {
+        convert[s16][f32] = s16_to_f32_sse41;
+        convert[f32][s16] = f32_to_s16_sse41;
+        convert[s32][f32] = s32_to_f32_sse41;
+        convert[f32][s32] = f32_to_s32_sse41;
+        convert[s16][s32] = s16_to_s32_sse41;
+        convert[s32][s16] = s32_to_s16_sse41;
+        isa = "sse4.1";
+      }
+#elif RECORD_FORMAT_NEON
+      if (!want || strcmp(want, "neon") == 0)
+      {
+        convert[s16][f32] = s16_to_f32_neon;
+        convert[f32][s16] = f32_to_s16_neon;
+        convert[s32][f32] = s32_to_f32_neon;
+        convert[f32][s32] = f32_to_s32_neon;
+        convert[s16][s32] = s16_to_s32_neon;
+        convert[s32][s16] = s32_to_s16_neon;
+        isa = "neon";
+      }
+#else
+      (void)s16;
+      (void)s32;
+      (void)f32;
+#endif
+      if (want && strcmp(want, isa) != 0)
+        isa = nullptr;
+    }
+  };
+
+  const Kernels &kernels()
+  {
+    static const Kernels instance;
+    return instance;
+  }
+
+  // Every instruction set there are kernels for, supported or not (isa
+  // then nullptr), the selected one aside.
+  const std::vector<Kernels> &kernel_sets()
+  {
+    static const std::vector<Kernels> sets = {Kernels("avx2"), Kernels("sse4.1"),
+                                              Kernels("neon"), Kernels("scalar")};
+    return sets;
+  }
+
+  const Kernels &kernels_for(const char *isa)
+  {
+    for (const Kernels &set : kernel_sets())
+    {
+      if (set.isa && strcmp(set.isa, isa) == 0)
+        return set;
+    }
+    return kernels();
+  }
+
+  size_t planar_index(size_t channels)
+  {
+    return channels == 1 ? 0 : channels == 2 ? 1 : 2;
+  }
+}
+
+size_t sample_format_bytes(SampleFormat format)
+{
+  switch (format)
+  {
+  case SampleFormat::kU8: return 1;
+  case SampleFormat::kS16: return 2;
+  case SampleFormat::kS24: return 3;
+  case SampleFormat::kS32: return 4;
+  case SampleFormat::kF32: return 4;
+  }
+  return 2;
+}
+
+unsigned sample_format_bits(SampleFormat format)
+{
+  switch (format)
+  {
+  case SampleFormat::kU8: return 8;
+  case SampleFormat::kS16: return 16;
+  case SampleFormat::kS24: return 24;
+  case SampleFormat::kS32: return 32;
+  case SampleFormat::kF32: return 24; // mantissa
+  }
+  return 16;
+}
+
+const char *sample_format_name(SampleFormat format)
+{
+  switch (format)
+  {
+  case SampleFormat::kU8: return "u8";
+  case SampleFormat::kS16: return "s16";
+  case SampleFormat::kS24: return "s24";
+  case SampleFormat::kS32: return "s32";
+  case SampleFormat::kF32: return "f32";
+  }
+  return "s16";
+}
+
+bool sample_format_from_name(const std::string &name, SampleFormat *format)
+{
+  static const SampleFormat kAll[] = {SampleFormat::kU8, SampleFormat::kS16, SampleFormat::kS24,
+                                      SampleFormat::kS32, SampleFormat::kF32};
+  for (SampleFormat candidate : kAll)
+  {
+    if (name == sample_format_name(candidate))
+    {
+      *format = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+void convert_samples(const void *src, SampleFormat from, void *dst, SampleFormat to, size_t samples)
+{
+  if (from == to)
+  {
+    if (src != dst)
+      memcpy(dst, src, samples * sample_format_bytes(from));
+    return;
+  }
+  kernels().convert[(size_t)from][(size_t)to]((const uint8_t *)src, (uint8_t *)dst, samples);
+}
+
+void deinterleave_to_f32(const void *src, SampleFormat from, size_t channels,
+                         float *const *dst, size_t frames)
+{
+  kDeinterleave[(size_t)from][planar_index(channels)]((const uint8_t *)src, channels, dst, frames);
+}
+
+void interleave_from_f32(const float *const *src, size_t channels,
+                         void *dst, SampleFormat to, size_t frames)
+{
+  kInterleave[(size_t)to][planar_index(channels)](src, channels, (uint8_t *)dst, frames);
+}
+
+const char *sample_format_isa()
+{
+  return kernels().isa;
+}
+
+std::vector<const char *> sample_format_isas()
+{
+  std::vector<const char *> isas = {kernels().isa};
+  for (const Kernels &set : kernel_sets())
+  {
+    if (set.isa && strcmp(set.isa, kernels().isa) != 0)
+      isas.push_back(set.isa);
+  }
+  return isas;
+}
+
+bool sample_format_has_kernel(const char *isa, SampleFormat from, SampleFormat to)
+{
+  if (from == to)
+    return false;
+  if (strcmp(isa, "scalar") == 0)
+    return true;
+  return kernels_for(isa).convert[(size_t)from][(size_t)to] != kScalarConvert[(size_t)from][(size_t)to];
+}
+
+void convert_samples_with(const char *isa, const void *src, SampleFormat from, void *dst,
+                          SampleFormat to, size_t samples)
+{
+  if (from == to)
+  {
+    memcpy(dst, src, samples * sample_format_bytes(from));
+    return;
+  }
+  kernels_for(isa).convert[(size_t)from][(size_t)to]((const uint8_t *)src, (uint8_t *)dst, samples);
+}
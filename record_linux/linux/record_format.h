@@ -0,0 +1,68 @@
+#ifndef RECORD_LINUX_FORMAT_H_
+#define RECORD_LINUX_FORMAT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+//  Sample formats and conversions
+//
+//  Little endian U8, S16, S24 (packed, 3 bytes), S32 and F32 (nominal range
+//  [-1, 1)). Integer formats convert between each other exactly (shifts,
+//  truncating when narrowing); to float by scaling, from float by scaling,
+//  rounding and clamping.
+//
+//  Kernels are instantiated per (source, destination) format, and per
+//  channel count for the planar ones. The hot pairs (S16/S32 <-> F32,
+//  S16 <-> S32) also have SSE4.1 and AVX2 versions, picked on first use
+//  from the running CPU, or NEON versions on ARM64.
+////////////////////////////////////////////////////////////////////////////////
+
+enum class SampleFormat
+{
+  kU8,
+  kS16,
+  kS24,
+  kS32,
+  kF32,
+};
+
+size_t sample_format_bytes(SampleFormat format);
+unsigned sample_format_bits(SampleFormat format); // significant bits
+
+// "u8", "s16", "s24", "s32" or "f32".
+const char *sample_format_name(SampleFormat format);
+bool sample_format_from_name(const std::string &name, SampleFormat *format);
+
+// Converts [samples] samples (any layout) from [from] to [to].
+// [src] and [dst] must not overlap unless the formats are the same.
+void convert_samples(const void *src, SampleFormat from, void *dst, SampleFormat to, size_t samples);
+
+// Interleaved [from] to one float buffer per channel.
+void deinterleave_to_f32(const void *src, SampleFormat from, size_t channels,
+                         float *const *dst, size_t frames);
+
+// One float buffer per channel to interleaved [to].
+void interleave_from_f32(const float *const *src, size_t channels,
+                         void *dst, SampleFormat to, size_t frames);
+
+// Instruction set of the selected kernels ("avx2", "sse4.1", "neon" or
+// "scalar").
+const char *sample_format_isa();
+
+// Instruction sets with kernels for the running CPU, the selected one first
+// and "scalar" last.
+std::vector<const char *> sample_format_isas();
+
+// Whether [isa] has a kernel of its own for [from] to [to], rather than
+// the scalar one.
+bool sample_format_has_kernel(const char *isa, SampleFormat from, SampleFormat to);
+
+// convert_samples() with the kernels of [isa], one of sample_format_isas(),
+// to check and time them against each other.
+void convert_samples_with(const char *isa, const void *src, SampleFormat from, void *dst,
+                          SampleFormat to, size_t samples);
+
+#endif // RECORD_LINUX_FORMAT_H_
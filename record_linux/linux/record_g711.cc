@@ -0,0 +1,137 @@
+#include "record_g711.h"
+
+namespace
+{
+  const int16_t kMuLawSegmentEnd[8] = {0x3F, 0x7F, 0xFF, 0x1FF, 0x3FF, 0x7FF, 0xFFF, 0x1FFF};
+  const int16_t kALawSegmentEnd[8] = {0x1F, 0x3F, 0x7F, 0xFF, 0x1FF, 0x3FF, 0x7FF, 0xFFF};
+  const int16_t kMuLawClip = 8159; // 14 bit magnitude
+  const int16_t kMuLawBias = 0x21; // 0x84 >> 2
+
+  int segment(int16_t value, const int16_t *ends)
+  {
+    int s = 0;
+    while (s < 8 && value > ends[s])
+      s++;
+    return s;
+  }
+
+  uint8_t mulaw_reference(int16_t sample)
+  {
+    int16_t value = sample >> 2;
+    uint8_t mask = 0xFF;
+    if (value < 0)
+    {
+      value = -value;
+      mask = 0x7F;
+    }
+    if (value > kMuLawClip)
+      value = kMuLawClip;
+    value += kMuLawBias;
+
+    const int s = segment(value, kMuLawSegmentEnd);
+    if (s >= 8)
+      return 0x7F ^ mask;
+    return (uint8_t)(((s << 4) | ((value >> (s + 1)) & 0xF)) ^ mask);
+  }
+
+  uint8_t alaw_reference(int16_t sample)
+  {
+    int16_t value = sample >> 3;
+    uint8_t mask = 0xD5;
+    if (value < 0)
+    {
+      value = -value - 1;
+      mask = 0x55;
+    }
+
+    const int s = segment(value, kALawSegmentEnd);
+    if (s >= 8)
+      return 0x7F ^ mask;
+    const int mantissa = s < 2 ? (value >> 1) & 0xF : (value >> s) & 0xF;
+    return (uint8_t)(((s << 4) | mantissa) ^ mask);
+  }
+
+  // Indexed by the top kBits bits of the sample, as unsigned.
+  template <int kBits>
+  struct Table
+  {
+    uint8_t codes[1 << kBits];
+
+    explicit Table(uint8_t (*encode)(int16_t))
+    {
+      for (uint32_t i = 0; i < (1u << kBits); i++)
+        codes[i] = encode((int16_t)(uint16_t)(i << (16 - kBits)));
+    }
+
+    uint8_t operator[](int16_t sample) const { return codes[(uint16_t)sample >> (16 - kBits)]; }
+  };
+
+  const Table<14> &mulaw_table()
+  {
+    static const Table<14> table(mulaw_reference);
+    return table;
+  }
+
+  const Table<13> &alaw_table()
+  {
+    static const Table<13> table(alaw_reference);
+    return table;
+  }
+}
+
+uint8_t g711_mulaw_encode(int16_t sample)
+{
+  return mulaw_table()[sample];
+}
+
+uint8_t g711_alaw_encode(int16_t sample)
+{
+  return alaw_table()[sample];
+}
+
+// ---------------------------------------------------------------------------
+// G711Codec
+// ---------------------------------------------------------------------------
+G711Codec::G711Codec(Law law)
+    : law_(law)
+{
+}
+
+void G711Codec::configure(uint32_t sample_rate, uint16_t channels)
+{
+  sample_rate_ = sample_rate;
+  channels_ = channels;
+}
+
+WavCodecFormat G711Codec::format() const
+{
+  WavCodecFormat format;
+  format.format_tag = law_ == kMuLaw ? 7 : 6; // WAVE_FORMAT_MULAW : WAVE_FORMAT_ALAW
+  format.block_align = channels_;
+  format.bits_per_sample = 8;
+  format.byte_rate = sample_rate_ * channels_;
+  format.extra = {0, 0}; // cbSize
+  return format;
+}
+
+size_t G711Codec::encode(const int16_t *samples, size_t frames, std::vector<uint8_t> *out)
+{
+  const size_t count = frames * channels_;
+  const size_t start = out->size();
+  out->resize(start + count);
+  uint8_t *dst = out->data() + start;
+
+  if (law_ == kMuLaw)
+  {
+    const Table<14> &table = mulaw_table();
+    for (size_t i = 0; i < count; i++)
+      dst[i] = table[samples[i]];
+  }
+  else
+  {
+    const Table<13> &table = alaw_table();
+    for (size_t i = 0; i < count; i++)
+      dst[i] = table[samples[i]];
+  }
+  return frames;
+}
@@ -0,0 +1,43 @@
+#ifndef RECORD_LINUX_G711_H_
+#define RECORD_LINUX_G711_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "record_writer.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//  G.711 companding (ITU-T G.711 mu-law and A-law), 8 bits per sample
+//
+//  mu-law only depends on the top 14 bits of a sample and A-law on the
+//  top 13, so encoding is one lookup in a 16 KiB or 8 KiB table, built
+//  once from the reference segment search.
+////////////////////////////////////////////////////////////////////////////////
+
+uint8_t g711_mulaw_encode(int16_t sample);
+uint8_t g711_alaw_encode(int16_t sample);
+
+class G711Codec : public WavCodec
+{
+public:
+  enum Law
+  {
+    kMuLaw,
+    kALaw,
+  };
+
+  explicit G711Codec(Law law);
+
+  void configure(uint32_t sample_rate, uint16_t channels) override;
+  WavCodecFormat format() const override;
+  size_t encode(const int16_t *samples, size_t frames, std::vector<uint8_t> *out) override;
+  size_t flush(std::vector<uint8_t> *) override { return 0; }
+
+private:
+  Law law_;
+  uint32_t sample_rate_ = 0;
+  uint16_t channels_ = 0;
+};
+
+#endif // RECORD_LINUX_G711_H_
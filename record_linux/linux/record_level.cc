@@ -0,0 +1,98 @@
+#include "record_level.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+// ---------------------------------------------------------------------------
+// LevelMeter
+// ---------------------------------------------------------------------------
+void LevelMeter::reset()
+{
+  current_db_.store(kSilenceDb, std::memory_order_relaxed);
+  max_db_.store(kSilenceDb, std::memory_order_relaxed);
+}
+
+float LevelMeter::process_s16(const int16_t *samples, size_t count)
+{
+  int32_t peak = 0;
+  for (size_t i = 0; i < count; i++)
+    peak = std::max(peak, abs((int32_t)samples[i]));
+
+  return store(peak > 0 ? 20.0f * log10f((float)peak / 32768.0f) : kSilenceDb);
+}
+
+float LevelMeter::process(const void *samples, SampleFormat format, size_t count)
+{
+  if (format == SampleFormat::kS16)
+    return process_s16((const int16_t *)samples, count);
+
+  const uint8_t *src = (const uint8_t *)samples;
+  const size_t sample_bytes = sample_format_bytes(format);
+  float block[kBlockSamples];
+  float peak = 0.0f;
+  while (count > 0)
+  {
+    const size_t n = std::min(count, kBlockSamples);
+    convert_samples(src, format, block, SampleFormat::kF32, n);
+    for (size_t i = 0; i < n; i++)
+      peak = std::max(peak, fabsf(block[i]));
+    src += n * sample_bytes;
+    count -= n;
+  }
+
+  return store(peak > 0.0f ? 20.0f * log10f(peak) : kSilenceDb);
+}
+
+float LevelMeter::store(float db)
+{
+  current_db_.store(db, std::memory_order_relaxed);
+  if (db > max_db_.load(std::memory_order_relaxed))
+    max_db_.store(db, std::memory_order_relaxed);
+  return db;
+}
+
+// ---------------------------------------------------------------------------
+// VoxTrigger
+// ---------------------------------------------------------------------------
+void VoxTrigger::configure(uint32_t sample_rate, float threshold_db, uint32_t min_duration_ms,
+                           uint32_t hang_ms)
+{
+  threshold_db_ = threshold_db;
+  min_frames_ = (uint64_t)min_duration_ms * sample_rate / 1000;
+  hang_frames_ = (uint64_t)hang_ms * sample_rate / 1000;
+  reset();
+}
+
+void VoxTrigger::reset()
+{
+  active_ = false;
+  above_ = 0;
+  below_ = 0;
+}
+
+VoxTrigger::Action VoxTrigger::update(float level_db, size_t frames)
+{
+  if (level_db >= threshold_db_)
+  {
+    above_ += frames;
+    below_ = 0;
+  }
+  else
+  {
+    below_ += frames;
+    above_ = 0;
+  }
+
+  if (!active_ && above_ >= std::max<uint64_t>(min_frames_, 1))
+  {
+    active_ = true;
+    return kStart;
+  }
+  if (active_ && below_ >= std::max<uint64_t>(hang_frames_, 1))
+  {
+    active_ = false;
+    return kStop;
+  }
+  return kNone;
+}
@@ -0,0 +1,75 @@
+#ifndef RECORD_LINUX_LEVEL_H_
+#define RECORD_LINUX_LEVEL_H_
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "record_format.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//  Capture level metering and level-triggered (VOX) take detection
+//
+//  LevelMeter measures the peak of every captured chunk in dBFS. It is fed
+//  by the capture thread and read from the platform thread (getAmplitude).
+//
+//  VoxTrigger decides when a take starts (level above the threshold for a
+//  minimum duration) and ends (level below it for the hang time).
+////////////////////////////////////////////////////////////////////////////////
+
+class LevelMeter
+{
+public:
+  static constexpr float kSilenceDb = -160.0f;
+
+  void reset();
+
+  // Returns the peak of [samples] in dBFS.
+  float process_s16(const int16_t *samples, size_t count);
+
+  // Same, for [count] samples in any [format].
+  float process(const void *samples, SampleFormat format, size_t count);
+
+  float current_db() const { return current_db_.load(std::memory_order_relaxed); }
+  float max_db() const { return max_db_.load(std::memory_order_relaxed); }
+
+private:
+  // Samples converted to float per pass.
+  static const size_t kBlockSamples = 256;
+
+  float store(float db);
+
+  std::atomic<float> current_db_{kSilenceDb};
+  std::atomic<float> max_db_{kSilenceDb};
+};
+
+class VoxTrigger
+{
+public:
+  enum Action
+  {
+    kNone,
+    kStart,
+    kStop,
+  };
+
+  void configure(uint32_t sample_rate, float threshold_db, uint32_t min_duration_ms, uint32_t hang_ms);
+  void reset();
+
+  // Feeds the level of the next [frames] captured frames.
+  Action update(float level_db, size_t frames);
+
+  bool active() const { return active_; }
+  uint64_t min_duration_frames() const { return min_frames_; }
+
+private:
+  float threshold_db_ = 0.0f;
+  uint64_t min_frames_ = 0;
+  uint64_t hang_frames_ = 0;
+
+  bool active_ = false;
+  uint64_t above_ = 0; // consecutive frames above the threshold
+  uint64_t below_ = 0; // consecutive frames below it
+};
+
+#endif // RECORD_LINUX_LEVEL_H_
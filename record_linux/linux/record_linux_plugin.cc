@@ -1,12 +1,33 @@
 #include "record_linux/record_linux_plugin.h"
+#include "record_benchmark.h"
+#include "record_channel_matrix.h"
+#include "record_clock.h"
+#include "record_config.h"
+#include "record_dither.h"
+#include "record_dsp.h"
+#include "record_engine.h"
+#include "record_format.h"
+#include "record_level.h"
+#include "record_pool.h"
+#include "record_pre_roll.h"
+#include "record_pulse.h"
+#include "record_realtime.h"
+#include "record_resampler.h"
+#include "record_state.h"
+#include "record_vad.h"
+#include "record_waveform.h"
+#include "record_writer.h"
+#include "record_xrun.h"
 
 #include <flutter_linux/flutter_linux.h>
 #include <glib-object.h>
 #include <gtk/gtk.h>
 #include <pulse/error.h>
-#include <pulse/simple.h>
+#include <algorithm>
 #include <cstring>
+#include <functional>
 #include <thread>
+#include <time.h>
 #include <cstdio>
 #include <cstdlib>
 #include <string>
@@ -15,47 +36,111 @@
 // ---------------------------------------------------------------------------
 // 1) We no longer use G_DEFINE_TYPE; we do manual GType registration
 // ---------------------------------------------------------------------------
+
+// Static variable for parent class
+static GObjectClass* parent_class = NULL;
+
+static void join_capture_thread(RecordLinuxPlugin *self);
+static void drain_capture_ring(RecordLinuxPlugin *self);
+
 static void record_linux_plugin_dispose(GObject *object)
 {
   RecordLinuxPlugin *self = (RecordLinuxPlugin *)object;
 
   // Stop if recording
-  g_mutex_lock(&self->state_mutex);
-  self->is_recording = false;
-  g_cond_broadcast(&self->pause_cond);
-  g_mutex_unlock(&self->state_mutex);
+  if (self->state)
+  {
+    self->state->reset();
+  }
 
-  if (self->record_thread_handle)
+  if (self->stop_thread_handle)
   {
-    g_thread_join(self->record_thread_handle);
-    self->record_thread_handle = nullptr;
+    g_thread_join(self->stop_thread_handle);
+    self->stop_thread_handle = nullptr;
+  }
+  join_capture_thread(self);
+  if (self->pool)
+  {
+    self->pool->detach(self->capture_source);
   }
+  delete self->capture_source;
+  self->capture_source = nullptr;
+  delete self->capture_ring;
+  self->capture_ring = nullptr;
+  delete self->realtime;
+  self->realtime = nullptr;
+  delete self->xrun;
+  self->xrun = nullptr;
+  delete self->capture_clock;
+  self->capture_clock = nullptr;
+
+  // Closed and drained first, no chunk is processed past this point
+  delete self->engine_capture;
+  self->engine_capture = nullptr;
+  delete self->engine_ref_capture;
+  self->engine_ref_capture = nullptr;
+  delete self->engine_queue;
+  self->engine_queue = nullptr;
+  CaptureEngine::release(self->engine);
+  self->engine = nullptr;
+  WorkerPool::release(self->pool);
+  self->pool = nullptr;
+  delete self->ref_pending;
+  self->ref_pending = nullptr;
 
   // Close file
-  if (self->file_handle)
+  if (self->file_writer)
   {
-    fclose(self->file_handle);
-    self->file_handle = nullptr;
+    self->file_writer->close();
+    delete self->file_writer;
+    self->file_writer = nullptr;
   }
+  delete self->stream_encoder;
+  self->stream_encoder = nullptr;
 
   // Disconnect from PulseAudio
-  if (self->pa_handle)
-  {
-    pa_simple_free(self->pa_handle);
-    self->pa_handle = nullptr;
-  }
+  delete self->pa_handle;
+  self->pa_handle = nullptr;
+  delete self->ref_pa_handle;
+  self->ref_pa_handle = nullptr;
+
+  delete self->dsp;
+  self->dsp = nullptr;
+  delete self->waveform;
+  self->waveform = nullptr;
+  delete self->vad;
+  self->vad = nullptr;
+  delete self->pre_roll;
+  self->pre_roll = nullptr;
+  delete self->meter;
+  self->meter = nullptr;
+  delete self->vox;
+  self->vox = nullptr;
+  delete self->resampler;
+  self->resampler = nullptr;
+  delete self->resampled;
+  self->resampled = nullptr;
+  delete self->matrix;
+  self->matrix = nullptr;
+  delete self->capture_dither;
+  self->capture_dither = nullptr;
+  delete self->output_dither;
+  self->output_dither = nullptr;
+  delete self->config;
+  self->config = nullptr;
+  delete self->warm_config;
+  self->warm_config = nullptr;
+  delete self->state;
+  self->state = nullptr;
 
   // Chain up
-  G_OBJECT_CLASS(record_linux_plugin_parent_class)->dispose(object);
+  parent_class->dispose(object);
 }
 
-// Static variable for parent class
-static GObjectClass* parent_class = NULL;
-
 // Type registration setup
 static void record_linux_plugin_class_init(RecordLinuxPluginClass* klass) {
   GObjectClass* object_class = G_OBJECT_CLASS(klass);
-  parent_class = g_type_class_peek_parent(klass);  // Store parent class
+  parent_class = G_OBJECT_CLASS(g_type_class_peek_parent(klass));  // Store parent class
   object_class->dispose = record_linux_plugin_dispose;
 }
 
@@ -107,20 +192,68 @@ static void record_linux_plugin_init(RecordLinuxPlugin *self)
 {
   // Initialize fields
   self->pa_handle = nullptr;
-  self->is_recording = false;
-  self->is_paused = false;
-  self->is_stream_mode = false;
+  self->ref_pa_handle = nullptr;
+  self->engine = nullptr;
+  self->engine_queue = nullptr;
+  self->engine_capture = nullptr;
+  self->engine_ref_capture = nullptr;
+  self->ref_pending = new PreRollRing();
+  self->resampler = nullptr;
+  self->resampled = new std::vector<float>();
+  self->matrix = nullptr;
+  self->capture_dither = new Ditherer();
+  self->output_dither = new Ditherer();
+  self->config = new RecordConfig();
+  self->warm_config = new RecordConfig();
+  self->dsp = new DspChain();
+  self->waveform = new WaveformPyramid();
+  self->vad = nullptr;
+  self->pre_roll = new PreRollRing();
+  self->meter = new LevelMeter();
+  self->vox = new VoxTrigger();
+  self->vox_path.clear();
+  self->vox_take = 0;
+  self->chunk_bytes = RecordLinuxPlugin::K_BUFFER_SIZE;
+  self->capture_frames = 0;
+  self->state = new RecorderState();
+  self->sink_active = false;
+  self->pre_roll_pending = 0;
+  self->stream_frames = 0;
+  self->stream_gap = false;
+  self->start_call_us = 0;
+  self->start_latency_us = -1;
+  self->warm_start = false;
+  self->thread_started_us = 0;
+  self->thread_cpu_us = 0;
+  self->thread_wakeups = 0;
+  self->thread_hole_bytes = 0;
+  self->dropouts = 0;
+  self->dropout_frames = 0;
+  self->filled_frames = 0;
+  self->recover_thread_handle = nullptr;
+  self->recovered_gap_frames = 0;
+  self->reconnects = 0;
+  self->reconnect_gap_us = 0;
   self->record_thread_handle = nullptr;
-  self->file_handle = nullptr;
+  self->pool = WorkerPool::acquire();
+  self->capture_source = new PoolSource([self]
+                                        { drain_capture_ring(self); });
+  self->capture_ring = new SlotRing();
+  self->capture_ring->configure(RecordLinuxPlugin::K_CAPTURE_SLOTS, sizeof(self->capture_buffer),
+                                sizeof(self->ref_buffer));
+  self->ring_dropped_bytes = 0;
+  self->realtime = new RealtimeThread();
+  self->xrun = new XrunDetector();
+  self->capture_clock = new CaptureClock();
+  self->converted_frames = 0;
+  self->pool->attach(self->capture_source);
+  self->stop_thread_handle = nullptr;
+  self->file_writer = nullptr;
   self->file_path.clear();
-  self->total_data_bytes = 0;
-
-  // Zero out WavHeader
-  memset(&self->wav_header, 0, sizeof(WavHeader));
+  self->stream_encoder = nullptr;
 
   // Initialize your mutexes & conds
-  g_mutex_init(&self->state_mutex);
-  g_cond_init(&self->pause_cond);
+  g_mutex_init(&self->sink_mutex);
 
   // If you want to zero out buffer
   memset(self->buffer, 0, RecordLinuxPlugin::K_BUFFER_SIZE);
@@ -174,10 +307,22 @@ extern "C" void record_linux_plugin_register_with_registrar(FlPluginRegistrar *r
         else if (strcmp(method, "startRecordingFile") == 0)
         {
           FlValue *args = fl_method_call_get_args(method_call);
+          FlValue *path_value = nullptr;
+          FlValue *config = nullptr;
           if (args && fl_value_get_type(args) == FL_VALUE_TYPE_STRING)
           {
-            const gchar *path = fl_value_get_string(args);
-            response = start_recording_file(self, path);
+            path_value = args;
+          }
+          else if (args && fl_value_get_type(args) == FL_VALUE_TYPE_MAP)
+          {
+            path_value = fl_value_lookup_string(args, "path");
+            config = fl_value_lookup_string(args, "config");
+          }
+
+          if (path_value && fl_value_get_type(path_value) == FL_VALUE_TYPE_STRING)
+          {
+            const gchar *path = fl_value_get_string(path_value);
+            response = start_recording_file(self, path, config);
           }
           else
           {
@@ -187,26 +332,67 @@ extern "C" void record_linux_plugin_register_with_registrar(FlPluginRegistrar *r
         }
         else if (strcmp(method, "stopRecordingFile") == 0)
         {
-          response = stop_recording_file(self);
+          response = stop_recording_file(self, method_call);
         }
         else if (strcmp(method, "startRecording") == 0)
         {
-          response = start_recording_stream(self);
+          FlValue *args = fl_method_call_get_args(method_call);
+          FlValue *config = (args && fl_value_get_type(args) == FL_VALUE_TYPE_MAP)
+                                ? fl_value_lookup_string(args, "config")
+                                : nullptr;
+          response = start_recording_stream(self, config);
         }
         else if (strcmp(method, "stopRecording") == 0)
         {
-          if (self->is_stream_mode)
+          if (self->state->has(RecorderState::kStream))
+          {
+            response = stop_recording_stream(self, method_call);
+          }
+          else
+          {
+            response = stop_recording_file(self, method_call);
+          }
+        }
+        else if (strcmp(method, "startPreRoll") == 0)
+        {
+          FlValue *args = fl_method_call_get_args(method_call);
+          FlValue *config = (args && fl_value_get_type(args) == FL_VALUE_TYPE_MAP)
+                                ? fl_value_lookup_string(args, "config")
+                                : nullptr;
+          response = start_pre_roll(self, config);
+        }
+        else if (strcmp(method, "stopPreRoll") == 0)
+        {
+          response = stop_pre_roll(self, method_call);
+        }
+        else if (strcmp(method, "startVox") == 0)
+        {
+          FlValue *args = fl_method_call_get_args(method_call);
+          FlValue *path_value = nullptr;
+          FlValue *config = nullptr;
+          if (args && fl_value_get_type(args) == FL_VALUE_TYPE_MAP)
+          {
+            path_value = fl_value_lookup_string(args, "path");
+            config = fl_value_lookup_string(args, "config");
+          }
+
+          if (path_value && fl_value_get_type(path_value) == FL_VALUE_TYPE_STRING)
           {
-            response = stop_recording_stream(self);
+            response = start_vox(self, fl_value_get_string(path_value), config);
           }
           else
           {
-            response = stop_recording_file(self);
+            response = FL_METHOD_RESPONSE(fl_method_error_response_new(
+                "argument_error", "Expected path string", nullptr));
           }
         }
+        else if (strcmp(method, "stopVox") == 0)
+        {
+          response = stop_vox(self, method_call);
+        }
         else if (strcmp(method, "cancelRecording") == 0)
         {
-          response = cancel_recording(self);
+          response = cancel_recording(self, method_call);
         }
         else if (strcmp(method, "pauseRecording") == 0)
         {
@@ -244,12 +430,36 @@ extern "C" void record_linux_plugin_register_with_registrar(FlPluginRegistrar *r
         {
           response = is_recording_fn(self);
         }
+        else if (strcmp(method, "getDspStats") == 0)
+        {
+          response = get_dsp_stats(self);
+        }
+        else if (strcmp(method, "getCaptureStats") == 0)
+        {
+          response = get_capture_stats(self);
+        }
+        else if (strcmp(method, "benchmarkWorkerPool") == 0)
+        {
+          response = benchmark_worker_pool(self, method_call);
+        }
+        else if (strcmp(method, "benchmarkResampler") == 0)
+        {
+          response = benchmark_resampler(self, method_call);
+        }
+        else if (strcmp(method, "benchmarkFormats") == 0)
+        {
+          response = benchmark_formats(self, method_call);
+        }
         else
         {
           response = FL_METHOD_RESPONSE(fl_method_not_implemented_response_new());
         }
 
-        fl_method_call_respond(method_call, response, nullptr);
+        // Otherwise answered once done (see stop_session, benchmark_worker_pool)
+        if (response)
+        {
+          fl_method_call_respond(method_call, response, nullptr);
+        }
       },
       plugin,
       nullptr);
@@ -259,409 +469,2092 @@ extern "C" void record_linux_plugin_register_with_registrar(FlPluginRegistrar *r
 // 5) Your existing helper functions for WAV & PulseAudio
 //    (unchanged from your snippet) EXCEPT no references to g_type_class_set_instance_size
 // ---------------------------------------------------------------------------
-static void write_wav_header(FILE *file, const WavHeader &header)
-{
-  fseek(file, 0, SEEK_SET);
-  fwrite(&header, sizeof(header), 1, file);
-  fflush(file);
-}
-
-static WavHeader init_wav_header()
+static EncoderSettings encoder_settings(RecordLinuxPlugin *self)
 {
-  WavHeader hdr;
-  memcpy(hdr.riff, "RIFF", 4);
-  memcpy(hdr.wave, "WAVE", 4);
-  memcpy(hdr.fmt_chunk_marker, "fmt ", 4);
-  memcpy(hdr.data_chunk_header, "data", 4);
-
-  hdr.overall_size = 0;
-  hdr.length_of_fmt = 16;
-  hdr.format_type = 1; // PCM
-  hdr.channels = 2;
-  hdr.sample_rate = 44100;
-  hdr.bits_per_sample = 16;
-  hdr.byterate = hdr.sample_rate * hdr.channels * (hdr.bits_per_sample / 8);
-  hdr.block_align = hdr.channels * (hdr.bits_per_sample / 8);
-  hdr.data_size = 0;
-  return hdr;
+  EncoderSettings settings;
+  settings.encoder = self->config->encoder;
+  settings.bit_rate = self->config->bit_rate;
+  settings.flac_level = self->config->flac_level;
+  settings.ogg_framing = self->config->stream_ogg_framing;
+  settings.sample_format = self->config->output_format;
+  settings.dither = self->config->dither;
+  return settings;
 }
 
-static void finalize_wav_header(RecordLinuxPlugin *self)
+// "/dir/name.wav", 3 => "/dir/name_003.wav"
+static std::string vox_take_path(const std::string &path, int take)
 {
-  if (!self->file_handle)
-    return;
-  self->wav_header.data_size = (uint32_t)self->total_data_bytes;
-  self->wav_header.overall_size =
-      (uint32_t)(self->total_data_bytes + sizeof(WavHeader) - 8);
+  const size_t slash = path.find_last_of('/');
+  size_t dot = path.find_last_of('.');
+  if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+  {
+    dot = path.size();
+  }
 
-  write_wav_header(self->file_handle, self->wav_header);
+  char suffix[16];
+  snprintf(suffix, sizeof(suffix), "_%03d", take);
+  return path.substr(0, dot) + suffix + path.substr(dot);
 }
 
-static bool connect_to_pulse(RecordLinuxPlugin *self, GError **gerror)
+// Creates the writer of the session encoder (WAV when unsupported) and
+// opens [path] with it. With LinuxRecordConfig.outputs, the other files are
+// written alongside, numbered like [path] for VOX take [take] (0 if none).
+static bool open_file_writer(RecordLinuxPlugin *self, const std::string &path, int take)
 {
-  self->pa_spec.format = PA_SAMPLE_S16LE;
-  self->pa_spec.rate = 44100;
-  self->pa_spec.channels = 2;
+  if (!file_writer_supported(self->config->encoder))
+  {
+    g_warning("Encoder '%s' is not supported, recording WAV", self->config->encoder.c_str());
+  }
 
-  int error = 0;
-  self->pa_handle = pa_simple_new(nullptr,
-                                  "record_linux_plugin",
-                                  PA_STREAM_RECORD,
-                                  nullptr,
-                                  "recording",
-                                  &self->pa_spec,
-                                  nullptr,
-                                  nullptr,
-                                  &error);
-  if (!self->pa_handle)
+  const EncoderSettings settings = encoder_settings(self);
+  self->file_writer = file_writer_create(settings);
+  if (!self->config->outputs.empty())
   {
-    if (gerror)
+    std::vector<MultiWriter::Output> extras;
+    for (const RecordOutput &output : self->config->outputs)
     {
-      *gerror = g_error_new_literal(
-          g_quark_from_static_string("pulse-error"),
-          error,
-          pa_strerror(error));
+      EncoderSettings extra_settings = settings;
+      extra_settings.encoder = output.encoder;
+      extra_settings.bit_rate = output.bit_rate;
+
+      MultiWriter::Output extra;
+      extra.writer.reset(file_writer_create(extra_settings));
+      extra.path = take > 0 ? vox_take_path(output.path, take) : output.path;
+      extras.push_back(std::move(extra));
     }
+    self->file_writer = new MultiWriter(std::unique_ptr<FileWriter>(self->file_writer),
+                                        std::move(extras));
+  }
+
+  if (!self->file_writer->open(path.c_str(), self->pa_spec.rate, self->pa_spec.channels))
+  {
+    delete self->file_writer;
+    self->file_writer = nullptr;
     return false;
   }
   return true;
 }
 
-static void disconnect_from_pulse(RecordLinuxPlugin *self)
+// Storage reserved up front for waveform peaks (grows past that).
+static const size_t K_WAVEFORM_RESERVE_SECONDS = 600;
+// Level 0 buckets batched per live waveform update (~90 ms at 44.1 kHz).
+static const size_t K_WAVEFORM_PUBLISH_BUCKETS = 16;
+
+// Invokes [method] on the Dart side from any thread.
+// Takes ownership of [args].
+static void invoke_method_on_main(RecordLinuxPlugin *self, const gchar *method, FlValue *args)
 {
-  if (self->pa_handle)
+  struct Invocation
   {
-    pa_simple_free(self->pa_handle);
-    self->pa_handle = nullptr;
-  }
+    RecordLinuxPlugin *plugin;
+    const gchar *method;
+    FlValue *args;
+  };
+
+  auto invoke = [](gpointer data) -> gboolean
+  {
+    auto *invocation = static_cast<Invocation *>(data);
+    fl_method_channel_invoke_method(invocation->plugin->channel,
+                                    invocation->method,
+                                    invocation->args,
+                                    nullptr,
+                                    nullptr,
+                                    nullptr);
+    fl_value_unref(invocation->args);
+    delete invocation;
+    return G_SOURCE_REMOVE;
+  };
+
+  g_idle_add_full(G_PRIORITY_DEFAULT, invoke, new Invocation{self, method, args}, nullptr);
 }
 
-// ---------------------------------------------------------------------------
-// 6) The background recording thread logic (unchanged from your snippet)
-// ---------------------------------------------------------------------------
-static gpointer record_thread_func(gpointer user_data)
+// Sends waveform buckets completed since the last call, one message per level.
+static void publish_waveform(RecordLinuxPlugin *self)
 {
-  RecordLinuxPlugin *self = (RecordLinuxPlugin *)user_data;
-  int error = 0;
+  WaveformPyramid *waveform = self->waveform;
 
-  while (true)
+  for (size_t level = 0; level < WaveformPyramid::kLevelCount; level++)
   {
-    g_mutex_lock(&self->state_mutex);
-    bool should_record = self->is_recording;
-    bool paused = self->is_paused;
-    bool stream = self->is_stream_mode;
-    g_mutex_unlock(&self->state_mutex);
-
-    if (!should_record)
-      break;
-
-    if (paused)
-    {
-      g_mutex_lock(&self->state_mutex);
-      while (self->is_paused && self->is_recording)
-      {
-        g_cond_wait(&self->pause_cond, &self->state_mutex);
-      }
-      g_mutex_unlock(&self->state_mutex);
+    const size_t first = waveform->published(level);
+    const size_t count = waveform->bucket_count(level) - first;
+    if (count == 0)
       continue;
-    }
 
-    // Read from PulseAudio
-    ssize_t r = pa_simple_read(self->pa_handle, self->buffer,
-                               RecordLinuxPlugin::K_BUFFER_SIZE, &error);
-    if (r < 0)
-    {
-      g_warning("pa_simple_read() failed: %s", pa_strerror(error));
-      break;
-    }
+    const WaveformBucket *buckets = waveform->buckets(level) + first * waveform->channels();
+    FlValue *update = fl_value_new_map();
+    fl_value_set_string_take(update, "level", fl_value_new_int((int64_t)level));
+    fl_value_set_string_take(update, "framesPerBucket",
+                             fl_value_new_int(WaveformPyramid::frames_per_bucket(level)));
+    fl_value_set_string_take(update, "firstBucket", fl_value_new_int((int64_t)first));
+    fl_value_set_string_take(update, "numChannels", fl_value_new_int((int64_t)waveform->channels()));
+    fl_value_set_string_take(update, "data",
+                             fl_value_new_uint8_list((const uint8_t *)buckets,
+                                                     count * waveform->channels() * sizeof(WaveformBucket)));
+    invoke_method_on_main(self, "waveformData", update);
+  }
 
-    if (!stream)
-    {
-      // File-based
-      if (self->file_handle)
-      {
-        fwrite(self->buffer, 1, RecordLinuxPlugin::K_BUFFER_SIZE, self->file_handle);
-        self->total_data_bytes += RecordLinuxPlugin::K_BUFFER_SIZE;
-      }
-    }
-    else
-    {
-      // Stream-based => send data back to Dart
-      auto *chunk = new std::vector<uint8_t>(self->buffer,
-                                             self->buffer + RecordLinuxPlugin::K_BUFFER_SIZE);
+  waveform->mark_published();
+}
 
-      auto send_chunk = [](gpointer data) -> gboolean
-      {
-        auto pair = static_cast<std::pair<RecordLinuxPlugin *, std::vector<uint8_t> *> *>(data);
-        RecordLinuxPlugin *plugin = pair->first;
-        std::vector<uint8_t> *bytesVec = pair->second;
+// Sends a speech start/end event to Dart.
+static void publish_vad_event(RecordLinuxPlugin *self, const VadEvent &event)
+{
+  FlValue *args = fl_value_new_map();
+  fl_value_set_string_take(args, "speech", fl_value_new_bool(event.speech));
+  fl_value_set_string_take(args, "captureFrame", fl_value_new_int((int64_t)event.capture_frame));
+  fl_value_set_string_take(args, "outputFrame", fl_value_new_int((int64_t)event.output_frame));
+  fl_value_set_string_take(args, "timeUs", fl_value_new_int(self->vad->capture_time_us(event.capture_frame)));
+  invoke_method_on_main(self, "vadEvent", args);
+}
 
-        FlValue *typed_data = fl_value_new_uint8_list(bytesVec->data(), bytesVec->size());
-        fl_method_channel_invoke_method(plugin->channel,
-                                        "audioData",
-                                        typed_data,
-                                        nullptr,
-                                        nullptr,
-                                        nullptr);
+// Resets the session config from the Dart RecordConfig map (may be null)
+// and prepares the DSP chain accordingly.
+static void apply_config(RecordLinuxPlugin *self, FlValue *config)
+{
+  // Parsed even when null, for the defaults to be resolved.
+  *self->config = RecordConfig();
+  record_config_from_value(config, self->config);
 
-        delete bytesVec;
-        delete pair;
-        return G_SOURCE_REMOVE;
-      };
+  self->dsp->configure((uint32_t)self->config->sample_rate,
+                       (size_t)self->config->num_channels,
+                       self->config->auto_gain,
+                       self->config->echo_cancel,
+                       self->config->noise_suppress);
 
-      auto *pair = new std::pair<RecordLinuxPlugin *, std::vector<uint8_t> *>(self, chunk);
-      g_idle_add_full(G_PRIORITY_DEFAULT, send_chunk, pair, nullptr);
-    }
+  if (self->config->waveform_peaks)
+  {
+    self->waveform->configure((size_t)self->config->num_channels,
+                              (uint32_t)self->config->sample_rate,
+                              K_WAVEFORM_RESERVE_SECONDS);
   }
 
-  return nullptr;
+  delete self->vad;
+  self->vad = nullptr;
+  if (self->config->vad_mode == "events" || self->config->vad_mode == "gate")
+  {
+    const size_t frame_bytes = (size_t)self->config->num_channels * sizeof(int16_t);
+    self->vad = new VoiceGate();
+    self->vad->configure((uint32_t)self->config->sample_rate,
+                         (size_t)self->config->num_channels,
+                         RecordLinuxPlugin::K_BUFFER_SIZE / frame_bytes,
+                         self->config->vad_mode == "gate",
+                         (uint32_t)self->config->vad_hangover_ms,
+                         (uint32_t)self->config->vad_pre_roll_ms);
+  }
 }
 
-// ---------------------------------------------------------------------------
-// 7) All your plugin method implementations EXACTLY as in your snippet
-// ---------------------------------------------------------------------------
-FlMethodResponse *create_recorder(RecordLinuxPlugin *self)
+// Reference audio not consumed yet, at most one second: the ring drops the
+// oldest. On the session queue or the pool, whichever processes the capture.
+static void append_reference(RecordLinuxPlugin *self, const uint8_t *data, size_t bytes)
 {
-  // Possibly no-op
-  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+  self->ref_pending->write(data, bytes / sizeof(int16_t));
 }
 
-FlMethodResponse *dispose_recorder(RecordLinuxPlugin *self)
+// Opens the far-end reference stream used by the echo canceller.
+// Failure is not fatal: echo cancellation is then skipped.
+static void connect_reference(RecordLinuxPlugin *self)
 {
-  // ...
-  g_mutex_lock(&self->state_mutex);
-  self->is_recording = false;
-  g_cond_broadcast(&self->pause_cond);
-  g_mutex_unlock(&self->state_mutex);
+  pa_sample_spec spec;
+  spec.format = PA_SAMPLE_S16LE;
+  spec.rate = self->pa_spec.rate;
+  spec.channels = 1;
 
-  if (self->record_thread_handle)
+  const size_t chunk_bytes = self->chunk_bytes / self->pa_spec.channels;
+  int error = 0;
+  self->ref_pending->configure(spec.rate, sizeof(int16_t));
+  if (self->engine_capture)
   {
-    g_thread_join(self->record_thread_handle);
-    self->record_thread_handle = nullptr;
+    // Delivered on the session queue, like the capture it goes with.
+    self->engine_ref_capture = new EngineCapture(self->engine, self->engine_queue);
+    if (self->engine_ref_capture->open(self->config->echo_reference.c_str(), "echo reference", spec,
+                                       chunk_bytes,
+                                       [self](const uint8_t *data, size_t bytes, uint64_t, int64_t)
+                                       { append_reference(self, data, bytes); },
+                                       nullptr, &error))
+      return;
+    delete self->engine_ref_capture;
+    self->engine_ref_capture = nullptr;
   }
-  if (self->file_handle)
+  else
   {
-    fclose(self->file_handle);
-    self->file_handle = nullptr;
+    // Read by the capture thread along with each chunk (see
+    // record_thread_func).
+    self->ref_pa_handle = new PulseCapture();
+    if (self->ref_pa_handle->open(self->config->echo_reference.c_str(), "echo reference", spec,
+                                  chunk_bytes, &error))
+      return;
+    delete self->ref_pa_handle;
+    self->ref_pa_handle = nullptr;
   }
-  disconnect_from_pulse(self);
+  g_warning("Echo reference '%s' unavailable: %s",
+            self->config->echo_reference.c_str(), pa_strerror(error));
+}
 
-  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+static void process_engine_chunk(RecordLinuxPlugin *self, const uint8_t *data, size_t captured,
+                                 SampleFormat capture_format, uint64_t gap_frames, int64_t time_ns);
+static void handle_engine_failure(RecordLinuxPlugin *self, int error);
+
+// (Re)opens engine_capture on the shared event loop, processed on the
+// queue of this plugin instead of a capture thread.
+static bool open_engine_capture(RecordLinuxPlugin *self, const char *device,
+                                const pa_sample_spec &spec, size_t chunk_bytes, int *error)
+{
+  const SampleFormat capture_format = self->config->capture_format;
+  const size_t frame_bytes = spec.channels * sample_format_bytes(capture_format);
+  return self->engine_capture->open(
+      device, "recording", spec, chunk_bytes,
+      [self, capture_format, frame_bytes](const uint8_t *data, size_t bytes, uint64_t gap_frames,
+                                          int64_t time_ns)
+      { process_engine_chunk(self, data, bytes / frame_bytes, capture_format, gap_frames, time_ns); },
+      [self](int error)
+      { handle_engine_failure(self, error); },
+      error);
 }
 
-FlMethodResponse *start_recording_file(RecordLinuxPlugin *self, const gchar *path)
+static bool connect_engine(RecordLinuxPlugin *self, const char *device, const pa_sample_spec &spec,
+                           size_t chunk_bytes, int *error)
 {
-  // EXACT same as your snippet
-  g_mutex_lock(&self->state_mutex);
-  if (self->is_recording)
+  if (!self->engine)
   {
-    g_mutex_unlock(&self->state_mutex);
-    return (FlMethodResponse *)fl_method_error_response_new(
-        "already_recording", "A recording session is already in progress.", nullptr);
+    self->engine = CaptureEngine::acquire();
+    self->engine_queue = new SerialQueue(self->engine->pool());
   }
-  g_mutex_unlock(&self->state_mutex);
 
-  GError *gerror = nullptr;
-  if (!connect_to_pulse(self, &gerror))
+  self->engine_capture = new EngineCapture(self->engine, self->engine_queue);
+  if (!open_engine_capture(self, device, spec, chunk_bytes, error))
   {
-    if (gerror)
-    {
-      auto resp = fl_method_error_response_new("pulse_error", gerror->message, nullptr);
-      g_error_free(gerror);
-      return (FlMethodResponse *)resp;
-    }
-    return (FlMethodResponse *)fl_method_error_response_new(
-        "pulse_error", "Unknown PulseAudio error", nullptr);
+    delete self->engine_capture;
+    self->engine_capture = nullptr;
+    return false;
   }
+  return true;
+}
 
-  self->wav_header = init_wav_header();
-  self->file_path = path ? path : "";
-  self->file_handle = fopen(self->file_path.c_str(), "wb");
-  if (!self->file_handle)
+static pa_sample_format_t pulse_sample_format(SampleFormat format)
+{
+  switch (format)
   {
-    disconnect_from_pulse(self);
-    return (FlMethodResponse *)fl_method_error_response_new(
-        "file_io_error", "Failed to open the file for writing.", nullptr);
+  case SampleFormat::kU8:
+    return PA_SAMPLE_U8;
+  case SampleFormat::kS24:
+    return PA_SAMPLE_S24LE;
+  case SampleFormat::kS32:
+    return PA_SAMPLE_S32LE;
+  case SampleFormat::kF32:
+    return PA_SAMPLE_FLOAT32LE;
+  default:
+    return PA_SAMPLE_S16LE;
   }
-
-  fwrite(&self->wav_header, sizeof(self->wav_header), 1, self->file_handle);
-  fflush(self->file_handle);
-
-  self->total_data_bytes = 0;
-  self->is_stream_mode = false;
-
-  g_mutex_lock(&self->state_mutex);
-  self->is_recording = true;
-  self->is_paused = false;
-  self->record_thread_handle = g_thread_new("record_thread", record_thread_func, self);
-  g_mutex_unlock(&self->state_mutex);
-
-  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
 }
 
-FlMethodResponse *stop_recording_file(RecordLinuxPlugin *self)
+// What the device is asked for, once pa_spec is set.
+static pa_sample_spec capture_sample_spec(RecordLinuxPlugin *self)
 {
-  // ...
-  g_mutex_lock(&self->state_mutex);
-  bool was_recording = self->is_recording;
-  self->is_recording = false;
-  g_cond_broadcast(&self->pause_cond);
-  g_mutex_unlock(&self->state_mutex);
+  pa_sample_spec spec = self->pa_spec;
+  spec.rate = (uint32_t)self->config->capture_sample_rate;
+  spec.channels = (uint8_t)self->config->device_channels;
+  return spec;
+}
 
-  if (was_recording && self->record_thread_handle)
+static bool connect_to_pulse(RecordLinuxPlugin *self, GError **gerror)
+{
+  // Captured in the requested format, processed as S16 (see record_thread_func).
+  self->pa_spec.format = pulse_sample_format(self->config->capture_format);
+  self->pa_spec.rate = (uint32_t)self->config->sample_rate;
+  self->pa_spec.channels = (uint8_t)self->config->num_channels;
+
+  const size_t frame_bytes = self->pa_spec.channels * sizeof(int16_t);
+  const size_t chunk_frames = RecordLinuxPlugin::K_BUFFER_SIZE / frame_bytes;
+  self->chunk_bytes = chunk_frames * frame_bytes;
+
+  // The device may run at another rate and channel count, mapped to the
+  // session ones in-process. Reads are shortened so that a chunk fits in
+  // capture_buffer and, once resampled, in buffer.
+  const pa_sample_spec capture_spec = capture_sample_spec(self);
+  const size_t capture_frame_bytes =
+      capture_spec.channels * sample_format_bytes(self->config->capture_format);
+  self->capture_frames = std::min(chunk_frames, sizeof(self->capture_buffer) / capture_frame_bytes);
+
+  delete self->resampler;
+  self->resampler = nullptr;
+  if (capture_spec.rate != self->pa_spec.rate)
   {
-    g_thread_join(self->record_thread_handle);
-    self->record_thread_handle = nullptr;
+    self->resampler = new Resampler();
+    self->resampler->configure(capture_spec.rate, self->pa_spec.rate, self->pa_spec.channels,
+                               self->config->resampler_quality);
+    self->capture_frames = std::min((size_t)((chunk_frames - 2) * capture_spec.rate / self->pa_spec.rate),
+                                    sizeof(self->capture_buffer) / capture_frame_bytes);
+    self->resampled->reserve(chunk_frames * self->pa_spec.channels);
   }
 
-  finalize_wav_header(self);
+  self->capture_dither->configure(self->config->dither, self->pa_spec.channels);
 
-  if (self->file_handle)
+  delete self->matrix;
+  self->matrix = nullptr;
+  if (!self->config->channel_matrix.empty())
   {
-    fclose(self->file_handle);
-    self->file_handle = nullptr;
+    self->matrix = new ChannelMatrix();
+    self->matrix->configure(capture_spec.channels, self->config->channel_matrix,
+                            self->capture_frames);
   }
-  disconnect_from_pulse(self);
-
-  FlValue *result = fl_value_new_string(self->file_path.c_str());
-  return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
-}
 
-FlMethodResponse *start_recording_stream(RecordLinuxPlugin *self)
-{
-  // ...
-  g_mutex_lock(&self->state_mutex);
-  if (self->is_recording)
+  const char *device = self->config->device_id.empty()
+                           ? nullptr
+                           : self->config->device_id.c_str();
+
+  // Losses are counted per connection. A gap in the thread reads beyond
+  // two fragments, with 20 ms to spare, is one (see XrunDetector).
+  __atomic_store_n(&self->thread_hole_bytes, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&self->dropouts, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&self->dropout_frames, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&self->filled_frames, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&self->recovered_gap_frames, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&self->reconnects, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&self->reconnect_gap_us, 0, __ATOMIC_RELAXED);
+  self->xrun->configure(capture_spec.rate, 2 * self->capture_frames + capture_spec.rate / 50);
+  self->capture_clock->configure(capture_spec.rate);
+  self->converted_frames = 0;
+
+  // Fragments of one read keep the latency at one chunk.
+  int error = 0;
+  bool connected = false;
+  if (self->config->capture_engine == "eventLoop")
   {
-    g_mutex_unlock(&self->state_mutex);
-    return (FlMethodResponse *)fl_method_error_response_new(
-        "already_recording", "A recording session is already in progress.", nullptr);
+    if (self->config->realtime_policy != RealtimePolicy::kOff)
+    {
+      g_warning("realtimePolicy applies to the capture thread, not to the event loop");
+    }
+    connected = connect_engine(self, device, capture_spec,
+                               self->capture_frames * capture_frame_bytes, &error);
   }
-  g_mutex_unlock(&self->state_mutex);
-
-  GError *gerror = nullptr;
-  if (!connect_to_pulse(self, &gerror))
+  else
+  {
+    self->pa_handle = new PulseCapture();
+    connected = self->pa_handle->open(device, "recording", capture_spec,
+                                      self->capture_frames * capture_frame_bytes, &error);
+    if (!connected)
+    {
+      delete self->pa_handle;
+      self->pa_handle = nullptr;
+    }
+  }
+  if (!connected)
   {
     if (gerror)
     {
-      auto resp = fl_method_error_response_new("pulse_error", gerror->message, nullptr);
-      g_error_free(gerror);
-      return (FlMethodResponse *)resp;
+      *gerror = g_error_new_literal(
+          g_quark_from_static_string("pulse-error"),
+          error,
+          pa_strerror(error));
     }
-    return (FlMethodResponse *)fl_method_error_response_new(
-        "pulse_error", "Unknown PulseAudio error", nullptr);
+    return false;
   }
 
-  self->file_path.clear();
-  self->file_handle = nullptr;
-  self->total_data_bytes = 0;
-  self->is_stream_mode = true;
-
-  g_mutex_lock(&self->state_mutex);
-  self->is_recording = true;
-  self->is_paused = false;
-  self->record_thread_handle = g_thread_new("record_thread", record_thread_func, self);
-  g_mutex_unlock(&self->state_mutex);
+  if (self->dsp->wants_reference())
+  {
+    connect_reference(self);
+  }
+  return true;
+}
 
-  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+static void disconnect_from_pulse(RecordLinuxPlugin *self)
+{
+  delete self->pa_handle;
+  self->pa_handle = nullptr;
+  delete self->ref_pa_handle;
+  self->ref_pa_handle = nullptr;
+  delete self->engine_capture;
+  self->engine_capture = nullptr;
+  delete self->engine_ref_capture;
+  self->engine_ref_capture = nullptr;
 }
 
-FlMethodResponse *stop_recording_stream(RecordLinuxPlugin *self)
+// Appends [frames] of S16 to [chunk] in the output sample format.
+static void append_pcm(RecordLinuxPlugin *self, std::vector<uint8_t> *chunk,
+                       const uint8_t *data, size_t frames)
 {
-  // ...
-  g_mutex_lock(&self->state_mutex);
-  bool was_recording = self->is_recording;
-  self->is_recording = false;
-  g_cond_broadcast(&self->pause_cond);
-  g_mutex_unlock(&self->state_mutex);
+  const SampleFormat format = self->config->output_format;
+  const size_t samples = frames * self->pa_spec.channels;
+  const size_t start = chunk->size();
+  chunk->resize(start + samples * sample_format_bytes(format));
+  self->output_dither->convert(data, SampleFormat::kS16, chunk->data() + start, format, samples);
+}
 
-  if (was_recording && self->record_thread_handle)
+// Capture time of output frame [frame] (session rate, counted since the
+// connection): back through the DSP delay and the resampler to the capture
+// clock, whose frames the resampler output is aligned with.
+static int64_t output_time_ns(RecordLinuxPlugin *self, double frame)
+{
+  if (self->dsp->enabled())
   {
-    g_thread_join(self->record_thread_handle);
-    self->record_thread_handle = nullptr;
+    frame -= (double)self->dsp->latency_frames();
   }
-
-  disconnect_from_pulse(self);
-  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+  return self->capture_clock->time_of(frame * self->config->capture_sample_rate / self->pa_spec.rate);
 }
 
-FlMethodResponse *cancel_recording(RecordLinuxPlugin *self)
+// Starts an "audioData" chunk of [frames] with its header, the first frame
+// being output frame [output_frame]. Reserved for the samples to follow in
+// the same allocation. Called with sink_mutex held.
+static std::vector<uint8_t> *new_audio_chunk(RecordLinuxPlugin *self, size_t frames,
+                                             double output_frame, uint16_t flags)
 {
-  bool fileMode = !self->is_stream_mode;
-  FlMethodResponse *stopResp;
-  if (fileMode)
+  AudioChunkHeader header;
+  header.size = sizeof(header);
+  header.flags = flags;
+  if (self->capture_clock->settled())
   {
-    stopResp = stop_recording_file(self);
+    header.flags |= AudioChunkHeader::kSettled;
   }
-  else
+  if (self->stream_gap)
   {
-    stopResp = stop_recording_stream(self);
+    header.flags |= AudioChunkHeader::kGap;
+    self->stream_gap = false;
   }
+  header.frames = (uint32_t)frames;
+  header.first_frame = self->stream_frames;
+  header.time_ns = output_time_ns(self, output_frame);
+  header.drift_ppm = self->capture_clock->drift_ppm();
+  self->stream_frames += (int64_t)frames;
+
+  auto *chunk = new std::vector<uint8_t>();
+  chunk->reserve(sizeof(header) +
+                 frames * self->pa_spec.channels * sample_format_bytes(self->config->output_format));
+  chunk->resize(sizeof(header));
+  memcpy(chunk->data(), &header, sizeof(header));
+  return chunk;
+}
 
-  if (fileMode && !self->file_path.empty())
+// Sends PCM bytes to Dart ("audioData"). Takes ownership of [chunk].
+static void send_audio_data(RecordLinuxPlugin *self, std::vector<uint8_t> *chunk)
+{
+  auto send_chunk = [](gpointer data) -> gboolean
   {
-    remove(self->file_path.c_str());
-    self->file_path.clear();
-  }
+    auto pair = static_cast<std::pair<RecordLinuxPlugin *, std::vector<uint8_t> *> *>(data);
+    RecordLinuxPlugin *plugin = pair->first;
+    std::vector<uint8_t> *bytesVec = pair->second;
+
+    FlValue *typed_data = fl_value_new_uint8_list(bytesVec->data(), bytesVec->size());
+    fl_method_channel_invoke_method(plugin->channel,
+                                    "audioData",
+                                    typed_data,
+                                    nullptr,
+                                    nullptr,
+                                    nullptr);
+
+    delete bytesVec;
+    delete pair;
+    return G_SOURCE_REMOVE;
+  };
 
-  return stopResp;
+  auto *pair = new std::pair<RecordLinuxPlugin *, std::vector<uint8_t> *>(self, chunk);
+  g_idle_add_full(G_PRIORITY_DEFAULT, send_chunk, pair, nullptr);
 }
 
-FlMethodResponse *pause_recording(RecordLinuxPlugin *self)
+// Sends one encoded stream payload to Dart ("audioPacket"), from any
+// thread. Takes ownership of [data].
+static void send_audio_packet(RecordLinuxPlugin *self, std::vector<uint8_t> *data,
+                              int64_t pts_us, int64_t duration_us)
 {
-  g_mutex_lock(&self->state_mutex);
-  if (!self->is_recording)
-  {
-    g_mutex_unlock(&self->state_mutex);
-    return (FlMethodResponse *)fl_method_error_response_new(
-        "not_recording", "No active recording session to pause.", nullptr);
-  }
-  self->is_paused = true;
-  g_mutex_unlock(&self->state_mutex);
-
-  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+  FlValue *args = fl_value_new_map();
+  fl_value_set_string_take(args, "data", fl_value_new_uint8_list(data->data(), data->size()));
+  fl_value_set_string_take(args, "ptsUs", fl_value_new_int(pts_us));
+  fl_value_set_string_take(args, "durationUs", fl_value_new_int(duration_us));
+  invoke_method_on_main(self, "audioPacket", args);
+  delete data;
 }
 
-FlMethodResponse *resume_recording(RecordLinuxPlugin *self)
+// Hands up to [frames] of pre-roll history to the sinks in one bulk write,
+// ahead of the [chunk_frames] just captured, output frame [output_frame].
+// Called with sink_mutex held.
+static void flush_pre_roll(RecordLinuxPlugin *self, size_t frames, size_t chunk_frames,
+                           uint64_t output_frame)
 {
-  g_mutex_lock(&self->state_mutex);
-  if (!self->is_recording)
+  PreRollRing::Span first, second;
+  frames = self->pre_roll->last(frames, &first, &second);
+  if (frames == 0)
+    return;
+
+  // History is not gated, but stays in the timing map and event clock.
+  if (self->vad)
   {
-    g_mutex_unlock(&self->state_mutex);
-    return (FlMethodResponse *)fl_method_error_response_new(
-        "not_recording", "No active recording session to resume.", nullptr);
+    const uint64_t history_us = (uint64_t)(frames + chunk_frames) * 1000000ull / self->pa_spec.rate;
+    self->vad->reset(g_get_real_time() - (int64_t)history_us);
+    self->vad->pass_through(frames);
   }
-  self->is_paused = false;
-  g_cond_broadcast(&self->pause_cond);
-  g_mutex_unlock(&self->state_mutex);
 
-  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
-}
+  if (self->config->waveform_peaks)
+  {
+    self->waveform->add_s16((const int16_t *)first.data, first.frames);
+    self->waveform->add_s16((const int16_t *)second.data, second.frames);
+  }
 
-FlMethodResponse *list_input_devices(RecordLinuxPlugin *self)
-{
-  // Not implemented => return empty list
-  FlValue *devices = fl_value_new_list();
-  return FL_METHOD_RESPONSE(fl_method_success_response_new(devices));
+  if (!self->state->has(RecorderState::kStream))
+  {
+    if (self->file_writer)
+    {
+      self->file_writer->write_s16((const int16_t *)first.data, first.frames);
+      self->file_writer->write_s16((const int16_t *)second.data, second.frames);
+    }
+  }
+  else if (self->stream_encoder)
+  {
+    self->stream_encoder->write_s16((const int16_t *)first.data, first.frames);
+    self->stream_encoder->write_s16((const int16_t *)second.data, second.frames);
+  }
+  else
+  {
+    auto *chunk = new_audio_chunk(self, frames, (double)output_frame - (double)frames,
+                                  AudioChunkHeader::kPreRoll);
+    append_pcm(self, chunk, first.data, first.frames);
+    append_pcm(self, chunk, second.data, second.frames);
+    send_audio_data(self, chunk);
+  }
 }
 
-FlMethodResponse *is_encoder_supported(RecordLinuxPlugin *self, const gchar *encoder)
+// Completes the file of the session and writes its sidecars.
+static void finish_file(RecordLinuxPlugin *self, bool was_recording)
 {
-  bool supported = false;
-  if (encoder && strcmp(encoder, "wav") == 0)
+  if (self->file_writer)
   {
-    supported = true;
-  }
+    if (!self->file_writer->close())
+    {
+      g_warning("Failed to complete %s", self->file_path.c_str());
+    }
+    delete self->file_writer;
+    self->file_writer = nullptr;
+  }
+
+  if (was_recording && self->config->waveform_peaks)
+  {
+    self->waveform->flush();
+    publish_waveform(self);
+
+    std::string peaks_path = self->file_path + ".peaks";
+    if (!self->waveform->write_sidecar(peaks_path.c_str()))
+    {
+      g_warning("Failed to write waveform peaks to %s", peaks_path.c_str());
+    }
+  }
+
+  if (was_recording && self->config->vad_mode == "gate")
+  {
+    std::string map_path = self->file_path + ".vad.json";
+    if (!self->vad->write_timing_map(map_path.c_str()))
+    {
+      g_warning("Failed to write VAD timing map to %s", map_path.c_str());
+    }
+  }
+}
+
+// Sends a VOX take start/end to Dart.
+static void publish_vox_take(RecordLinuxPlugin *self, bool started)
+{
+  FlValue *args = fl_value_new_map();
+  fl_value_set_string_take(args, "index", fl_value_new_int(self->vox_take));
+  fl_value_set_string_take(args, "path", fl_value_new_string(self->file_path.c_str()));
+  fl_value_set_string_take(args, "started", fl_value_new_bool(started));
+  invoke_method_on_main(self, "voxTake", args);
+}
+
+// Opens the file of the next VOX take from the capture thread, with the
+// pre-roll and the audio that triggered it. Called with sink_mutex held.
+static void open_vox_take(RecordLinuxPlugin *self)
+{
+  self->vox_take++;
+  self->file_path = vox_take_path(self->vox_path, self->vox_take);
+  if (!open_file_writer(self, self->file_path, self->vox_take))
+  {
+    g_warning("Failed to open VOX take %s", self->file_path.c_str());
+    return;
+  }
+
+  if (self->config->waveform_peaks)
+  {
+    self->waveform->reset();
+  }
+  if (self->vad)
+  {
+    self->vad->reset(g_get_real_time());
+  }
+
+  const uint64_t pre_roll_frames = (uint64_t)self->config->pre_roll_ms * self->pa_spec.rate / 1000;
+  self->state->update_flags(0, RecorderState::kStream);
+  // No more than the ring holds (none with preRollBufferMs: 0).
+  self->pre_roll_pending = (size_t)std::min<uint64_t>(
+      pre_roll_frames + self->vox->min_duration_frames(), self->pre_roll->capacity());
+  self->sink_active = true;
+
+  publish_vox_take(self, true);
+}
+
+// Completes the current VOX take. Called with sink_mutex held.
+static void close_vox_take(RecordLinuxPlugin *self)
+{
+  if (!self->sink_active)
+    return;
+
+  self->sink_active = false;
+  self->pre_roll_pending = 0;
+  finish_file(self, true);
+  publish_vox_take(self, false);
+}
+
+// Corks or uncorks the capture and reference streams, on the capture thread.
+// Returns false when the capture stream failed.
+static bool set_capture_corked(RecordLinuxPlugin *self, bool corked, int *error)
+{
+  if (self->ref_pa_handle && !self->ref_pa_handle->set_corked(corked, error))
+  {
+    g_warning("Echo reference %s failed: %s", corked ? "cork" : "uncork", pa_strerror(*error));
+  }
+  if (!self->pa_handle->set_corked(corked, error))
+    return false;
+  // The time corked is no loss.
+  if (!corked)
+  {
+    self->xrun->restart();
+  }
+  return true;
+}
+
+// Reference frames matching the [frames] just captured, or nullptr when the
+// reference stream has not delivered that many.
+static const int16_t *read_reference(RecordLinuxPlugin *self, size_t frames)
+{
+  if (frames * sizeof(int16_t) > sizeof(self->ref_buffer) ||
+      self->ref_pending->take(self->ref_buffer, frames) == 0)
+    return nullptr;
+  return (const int16_t *)self->ref_buffer;
+}
+
+static void report_dropout(RecordLinuxPlugin *self, SampleFormat capture_format,
+                           uint64_t frames, uint32_t word);
+
+// Runs [captured] frames of [capture], in [capture_format] with the device
+// rate and channels, through conversion, DSP and the sinks. [word] is the
+// recorder state when they were read, [gap_frames] the frames lost just
+// before them and [time_ns] the capture time of the first (0 if unknown).
+// Called by the capture thread, or on the session queue with the
+// event-loop engine.
+static void process_capture(RecordLinuxPlugin *self, const uint8_t *capture,
+                            SampleFormat capture_format, size_t captured, uint32_t word,
+                            uint64_t gap_frames, int64_t time_ns)
+{
+  // Whatever was lost before this chunk goes first.
+  if (gap_frames > 0)
+  {
+    report_dropout(self, capture_format, gap_frames, word);
+  }
+  self->capture_clock->update(time_ns, captured);
+
+  const bool armed = (word & RecorderState::kArmed) != 0;
+  const bool vox = (word & RecorderState::kVox) != 0;
+  const size_t channels = self->pa_spec.channels;
+  const size_t frame_bytes = channels * sizeof(int16_t);
+
+  // Only the session channels go further
+  if (self->matrix)
+  {
+    capture = self->matrix->process(capture, capture_format, captured);
+    capture_format = self->matrix->output_format(capture_format);
+  }
+
+  // Converted to S16 at the session rate unless captured as such
+  size_t frames = captured;
+  if (self->resampler)
+  {
+    self->resampled->clear();
+    self->resampler->process(capture, capture_format, captured, self->resampled);
+    frames = self->resampled->size() / channels;
+    self->capture_dither->convert(self->resampled->data(), SampleFormat::kF32, self->buffer,
+                                  SampleFormat::kS16, frames * channels);
+  }
+  else if (capture != self->buffer)
+  {
+    self->capture_dither->convert(capture, capture_format, self->buffer, SampleFormat::kS16,
+                                  frames * channels);
+  }
+  const size_t chunk_bytes = frames * frame_bytes;
+  const uint64_t output_frame = self->converted_frames;
+  self->converted_frames += frames;
+  if (frames == 0)
+    return; // filter still filling up
+
+  // In-place DSP between capture and sinks
+  if (self->dsp->enabled())
+  {
+    self->dsp->process_s16((int16_t *)self->buffer, read_reference(self, frames), frames);
+  }
+
+  // Metered at the capture precision unless processed
+  const float level_db = self->dsp->enabled()
+                             ? self->meter->process_s16((const int16_t *)self->buffer,
+                                                        frames * channels)
+                             : self->meter->process(capture, capture_format,
+                                                    captured * channels);
+  const VoxTrigger::Action vox_action =
+      vox ? self->vox->update(level_db, frames) : VoxTrigger::kNone;
+
+  g_mutex_lock(&self->sink_mutex);
+
+  if (vox_action == VoxTrigger::kStart)
+  {
+    open_vox_take(self);
+  }
+
+  // Session just started while armed: history first, then this chunk.
+  if (self->sink_active && self->pre_roll_pending > 0)
+  {
+    flush_pre_roll(self, self->pre_roll_pending, frames, output_frame);
+    self->pre_roll_pending = 0;
+  }
+  if (armed)
+  {
+    self->pre_roll->write(self->buffer, frames);
+  }
+
+  if (!self->sink_active)
+  {
+    g_mutex_unlock(&self->sink_mutex);
+    return;
+  }
+
+  // Voice activity: events, and optionally silence trimming
+  const uint8_t *sink_data = self->buffer;
+  size_t sink_bytes = chunk_bytes;
+  double sink_frame = (double)output_frame;
+  if (self->vad)
+  {
+    const int16_t *voiced = nullptr;
+    size_t voiced_frames = self->vad->process((const int16_t *)self->buffer, frames, &voiced);
+    sink_data = (const uint8_t *)voiced;
+    sink_bytes = voiced_frames * frame_bytes;
+
+    // Trimmed output starts wherever the kept speech (or its pre-roll)
+    // does: back through the gate's timing map, whose capture frames are
+    // this chunk's shifted.
+    uint64_t gate_frame;
+    if (voiced_frames > 0 && sink_data != self->buffer &&
+        self->vad->capture_frame_of(self->vad->output_frames() - voiced_frames, &gate_frame))
+    {
+      sink_frame = (double)output_frame + (double)gate_frame -
+                   (double)(self->vad->capture_frames() - frames);
+    }
+
+    for (size_t i = 0; i < self->vad->event_count(); i++)
+    {
+      publish_vad_event(self, self->vad->event(i));
+    }
+  }
+
+  if (self->config->waveform_peaks)
+  {
+    WaveformPyramid *waveform = self->waveform;
+    waveform->add_s16((const int16_t *)sink_data, sink_bytes / frame_bytes);
+    if (waveform->bucket_count(0) - waveform->published(0) >= K_WAVEFORM_PUBLISH_BUCKETS)
+    {
+      publish_waveform(self);
+    }
+  }
+
+  if (!self->state->has(RecorderState::kStream))
+  {
+    // File-based
+    if (self->file_writer && sink_bytes > 0)
+    {
+      self->file_writer->write_s16((const int16_t *)sink_data, sink_bytes / frame_bytes);
+    }
+  }
+  else if (sink_bytes > 0)
+  {
+    // Stream-based => send data back to Dart, encoded or as is
+    if (self->stream_encoder)
+    {
+      self->stream_encoder->write_s16((const int16_t *)sink_data, sink_bytes / frame_bytes);
+    }
+    else
+    {
+      auto *chunk = new_audio_chunk(self, sink_bytes / frame_bytes, sink_frame, 0);
+      append_pcm(self, chunk, sink_data, sink_bytes / frame_bytes);
+      send_audio_data(self, chunk);
+    }
+  }
+
+  if (self->start_latency_us < 0 && self->start_call_us > 0)
+  {
+    self->start_latency_us = g_get_monotonic_time() - self->start_call_us;
+  }
+
+  if (vox_action == VoxTrigger::kStop)
+  {
+    close_vox_take(self);
+  }
+
+  g_mutex_unlock(&self->sink_mutex);
+}
+
+// Audio lost before the chunk about to be processed: counted, told to Dart
+// and, with fillDropouts, replaced with as much silence, run through the
+// pipeline like any capture so that the outputs stay in time.
+static void report_dropout(RecordLinuxPlugin *self, SampleFormat capture_format,
+                           uint64_t frames, uint32_t word)
+{
+  const bool fill = self->config->fill_dropouts;
+  __atomic_add_fetch(&self->dropouts, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&self->dropout_frames, frames, __ATOMIC_RELAXED);
+
+  FlValue *args = fl_value_new_map();
+  fl_value_set_string_take(args, "droppedFrames", fl_value_new_int((int64_t)frames));
+  fl_value_set_string_take(args, "durationUs",
+                           fl_value_new_int((int64_t)(frames * 1000000 / self->config->capture_sample_rate)));
+  fl_value_set_string_take(args, "filled", fl_value_new_bool(fill));
+  invoke_method_on_main(self, "dropout", args);
+
+  if (!fill)
+  {
+    self->capture_clock->skip(frames);
+    g_mutex_lock(&self->sink_mutex);
+    self->stream_gap = true;
+    g_mutex_unlock(&self->sink_mutex);
+    return;
+  }
+
+  // U8 is offset binary, the other formats are silent at zero.
+  memset(self->silence_buffer, capture_format == SampleFormat::kU8 ? 0x80 : 0,
+         sizeof(self->silence_buffer));
+  for (uint64_t left = frames; left > 0;)
+  {
+    const size_t n = (size_t)std::min<uint64_t>(left, self->capture_frames);
+    process_capture(self, self->silence_buffer, capture_format, n, word, 0, 0);
+    left -= n;
+  }
+  __atomic_add_fetch(&self->filled_frames, frames, __ATOMIC_RELAXED);
+}
+
+// The capture stream failed and delivers nothing more: flagged, so that the
+// session no longer reports as recording, and told to Dart, which ends it.
+// Reported once per connection.
+static void report_capture_failure(RecordLinuxPlugin *self, int error)
+{
+  const uint32_t word = self->state->update_flags(RecorderState::kFailed, RecorderState::kWarm);
+  if (word & RecorderState::kFailed)
+    return;
+  g_warning("PulseAudio capture failed: %s", pa_strerror(error));
+
+  // Warm between sessions, there is nothing to end: the next start connects again.
+  if (RecorderState::state_of(word) == RecorderState::kIdle && (word & RecorderState::kArmed) == 0)
+    return;
+
+  FlValue *args = fl_value_new_map();
+  fl_value_set_string_take(args, "code", fl_value_new_int(error));
+  fl_value_set_string_take(args, "message", fl_value_new_string(pa_strerror(error)));
+  invoke_method_on_main(self, "captureError", args);
+}
+
+// Backoff between reconnection attempts, doubled up to the maximum.
+static const int64_t K_RECONNECT_FIRST_US = 100000;
+static const int64_t K_RECONNECT_MAX_US = 2000000;
+
+// Whether the capture serves a session (recording, paused or armed for
+// pre-roll), which a reconnection keeps going.
+static bool capture_in_session(uint32_t word)
+{
+  const RecorderState::State state = RecorderState::state_of(word);
+  return state == RecorderState::kRecording || state == RecorderState::kPausing ||
+         state == RecorderState::kPaused || (word & RecorderState::kArmed) != 0;
+}
+
+// Opens the lost capture again, to [device] (nullptr for the default
+// source), with the spec and chunks of the connection.
+static bool reopen_capture(RecordLinuxPlugin *self, const char *device, int *error)
+{
+  const pa_sample_spec spec = capture_sample_spec(self);
+  const size_t chunk_bytes = self->capture_frames * pa_frame_size(&spec);
+  if (self->engine_capture)
+    return open_engine_capture(self, device, spec, chunk_bytes, error);
+  return self->pa_handle->open(device, "recording", spec, chunk_bytes, error);
+}
+
+// The capture was lost with [error] at [lost_us]: with reconnect, and while
+// a session uses it, connected again with backoff, alternately to the
+// session device and the fallback, until it works or the session ends.
+// The file or stream stays open meanwhile. The outage (the time not
+// paused) goes to recovered_gap_frames before each attempt, to be passed
+// as the gap before the first chunk of the new stream, after those read
+// before the loss, and filled like any dropout. Told to Dart
+// ("captureRecovered"). Returns false when not enabled or when the session
+// ended first, the capture then marked failed without a report.
+static bool recover_capture(RecordLinuxPlugin *self, int error, int64_t lost_us)
+{
+  uint32_t word = self->state->load();
+  if (!self->config->reconnect || !capture_in_session(word))
+    return false;
+  g_warning("PulseAudio capture lost: %s, reconnecting", pa_strerror(error));
+
+  const std::string primary = self->config->device_id;
+  const std::string fallback = self->config->fallback_device_id;
+  int64_t gap_us = 0;
+  int64_t counted_since_us = lost_us; // -1 while paused
+  int64_t backoff_us = K_RECONNECT_FIRST_US;
+  int attempts = 0;
+  bool fell_back = false;
+  while (true)
+  {
+    word = self->state->load();
+    if (!capture_in_session(word))
+    {
+      self->state->update_flags(RecorderState::kFailed, RecorderState::kWarm);
+      return false;
+    }
+    // Nothing left to cork: the pause holds at once.
+    const RecorderState::State state = RecorderState::state_of(word);
+    if (state == RecorderState::kPausing)
+    {
+      self->state->transition(RecorderState::mask(RecorderState::kPausing), RecorderState::kPaused);
+      continue;
+    }
+
+    // Paused time is no loss.
+    const int64_t now_us = g_get_monotonic_time();
+    const bool paused = state == RecorderState::kPaused;
+    if (paused && counted_since_us >= 0)
+    {
+      gap_us += now_us - counted_since_us;
+      counted_since_us = -1;
+    }
+    else if (!paused && counted_since_us < 0)
+    {
+      counted_since_us = now_us;
+    }
+    const int64_t outage_us = gap_us + (counted_since_us >= 0 ? now_us - counted_since_us : 0);
+    __atomic_store_n(&self->recovered_gap_frames,
+                     (uint64_t)(outage_us * self->config->capture_sample_rate / 1000000),
+                     __ATOMIC_RELAXED);
+
+    // Every other attempt on the fallback, the default source unless set.
+    const bool use_fallback = attempts % 2 == 1 && fallback != primary;
+    const std::string &device = use_fallback ? fallback : primary;
+    attempts++;
+    if (reopen_capture(self, device.empty() ? nullptr : device.c_str(), &error))
+    {
+      gap_us = outage_us;
+      fell_back = use_fallback;
+      break;
+    }
+
+    // A stop, pause or resume cuts the wait short.
+    self->state->wait_for(word, backoff_us);
+    backoff_us = std::min(backoff_us * 2, K_RECONNECT_MAX_US);
+  }
+
+  // Paused meanwhile: stopped on the server like any pause.
+  if (RecorderState::state_of(self->state->load()) == RecorderState::kPaused)
+  {
+    if (self->engine_capture)
+      self->engine_capture->set_corked(true, nullptr);
+    else
+      self->pa_handle->set_corked(true, &error);
+  }
+  if (self->pa_handle)
+  {
+    self->xrun->restart();
+  }
+
+  __atomic_add_fetch(&self->reconnects, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&self->reconnect_gap_us, gap_us, __ATOMIC_RELAXED);
+  const std::string &device = fell_back ? fallback : primary;
+  g_message("PulseAudio capture reconnected to %s after %d attempts, %lld ms lost",
+            device.empty() ? "the default source" : device.c_str(), attempts,
+            (long long)(gap_us / 1000));
+
+  FlValue *args = fl_value_new_map();
+  fl_value_set_string_take(args, "gapUs", fl_value_new_int(gap_us));
+  fl_value_set_string_take(args, "attempts", fl_value_new_int(attempts));
+  fl_value_set_string_take(args, "deviceId", fl_value_new_string(device.c_str()));
+  fl_value_set_string_take(args, "fallback", fl_value_new_bool(fell_back));
+  invoke_method_on_main(self, "captureRecovered", args);
+  return true;
+}
+
+struct RecoverJob
+{
+  RecordLinuxPlugin *self;
+  int error;
+  int64_t lost_us;
+};
+
+static gpointer recover_thread_func(gpointer data)
+{
+  RecoverJob *job = static_cast<RecoverJob *>(data);
+  if (!recover_capture(job->self, job->error, job->lost_us))
+  {
+    report_capture_failure(job->self, job->error);
+  }
+  delete job;
+  return nullptr;
+}
+
+// The event-loop capture failed, on the session queue. Reconnected on a
+// thread of its own, since reopening drains this queue.
+static void handle_engine_failure(RecordLinuxPlugin *self, int error)
+{
+  if (!self->config->reconnect || !capture_in_session(self->state->load()))
+  {
+    report_capture_failure(self, error);
+    return;
+  }
+
+  RecoverJob *job = new RecoverJob{self, error, g_get_monotonic_time()};
+  g_mutex_lock(&self->sink_mutex);
+  GThread *previous = self->recover_thread_handle;
+  self->recover_thread_handle = g_thread_new("record_recover", recover_thread_func, job);
+  g_mutex_unlock(&self->sink_mutex);
+  // Past its reconnection, or this stream would not have failed.
+  if (previous)
+  {
+    g_thread_join(previous);
+  }
+}
+
+// Joins the reconnection of the event-loop capture, if any. It gives up
+// once the session ends.
+static void join_recover_thread(RecordLinuxPlugin *self)
+{
+  g_mutex_lock(&self->sink_mutex);
+  GThread *thread = self->recover_thread_handle;
+  self->recover_thread_handle = nullptr;
+  g_mutex_unlock(&self->sink_mutex);
+  if (thread)
+  {
+    g_thread_join(thread);
+  }
+}
+
+// A chunk of the event-loop engine, on the session queue.
+static void process_engine_chunk(RecordLinuxPlugin *self, const uint8_t *data, size_t captured,
+                                 SampleFormat capture_format, uint64_t gap_frames, int64_t time_ns)
+{
+  // Read before the pause or stop reached the server: not part of the session.
+  const uint32_t word = self->state->load();
+  if (RecorderState::state_of(word) != RecorderState::kRecording)
+    return;
+  gap_frames += __atomic_exchange_n(&self->recovered_gap_frames, 0, __ATOMIC_RELAXED);
+  process_capture(self, data, capture_format, captured, word, gap_frames, time_ns);
+}
+
+static int64_t current_thread_cpu_us()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Corks or uncorks the event-loop capture, without waiting. The session is
+// paused once the cork is acknowledged, after the chunks read before it.
+static void set_engine_corked(RecordLinuxPlugin *self, bool corked)
+{
+  if (self->engine_ref_capture)
+  {
+    self->engine_ref_capture->set_corked(corked, nullptr);
+  }
+  if (!corked)
+  {
+    self->engine_capture->set_corked(false, nullptr);
+    return;
+  }
+  RecorderState *state = self->state;
+  self->engine_capture->set_corked(true, [state]
+                                   { state->transition(RecorderState::mask(RecorderState::kPausing),
+                                                       RecorderState::kPaused); });
+}
+
+// ---------------------------------------------------------------------------
+// 6) The background recording thread logic (unchanged from your snippet)
+// ---------------------------------------------------------------------------
+static gpointer record_thread_func(gpointer user_data)
+{
+  RecordLinuxPlugin *self = (RecordLinuxPlugin *)user_data;
+  int error = 0;
+
+  g_mutex_lock(&self->sink_mutex);
+  self->thread_started_us = g_get_monotonic_time();
+  g_mutex_unlock(&self->sink_mutex);
+  __atomic_store_n(&self->thread_cpu_us, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&self->thread_wakeups, 0, __ATOMIC_RELAXED);
+
+  // Opt-in real-time scheduling, with what the loop touches kept in RAM.
+  // The scheduling latency is measured either way, for a comparison.
+  RealtimeThread *realtime = self->realtime;
+  realtime->enter(self->config->realtime_policy, self->config->realtime_priority,
+                  self->config->cpu_affinity);
+  realtime->lock(self->capture_ring->memory(), self->capture_ring->memory_bytes());
+  realtime->lock(self->capture_buffer, sizeof(self->capture_buffer));
+  realtime->lock(self->ref_capture_buffer, sizeof(self->ref_capture_buffer));
+  realtime->lock(self->state, sizeof(*self->state));
+  realtime->rebase(self->pa_handle->wakeups());
+
+  // Frames lost since the last chunk published, passed on with the next.
+  self->xrun->restart();
+  uint64_t gap_frames = 0;
+  uint64_t ref_due = 0; // reference frames owed, times the capture rate
+  int failure = 0;
+  int64_t last_read_us = g_get_monotonic_time(); // end of the audio read so far
+
+  while (true)
+  {
+    // One load per chunk; control calls never wait on this thread.
+    const uint32_t word = self->state->load();
+    const RecorderState::State state = RecorderState::state_of(word);
+    const bool armed = (word & RecorderState::kArmed) != 0;
+
+    if (state == RecorderState::kPausing)
+    {
+      // The read in flight is done and ends the session audio: stop the
+      // server side capture, then acknowledge and park.
+      if (!set_capture_corked(self, true, &error) &&
+          !recover_capture(self, error, g_get_monotonic_time()))
+      {
+        failure = error;
+        break;
+      }
+      self->state->transition(RecorderState::mask(RecorderState::kPausing),
+                              RecorderState::kPaused);
+      continue;
+    }
+    if (state == RecorderState::kPaused)
+    {
+      self->state->wait(word);
+      realtime->rebase(self->pa_handle->wakeups());
+      continue;
+    }
+    if (state != RecorderState::kRecording && !armed)
+    {
+      if ((word & RecorderState::kWarm) == 0)
+        break;
+
+      // Warm between sessions: corked and parked until the next start.
+      if (!self->pa_handle->corked() && !set_capture_corked(self, true, &error))
+      {
+        failure = error;
+        break;
+      }
+      self->state->wait(word);
+      realtime->rebase(self->pa_handle->wakeups());
+      continue;
+    }
+
+    // Resumed (or back to pre-roll): the next read is fresh audio.
+    if (self->pa_handle->corked())
+    {
+      if (!set_capture_corked(self, false, &error))
+      {
+        if (!recover_capture(self, error, g_get_monotonic_time()))
+        {
+          failure = error;
+          break;
+        }
+        continue;
+      }
+      last_read_us = g_get_monotonic_time();
+    }
+
+    // Read from PulseAudio into the next slot of the ring. When the pool is
+    // that far behind, the chunk is read all the same, to keep the server
+    // side from overrunning, and dropped.
+    const size_t capture_frame_bytes =
+        (size_t)self->config->device_channels * sample_format_bytes(self->config->capture_format);
+    const size_t read_bytes = self->capture_frames * capture_frame_bytes;
+    uint8_t *slot = self->capture_ring->reserve();
+    const size_t r = self->pa_handle->read(slot ? slot : self->capture_buffer, read_bytes, &error);
+    if (r < read_bytes && error != PulseCapture::kInterrupted)
+    {
+      // Lost (server gone, device unplugged): what the pool still has goes
+      // to the sinks while this reconnects, the outage after it.
+      if (!recover_capture(self, error, last_read_us))
+      {
+        failure = error;
+        break;
+      }
+      continue;
+    }
+
+    // Cut short by stop or pause: the frames before the request still count.
+    const size_t captured = r / capture_frame_bytes;
+    if (captured == 0)
+      continue;
+
+    // Audio already waiting once the chunk is in: more than a chunk of it
+    // means the thread ran late. Audio that should be and is not means the
+    // server overran.
+    const int64_t rate = self->config->capture_sample_rate;
+    const size_t backlog_frames = self->pa_handle->backlog_bytes() / capture_frame_bytes;
+    realtime->sample((int64_t)backlog_frames * 1000000 / rate,
+                     (int64_t)self->capture_frames * 1000000 / rate, self->pa_handle->wakeups());
+    last_read_us = g_get_monotonic_time();
+    gap_frames += self->xrun->update(last_read_us, captured, backlog_frames);
+    gap_frames += __atomic_exchange_n(&self->recovered_gap_frames, 0, __ATOMIC_RELAXED);
+
+    // The frame after the chunk was captured as long ago as the server
+    // reports, the chunk before it.
+    int64_t time_ns = 0;
+    int64_t delay_us = 0;
+    if (self->pa_handle->capture_delay_us(&delay_us))
+    {
+      struct timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      time_ns = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec - delay_us * 1000 -
+                (int64_t)captured * 1000000000 / rate;
+    }
+
+    // The echo reference goes with the chunk, read here: the stream has one
+    // owner thread, which corks it too. As many frames at the session rate
+    // as the chunk covers at the capture rate.
+    size_t ref_bytes = 0;
+    if (self->ref_pa_handle)
+    {
+      ref_due += (uint64_t)captured * self->pa_spec.rate;
+      const size_t ref_frames = (size_t)(ref_due / (uint64_t)rate);
+      ref_due -= (uint64_t)ref_frames * (uint64_t)rate;
+      ref_bytes = std::min(ref_frames * sizeof(int16_t), self->capture_ring->side_bytes());
+      uint8_t *ref = slot ? slot + self->capture_ring->slot_bytes() : self->ref_capture_buffer;
+      int ref_error = 0;
+      if (ref_bytes > 0 && self->ref_pa_handle->read(ref, ref_bytes, &ref_error) != ref_bytes)
+      {
+        ref_bytes = 0;
+      }
+    }
+
+    if (slot)
+    {
+      self->capture_ring->publish(captured * capture_frame_bytes, word, gap_frames, time_ns,
+                                  ref_bytes);
+      self->pool->signal(self->capture_source);
+      gap_frames = 0;
+    }
+    else
+    {
+      __atomic_add_fetch(&self->ring_dropped_bytes, captured * capture_frame_bytes, __ATOMIC_RELAXED);
+      gap_frames += captured;
+    }
+
+    __atomic_store_n(&self->thread_cpu_us, current_thread_cpu_us(), __ATOMIC_RELAXED);
+    __atomic_store_n(&self->thread_wakeups, self->pa_handle->wakeups(), __ATOMIC_RELAXED);
+    __atomic_store_n(&self->thread_hole_bytes, self->pa_handle->hole_bytes(), __ATOMIC_RELAXED);
+  }
+
+  realtime->leave();
+
+  // Gone, the capture cannot be kept warm: the next start connects again.
+  if (failure != 0)
+  {
+    report_capture_failure(self, failure);
+  }
+  self->state->update_flags(0, RecorderState::kWarm);
+  return nullptr;
+}
+
+// Processes the chunks the capture thread published, in order. Runs on the
+// pool, never concurrently with itself.
+static void drain_capture_ring(RecordLinuxPlugin *self)
+{
+  const SampleFormat capture_format = self->config->capture_format;
+  const size_t capture_frame_bytes =
+      (size_t)self->config->device_channels * sample_format_bytes(capture_format);
+  const uint8_t *data;
+  size_t bytes;
+  uint32_t word;
+  uint64_t gap_frames;
+  int64_t time_ns;
+  size_t ref_bytes;
+  while (self->capture_ring->front(&data, &bytes, &word, &gap_frames, &time_ns, &ref_bytes))
+  {
+    // The echo reference read along with the chunk.
+    if (ref_bytes > 0)
+    {
+      self->ref_pending->write(data + self->capture_ring->slot_bytes(), ref_bytes / sizeof(int16_t));
+    }
+    process_capture(self, data, capture_format, bytes / capture_frame_bytes, word, gap_frames,
+                    time_ns);
+    self->capture_ring->pop();
+  }
+}
+
+// Joins the capture thread, if any, then waits for the pool to process
+// what it handed over.
+static void join_capture_thread(RecordLinuxPlugin *self)
+{
+  join_recover_thread(self);
+  if (self->record_thread_handle)
+  {
+    g_thread_join(self->record_thread_handle);
+    self->record_thread_handle = nullptr;
+  }
+  if (self->pool)
+  {
+    self->pool->flush(self->capture_source);
+  }
+}
+
+// Prepares the sinks of a new session and hands them to the capture thread,
+// starting it unless it already runs for pre-roll.
+// When armed, [pre_roll_ms] of history are flushed before live audio.
+// [call_us] is the monotonic time of the start call.
+static void begin_session(RecordLinuxPlugin *self, bool stream, int pre_roll_ms, int64_t call_us)
+{
+  const bool armed = self->state->has(RecorderState::kArmed);
+
+  if (armed && self->config->waveform_peaks)
+  {
+    self->waveform->reset();
+  }
+  if (self->vad)
+  {
+    self->vad->reset(g_get_real_time());
+  }
+  self->meter->reset();
+
+  g_mutex_lock(&self->sink_mutex);
+  self->output_dither->configure(self->config->dither, self->pa_spec.channels);
+  self->state->update_flags(stream ? RecorderState::kStream : 0,
+                            stream ? 0 : RecorderState::kStream);
+  self->pre_roll_pending =
+      armed ? std::min((size_t)pre_roll_ms * self->pa_spec.rate / 1000, self->pre_roll->capacity())
+            : 0;
+  self->stream_frames = 0;
+  self->stream_gap = false;
+  self->start_call_us = call_us;
+  self->start_latency_us = -1;
+  self->sink_active = true;
+  g_mutex_unlock(&self->sink_mutex);
+
+  // Wakes a warm thread, which uncorks and reads. With the event-loop
+  // engine, the chunks from now on are processed.
+  self->state->transition(RecorderState::mask(RecorderState::kStarting), RecorderState::kRecording);
+  if (!self->record_thread_handle && !self->engine_capture)
+  {
+    self->record_thread_handle = g_thread_new("record_thread", record_thread_func, self);
+  }
+}
+
+// Undoes prepare_capture() when the sinks could not be set up.
+static void abort_session(RecordLinuxPlugin *self)
+{
+  // A connection made for this start goes; one held by a capture thread
+  // (warm or armed) stays.
+  if (!self->record_thread_handle)
+  {
+    self->state->update_flags(0, RecorderState::kWarm);
+    disconnect_from_pulse(self);
+  }
+  self->state->transition(RecorderState::mask(RecorderState::kStarting), RecorderState::kIdle);
+}
+
+// Takes the sinks back from the capture thread. The thread is joined unless
+// it keeps running for pre-roll or parks warm; [keep_capture] tells which.
+// Runs on the stop worker, the state stays stopping until the session is
+// finalized.
+static void end_session(RecordLinuxPlugin *self, bool keep_capture)
+{
+  // The chunks read before the stop go to the sinks first.
+  if (!keep_capture)
+  {
+    join_capture_thread(self);
+  }
+  else
+  {
+    self->pool->flush(self->capture_source);
+  }
+
+  // Once released, the pool no longer touches the file or stream.
+  g_mutex_lock(&self->sink_mutex);
+  self->sink_active = false;
+  self->pre_roll_pending = 0;
+  g_mutex_unlock(&self->sink_mutex);
+
+  // Likewise once the chunks queued are processed, and the stream no
+  // longer reopened.
+  join_recover_thread(self);
+  if (self->engine_capture)
+  {
+    self->engine_capture->close();
+  }
+  if (self->engine_ref_capture)
+  {
+    self->engine_ref_capture->close();
+  }
+}
+
+// Completes a stream session once the capture thread let go of it.
+static void finish_stream(RecordLinuxPlugin *self, bool was_recording)
+{
+  // Emit what the encoder still holds.
+  if (self->stream_encoder)
+  {
+    self->stream_encoder->close();
+    delete self->stream_encoder;
+    self->stream_encoder = nullptr;
+  }
+
+  if (was_recording && self->config->waveform_peaks)
+  {
+    self->waveform->flush();
+    publish_waveform(self);
+  }
+}
+
+// Deletes the file of a cancelled session and its side files.
+static void remove_recording(RecordLinuxPlugin *self)
+{
+  if (self->file_path.empty())
+    return;
+
+  remove(self->file_path.c_str());
+  if (self->config->waveform_peaks)
+  {
+    remove((self->file_path + ".peaks").c_str());
+  }
+  if (self->config->vad_mode == "gate")
+  {
+    remove((self->file_path + ".vad.json").c_str());
+  }
+  self->file_path.clear();
+}
+
+// A stop, cancel or disarm finalized by stop_thread_func.
+struct StopJob
+{
+  RecordLinuxPlugin *self;   // referenced
+  FlMethodCall *method_call; // referenced
+  GThread *previous;         // stop worker still running, joined first
+  bool stream;
+  bool cancel;
+  bool was_recording;
+  bool keep_capture; // armed or warm: the capture thread stays
+  bool idle;         // nothing to stop: only answered after [previous]
+  bool disarm;       // pre-roll or VOX capture ended between sessions
+  bool vox;          // with [disarm], the take in progress is closed
+};
+
+static gpointer stop_thread_func(gpointer data)
+{
+  StopJob *job = static_cast<StopJob *>(data);
+  RecordLinuxPlugin *self = job->self;
+
+  if (job->previous)
+  {
+    g_thread_join(job->previous);
+  }
+
+  FlValue *result = nullptr;
+  if (job->disarm)
+  {
+    join_capture_thread(self);
+    if (job->vox)
+    {
+      // The take in progress ends here.
+      g_mutex_lock(&self->sink_mutex);
+      close_vox_take(self);
+      g_mutex_unlock(&self->sink_mutex);
+      result = fl_value_new_int(self->vox_take);
+    }
+  }
+  else if (job->idle)
+  {
+    if (!job->stream)
+    {
+      result = fl_value_new_string(self->file_path.c_str());
+    }
+  }
+  else if (job->stream)
+  {
+    end_session(self, job->keep_capture);
+    finish_stream(self, job->was_recording);
+  }
+  else
+  {
+    end_session(self, job->keep_capture);
+    finish_file(self, job->was_recording);
+    result = fl_value_new_string(self->file_path.c_str());
+  }
+
+  if (!job->idle)
+  {
+    if (!job->keep_capture)
+    {
+      disconnect_from_pulse(self);
+    }
+    if (job->cancel && !job->stream)
+    {
+      remove_recording(self);
+    }
+
+    // Ready for the next session before Dart hears about it.
+    self->state->transition(RecorderState::mask(RecorderState::kStopping), RecorderState::kIdle);
+  }
+
+  auto respond = [](gpointer data) -> gboolean
+  {
+    auto *pair = static_cast<std::pair<StopJob *, FlValue *> *>(data);
+    StopJob *job = pair->first;
+    g_autoptr(FlMethodResponse) response =
+        FL_METHOD_RESPONSE(fl_method_success_response_new(pair->second));
+    fl_method_call_respond(job->method_call, response, nullptr);
+    if (pair->second)
+    {
+      fl_value_unref(pair->second);
+    }
+    g_object_unref(job->method_call);
+    g_object_unref(job->self);
+    delete job;
+    delete pair;
+    return G_SOURCE_REMOVE;
+  };
+  g_idle_add_full(G_PRIORITY_DEFAULT, respond, new std::pair<StopJob *, FlValue *>(job, result),
+                  nullptr);
+  return nullptr;
+}
+
+// Stops the session and returns at once: the capture read is interrupted,
+// then a worker joins the capture thread, finalizes the file or stream and
+// answers [method_call]. A stop arriving while the previous one is still
+// finalizing is answered after it, without tearing anything down: the
+// state is idle by then and a new session may already be starting. With
+// nothing running or finalizing, it is answered at once.
+static void stop_session(RecordLinuxPlugin *self, FlMethodCall *method_call, bool stream, bool cancel)
+{
+  // Also wakes the capture thread when paused.
+  uint32_t word = 0;
+  const bool was_recording = self->state->transition(
+      RecorderState::mask(RecorderState::kRecording) | RecorderState::mask(RecorderState::kPausing) |
+          RecorderState::mask(RecorderState::kPaused),
+      RecorderState::kStopping, 0, 0, &word);
+  const bool armed = (word & RecorderState::kArmed) != 0;
+  if (was_recording && !armed && self->pa_handle)
+  {
+    self->pa_handle->interrupt();
+  }
+  const bool idle = !was_recording && !armed;
+
+  if (idle && RecorderState::state_of(word) != RecorderState::kStopping)
+  {
+    FlValue *result = stream ? nullptr : fl_value_new_string(self->file_path.c_str());
+    g_autoptr(FlMethodResponse) response =
+        FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+    fl_method_call_respond(method_call, response, nullptr);
+    if (result)
+    {
+      fl_value_unref(result);
+    }
+    return;
+  }
+
+  StopJob *job = new StopJob();
+  job->self = RECORD_LINUX_PLUGIN(g_object_ref(self));
+  job->method_call = FL_METHOD_CALL(g_object_ref(method_call));
+  job->previous = self->stop_thread_handle;
+  job->stream = stream;
+  job->cancel = cancel;
+  job->was_recording = was_recording;
+  job->keep_capture = (word & (RecorderState::kArmed | RecorderState::kWarm)) != 0;
+  job->idle = idle;
+  self->stop_thread_handle = g_thread_new("record_stop", stop_thread_func, job);
+}
+
+// Ends pre-roll or VOX capture between sessions like stop_session: the state
+// stays stopping while a worker joins the capture thread, closes the VOX
+// take in progress and disconnects, then answers [method_call].
+static void disarm_capture(RecordLinuxPlugin *self, FlMethodCall *method_call, bool vox)
+{
+  StopJob *job = new StopJob();
+  job->self = RECORD_LINUX_PLUGIN(g_object_ref(self));
+  job->method_call = FL_METHOD_CALL(g_object_ref(method_call));
+  job->previous = self->stop_thread_handle;
+  job->disarm = true;
+  job->vox = vox;
+  self->stop_thread_handle = g_thread_new("record_stop", stop_thread_func, job);
+}
+
+// Closes the connection kept warm and its parked thread, or what a failed
+// read left behind.
+static void cool_capture(RecordLinuxPlugin *self)
+{
+  self->state->update_flags(0, RecorderState::kWarm | RecorderState::kFailed);
+  if (self->pa_handle)
+  {
+    self->pa_handle->interrupt();
+  }
+  join_capture_thread(self);
+  disconnect_from_pulse(self);
+}
+
+// Error response when the output format of [config] is wider than S16,
+// which everything after the capture conversion is: the extra bits would
+// only be padding. nullptr otherwise.
+static FlMethodResponse *check_output_format(FlValue *config)
+{
+  RecordConfig session;
+  if (config)
+  {
+    record_config_from_value(config, &session);
+  }
+  if (sample_format_bytes(session.output_format) <= sizeof(int16_t))
+  {
+    return nullptr;
+  }
+  return (FlMethodResponse *)fl_method_error_response_new(
+      "format_unsupported",
+      "Output formats wider than s16 are not supported: audio is processed as 16-bit PCM.", nullptr);
+}
+
+// Connects with the session config unless capture already runs for
+// pre-roll, in which case the armed configuration is kept and only the
+// pre-roll amount is read from [config].
+// Returns an error response on failure, nullptr otherwise.
+static FlMethodResponse *prepare_capture(RecordLinuxPlugin *self, FlValue *config, int *pre_roll_ms)
+{
+  FlMethodResponse *unsupported = check_output_format(config);
+  if (unsupported)
+  {
+    return unsupported;
+  }
+  if (self->state->has(RecorderState::kVox))
+  {
+    return (FlMethodResponse *)fl_method_error_response_new(
+        "vox_active", "Recording is driven by VOX, stop it first.", nullptr);
+  }
+  uint32_t word = 0;
+  if (!self->state->transition(RecorderState::mask(RecorderState::kIdle), RecorderState::kStarting,
+                               0, 0, &word))
+  {
+    return (FlMethodResponse *)fl_method_error_response_new(
+        "already_recording", "A recording session is already in progress.", nullptr);
+  }
+  const bool armed = (word & RecorderState::kArmed) != 0;
+
+  if (armed && (word & RecorderState::kFailed))
+  {
+    self->state->transition(RecorderState::mask(RecorderState::kStarting), RecorderState::kIdle);
+    return (FlMethodResponse *)fl_method_error_response_new(
+        "capture_failed", "The pre-roll capture failed, stop it first.", nullptr);
+  }
+
+  if (armed)
+  {
+    RecordConfig session;
+    if (config)
+    {
+      record_config_from_value(config, &session);
+    }
+    *pre_roll_ms = session.pre_roll_ms;
+    self->config->encoder = session.encoder;
+    self->config->bit_rate = session.bit_rate;
+    self->config->flac_level = session.flac_level;
+    self->config->stream_ogg_framing = session.stream_ogg_framing;
+    self->config->output_format = session.output_format;
+    self->config->dither = session.dither;
+    self->config->outputs = session.outputs;
+    return nullptr;
+  }
+
+  *pre_roll_ms = 0;
+  apply_config(self, config);
+
+  // The parked thread only has to uncork (see begin_session).
+  self->warm_start = self->state->has(RecorderState::kWarm) &&
+                     record_config_same_capture(*self->warm_config, *self->config);
+  if (self->warm_start)
+  {
+    return nullptr;
+  }
+  cool_capture(self);
+
+  GError *gerror = nullptr;
+  if (!connect_to_pulse(self, &gerror))
+  {
+    self->state->transition(RecorderState::mask(RecorderState::kStarting), RecorderState::kIdle);
+    if (gerror)
+    {
+      auto resp = fl_method_error_response_new("pulse_error", gerror->message, nullptr);
+      g_error_free(gerror);
+      return (FlMethodResponse *)resp;
+    }
+    return (FlMethodResponse *)fl_method_error_response_new(
+        "pulse_error", "Unknown PulseAudio error", nullptr);
+  }
+
+  // Kept warm for the next session with the same capture config, which the
+  // event-loop engine does not do.
+  if (self->pa_handle)
+  {
+    *self->warm_config = *self->config;
+    self->state->update_flags(RecorderState::kWarm, 0);
+  }
+  return nullptr;
+}
+
+// ---------------------------------------------------------------------------
+// 7) All your plugin method implementations EXACTLY as in your snippet
+// ---------------------------------------------------------------------------
+FlMethodResponse *create_recorder(RecordLinuxPlugin *self)
+{
+  // Connects with the default config and parks a capture thread on the
+  // corked stream, so that a start with that config only uncorks.
+  // Not fatal: start then connects as usual.
+  if (self->state->load() != RecorderState::kIdle || self->pa_handle)
+  {
+    return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+  }
+
+  apply_config(self, nullptr);
+
+  GError *gerror = nullptr;
+  int error = 0;
+  if (!connect_to_pulse(self, &gerror) || !self->pa_handle->set_corked(true, &error) ||
+      (self->ref_pa_handle && !self->ref_pa_handle->set_corked(true, &error)))
+  {
+    g_warning("Capture not pre-warmed: %s",
+              gerror ? gerror->message : pa_strerror(error));
+    if (gerror)
+    {
+      g_error_free(gerror);
+    }
+    disconnect_from_pulse(self);
+    return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+  }
+
+  *self->warm_config = *self->config;
+  self->state->update_flags(RecorderState::kWarm, 0);
+  self->record_thread_handle = g_thread_new("record_thread", record_thread_func, self);
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+}
+
+FlMethodResponse *dispose_recorder(RecordLinuxPlugin *self)
+{
+  // ...
+  // A stop still finalizing completes first.
+  if (self->stop_thread_handle)
+  {
+    g_thread_join(self->stop_thread_handle);
+    self->stop_thread_handle = nullptr;
+  }
+  self->state->reset();
+
+  join_capture_thread(self);
+  // Also waits for the engine chunks in flight.
+  disconnect_from_pulse(self);
+  g_mutex_lock(&self->sink_mutex);
+  self->sink_active = false;
+  g_mutex_unlock(&self->sink_mutex);
+  if (self->file_writer)
+  {
+    self->file_writer->close();
+    delete self->file_writer;
+    self->file_writer = nullptr;
+  }
+  delete self->stream_encoder;
+  self->stream_encoder = nullptr;
+
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+}
+
+FlMethodResponse *start_recording_file(RecordLinuxPlugin *self, const gchar *path, FlValue *config)
+{
+  const int64_t call_us = g_get_monotonic_time();
+  int pre_roll_ms = 0;
+  FlMethodResponse *error = prepare_capture(self, config, &pre_roll_ms);
+  if (error)
+  {
+    return error;
+  }
+
+  self->file_path = path ? path : "";
+  if (!open_file_writer(self, self->file_path, 0))
+  {
+    abort_session(self);
+    return (FlMethodResponse *)fl_method_error_response_new(
+        "file_io_error", "Failed to open the file for writing.", nullptr);
+  }
+
+  begin_session(self, false, pre_roll_ms, call_us);
+
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+}
+
+FlMethodResponse *stop_recording_file(RecordLinuxPlugin *self, FlMethodCall *method_call)
+{
+  if (self->state->has(RecorderState::kVox))
+  {
+    return (FlMethodResponse *)fl_method_error_response_new(
+        "vox_active", "Recording is driven by VOX, use stopVox.", nullptr);
+  }
+
+  // Answered with the file path once finalized.
+  stop_session(self, method_call, false, false);
+  return nullptr;
+}
+
+FlMethodResponse *start_recording_stream(RecordLinuxPlugin *self, FlValue *config)
+{
+  const int64_t call_us = g_get_monotonic_time();
+  int pre_roll_ms = 0;
+  FlMethodResponse *error = prepare_capture(self, config, &pre_roll_ms);
+  if (error)
+  {
+    return error;
+  }
+
+  self->file_path.clear();
+  self->file_writer = nullptr;
+
+  // Compressed payload when the encoder asks for it, raw PCM otherwise.
+  // One left by a session not finished as a stream goes first, with its worker.
+  delete self->stream_encoder;
+  self->stream_encoder = stream_encoder_create(encoder_settings(self));
+  if (self->config->encoder == "opus" && !self->stream_encoder)
+  {
+    abort_session(self);
+    return (FlMethodResponse *)fl_method_error_response_new(
+        "encoder_unsupported", "Opus was not available at build time.", nullptr);
+  }
+  if (self->stream_encoder &&
+      !self->stream_encoder->open(self->pa_spec.rate, self->pa_spec.channels,
+                                  [self](std::vector<uint8_t> *data, int64_t pts_us, int64_t duration_us)
+                                  { send_audio_packet(self, data, pts_us, duration_us); }))
+  {
+    delete self->stream_encoder;
+    self->stream_encoder = nullptr;
+    abort_session(self);
+    return (FlMethodResponse *)fl_method_error_response_new(
+        "encoder_error", "Failed to initialize the stream encoder.", nullptr);
+  }
+
+  begin_session(self, true, pre_roll_ms, call_us);
+
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+}
+
+FlMethodResponse *stop_recording_stream(RecordLinuxPlugin *self, FlMethodCall *method_call)
+{
+  if (self->state->has(RecorderState::kVox))
+  {
+    return (FlMethodResponse *)fl_method_error_response_new(
+        "vox_active", "Recording is driven by VOX, use stopVox.", nullptr);
+  }
+
+  // Answered once the encoder emitted what it still holds.
+  stop_session(self, method_call, true, false);
+  return nullptr;
+}
+
+// Connects and starts capturing into the pre-roll ring, with level-triggered
+// takes when [vox]. Returns an error response on failure, nullptr otherwise.
+static FlMethodResponse *arm_capture(RecordLinuxPlugin *self, FlValue *config, bool vox)
+{
+  FlMethodResponse *unsupported = check_output_format(config);
+  if (unsupported)
+  {
+    return unsupported;
+  }
+  const uint32_t word = self->state->load();
+  if (RecorderState::state_of(word) != RecorderState::kIdle || (word & RecorderState::kArmed))
+  {
+    return (FlMethodResponse *)fl_method_error_response_new(
+        "already_recording", "Capture is already running.", nullptr);
+  }
+
+  // Pre-roll captures with its own config, on a capture thread.
+  cool_capture(self);
+
+  apply_config(self, config);
+  self->config->capture_engine = "thread";
+
+  GError *gerror = nullptr;
+  if (!connect_to_pulse(self, &gerror))
+  {
+    if (gerror)
+    {
+      auto resp = fl_method_error_response_new("pulse_error", gerror->message, nullptr);
+      g_error_free(gerror);
+      return (FlMethodResponse *)resp;
+    }
+    return (FlMethodResponse *)fl_method_error_response_new(
+        "pulse_error", "Unknown PulseAudio error", nullptr);
+  }
+
+  // Allocated once here, the capture thread only overwrites it.
+  // VOX takes need their pre-roll plus the audio that triggered them.
+  int history_ms = self->config->pre_roll_buffer_ms;
+  if (vox)
+  {
+    history_ms = std::max(history_ms, self->config->pre_roll_ms + self->config->vox_min_duration_ms);
+    self->vox->configure(self->pa_spec.rate,
+                         (float)self->config->vox_threshold_db,
+                         (uint32_t)self->config->vox_min_duration_ms,
+                         (uint32_t)self->config->vox_hang_ms);
+  }
+  const size_t frame_bytes = self->pa_spec.channels * sizeof(int16_t);
+  self->pre_roll->configure((size_t)history_ms * self->pa_spec.rate / 1000, frame_bytes);
+  self->meter->reset();
+
+  g_mutex_lock(&self->sink_mutex);
+  self->sink_active = false;
+  self->pre_roll_pending = 0;
+  g_mutex_unlock(&self->sink_mutex);
+
+  self->state->update_flags(RecorderState::kArmed | (vox ? RecorderState::kVox : 0), 0);
+  self->record_thread_handle = g_thread_new("record_thread", record_thread_func, self);
+
+  return nullptr;
+}
+
+FlMethodResponse *start_pre_roll(RecordLinuxPlugin *self, FlValue *config)
+{
+  FlMethodResponse *error = arm_capture(self, config, false);
+  if (error)
+  {
+    return error;
+  }
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+}
+
+FlMethodResponse *stop_pre_roll(RecordLinuxPlugin *self, FlMethodCall *method_call)
+{
+  if (self->state->has(RecorderState::kVox))
+  {
+    return (FlMethodResponse *)fl_method_error_response_new(
+        "vox_active", "Capture is driven by VOX, use stopVox.", nullptr);
+  }
+  if (!self->state->has(RecorderState::kArmed))
+  {
+    return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+  }
+
+  // Between sessions, answered once the capture thread is gone.
+  if (self->state->transition(RecorderState::mask(RecorderState::kIdle), RecorderState::kStopping,
+                              0, RecorderState::kArmed))
+  {
+    disarm_capture(self, method_call, false);
+    return nullptr;
+  }
+
+  // A running session keeps capturing; it disconnects when it stops.
+  self->state->update_flags(0, RecorderState::kArmed);
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+}
+
+FlMethodResponse *start_vox(RecordLinuxPlugin *self, const gchar *path, FlValue *config)
+{
+  self->vox_path = path ? path : "";
+  self->vox_take = 0;
+
+  FlMethodResponse *error = arm_capture(self, config, true);
+  if (error)
+  {
+    return error;
+  }
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+}
+
+FlMethodResponse *stop_vox(RecordLinuxPlugin *self, FlMethodCall *method_call)
+{
+  // VOX only runs between sessions. Answered with the take count once the
+  // take in progress is closed.
+  if (!self->state->has(RecorderState::kVox) ||
+      !self->state->transition(RecorderState::mask(RecorderState::kIdle), RecorderState::kStopping,
+                               0, RecorderState::kArmed | RecorderState::kVox))
+  {
+    return (FlMethodResponse *)fl_method_error_response_new(
+        "not_recording", "VOX is not running.", nullptr);
+  }
+
+  disarm_capture(self, method_call, true);
+  return nullptr;
+}
+
+FlMethodResponse *cancel_recording(RecordLinuxPlugin *self, FlMethodCall *method_call)
+{
+  if (self->state->has(RecorderState::kVox))
+  {
+    return (FlMethodResponse *)fl_method_error_response_new(
+        "vox_active", "Recording is driven by VOX, use stopVox.", nullptr);
+  }
+
+  // The file is deleted by the stop worker, once closed.
+  stop_session(self, method_call, self->state->has(RecorderState::kStream), true);
+  return nullptr;
+}
+
+FlMethodResponse *pause_recording(RecordLinuxPlugin *self)
+{
+  // Returns at once; the capture thread parks after its current read.
+  const uint32_t active = RecorderState::mask(RecorderState::kRecording) |
+                          RecorderState::mask(RecorderState::kPausing) |
+                          RecorderState::mask(RecorderState::kPaused);
+  uint32_t word = 0;
+  if (!self->state->transition(RecorderState::mask(RecorderState::kRecording),
+                               RecorderState::kPausing, 0, 0, &word) &&
+      (active & RecorderState::mask(RecorderState::state_of(word))) == 0)
+  {
+    return (FlMethodResponse *)fl_method_error_response_new(
+        "not_recording", "No active recording session to pause.", nullptr);
+  }
+  // The frames read so far are kept, the rest of the read is not waited for.
+  if (self->pa_handle)
+  {
+    self->pa_handle->interrupt();
+  }
+  // No thread to park with the event-loop engine: paused once corked.
+  if (self->engine_capture && RecorderState::state_of(word) == RecorderState::kRecording)
+  {
+    set_engine_corked(self, true);
+  }
+
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+}
+
+FlMethodResponse *resume_recording(RecordLinuxPlugin *self)
+{
+  uint32_t word = 0;
+  if (!self->state->transition(RecorderState::mask(RecorderState::kPausing) |
+                                   RecorderState::mask(RecorderState::kPaused),
+                               RecorderState::kRecording, 0, 0, &word) &&
+      RecorderState::state_of(word) != RecorderState::kRecording)
+  {
+    return (FlMethodResponse *)fl_method_error_response_new(
+        "not_recording", "No active recording session to resume.", nullptr);
+  }
+  if (self->engine_capture && RecorderState::state_of(word) != RecorderState::kRecording)
+  {
+    set_engine_corked(self, false);
+  }
+
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+}
+
+FlMethodResponse *list_input_devices(RecordLinuxPlugin *self)
+{
+  // Not implemented => return empty list
+  FlValue *devices = fl_value_new_list();
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(devices));
+}
+
+FlMethodResponse *is_encoder_supported(RecordLinuxPlugin *self, const gchar *encoder)
+{
+  bool supported = false;
+  if (encoder && (file_writer_supported(encoder) || stream_encoder_supported(encoder)))
+  {
+    supported = true;
+  }
   FlValue *result = fl_value_new_bool(supported);
   return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
 }
 
 FlMethodResponse *get_amplitude(RecordLinuxPlugin *self)
 {
-  // Stub => always -160 dB
+  // Peak of the last captured chunk, and the highest since the start.
   FlValue *amplitude = fl_value_new_map();
-  fl_value_set_string_take(amplitude, "current", fl_value_new_float(-160.0));
-  fl_value_set_string_take(amplitude, "max", fl_value_new_float(-160.0));
+  fl_value_set_string_take(amplitude, "current", fl_value_new_float(self->meter->current_db()));
+  fl_value_set_string_take(amplitude, "max", fl_value_new_float(self->meter->max_db()));
   return FL_METHOD_RESPONSE(fl_method_success_response_new(amplitude));
 }
 
@@ -673,9 +2566,8 @@ FlMethodResponse *has_permission(RecordLinuxPlugin *self)
 
 FlMethodResponse *is_paused_fn(RecordLinuxPlugin *self)
 {
-  g_mutex_lock(&self->state_mutex);
-  bool paused = self->is_paused;
-  g_mutex_unlock(&self->state_mutex);
+  const RecorderState::State state = self->state->state();
+  bool paused = state == RecorderState::kPausing || state == RecorderState::kPaused;
 
   FlValue *result = fl_value_new_bool(paused);
   return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
@@ -683,10 +2575,280 @@ FlMethodResponse *is_paused_fn(RecordLinuxPlugin *self)
 
 FlMethodResponse *is_recording_fn(RecordLinuxPlugin *self)
 {
-  g_mutex_lock(&self->state_mutex);
-  bool rec = (self->is_recording && !self->is_paused);
-  g_mutex_unlock(&self->state_mutex);
+  // A session whose capture failed stays until stopped, not recording.
+  const uint32_t word = self->state->load();
+  bool rec = RecorderState::state_of(word) == RecorderState::kRecording &&
+             (word & RecorderState::kFailed) == 0;
 
   FlValue *result = fl_value_new_bool(rec);
   return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
 }
+
+FlMethodResponse *get_dsp_stats(RecordLinuxPlugin *self)
+{
+  DspStageReport reports[DspChain::kStageCount];
+  size_t count = self->dsp->report(reports);
+
+  FlValue *stages = fl_value_new_map();
+  for (size_t i = 0; i < count; i++)
+  {
+    FlValue *stage = fl_value_new_map();
+    fl_value_set_string_take(stage, "enabled", fl_value_new_bool(reports[i].enabled));
+    fl_value_set_string_take(stage, "blocks", fl_value_new_int((int64_t)reports[i].blocks));
+    fl_value_set_string_take(stage, "avgUs", fl_value_new_float(reports[i].avg_us));
+    fl_value_set_string_take(stage, "maxUs", fl_value_new_float(reports[i].max_us));
+    fl_value_set_string_take(stage, "load", fl_value_new_float(reports[i].load));
+    fl_value_set_string_take(stages, reports[i].name, stage);
+  }
+
+  FlValue *result = fl_value_new_map();
+  fl_value_set_string_take(result, "blockFrames", fl_value_new_int((int64_t)self->dsp->block_frames()));
+  fl_value_set_string_take(result, "latencyFrames", fl_value_new_int((int64_t)self->dsp->latency_frames()));
+  fl_value_set_string_take(result, "stages", stages);
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+}
+
+FlMethodResponse *get_capture_stats(RecordLinuxPlugin *self)
+{
+  g_mutex_lock(&self->sink_mutex);
+  const int64_t start_latency_us = self->start_latency_us;
+  const int64_t thread_started_us = self->thread_started_us;
+  g_mutex_unlock(&self->sink_mutex);
+
+  // Cost of the capture: this plugin's thread and the pool processing its
+  // chunks, or the whole event loop (loop thread and pool) shared by every
+  // session of the process. The pool serves every session either way.
+  const bool event_loop = self->config->capture_engine == "eventLoop" && self->engine;
+  int64_t cpu_us = __atomic_load_n(&self->thread_cpu_us, __ATOMIC_RELAXED) + self->pool->cpu_us();
+  int64_t wakeups = (int64_t)__atomic_load_n(&self->thread_wakeups, __ATOMIC_RELAXED);
+  int64_t elapsed_us = thread_started_us > 0 ? g_get_monotonic_time() - thread_started_us : 0;
+  int64_t sessions = self->record_thread_handle ? 1 : 0;
+  int64_t workers = (int64_t)self->pool->size();
+  int64_t dropped_bytes = (int64_t)__atomic_load_n(&self->ring_dropped_bytes, __ATOMIC_RELAXED);
+  int64_t hole_bytes = (int64_t)__atomic_load_n(&self->thread_hole_bytes, __ATOMIC_RELAXED);
+  if (event_loop)
+  {
+    const CaptureEngine::Stats stats = self->engine->stats();
+    cpu_us = stats.loop_cpu_us + stats.worker_cpu_us;
+    wakeups = (int64_t)stats.wakeups;
+    elapsed_us = stats.uptime_us;
+    sessions = (int64_t)stats.captures;
+    workers = (int64_t)stats.workers;
+    if (self->engine_capture)
+    {
+      dropped_bytes = (int64_t)self->engine_capture->dropped_bytes();
+      hole_bytes = (int64_t)self->engine_capture->hole_bytes();
+    }
+  }
+
+  FlValue *result = fl_value_new_map();
+  fl_value_set_string_take(result, "engine", fl_value_new_string(event_loop ? "eventLoop" : "thread"));
+  fl_value_set_string_take(result, "cpuUs", fl_value_new_int(cpu_us));
+  fl_value_set_string_take(result, "wakeups", fl_value_new_int(wakeups));
+  fl_value_set_string_take(result, "elapsedUs", fl_value_new_int(elapsed_us));
+  fl_value_set_string_take(result, "sessions", fl_value_new_int(sessions));
+  fl_value_set_string_take(result, "workers", fl_value_new_int(workers));
+  fl_value_set_string_take(result, "droppedBytes", fl_value_new_int(dropped_bytes));
+  fl_value_set_string_take(result, "workerCpuUs", fl_value_new_int(self->pool->cpu_us()));
+  fl_value_set_string_take(result, "steals", fl_value_new_int((int64_t)self->pool->steals()));
+
+  // Audio lost since the capture connected, in frames at the capture rate
+  const int64_t capture_frame_bytes =
+      (int64_t)self->config->device_channels * (int64_t)sample_format_bytes(self->config->capture_format);
+  fl_value_set_string_take(result, "overruns",
+                           fl_value_new_int((int64_t)__atomic_load_n(&self->dropouts, __ATOMIC_RELAXED)));
+  fl_value_set_string_take(result, "droppedFrames",
+                           fl_value_new_int((int64_t)__atomic_load_n(&self->dropout_frames, __ATOMIC_RELAXED)));
+  fl_value_set_string_take(result, "filledFrames",
+                           fl_value_new_int((int64_t)__atomic_load_n(&self->filled_frames, __ATOMIC_RELAXED)));
+  fl_value_set_string_take(result, "underrunFrames",
+                           fl_value_new_int(capture_frame_bytes > 0 ? hole_bytes / capture_frame_bytes : 0));
+  fl_value_set_string_take(result, "failed",
+                           fl_value_new_bool(self->state->has(RecorderState::kFailed)));
+  fl_value_set_string_take(result, "clockDriftPpm", fl_value_new_float(self->capture_clock->drift_ppm()));
+  fl_value_set_string_take(result, "reconnects",
+                           fl_value_new_int((int64_t)__atomic_load_n(&self->reconnects, __ATOMIC_RELAXED)));
+  fl_value_set_string_take(result, "reconnectGapUs",
+                           fl_value_new_int(__atomic_load_n(&self->reconnect_gap_us, __ATOMIC_RELAXED)));
+
+  // Scheduling of the last capture thread
+  const RealtimeStats rt = self->realtime->stats();
+  FlValue *realtime = fl_value_new_map();
+  fl_value_set_string_take(realtime, "policy", fl_value_new_string(realtime_policy_name(rt.policy)));
+  fl_value_set_string_take(realtime, "priority", fl_value_new_int(rt.priority));
+  fl_value_set_string_take(realtime, "rtkit", fl_value_new_bool(rt.rtkit));
+  fl_value_set_string_take(realtime, "pinned", fl_value_new_bool(rt.pinned));
+  fl_value_set_string_take(realtime, "lockedBytes", fl_value_new_int((int64_t)rt.locked_bytes));
+  fl_value_set_string_take(realtime, "reads", fl_value_new_int((int64_t)rt.reads));
+  fl_value_set_string_take(realtime, "avgLatencyUs",
+                           fl_value_new_int(rt.reads ? rt.total_latency_us / (int64_t)rt.reads : 0));
+  fl_value_set_string_take(realtime, "maxLatencyUs", fl_value_new_int(rt.max_latency_us));
+  fl_value_set_string_take(realtime, "lateReads", fl_value_new_int((int64_t)rt.late_reads));
+  fl_value_set_string_take(realtime, "preemptions", fl_value_new_int((int64_t)rt.preemptions));
+  fl_value_set_string_take(realtime, "strayBlocks", fl_value_new_int((int64_t)rt.stray_blocks));
+  fl_value_set_string_take(realtime, "majorFaults", fl_value_new_int((int64_t)rt.major_faults));
+  fl_value_set_string_take(result, "realtime", realtime);
+  fl_value_set_string_take(result, "startLatencyUs",
+                           start_latency_us >= 0 ? fl_value_new_int(start_latency_us)
+                                                 : fl_value_new_null());
+  fl_value_set_string_take(result, "warmStart", fl_value_new_bool(self->warm_start));
+  fl_value_set_string_take(result, "warm",
+                           fl_value_new_bool(self->state->has(RecorderState::kWarm)));
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+}
+
+// A method answered from a thread of its own: [run] builds the result
+// there, and the response is sent from the main loop.
+struct ThreadCall
+{
+  FlMethodCall *method_call;
+  std::function<FlValue *()> run;
+  FlValue *result;
+};
+
+static gboolean respond_thread_call(gpointer data)
+{
+  ThreadCall *call = static_cast<ThreadCall *>(data);
+  g_autoptr(FlMethodResponse) response =
+      FL_METHOD_RESPONSE(fl_method_success_response_new(call->result));
+  fl_method_call_respond(call->method_call, response, nullptr);
+  fl_value_unref(call->result);
+  g_object_unref(call->method_call);
+  delete call;
+  return G_SOURCE_REMOVE;
+}
+
+static gpointer thread_call_func(gpointer data)
+{
+  ThreadCall *call = static_cast<ThreadCall *>(data);
+  call->result = call->run();
+  g_idle_add_full(G_PRIORITY_DEFAULT, respond_thread_call, call, nullptr);
+  return nullptr;
+}
+
+// Answers [method_call] with what [run] returns, run on a thread named
+// [name]. Returns nullptr: the response is sent later.
+static FlMethodResponse *respond_from_thread(const char *name, FlMethodCall *method_call,
+                                             std::function<FlValue *()> run)
+{
+  ThreadCall *call = new ThreadCall();
+  call->method_call = FL_METHOD_CALL(g_object_ref(method_call));
+  call->run = std::move(run);
+  call->result = nullptr;
+  g_thread_unref(g_thread_new(name, thread_call_func, call));
+  return nullptr;
+}
+
+// Positive integer argument [key] of [method_call], [fallback] when absent.
+static int64_t positive_int_arg(FlMethodCall *method_call, const char *key, int64_t fallback)
+{
+  FlValue *args = fl_method_call_get_args(method_call);
+  if (!args || fl_value_get_type(args) != FL_VALUE_TYPE_MAP)
+    return fallback;
+  FlValue *value = fl_value_lookup_string(args, key);
+  if (value && fl_value_get_type(value) == FL_VALUE_TYPE_INT && fl_value_get_int(value) > 0)
+    return fl_value_get_int(value);
+  return fallback;
+}
+
+static FlValue *pool_benchmark_value(const std::vector<PoolBenchmarkRun> &list)
+{
+  FlValue *runs = fl_value_new_list();
+  for (const PoolBenchmarkRun &run : list)
+  {
+    FlValue *entry = fl_value_new_map();
+    fl_value_set_string_take(entry, "workers", fl_value_new_int((int64_t)run.workers));
+    fl_value_set_string_take(entry, "chunks", fl_value_new_int((int64_t)run.chunks));
+    fl_value_set_string_take(entry, "seconds", fl_value_new_float(run.seconds));
+    fl_value_set_string_take(entry, "chunksPerSecond", fl_value_new_float(run.chunks_per_second));
+    fl_value_set_string_take(entry, "realtimeFactor", fl_value_new_float(run.realtime_factor));
+    fl_value_set_string_take(entry, "steals", fl_value_new_int((int64_t)run.steals));
+    fl_value_append_take(runs, entry);
+  }
+  return runs;
+}
+
+// Runs the worker pool benchmark on its own thread, on pools of its own
+// (recording is unaffected), and answers [method_call] with one map per
+// pool size.
+FlMethodResponse *benchmark_worker_pool(RecordLinuxPlugin *self, FlMethodCall *method_call)
+{
+  const size_t max_workers = (size_t)positive_int_arg(
+      method_call, "maxWorkers", std::max(1u, std::thread::hardware_concurrency()));
+  // Enough sessions by default to keep every worker of the largest pool busy.
+  const size_t sessions = (size_t)positive_int_arg(method_call, "sessions", max_workers * 2);
+  const double audio_seconds = (double)positive_int_arg(method_call, "audioSeconds", 10);
+
+  return respond_from_thread("record_benchmark", method_call, [=]
+                             {
+                               return pool_benchmark_value(
+                                   run_pool_benchmark(max_workers, sessions, audio_seconds));
+                             });
+}
+
+static FlValue *resampler_benchmark_value(const std::vector<ResamplerBenchmarkRun> &list)
+{
+  FlValue *runs = fl_value_new_list();
+  for (const ResamplerBenchmarkRun &run : list)
+  {
+    FlValue *entry = fl_value_new_map();
+    fl_value_set_string_take(entry, "inRate", fl_value_new_int(run.in_rate));
+    fl_value_set_string_take(entry, "outRate", fl_value_new_int(run.out_rate));
+    fl_value_set_string_take(entry, "quality",
+                             fl_value_new_string(resampler_quality_name(run.quality)));
+    fl_value_set_string_take(entry, "taps", fl_value_new_int((int64_t)run.taps));
+    fl_value_set_string_take(entry, "passband", fl_value_new_float(run.design.passband));
+    fl_value_set_string_take(entry, "stopband", fl_value_new_float(run.design.stopband));
+    fl_value_set_string_take(entry, "designRippleDb", fl_value_new_float(run.design.ripple_db));
+    fl_value_set_string_take(entry, "designAttenuationDb",
+                             fl_value_new_float(run.design.attenuation_db));
+    fl_value_set_string_take(entry, "rippleDb", fl_value_new_float(run.ripple_db));
+    fl_value_set_string_take(entry, "attenuationDb", fl_value_new_float(run.attenuation_db));
+    fl_value_set_string_take(entry, "withinDesign", fl_value_new_bool(run.within_design));
+    fl_value_set_string_take(entry, "mflops", fl_value_new_float(run.mflops));
+    fl_value_set_string_take(entry, "realtimeFactor", fl_value_new_float(run.realtime_factor));
+    fl_value_append_take(runs, entry);
+  }
+  return runs;
+}
+
+// Measures the response and throughput of every resampler preset on its
+// own thread, and answers [method_call] with one map per preset and rates.
+FlMethodResponse *benchmark_resampler(RecordLinuxPlugin *self, FlMethodCall *method_call)
+{
+  const double audio_seconds = (double)positive_int_arg(method_call, "audioSeconds", 10);
+
+  return respond_from_thread("record_benchmark", method_call, [=]
+                             { return resampler_benchmark_value(run_resampler_benchmark(audio_seconds)); });
+}
+
+static FlValue *format_benchmark_value(const std::vector<FormatBenchmarkRun> &list)
+{
+  FlValue *runs = fl_value_new_list();
+  for (const FormatBenchmarkRun &run : list)
+  {
+    FlValue *entry = fl_value_new_map();
+    fl_value_set_string_take(entry, "kernel", fl_value_new_string(run.kernel));
+    fl_value_set_string_take(entry, "from", fl_value_new_string(sample_format_name(run.from)));
+    fl_value_set_string_take(entry, "to", fl_value_new_string(sample_format_name(run.to)));
+    fl_value_set_string_take(entry, "isa", fl_value_new_string(run.isa));
+    fl_value_set_string_take(entry, "msamplesPerSecond",
+                             fl_value_new_float(run.msamples_per_second));
+    fl_value_set_string_take(entry, "gbytesPerSecond", fl_value_new_float(run.gbytes_per_second));
+    fl_value_set_string_take(entry, "mismatches", fl_value_new_int((int64_t)run.mismatches));
+    fl_value_set_string_take(entry, "maxError", fl_value_new_float(run.max_error));
+    fl_value_append_take(runs, entry);
+  }
+  return runs;
+}
+
+// Times each sample format kernel, checks the vector ones against the
+// scalar ones on its own thread, and answers [method_call] with one map
+// per kernel and instruction set.
+FlMethodResponse *benchmark_formats(RecordLinuxPlugin *self, FlMethodCall *method_call)
+{
+  const double audio_seconds = (double)positive_int_arg(method_call, "audioSeconds", 60);
+
+  return respond_from_thread("record_benchmark", method_call, [=]
+                             { return format_benchmark_value(run_format_benchmark(audio_seconds)); });
+}
@@ -0,0 +1,27 @@
+#ifndef RECORD_LINUX_MD5_H_
+#define RECORD_LINUX_MD5_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+////////////////////////////////////////////////////////////////////////////////
+//  MD5 (RFC 1321), used for the FLAC STREAMINFO audio signature
+////////////////////////////////////////////////////////////////////////////////
+class Md5
+{
+public:
+  Md5() { reset(); }
+
+  void reset();
+  void update(const void *data, size_t size);
+  void finish(uint8_t digest[16]);
+
+private:
+  void transform(const uint8_t block[64]);
+
+  uint32_t state_[4];
+  uint64_t length_; // bytes
+  uint8_t buffer_[64];
+};
+
+#endif // RECORD_LINUX_MD5_H_
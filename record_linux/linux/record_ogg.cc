@@ -0,0 +1,91 @@
+#include "record_ogg.h"
+
+namespace
+{
+  // CRC-32, polynomial 0x04c11db7, unreflected, zero initial value.
+  struct CrcTable
+  {
+    uint32_t entries[256];
+
+    CrcTable()
+    {
+      for (uint32_t i = 0; i < 256; i++)
+      {
+        uint32_t crc = i << 24;
+        for (int b = 0; b < 8; b++)
+          crc = (crc & 0x80000000u) ? (crc << 1) ^ 0x04c11db7u : crc << 1;
+        entries[i] = crc;
+      }
+    }
+  };
+
+  uint32_t crc32(uint32_t crc, const uint8_t *data, size_t size)
+  {
+    static const CrcTable table;
+    for (size_t i = 0; i < size; i++)
+      crc = (crc << 8) ^ table.entries[((crc >> 24) ^ data[i]) & 0xFF];
+    return crc;
+  }
+
+  void put_le(std::vector<uint8_t> *out, uint64_t value, int bytes)
+  {
+    for (int i = 0; i < bytes; i++)
+      out->push_back((uint8_t)(value >> (8 * i)));
+  }
+}
+
+void OggStream::reset(uint32_t serial)
+{
+  serial_ = serial;
+  sequence_ = 0;
+  first_ = true;
+  granule_ = 0;
+  packets_ = 0;
+  segments_.clear();
+  body_.clear();
+}
+
+void OggStream::add_packet(const uint8_t *packet, size_t size, int64_t granule,
+                           std::vector<uint8_t> *out)
+{
+  const size_t lacing = size / 255 + 1;
+  if (segments_.size() + lacing > kMaxSegments)
+    flush_page(out, false);
+
+  for (size_t i = 0; i + 1 < lacing; i++)
+    segments_.push_back(255);
+  segments_.push_back((uint8_t)(size % 255));
+  body_.insert(body_.end(), packet, packet + size);
+  granule_ = granule;
+  packets_++;
+}
+
+void OggStream::flush_page(std::vector<uint8_t> *out, bool eos)
+{
+  if (packets_ == 0 && !eos)
+    return;
+
+  const size_t start = out->size();
+  out->push_back('O');
+  out->push_back('g');
+  out->push_back('g');
+  out->push_back('S');
+  out->push_back(0); // version
+  out->push_back((uint8_t)((first_ ? 0x02 : 0) | (eos ? 0x04 : 0)));
+  put_le(out, (uint64_t)granule_, 8);
+  put_le(out, serial_, 4);
+  put_le(out, sequence_++, 4);
+  put_le(out, 0, 4); // CRC, below
+  out->push_back((uint8_t)segments_.size());
+  out->insert(out->end(), segments_.begin(), segments_.end());
+  out->insert(out->end(), body_.begin(), body_.end());
+
+  const uint32_t crc = crc32(0, out->data() + start, out->size() - start);
+  for (int i = 0; i < 4; i++)
+    (*out)[start + 22 + i] = (uint8_t)(crc >> (8 * i));
+
+  first_ = false;
+  packets_ = 0;
+  segments_.clear();
+  body_.clear();
+}
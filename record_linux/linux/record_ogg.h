@@ -0,0 +1,44 @@
+#ifndef RECORD_LINUX_OGG_H_
+#define RECORD_LINUX_OGG_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+//  Ogg framing (RFC 3533)
+//
+//  OggStream collects the packets of one logical bitstream into pages.
+//  Packets are lacing-coded into the page segment table; a page is emitted
+//  by flush_page(), or by add_packet() when the segment table is full. The
+//  page granule position is the one of its last completed packet.
+////////////////////////////////////////////////////////////////////////////////
+class OggStream
+{
+public:
+  static const size_t kMaxSegments = 255;
+
+  void reset(uint32_t serial);
+
+  // Adds [packet] ending at [granule]. Packets must be shorter than
+  // 255 * 255 bytes.
+  void add_packet(const uint8_t *packet, size_t size, int64_t granule,
+                  std::vector<uint8_t> *out);
+
+  // Emits the pending packets as one page (nothing if there are none,
+  // unless [eos] is set).
+  void flush_page(std::vector<uint8_t> *out, bool eos);
+
+  size_t pending_packets() const { return packets_; }
+
+private:
+  uint32_t serial_ = 0;
+  uint32_t sequence_ = 0;
+  bool first_ = true;
+  int64_t granule_ = 0;
+  size_t packets_ = 0;
+  std::vector<uint8_t> segments_;
+  std::vector<uint8_t> body_;
+};
+
+#endif // RECORD_LINUX_OGG_H_
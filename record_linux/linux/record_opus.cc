@@ -0,0 +1,476 @@
+#include "record_opus.h"
+
+#include <opus_multistream.h>
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+
+namespace
+{
+  const uint32_t kOpusRates[] = {8000, 12000, 16000, 24000, 48000};
+  const size_t kMaxPacketBytesPerStream = 1275 * 3;
+
+  // Lowest Opus rate keeping the capture bandwidth (48 kHz above that).
+  uint32_t opus_rate_for(uint32_t sample_rate)
+  {
+    for (uint32_t rate : kOpusRates)
+    {
+      if (rate >= sample_rate)
+        return rate;
+    }
+    return 48000;
+  }
+
+  void put_le(std::vector<uint8_t> *out, uint32_t value, int bytes)
+  {
+    for (int i = 0; i < bytes; i++)
+      out->push_back((uint8_t)(value >> (8 * i)));
+  }
+}
+
+// ---------------------------------------------------------------------------
+// OpusPacketEncoder
+// ---------------------------------------------------------------------------
+OpusPacketEncoder::~OpusPacketEncoder()
+{
+  if (encoder_)
+    opus_multistream_encoder_destroy(encoder_);
+}
+
+bool OpusPacketEncoder::configure(uint32_t sample_rate, size_t channels, int bit_rate,
+                                  PacketCallback callback)
+{
+  if (encoder_)
+  {
+    opus_multistream_encoder_destroy(encoder_);
+    encoder_ = nullptr;
+  }
+
+  channels_ = std::max<size_t>(1, std::min<size_t>(channels, 8));
+  sample_rate_ = sample_rate;
+  encoder_rate_ = opus_rate_for(sample_rate);
+  frame_size_ = encoder_rate_ * kFrameMs / 1000;
+  mapping_family_ = channels_ > 2 ? 1 : 0;
+  callback_ = callback;
+
+  int error = OPUS_OK;
+  encoder_ = opus_multistream_surround_encoder_create(
+      (opus_int32)encoder_rate_, (int)channels_, mapping_family_, &streams_, &coupled_,
+      mapping_, OPUS_APPLICATION_AUDIO, &error);
+  if (!encoder_ || error != OPUS_OK)
+  {
+    encoder_ = nullptr;
+    return false;
+  }
+  if (bit_rate > 0)
+    opus_multistream_encoder_ctl(encoder_, OPUS_SET_BITRATE(bit_rate));
+
+  opus_int32 lookahead = 0;
+  opus_multistream_encoder_ctl(encoder_, OPUS_GET_LOOKAHEAD(&lookahead));
+  pre_skip_ = (uint32_t)lookahead * (kGranuleRate / encoder_rate_);
+
+  resampler_.configure(sample_rate, encoder_rate_, channels_);
+  input_.clear();
+  pending_.clear();
+  packet_.resize(kMaxPacketBytesPerStream * (size_t)streams_);
+  input_frames_ = 0;
+  granule_ = 0;
+  failed_packets_ = 0;
+  return true;
+}
+
+void OpusPacketEncoder::encode_s16(const int16_t *samples, size_t frames)
+{
+  if (!encoder_)
+    return;
+
+  const size_t count = frames * channels_;
+  input_.resize(count);
+  convert_samples(samples, SampleFormat::kS16, input_.data(), SampleFormat::kF32, count);
+  input_frames_ += frames;
+
+  resampler_.process(input_.data(), frames, &pending_);
+  encode_pending(false);
+}
+
+void OpusPacketEncoder::finish()
+{
+  if (!encoder_)
+    return;
+
+  resampler_.flush(&pending_);
+
+  // The decoder drops pre_skip_ samples: feed as much silence so that the
+  // last captured sample gets encoded, then complete the last frame.
+  const size_t lookahead = pre_skip_ / (kGranuleRate / encoder_rate_);
+  size_t frames = pending_.size() / channels_ + lookahead;
+  frames = (frames + frame_size_ - 1) / frame_size_ * frame_size_;
+  pending_.resize(frames * channels_, 0.0f);
+  encode_pending(true);
+}
+
+void OpusPacketEncoder::encode_pending(bool last)
+{
+  const size_t frame_samples = frame_size_ * channels_;
+  const size_t packets = pending_.size() / frame_samples;
+  const int64_t step = (int64_t)frame_size_ * (kGranuleRate / encoder_rate_);
+  // Exact end: pre-skip plus the captured duration at 48 kHz.
+  const int64_t end = (int64_t)pre_skip_ +
+                      (int64_t)((input_frames_ * kGranuleRate + sample_rate_ / 2) / sample_rate_);
+
+  for (size_t p = 0; p < packets; p++)
+  {
+    const int size = opus_multistream_encode_float(encoder_, &pending_[p * frame_samples],
+                                                   (int)frame_size_, packet_.data(),
+                                                   (opus_int32)packet_.size());
+    granule_ += step;
+    if (size < 0)
+    {
+      failed_packets_++;
+      continue;
+    }
+
+    const int64_t granule = last && p + 1 == packets ? std::min(granule_, end) : granule_;
+    callback_(packet_.data(), (size_t)size, granule);
+  }
+  pending_.erase(pending_.begin(), pending_.begin() + packets * frame_samples);
+}
+
+void OpusPacketEncoder::head(std::vector<uint8_t> *out) const
+{
+  const char magic[] = "OpusHead";
+  out->insert(out->end(), magic, magic + 8);
+  out->push_back(1); // version
+  out->push_back((uint8_t)channels_);
+  put_le(out, pre_skip_, 2);
+  put_le(out, sample_rate_, 4); // input sample rate, informative
+  put_le(out, 0, 2);            // output gain
+  out->push_back((uint8_t)mapping_family_);
+  if (mapping_family_ != 0)
+  {
+    out->push_back((uint8_t)streams_);
+    out->push_back((uint8_t)coupled_);
+    out->insert(out->end(), mapping_, mapping_ + channels_);
+  }
+}
+
+void OpusPacketEncoder::tags(std::vector<uint8_t> *out) const
+{
+  const char magic[] = "OpusTags";
+  out->insert(out->end(), magic, magic + 8);
+  const char *vendor = opus_get_version_string();
+  const size_t length = strlen(vendor);
+  put_le(out, (uint32_t)length, 4);
+  out->insert(out->end(), vendor, vendor + length);
+  put_le(out, 0, 4); // no user comment
+}
+
+// ---------------------------------------------------------------------------
+// OpusEncodeWorker
+// ---------------------------------------------------------------------------
+OpusEncodeWorker::~OpusEncodeWorker()
+{
+  finish();
+}
+
+bool OpusEncodeWorker::start(uint32_t sample_rate, size_t channels, int bit_rate,
+                             OpusPacketEncoder::PacketCallback callback)
+{
+  if (!encoder_.configure(sample_rate, channels, bit_rate, callback))
+    return false;
+
+  channels_ = channels;
+  const size_t block_samples = kBlockFrames * channels;
+  free_.clear();
+  for (int i = 0; i < 8; i++)
+  {
+    std::unique_ptr<Block> block(new Block());
+    block->samples.resize(block_samples);
+    free_.push_back(std::move(block));
+  }
+  current_ = std::move(free_.back());
+  free_.pop_back();
+  current_->frames = 0;
+
+  closing_ = false;
+  worker_ = std::thread(&OpusEncodeWorker::run, this);
+  return true;
+}
+
+void OpusEncodeWorker::submit_block()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  queue_.push_back(std::move(current_));
+  if (!free_.empty())
+  {
+    current_ = std::move(free_.back());
+    free_.pop_back();
+  }
+  else
+  {
+    current_.reset(new Block());
+    current_->samples.resize(kBlockFrames * channels_);
+  }
+  current_->frames = 0;
+  cond_.notify_one();
+}
+
+void OpusEncodeWorker::write_s16(const int16_t *samples, size_t frames)
+{
+  if (!current_)
+    return;
+
+  while (frames > 0)
+  {
+    const size_t n = std::min(frames, kBlockFrames - current_->frames);
+    memcpy(&current_->samples[current_->frames * channels_], samples,
+           n * channels_ * sizeof(int16_t));
+    current_->frames += n;
+    samples += n * channels_;
+    frames -= n;
+
+    if (current_->frames == kBlockFrames)
+      submit_block();
+  }
+}
+
+void OpusEncodeWorker::run()
+{
+  while (true)
+  {
+    std::unique_ptr<Block> block;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cond_.wait(lock, [this]
+                 { return closing_ || !queue_.empty(); });
+      if (queue_.empty())
+        return;
+      block = std::move(queue_.front());
+      queue_.pop_front();
+    }
+
+    encoder_.encode_s16(block->samples.data(), block->frames);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_.push_back(std::move(block));
+  }
+}
+
+void OpusEncodeWorker::finish()
+{
+  if (!worker_.joinable())
+    return;
+
+  if (current_->frames > 0)
+    submit_block();
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closing_ = true;
+    cond_.notify_one();
+  }
+  worker_.join();
+
+  encoder_.finish();
+  current_.reset();
+  free_.clear();
+}
+
+// ---------------------------------------------------------------------------
+// OggOpusWriter
+// ---------------------------------------------------------------------------
+OggOpusWriter::OggOpusWriter(int bit_rate) : bit_rate_(bit_rate) {}
+
+OggOpusWriter::~OggOpusWriter()
+{
+  close();
+}
+
+bool OggOpusWriter::open(const char *path, uint32_t sample_rate, uint16_t channels)
+{
+  file_ = fopen(path, "wb");
+  if (!file_)
+    return false;
+
+  using namespace std::placeholders;
+  if (!worker_.start(sample_rate, channels, bit_rate_,
+                     std::bind(&OggOpusWriter::on_packet, this, _1, _2, _3)))
+  {
+    fclose(file_);
+    file_ = nullptr;
+    return false;
+  }
+
+  frames_ = 0;
+  io_error_ = false;
+  page_start_ = 0;
+
+  // Each header packet on its own page.
+  std::random_device random;
+  ogg_.reset(random());
+  std::vector<uint8_t> header;
+  pages_.clear();
+  worker_.encoder().head(&header);
+  ogg_.add_packet(header.data(), header.size(), 0, &pages_);
+  ogg_.flush_page(&pages_, false);
+  header.clear();
+  worker_.encoder().tags(&header);
+  ogg_.add_packet(header.data(), header.size(), 0, &pages_);
+  ogg_.flush_page(&pages_, false);
+  write_pages(false);
+  return true;
+}
+
+void OggOpusWriter::write_s16(const int16_t *samples, size_t frames)
+{
+  if (!file_)
+    return;
+
+  frames_ += frames;
+  worker_.write_s16(samples, frames);
+}
+
+void OggOpusWriter::on_packet(const uint8_t *packet, size_t size, int64_t granule)
+{
+  ogg_.add_packet(packet, size, granule, &pages_);
+  // About one page per second keeps seeking granular.
+  if (granule - page_start_ >= OpusPacketEncoder::kGranuleRate)
+  {
+    ogg_.flush_page(&pages_, false);
+    page_start_ = granule;
+    write_pages(false);
+  }
+}
+
+void OggOpusWriter::write_pages(bool eos)
+{
+  if (eos)
+    ogg_.flush_page(&pages_, true);
+  if (pages_.empty())
+    return;
+  if (fwrite(pages_.data(), 1, pages_.size(), file_) != pages_.size())
+    io_error_ = true;
+  pages_.clear();
+}
+
+bool OggOpusWriter::close()
+{
+  if (!file_)
+    return false;
+
+  worker_.finish();
+  // Audio missing from the file
+  if (worker_.encoder().failed_packets() > 0)
+    io_error_ = true;
+  write_pages(true);
+
+  const bool ok = fclose(file_) == 0 && !io_error_;
+  file_ = nullptr;
+  return ok;
+}
+
+// ---------------------------------------------------------------------------
+// OpusStreamEncoder
+// ---------------------------------------------------------------------------
+OpusStreamEncoder::OpusStreamEncoder(int bit_rate, bool ogg)
+    : bit_rate_(bit_rate), ogg_framing_(ogg) {}
+
+OpusStreamEncoder::~OpusStreamEncoder()
+{
+  close();
+}
+
+bool OpusStreamEncoder::open(uint32_t sample_rate, uint16_t channels, Output output)
+{
+  using namespace std::placeholders;
+  output_ = output;
+  if (!worker_.start(sample_rate, channels, bit_rate_,
+                     std::bind(&OpusStreamEncoder::on_packet, this, _1, _2, _3)))
+    return false;
+
+  page_start_ = 0;
+  page_end_ = 0;
+  if (ogg_framing_)
+  {
+    // Headers first, as a page each.
+    std::random_device random;
+    ogg_.reset(random());
+    std::vector<uint8_t> *pages = new std::vector<uint8_t>();
+    std::vector<uint8_t> header;
+    worker_.encoder().head(&header);
+    ogg_.add_packet(header.data(), header.size(), 0, pages);
+    ogg_.flush_page(pages, false);
+    header.clear();
+    worker_.encoder().tags(&header);
+    ogg_.add_packet(header.data(), header.size(), 0, pages);
+    ogg_.flush_page(pages, false);
+    output_(pages, 0, 0);
+  }
+  return true;
+}
+
+void OpusStreamEncoder::write_s16(const int16_t *samples, size_t frames)
+{
+  worker_.write_s16(samples, frames);
+}
+
+// Session time of a granule position (pre-skip removed), in microseconds.
+int64_t OpusStreamEncoder::granule_us(int64_t granule) const
+{
+  return (granule - (int64_t)worker_.encoder().pre_skip()) * 1000000 /
+         (int64_t)OpusPacketEncoder::kGranuleRate;
+}
+
+void OpusStreamEncoder::on_packet(const uint8_t *packet, size_t size, int64_t granule)
+{
+  const int64_t start = page_end_;
+  page_end_ = std::max(granule, start);
+
+  if (!ogg_framing_)
+  {
+    page_start_ = page_end_;
+    output_(new std::vector<uint8_t>(packet, packet + size), granule_us(start),
+            granule_us(page_end_) - granule_us(start));
+    return;
+  }
+
+  // A full segment table flushes the pending packets first.
+  std::vector<uint8_t> *overflow = new std::vector<uint8_t>();
+  ogg_.add_packet(packet, size, granule, overflow);
+  if (!overflow->empty())
+  {
+    output_(overflow, granule_us(page_start_), granule_us(start) - granule_us(page_start_));
+    page_start_ = start;
+  }
+  else
+  {
+    delete overflow;
+  }
+
+  if (page_end_ - page_start_ >= (int64_t)OpusPacketEncoder::kGranuleRate * kPageMs / 1000)
+    emit_page(false);
+}
+
+void OpusStreamEncoder::emit_page(bool eos)
+{
+  std::vector<uint8_t> *pages = new std::vector<uint8_t>();
+  ogg_.flush_page(pages, eos);
+  if (pages->empty())
+  {
+    delete pages;
+    return;
+  }
+  output_(pages, granule_us(page_start_), granule_us(page_end_) - granule_us(page_start_));
+  page_start_ = page_end_;
+}
+
+void OpusStreamEncoder::close()
+{
+  if (!worker_.running())
+    return;
+
+  worker_.finish();
+  if (ogg_framing_)
+    emit_page(true);
+}
@@ -0,0 +1,192 @@
+#ifndef RECORD_LINUX_OPUS_H_
+#define RECORD_LINUX_OPUS_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+#include "record_ogg.h"
+#include "record_resampler.h"
+#include "record_writer.h"
+
+struct OpusMSEncoder;
+
+////////////////////////////////////////////////////////////////////////////////
+//  Opus encoding (libopus), Ogg encapsulation (RFC 7845)
+//
+//  OpusPacketEncoder resamples the capture to the nearest Opus rate when
+//  needed and cuts it into 20 ms packets. Granule positions count 48 kHz
+//  samples including the encoder pre-skip; the last packet's is trimmed to
+//  the exact captured duration. One to eight channels (mapping family 0,
+//  or 1 for surround).
+//
+//  OpusEncodeWorker moves the encoding off the capture thread. On top of
+//  it, OggOpusWriter writes files with one Ogg page per second of audio and
+//  OpusStreamEncoder delivers packets (or short Ogg pages) with their
+//  presentation time.
+////////////////////////////////////////////////////////////////////////////////
+class OpusPacketEncoder
+{
+public:
+  static const uint32_t kGranuleRate = 48000;
+  static const uint32_t kFrameMs = 20;
+
+  // Receives each packet with its granule position.
+  typedef std::function<void(const uint8_t *packet, size_t size, int64_t granule)> PacketCallback;
+
+  ~OpusPacketEncoder();
+
+  bool configure(uint32_t sample_rate, size_t channels, int bit_rate, PacketCallback callback);
+
+  void encode_s16(const int16_t *samples, size_t frames);
+
+  // Encodes the remaining audio (and the pre-skip worth of padding).
+  void finish();
+
+  // "OpusHead" and "OpusTags" header packets.
+  void head(std::vector<uint8_t> *out) const;
+  void tags(std::vector<uint8_t> *out) const;
+
+  uint32_t encoder_rate() const { return encoder_rate_; }
+  uint32_t pre_skip() const { return pre_skip_; }
+
+  // Duration of one packet, in granule units.
+  int64_t packet_granules() const { return (int64_t)kGranuleRate * kFrameMs / 1000; }
+
+  // Packets the encoder failed on: dropped, their duration skipped.
+  uint64_t failed_packets() const { return failed_packets_; }
+
+private:
+  void encode_pending(bool last);
+
+  OpusMSEncoder *encoder_ = nullptr;
+  PacketCallback callback_;
+  uint32_t sample_rate_ = 0;
+  uint32_t encoder_rate_ = 0;
+  size_t channels_ = 0;
+  int mapping_family_ = 0;
+  int streams_ = 0;
+  int coupled_ = 0;
+  uint8_t mapping_[8] = {0};
+  uint32_t pre_skip_ = 0; // 48 kHz samples
+  size_t frame_size_ = 0; // at encoder_rate_
+
+  Resampler resampler_;
+  std::vector<float> input_;   // one capture chunk as float
+  std::vector<float> pending_; // at encoder_rate_, not yet encoded
+  std::vector<uint8_t> packet_;
+  uint64_t input_frames_ = 0;
+  int64_t granule_ = 0;
+  uint64_t failed_packets_ = 0;
+};
+
+// Buffers the capture into blocks, encoded on a worker thread. The packet
+// callback runs on the worker, and on the caller of finish().
+class OpusEncodeWorker
+{
+public:
+  ~OpusEncodeWorker();
+
+  bool start(uint32_t sample_rate, size_t channels, int bit_rate,
+             OpusPacketEncoder::PacketCallback callback);
+  void write_s16(const int16_t *samples, size_t frames);
+
+  // Encodes everything submitted, then stops the worker.
+  void finish();
+
+  const OpusPacketEncoder &encoder() const { return encoder_; }
+  bool running() const { return worker_.joinable(); }
+
+private:
+  static const size_t kBlockFrames = 4096;
+
+  struct Block
+  {
+    std::vector<int16_t> samples;
+    size_t frames = 0;
+  };
+
+  void submit_block();
+  void run();
+
+  size_t channels_ = 0;
+
+  // Capture side
+  std::unique_ptr<Block> current_;
+
+  // Hand-off
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::deque<std::unique_ptr<Block>> queue_;
+  std::vector<std::unique_ptr<Block>> free_;
+  bool closing_ = false;
+  std::thread worker_;
+
+  // Worker side
+  OpusPacketEncoder encoder_;
+};
+
+class OggOpusWriter : public FileWriter
+{
+public:
+  explicit OggOpusWriter(int bit_rate);
+  ~OggOpusWriter() override;
+
+  bool open(const char *path, uint32_t sample_rate, uint16_t channels) override;
+  void write_s16(const int16_t *samples, size_t frames) override;
+  bool close() override;
+  uint64_t frames() const override { return frames_; }
+
+private:
+  void on_packet(const uint8_t *packet, size_t size, int64_t granule);
+  void write_pages(bool eos);
+
+  int bit_rate_;
+  FILE *file_ = nullptr;
+  uint64_t frames_ = 0;
+  OpusEncodeWorker worker_;
+
+  // Worker side
+  OggStream ogg_;
+  std::vector<uint8_t> pages_;
+  int64_t page_start_ = 0; // granule of the last page written
+  bool io_error_ = false;
+};
+
+class OpusStreamEncoder : public StreamEncoder
+{
+public:
+  // Ogg pages are emitted every kPageMs, trading latency for overhead.
+  static const uint32_t kPageMs = 100;
+
+  OpusStreamEncoder(int bit_rate, bool ogg);
+  ~OpusStreamEncoder() override;
+
+  bool open(uint32_t sample_rate, uint16_t channels, Output output) override;
+  void write_s16(const int16_t *samples, size_t frames) override;
+  void close() override;
+
+private:
+  void on_packet(const uint8_t *packet, size_t size, int64_t granule);
+  void emit_page(bool eos);
+  int64_t granule_us(int64_t granule) const;
+
+  int bit_rate_;
+  bool ogg_framing_;
+  Output output_;
+  OpusEncodeWorker worker_;
+
+  // Worker side
+  OggStream ogg_;
+  int64_t page_start_ = 0; // granule where the pending page starts
+  int64_t page_end_ = 0;
+};
+
+#endif // RECORD_LINUX_OPUS_H_
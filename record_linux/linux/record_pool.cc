@@ -0,0 +1,356 @@
+#include "record_pool.h"
+
+#include <algorithm>
+#include <climits>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace
+{
+  static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex word size");
+
+  long futex(const std::atomic<uint32_t> *word, int op, uint32_t value)
+  {
+    return syscall(SYS_futex, (uint32_t *)word, op, value, nullptr, nullptr, 0);
+  }
+
+  std::mutex pool_mutex;
+  WorkerPool *pool_instance = nullptr;
+  int pool_refs = 0;
+
+  // Index of the calling worker in its pool, for submit().
+  thread_local const WorkerPool *current_pool = nullptr;
+  thread_local size_t current_worker = 0;
+}
+
+WorkerPool *WorkerPool::acquire()
+{
+  std::lock_guard<std::mutex> lock(pool_mutex);
+  if (!pool_instance)
+    pool_instance = new WorkerPool(std::max(1u, std::thread::hardware_concurrency()));
+  pool_refs++;
+  return pool_instance;
+}
+
+void WorkerPool::release(WorkerPool *pool)
+{
+  std::lock_guard<std::mutex> lock(pool_mutex);
+  if (!pool || pool != pool_instance)
+    return;
+  if (--pool_refs == 0)
+  {
+    delete pool_instance;
+    pool_instance = nullptr;
+  }
+}
+
+WorkerPool::WorkerPool(size_t threads)
+{
+  for (size_t i = 0; i < threads; i++)
+    workers_.emplace_back(new Worker());
+  for (size_t i = 0; i < threads; i++)
+    workers_[i]->thread = std::thread(&WorkerPool::run, this, i);
+}
+
+WorkerPool::~WorkerPool()
+{
+  closing_.store(true);
+  epoch_.fetch_add(1);
+  futex(&epoch_, FUTEX_WAKE_PRIVATE, INT_MAX);
+  for (std::unique_ptr<Worker> &worker : workers_)
+    worker->thread.join();
+}
+
+void WorkerPool::wake()
+{
+  epoch_.fetch_add(1);
+  if (sleepers_.load() > 0)
+    futex(&epoch_, FUTEX_WAKE_PRIVATE, 1);
+}
+
+void WorkerPool::submit(Task task)
+{
+  const size_t index = current_pool == this
+                           ? current_worker
+                           : next_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+  {
+    std::lock_guard<std::mutex> lock(workers_[index]->mutex);
+    workers_[index]->tasks.push_back(std::move(task));
+  }
+  queued_.fetch_add(1);
+  wake();
+}
+
+bool WorkerPool::run_queued()
+{
+  if (current_pool != this)
+    return false;
+
+  Task task;
+  if (!take(current_worker, &task))
+    return false;
+  task();
+  tasks_.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+bool WorkerPool::take(size_t index, Task *task)
+{
+  if (queued_.load() == 0)
+    return false;
+
+  // Own tasks oldest first, then the newest of another worker's.
+  for (size_t i = 0; i < workers_.size(); i++)
+  {
+    Worker &worker = *workers_[(index + i) % workers_.size()];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (worker.tasks.empty())
+      continue;
+    if (i == 0)
+    {
+      *task = std::move(worker.tasks.front());
+      worker.tasks.pop_front();
+    }
+    else
+    {
+      *task = std::move(worker.tasks.back());
+      worker.tasks.pop_back();
+      steals_.fetch_add(1, std::memory_order_relaxed);
+    }
+    queued_.fetch_sub(1);
+    return true;
+  }
+  return false;
+}
+
+void WorkerPool::run(size_t index)
+{
+  current_pool = this;
+  current_worker = index;
+
+  while (true)
+  {
+    const uint32_t epoch = epoch_.load();
+
+    // Real-time hand-offs go first, they have the tightest deadlines.
+    if (run_source())
+      continue;
+
+    Task task;
+    if (take(index, &task))
+    {
+      task();
+      tasks_.fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
+
+    if (closing_.load())
+      return;
+
+    // Any submit or signal after the epoch load bumped it: no lost wakeup.
+    sleepers_.fetch_add(1);
+    futex(&epoch_, FUTEX_WAIT_PRIVATE, epoch);
+    sleepers_.fetch_sub(1);
+  }
+}
+
+void WorkerPool::attach(PoolSource *source)
+{
+  std::lock_guard<std::mutex> lock(sources_mutex_);
+  sources_.push_back(source);
+}
+
+void WorkerPool::detach(PoolSource *source)
+{
+  {
+    std::lock_guard<std::mutex> lock(sources_mutex_);
+    sources_.erase(std::remove(sources_.begin(), sources_.end(), source), sources_.end());
+  }
+  flush(source);
+}
+
+void WorkerPool::signal(PoolSource *source)
+{
+  if (source->state_.fetch_or(PoolSource::kPending) == 0)
+  {
+    pending_sources_.fetch_add(1);
+    wake();
+  }
+}
+
+bool WorkerPool::run_source()
+{
+  if (pending_sources_.load() == 0)
+    return false;
+
+  PoolSource *claimed = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(sources_mutex_);
+    for (PoolSource *source : sources_)
+    {
+      uint32_t expected = PoolSource::kPending;
+      if (source->state_.compare_exchange_strong(expected, PoolSource::kRunning))
+      {
+        claimed = source;
+        break;
+      }
+    }
+  }
+  if (!claimed)
+    return false;
+
+  pending_sources_.fetch_sub(1);
+  run_claimed(claimed);
+  return true;
+}
+
+void WorkerPool::run_claimed(PoolSource *source)
+{
+  // Signals arriving while it runs make it run again here.
+  while (true)
+  {
+    source->run_();
+    uint32_t expected = PoolSource::kRunning;
+    if (source->state_.compare_exchange_strong(expected, 0))
+      return;
+    source->state_.store(PoolSource::kRunning);
+  }
+}
+
+void WorkerPool::flush(PoolSource *source)
+{
+  while (true)
+  {
+    uint32_t expected = PoolSource::kPending;
+    if (source->state_.compare_exchange_strong(expected, PoolSource::kRunning))
+    {
+      // Not claimed by a worker yet: run here.
+      pending_sources_.fetch_sub(1);
+      run_claimed(source);
+      return;
+    }
+    if (expected == 0)
+      return;
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+  }
+}
+
+int64_t WorkerPool::cpu_us() const
+{
+  int64_t total = 0;
+  for (const std::unique_ptr<Worker> &worker : workers_)
+  {
+    clockid_t clock;
+    struct timespec ts;
+    if (pthread_getcpuclockid(worker->thread.native_handle(), &clock) == 0 &&
+        clock_gettime(clock, &ts) == 0)
+      total += (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+  }
+  return total;
+}
+
+SerialQueue::~SerialQueue()
+{
+  drain();
+}
+
+void SerialQueue::submit(WorkerPool::Task task)
+{
+  bool schedule = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tasks_.push_back(std::move(task));
+    if (!scheduled_)
+    {
+      scheduled_ = true;
+      schedule = true;
+    }
+  }
+  if (schedule)
+    pool_->submit([this]
+                  { run_pending(); });
+}
+
+void SerialQueue::run_pending()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!tasks_.empty())
+  {
+    WorkerPool::Task task = std::move(tasks_.front());
+    tasks_.pop_front();
+    lock.unlock();
+    task();
+    lock.lock();
+  }
+  scheduled_ = false;
+  idle_.notify_all();
+}
+
+void SerialQueue::drain()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  idle_.wait(lock, [this]
+             { return !scheduled_; });
+}
+
+void SlotRing::configure(size_t slots, size_t slot_bytes, size_t side_bytes)
+{
+  slot_bytes_ = slot_bytes;
+  side_bytes_ = side_bytes;
+  data_.assign(slots * (slot_bytes + side_bytes), 0);
+  slots_.assign(slots, Slot());
+  clear();
+}
+
+void SlotRing::clear()
+{
+  head_.store(0, std::memory_order_relaxed);
+  tail_.store(0, std::memory_order_relaxed);
+}
+
+uint8_t *SlotRing::reserve()
+{
+  const size_t head = head_.load(std::memory_order_relaxed);
+  if (slots_.empty() || head - tail_.load(std::memory_order_acquire) == slots_.size())
+    return nullptr;
+  return &data_[(head % slots_.size()) * (slot_bytes_ + side_bytes_)];
+}
+
+void SlotRing::publish(size_t bytes, uint32_t tag, uint64_t gap, int64_t time_ns, size_t side)
+{
+  const size_t head = head_.load(std::memory_order_relaxed);
+  Slot &slot = slots_[head % slots_.size()];
+  slot.bytes = bytes;
+  slot.tag = tag;
+  slot.gap = gap;
+  slot.time_ns = time_ns;
+  slot.side = side;
+  head_.store(head + 1, std::memory_order_release);
+}
+
+bool SlotRing::front(const uint8_t **data, size_t *bytes, uint32_t *tag, uint64_t *gap,
+                     int64_t *time_ns, size_t *side) const
+{
+  const size_t tail = tail_.load(std::memory_order_relaxed);
+  if (slots_.empty() || tail == head_.load(std::memory_order_acquire))
+    return false;
+  const size_t index = tail % slots_.size();
+  *data = &data_[index * (slot_bytes_ + side_bytes_)];
+  *bytes = slots_[index].bytes;
+  *tag = slots_[index].tag;
+  if (gap)
+    *gap = slots_[index].gap;
+  if (time_ns)
+    *time_ns = slots_[index].time_ns;
+  if (side)
+    *side = slots_[index].side;
+  return true;
+}
+
+void SlotRing::pop()
+{
+  tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
@@ -0,0 +1,186 @@
+#ifndef RECORD_LINUX_POOL_H_
+#define RECORD_LINUX_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+//  Worker pool
+//
+//  WorkerPool runs tasks on a fixed set of threads, each with its own
+//  deque: a worker takes its own tasks first and steals from the others
+//  when it runs out, so that a burst from one session spreads over the
+//  cores. A SerialQueue runs its tasks one at a time, in submission order,
+//  on whichever worker is free: the pipeline of one session never runs
+//  concurrently with itself, while the sessions share the workers.
+//
+//  A PoolSource is the hand-off from a real-time thread: signal() neither
+//  locks nor allocates, it only flags the source and wakes a worker. The
+//  source then runs once on a worker, again if signalled meanwhile, and
+//  never concurrently with itself. Paired with a SlotRing, the capture
+//  thread publishes chunks and the pool processes them in order.
+////////////////////////////////////////////////////////////////////////////////
+class PoolSource
+{
+public:
+  explicit PoolSource(std::function<void()> run) : run_(std::move(run)) {}
+
+private:
+  friend class WorkerPool;
+  static const uint32_t kPending = 1;
+  static const uint32_t kRunning = 2;
+
+  std::function<void()> run_;
+  std::atomic<uint32_t> state_{0};
+};
+
+class WorkerPool
+{
+public:
+  typedef std::function<void()> Task;
+
+  // The process wide pool, one worker per core, started on first use.
+  // Every acquire() is paired with a release(); the last one stops it.
+  static WorkerPool *acquire();
+  static void release(WorkerPool *pool);
+
+  explicit WorkerPool(size_t threads);
+  // Runs the tasks still queued, then stops the workers.
+  ~WorkerPool();
+
+  // From a worker, queued on its own deque, else spread over the workers.
+  void submit(Task task);
+  // From a worker: runs one queued task, its own first, so that a task
+  // waiting on those it submitted keeps its worker busy instead of parking
+  // it. Returns false when none is queued, or when not called from a worker.
+  bool run_queued();
+
+  // Sources are attached before the first signal() and detached once their
+  // thread stopped signalling; detach() runs a pending source inline.
+  void attach(PoolSource *source);
+  void detach(PoolSource *source);
+  // Real-time safe.
+  void signal(PoolSource *source);
+  // Waits until [source] ran since its last signal.
+  void flush(PoolSource *source);
+
+  size_t size() const { return workers_.size(); }
+
+  // CPU time used by the workers so far.
+  int64_t cpu_us() const;
+  // Tasks run, and those taken from another worker's deque.
+  uint64_t tasks() const { return tasks_.load(std::memory_order_relaxed); }
+  uint64_t steals() const { return steals_.load(std::memory_order_relaxed); }
+
+private:
+  struct Worker
+  {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+    std::thread thread;
+  };
+
+  void run(size_t index);
+  bool take(size_t index, Task *task);
+  bool run_source();
+  void run_claimed(PoolSource *source);
+  void wake();
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::atomic<size_t> next_{0};   // round robin of outside submissions
+  std::atomic<size_t> queued_{0}; // tasks in the deques
+  std::atomic<uint32_t> epoch_{0}; // futex word, bumped by each wakeup
+  std::atomic<int> sleepers_{0};
+  std::atomic<bool> closing_{false};
+
+  std::mutex sources_mutex_;
+  std::vector<PoolSource *> sources_;
+  std::atomic<uint32_t> pending_sources_{0}; // signals not yet claimed
+
+  std::atomic<uint64_t> tasks_{0};
+  std::atomic<uint64_t> steals_{0};
+};
+
+class SerialQueue
+{
+public:
+  explicit SerialQueue(WorkerPool *pool) : pool_(pool) {}
+  // Waits for the tasks submitted.
+  ~SerialQueue();
+
+  void submit(WorkerPool::Task task);
+
+  // Blocks until every task submitted so far has run.
+  void drain();
+
+private:
+  void run_pending();
+
+  WorkerPool *pool_;
+  std::mutex mutex_;
+  std::condition_variable idle_;
+  std::deque<WorkerPool::Task> tasks_;
+  bool scheduled_ = false; // a worker runs, or is about to run, the tasks
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//  Single producer, single consumer ring of fixed size slots
+//
+//  Allocated by configure(); the producer then fills and publishes slots
+//  and the consumer reads and pops them, without locks or allocation.
+//  Each slot may carry side data, at slot_bytes() past its start, handed
+//  over with it (e.g. the echo reference read along with a capture chunk).
+////////////////////////////////////////////////////////////////////////////////
+class SlotRing
+{
+public:
+  // Not real-time safe. Neither side may be running.
+  void configure(size_t slots, size_t slot_bytes, size_t side_bytes = 0);
+  void clear();
+
+  size_t slot_bytes() const { return slot_bytes_; }
+  size_t side_bytes() const { return side_bytes_; }
+  // The storage of the slots, e.g. to lock it in RAM.
+  const void *memory() const { return data_.data(); }
+  size_t memory_bytes() const { return data_.size(); }
+
+  // Producer: the slot to fill next, or nullptr when the ring is full.
+  uint8_t *reserve();
+  // Producer: hands the reserved slot, holding [bytes], over with [tag],
+  // [gap] (what the producer lost just before it), [time_ns] (when it was
+  // produced) and [side] bytes of side data.
+  void publish(size_t bytes, uint32_t tag, uint64_t gap = 0, int64_t time_ns = 0,
+               size_t side = 0);
+
+  // Consumer: the oldest published slot, false when there is none.
+  bool front(const uint8_t **data, size_t *bytes, uint32_t *tag, uint64_t *gap = nullptr,
+             int64_t *time_ns = nullptr, size_t *side = nullptr) const;
+  void pop();
+
+private:
+  struct Slot
+  {
+    size_t bytes = 0;
+    uint32_t tag = 0;
+    uint64_t gap = 0;
+    int64_t time_ns = 0;
+    size_t side = 0;
+  };
+
+  std::vector<uint8_t> data_;
+  std::vector<Slot> slots_;
+  size_t slot_bytes_ = 0;
+  size_t side_bytes_ = 0;
+  std::atomic<size_t> head_{0}; // next to publish, written by the producer
+  std::atomic<size_t> tail_{0}; // next to pop, written by the consumer
+};
+
+#endif // RECORD_LINUX_POOL_H_
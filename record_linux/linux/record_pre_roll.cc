@@ -0,0 +1,72 @@
+#include "record_pre_roll.h"
+
+#include <algorithm>
+#include <cstring>
+
+void PreRollRing::configure(size_t capacity_frames, size_t frame_bytes)
+{
+  capacity_ = capacity_frames;
+  frame_bytes_ = frame_bytes;
+  data_.assign(capacity_ * frame_bytes_, 0);
+  clear();
+}
+
+void PreRollRing::clear()
+{
+  head_ = 0;
+  count_ = 0;
+}
+
+void PreRollRing::write(const uint8_t *data, size_t frames)
+{
+  if (capacity_ == 0)
+    return;
+
+  // Only the newest capacity_ frames can survive.
+  if (frames > capacity_)
+  {
+    data += (frames - capacity_) * frame_bytes_;
+    frames = capacity_;
+  }
+
+  const size_t first = std::min(frames, capacity_ - head_);
+  memcpy(&data_[head_ * frame_bytes_], data, first * frame_bytes_);
+  memcpy(&data_[0], data + first * frame_bytes_, (frames - first) * frame_bytes_);
+
+  head_ = (head_ + frames) % capacity_;
+  count_ = std::min(capacity_, count_ + frames);
+}
+
+size_t PreRollRing::last(size_t frames, Span *first, Span *second) const
+{
+  frames = std::min(frames, count_);
+  if (frames == 0)
+  {
+    // Also when there is no storage at all (capacity 0).
+    *first = {nullptr, 0};
+    *second = {nullptr, 0};
+    return 0;
+  }
+  const size_t start = (head_ + capacity_ - frames) % capacity_;
+  const size_t run = std::min(frames, capacity_ - start);
+
+  first->data = &data_[start * frame_bytes_];
+  first->frames = run;
+  second->data = frames > run ? &data_[0] : nullptr;
+  second->frames = frames - run;
+  return frames;
+}
+
+size_t PreRollRing::take(uint8_t *dest, size_t frames)
+{
+  if (frames == 0 || frames > count_ || capacity_ == 0)
+    return 0;
+
+  const size_t start = (head_ + capacity_ - count_) % capacity_;
+  const size_t run = std::min(frames, capacity_ - start);
+  memcpy(dest, &data_[start * frame_bytes_], run * frame_bytes_);
+  memcpy(dest + run * frame_bytes_, &data_[0], (frames - run) * frame_bytes_);
+
+  count_ -= frames;
+  return frames;
+}
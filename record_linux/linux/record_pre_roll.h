@@ -0,0 +1,51 @@
+#ifndef RECORD_LINUX_PRE_ROLL_H_
+#define RECORD_LINUX_PRE_ROLL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+//  Fixed-size history of captured frames
+//
+//  Storage is allocated once by configure(); write() overwrites the oldest
+//  frames and never allocates. last() exposes the newest frames as at most
+//  two contiguous spans so they can be flushed with bulk writes, take()
+//  consumes the oldest ones as a FIFO.
+//  Not thread-safe: written and read by one thread (the capture thread, or
+//  the session queue for the echo reference).
+////////////////////////////////////////////////////////////////////////////////
+class PreRollRing
+{
+public:
+  void configure(size_t capacity_frames, size_t frame_bytes);
+  void clear();
+
+  size_t capacity() const { return capacity_; }
+  size_t frames() const { return count_; }
+
+  void write(const uint8_t *data, size_t frames);
+
+  struct Span
+  {
+    const uint8_t *data;
+    size_t frames;
+  };
+
+  // Newest [frames] frames (clamped to what is stored), oldest first.
+  // Returns the total number of frames in both spans.
+  size_t last(size_t frames, Span *first, Span *second) const;
+
+  // Copies the oldest [frames] frames to [dest] and drops them, if that
+  // many are stored. Returns the frames copied, 0 otherwise.
+  size_t take(uint8_t *dest, size_t frames);
+
+private:
+  std::vector<uint8_t> data_;
+  size_t frame_bytes_ = 0;
+  size_t capacity_ = 0;
+  size_t head_ = 0; // next frame written
+  size_t count_ = 0;
+};
+
+#endif // RECORD_LINUX_PRE_ROLL_H_
@@ -0,0 +1,280 @@
+#include "record_pulse.h"
+
+#include <algorithm>
+#include <cstring>
+#include <pulse/def.h>
+
+PulseCapture::~PulseCapture()
+{
+  close();
+}
+
+bool PulseCapture::open(const char *device, const char *stream_name, const pa_sample_spec &spec,
+                        size_t fragment_bytes, int *error)
+{
+  close();
+  hole_bytes_.store(0, std::memory_order_relaxed);
+
+  {
+    std::lock_guard<std::mutex> lock(mainloop_mutex_);
+    mainloop_ = pa_mainloop_new();
+  }
+  context_ = mainloop_ ? pa_context_new(pa_mainloop_get_api(mainloop_), "record_linux_plugin") : nullptr;
+  if (!context_ || pa_context_connect(context_, nullptr, PA_CONTEXT_NOFLAGS, nullptr) < 0)
+  {
+    *error = context_ ? pa_context_errno(context_) : PA_ERR_INTERNAL;
+    close();
+    return false;
+  }
+
+  while (pa_context_get_state(context_) != PA_CONTEXT_READY)
+  {
+    if (!iterate(true, error))
+    {
+      close();
+      return false;
+    }
+  }
+
+  stream_ = pa_stream_new(context_, stream_name, &spec, nullptr);
+  if (!stream_)
+  {
+    *error = pa_context_errno(context_);
+    close();
+    return false;
+  }
+
+  pa_buffer_attr attr;
+  attr.maxlength = (uint32_t)-1;
+  attr.tlength = (uint32_t)-1;
+  attr.prebuf = (uint32_t)-1;
+  attr.minreq = (uint32_t)-1;
+  attr.fragsize = (uint32_t)fragment_bytes;
+  // Timing kept up to date for capture_delay_us().
+  if (pa_stream_connect_record(stream_, device, &attr,
+                               (pa_stream_flags_t)(PA_STREAM_ADJUST_LATENCY | PA_STREAM_INTERPOLATE_TIMING |
+                                                   PA_STREAM_AUTO_TIMING_UPDATE)) < 0)
+  {
+    *error = pa_context_errno(context_);
+    close();
+    return false;
+  }
+
+  while (pa_stream_get_state(stream_) != PA_STREAM_READY)
+  {
+    if (!iterate(true, error))
+    {
+      close();
+      return false;
+    }
+  }
+  corked_ = false;
+  return true;
+}
+
+void PulseCapture::close()
+{
+  if (stream_)
+  {
+    pa_stream_disconnect(stream_);
+    pa_stream_unref(stream_);
+    stream_ = nullptr;
+  }
+  if (context_)
+  {
+    pa_context_disconnect(context_);
+    pa_context_unref(context_);
+    context_ = nullptr;
+  }
+  if (mainloop_)
+  {
+    std::lock_guard<std::mutex> lock(mainloop_mutex_);
+    pa_mainloop_free(mainloop_);
+    mainloop_ = nullptr;
+  }
+  fragment_ = nullptr;
+  fragment_size_ = 0;
+  fragment_offset_ = 0;
+  corked_ = false;
+}
+
+int PulseCapture::failure() const
+{
+  const int error = context_ ? pa_context_errno(context_) : PA_ERR_BADSTATE;
+  return error != PA_OK ? error : PA_ERR_CONNECTIONTERMINATED;
+}
+
+bool PulseCapture::iterate(bool block, int *error)
+{
+  if (block)
+    wakeups_++;
+  if (pa_mainloop_iterate(mainloop_, block ? 1 : 0, nullptr) < 0 ||
+      !PA_CONTEXT_IS_GOOD(pa_context_get_state(context_)) ||
+      (stream_ && !PA_STREAM_IS_GOOD(pa_stream_get_state(stream_))))
+  {
+    *error = failure();
+    return false;
+  }
+  return true;
+}
+
+size_t PulseCapture::backlog_bytes() const
+{
+  if (!stream_)
+    return 0;
+  // Counts the fragment peeked until it is dropped.
+  const size_t readable = pa_stream_readable_size(stream_);
+  if (readable == (size_t)-1 || readable < fragment_offset_)
+    return 0;
+  return readable - fragment_offset_;
+}
+
+bool PulseCapture::capture_delay_us(int64_t *delay_us) const
+{
+  pa_usec_t latency = 0;
+  int negative = 0;
+  if (!stream_ || pa_stream_get_latency(stream_, &latency, &negative) < 0)
+    return false;
+  // Of the frame at the read index, the start of the fragment peeked.
+  const pa_sample_spec *spec = pa_stream_get_sample_spec(stream_);
+  *delay_us = (negative ? -(int64_t)latency : (int64_t)latency) -
+              (int64_t)pa_bytes_to_usec(fragment_offset_, spec);
+  return true;
+}
+
+size_t PulseCapture::read(void *data, size_t bytes, int *error)
+{
+  if (!stream_ || corked_)
+  {
+    *error = PA_ERR_BADSTATE;
+    return 0;
+  }
+
+  uint8_t *dst = (uint8_t *)data;
+  size_t done = 0;
+  while (done < bytes)
+  {
+    if (fragment_offset_ == fragment_size_)
+    {
+      if (fragment_size_ > 0)
+      {
+        pa_stream_drop(stream_);
+        fragment_size_ = 0;
+        fragment_offset_ = 0;
+      }
+
+      const void *fragment = nullptr;
+      size_t size = 0;
+      if (pa_stream_peek(stream_, &fragment, &size) < 0)
+      {
+        *error = failure();
+        return done;
+      }
+      if (size == 0)
+      {
+        if (interrupted_.exchange(false, std::memory_order_acquire))
+        {
+          *error = kInterrupted;
+          return done;
+        }
+        if (!iterate(true, error))
+          return done;
+        continue;
+      }
+      fragment_ = (const uint8_t *)fragment;
+      fragment_size_ = size;
+    }
+
+    // Holes (lost fragments) read as silence.
+    const size_t n = std::min(bytes - done, fragment_size_ - fragment_offset_);
+    if (fragment_)
+    {
+      memcpy(dst + done, fragment_ + fragment_offset_, n);
+    }
+    else
+    {
+      memset(dst + done, 0, n);
+      hole_bytes_.fetch_add(n, std::memory_order_relaxed);
+    }
+    fragment_offset_ += n;
+    done += n;
+  }
+  return done;
+}
+
+void PulseCapture::interrupt()
+{
+  interrupted_.store(true, std::memory_order_release);
+  std::lock_guard<std::mutex> lock(mainloop_mutex_);
+  if (mainloop_)
+    pa_mainloop_wakeup(mainloop_);
+}
+
+void PulseCapture::discard_readable()
+{
+  if (fragment_size_ > 0)
+  {
+    pa_stream_drop(stream_);
+    fragment_ = nullptr;
+    fragment_size_ = 0;
+    fragment_offset_ = 0;
+  }
+
+  const void *fragment = nullptr;
+  size_t size = 0;
+  while (pa_stream_peek(stream_, &fragment, &size) == 0 && size > 0)
+  {
+    pa_stream_drop(stream_);
+  }
+}
+
+bool PulseCapture::wait_operation(pa_operation *operation, int *error)
+{
+  if (!operation)
+  {
+    *error = failure();
+    return false;
+  }
+  bool ok = true;
+  while (pa_operation_get_state(operation) == PA_OPERATION_RUNNING)
+  {
+    if (!iterate(true, error))
+    {
+      ok = false;
+      break;
+    }
+  }
+  pa_operation_unref(operation);
+  return ok;
+}
+
+bool PulseCapture::set_corked(bool corked, int *error)
+{
+  if (!stream_)
+  {
+    *error = PA_ERR_BADSTATE;
+    return false;
+  }
+  if (corked == corked_)
+    return true;
+
+  // Server side buffers are flushed while stopped, so that nothing
+  // captured between the last read and the cork is delivered after it.
+  if (corked)
+  {
+    if (!wait_operation(pa_stream_cork(stream_, 1, nullptr, nullptr), error) ||
+        !wait_operation(pa_stream_flush(stream_, nullptr, nullptr), error))
+      return false;
+    discard_readable();
+    corked_ = true;
+    return true;
+  }
+
+  if (!wait_operation(pa_stream_flush(stream_, nullptr, nullptr), error))
+    return false;
+  discard_readable();
+  if (!wait_operation(pa_stream_cork(stream_, 0, nullptr, nullptr), error))
+    return false;
+  corked_ = false;
+  return true;
+}
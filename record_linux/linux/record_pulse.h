@@ -0,0 +1,86 @@
+#ifndef RECORD_LINUX_PULSE_H_
+#define RECORD_LINUX_PULSE_H_
+
+#include <atomic>
+#include <mutex>
+#include <pulse/context.h>
+#include <pulse/mainloop.h>
+#include <pulse/stream.h>
+#include <stddef.h>
+#include <stdint.h>
+
+////////////////////////////////////////////////////////////////////////////////
+//  PulseAudio record stream
+//
+//  A blocking reader like pa_simple, on the asynchronous API so that the
+//  stream can be corked: a corked stream is stopped on the server, which
+//  then neither buffers nor overruns. Corking discards the audio captured
+//  after the last read; uncorking discards anything left over. Reads thus
+//  resume with the first frame captured after the uncork.
+//
+//  The mainloop is iterated by the caller of read() and set_corked(), so
+//  one thread owns the object once it is open, and may open it again after
+//  a failure. interrupt() is the exception: any thread may call it to cut a
+//  blocked read short.
+////////////////////////////////////////////////////////////////////////////////
+class PulseCapture
+{
+public:
+  // *error of a read cut short by interrupt()
+  static const int kInterrupted = -1;
+
+  ~PulseCapture();
+
+  // Connects a record stream to [device] (nullptr for the default
+  // source), delivering fragments of about [fragment_bytes].
+  // Returns false with *error set (a PA_ERR_ code) on failure.
+  bool open(const char *device, const char *stream_name, const pa_sample_spec &spec,
+            size_t fragment_bytes, int *error);
+  void close();
+  bool is_open() const { return stream_ != nullptr; }
+
+  // Blocks until [bytes] are read, or until interrupted. Returns the number
+  // of bytes read (whole frames); when short, *error tells why.
+  size_t read(void *data, size_t bytes, int *error);
+
+  // Makes the read in progress, or else the next one, return at once.
+  void interrupt();
+
+  bool set_corked(bool corked, int *error);
+  bool corked() const { return corked_; }
+
+  // Times the reading thread blocked waiting for the server.
+  uint64_t wakeups() const { return wakeups_; }
+  // Holes in the stream (the source delivered nothing), read as silence.
+  // From any thread.
+  uint64_t hole_bytes() const { return hole_bytes_.load(std::memory_order_relaxed); }
+
+  // Audio already captured and not read yet, as received so far: how late
+  // the reader is.
+  size_t backlog_bytes() const;
+  // How long ago the next frame to read was captured, from the timing the
+  // server reports. False until it reported any.
+  bool capture_delay_us(int64_t *delay_us) const;
+
+private:
+  bool iterate(bool block, int *error);
+  bool wait_operation(pa_operation *operation, int *error);
+  void discard_readable();
+  int failure() const;
+
+  pa_mainloop *mainloop_ = nullptr;
+  std::mutex mainloop_mutex_; // mainloop_ replaced while interrupt() wakes it
+  pa_context *context_ = nullptr;
+  pa_stream *stream_ = nullptr;
+  bool corked_ = false;
+  std::atomic<bool> interrupted_{false};
+  uint64_t wakeups_ = 0;
+  std::atomic<uint64_t> hole_bytes_{0};
+
+  // Fragment peeked and not fully consumed
+  const uint8_t *fragment_ = nullptr; // nullptr for a hole
+  size_t fragment_size_ = 0;
+  size_t fragment_offset_ = 0;
+};
+
+#endif // RECORD_LINUX_PULSE_H_
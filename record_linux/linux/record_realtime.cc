@@ -0,0 +1,309 @@
+#include "record_realtime.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <gio/gio.h>
+#include <glib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef SCHED_RESET_ON_FORK
+#define SCHED_RESET_ON_FORK 0x40000000
+#endif
+
+namespace
+{
+  // Stack pre-faulted and locked by enter(), beyond what the capture uses.
+  const size_t kStackBytes = 128 * 1024;
+  // RLIMIT_RTTIME asked for with RealtimeKit, as PulseAudio does.
+  const rlim_t kRtTimeUs = 200000;
+  // Late reads are logged at most this often.
+  const int64_t kWarningIntervalUs = 1000000;
+
+  pid_t current_tid()
+  {
+    return (pid_t)syscall(SYS_gettid);
+  }
+
+  int64_t monotonic_us()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+  }
+
+  // An integer property of RealtimeKit, [fallback] when unavailable.
+  int64_t rtkit_property(GDBusConnection *bus, const char *name, int64_t fallback)
+  {
+    GVariant *reply = g_dbus_connection_call_sync(
+        bus, "org.freedesktop.RealtimeKit1", "/org/freedesktop/RealtimeKit1",
+        "org.freedesktop.DBus.Properties", "Get",
+        g_variant_new("(ss)", "org.freedesktop.RealtimeKit1", name), G_VARIANT_TYPE("(v)"),
+        G_DBUS_CALL_FLAGS_NONE, -1, nullptr, nullptr);
+    if (!reply)
+      return fallback;
+
+    GVariant *value = nullptr;
+    g_variant_get(reply, "(v)", &value);
+    int64_t result = fallback;
+    if (g_variant_is_of_type(value, G_VARIANT_TYPE_INT32))
+      result = g_variant_get_int32(value);
+    else if (g_variant_is_of_type(value, G_VARIANT_TYPE_INT64))
+      result = g_variant_get_int64(value);
+    g_variant_unref(value);
+    g_variant_unref(reply);
+    return result;
+  }
+}
+
+bool realtime_policy_from_name(const std::string &name, RealtimePolicy *policy)
+{
+  static const char *const kNames[] = {"off", "fifo", "roundRobin"};
+  for (size_t i = 0; i < sizeof(kNames) / sizeof(kNames[0]); i++)
+  {
+    if (name == kNames[i])
+    {
+      *policy = (RealtimePolicy)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+const char *realtime_policy_name(RealtimePolicy policy)
+{
+  switch (policy)
+  {
+  case RealtimePolicy::kFifo:
+    return "fifo";
+  case RealtimePolicy::kRoundRobin:
+    return "roundRobin";
+  default:
+    return "off";
+  }
+}
+
+void RealtimeThread::enter(RealtimePolicy policy, int priority, const std::vector<int> &cpus)
+{
+  policy_.store((int)RealtimePolicy::kOff);
+  priority_.store(0);
+  rtkit_.store(false);
+  pinned_.store(false);
+  locked_bytes_.store(0);
+  reads_.store(0);
+  max_latency_us_.store(0);
+  total_latency_us_.store(0);
+  late_reads_.store(0);
+  preemptions_.store(0);
+  stray_blocks_.store(0);
+  major_faults_.store(0);
+  last_audio_waits_ = 0;
+  last_warning_us_ = 0;
+  active_ = policy != RealtimePolicy::kOff;
+
+  if (!cpus.empty())
+  {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus)
+    {
+      if (cpu >= 0 && cpu < CPU_SETSIZE)
+        CPU_SET(cpu, &set);
+    }
+    const int error = CPU_COUNT(&set) > 0 ? pthread_setaffinity_np(pthread_self(), sizeof(set), &set)
+                                          : EINVAL;
+    if (error == 0)
+      pinned_.store(true);
+    else
+      g_warning("Capture thread CPU affinity not set: %s", strerror(error));
+  }
+
+  if (active_)
+  {
+    const int sched = policy == RealtimePolicy::kFifo ? SCHED_FIFO : SCHED_RR;
+    if (make_realtime_direct(sched, priority))
+    {
+      policy_.store((int)policy);
+    }
+    else if (make_realtime_rtkit(priority))
+    {
+      policy_.store((int)RealtimePolicy::kRoundRobin);
+      rtkit_.store(true);
+    }
+    else
+    {
+      g_warning("Capture thread stays at normal priority: neither allowed directly "
+                "(CAP_SYS_NICE, RLIMIT_RTPRIO) nor by RealtimeKit");
+    }
+
+    // The pages the capture is about to touch, faulted in and kept.
+    volatile uint8_t stack[kStackBytes];
+    memset((void *)stack, 0, sizeof(stack));
+    lock((const void *)stack, sizeof(stack));
+  }
+
+  rebase(0);
+}
+
+bool RealtimeThread::make_realtime_direct(int policy, int priority)
+{
+  struct sched_param param;
+  memset(&param, 0, sizeof(param));
+  param.sched_priority = std::min(std::max(priority, sched_get_priority_min(policy)),
+                                  sched_get_priority_max(policy));
+  // Not inherited by processes spawned from the capture thread.
+  if (sched_setscheduler(current_tid(), policy | SCHED_RESET_ON_FORK, &param) != 0)
+    return false;
+  priority_.store(param.sched_priority);
+  return true;
+}
+
+bool RealtimeThread::make_realtime_rtkit(int priority)
+{
+  GError *error = nullptr;
+  GDBusConnection *bus = g_bus_get_sync(G_BUS_TYPE_SYSTEM, nullptr, &error);
+  if (!bus)
+  {
+    g_warning("RealtimeKit unavailable: %s", error->message);
+    g_error_free(error);
+    return false;
+  }
+
+  // RealtimeKit only serves threads that cannot hog a CPU forever.
+  const int64_t max_priority = rtkit_property(bus, "MaxRealtimePriority", 20);
+  const int64_t max_rttime = rtkit_property(bus, "RTTimeUSecMax", kRtTimeUs);
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_RTTIME, &limit) == 0 &&
+      (limit.rlim_max == RLIM_INFINITY || limit.rlim_max > (rlim_t)max_rttime))
+  {
+    limit.rlim_cur = limit.rlim_max = std::min<rlim_t>(kRtTimeUs, (rlim_t)max_rttime);
+    setrlimit(RLIMIT_RTTIME, &limit);
+  }
+
+  const int granted = (int)std::max<int64_t>(1, std::min<int64_t>(priority, max_priority));
+  GVariant *reply = g_dbus_connection_call_sync(
+      bus, "org.freedesktop.RealtimeKit1", "/org/freedesktop/RealtimeKit1",
+      "org.freedesktop.RealtimeKit1", "MakeThreadRealtime",
+      g_variant_new("(tu)", (guint64)current_tid(), (guint32)granted), nullptr,
+      G_DBUS_CALL_FLAGS_NONE, -1, nullptr, &error);
+  g_object_unref(bus);
+  if (!reply)
+  {
+    g_warning("RealtimeKit refused: %s", error->message);
+    g_error_free(error);
+    return false;
+  }
+  g_variant_unref(reply);
+  priority_.store(granted);
+  return true;
+}
+
+void RealtimeThread::lock(const void *data, size_t bytes)
+{
+  if (!active_ || !data || bytes == 0)
+    return;
+  if (mlock(data, bytes) != 0)
+  {
+    g_warning("Capture buffers not locked in memory (%zu bytes): %s", bytes, strerror(errno));
+    return;
+  }
+  locked_.emplace_back(data, bytes);
+  locked_bytes_.fetch_add(bytes);
+}
+
+void RealtimeThread::rebase(uint64_t audio_waits)
+{
+  struct rusage usage;
+  getrusage(RUSAGE_THREAD, &usage);
+  last_nvcsw_ = usage.ru_nvcsw;
+  last_nivcsw_ = usage.ru_nivcsw;
+  last_majflt_ = usage.ru_majflt;
+  last_audio_waits_ = audio_waits;
+}
+
+void RealtimeThread::sample(int64_t backlog_us, int64_t late_us, uint64_t audio_waits)
+{
+  reads_.fetch_add(1, std::memory_order_relaxed);
+  total_latency_us_.fetch_add(backlog_us, std::memory_order_relaxed);
+  if (backlog_us > max_latency_us_.load(std::memory_order_relaxed))
+    max_latency_us_.store(backlog_us, std::memory_order_relaxed);
+
+  struct rusage usage;
+  getrusage(RUSAGE_THREAD, &usage);
+  const long voluntary = usage.ru_nvcsw - last_nvcsw_;
+  const long waits = (long)(audio_waits - last_audio_waits_);
+  const long preempted = usage.ru_nivcsw - last_nivcsw_;
+  const long faults = usage.ru_majflt - last_majflt_;
+  preemptions_.fetch_add((uint64_t)preempted, std::memory_order_relaxed);
+  major_faults_.fetch_add((uint64_t)faults, std::memory_order_relaxed);
+  if (voluntary > waits)
+    stray_blocks_.fetch_add((uint64_t)(voluntary - waits), std::memory_order_relaxed);
+  last_nvcsw_ = usage.ru_nvcsw;
+  last_nivcsw_ = usage.ru_nivcsw;
+  last_majflt_ = usage.ru_majflt;
+  last_audio_waits_ = audio_waits;
+
+  if (backlog_us <= late_us)
+    return;
+  late_reads_.fetch_add(1, std::memory_order_relaxed);
+
+  // Only worth the log when real-time was asked for.
+  const int64_t now_us = monotonic_us();
+  if (active_ && now_us - last_warning_us_ >= kWarningIntervalUs)
+  {
+    last_warning_us_ = now_us;
+    g_warning("Capture thread woke %lld us late (%ld preemptions, %ld blocks not waiting for "
+              "audio since the last read)",
+              (long long)backlog_us, preempted, voluntary > waits ? voluntary - waits : 0);
+  }
+}
+
+void RealtimeThread::leave()
+{
+  for (const std::pair<const void *, size_t> &range : locked_)
+    munlock(range.first, range.second);
+  locked_.clear();
+
+  if (!active_)
+    return;
+  active_ = false;
+
+  struct sched_param param;
+  memset(&param, 0, sizeof(param));
+  sched_setscheduler(current_tid(), SCHED_OTHER, &param);
+
+  const RealtimeStats summary = stats();
+  g_message("Capture thread %s %d%s: %llu reads, scheduling latency avg %lld us max %lld us, "
+            "%llu late, %llu preemptions, %llu blocks not waiting for audio (possible priority "
+            "inversions), %llu major faults",
+            realtime_policy_name(summary.policy), summary.priority,
+            summary.rtkit ? " (RealtimeKit)" : "", (unsigned long long)summary.reads,
+            (long long)(summary.reads ? summary.total_latency_us / (int64_t)summary.reads : 0),
+            (long long)summary.max_latency_us, (unsigned long long)summary.late_reads,
+            (unsigned long long)summary.preemptions, (unsigned long long)summary.stray_blocks,
+            (unsigned long long)summary.major_faults);
+}
+
+RealtimeStats RealtimeThread::stats() const
+{
+  RealtimeStats stats;
+  stats.policy = (RealtimePolicy)policy_.load();
+  stats.priority = priority_.load();
+  stats.rtkit = rtkit_.load();
+  stats.pinned = pinned_.load();
+  stats.locked_bytes = locked_bytes_.load();
+  stats.reads = reads_.load(std::memory_order_relaxed);
+  stats.max_latency_us = max_latency_us_.load(std::memory_order_relaxed);
+  stats.total_latency_us = total_latency_us_.load(std::memory_order_relaxed);
+  stats.late_reads = late_reads_.load(std::memory_order_relaxed);
+  stats.preemptions = preemptions_.load(std::memory_order_relaxed);
+  stats.stray_blocks = stray_blocks_.load(std::memory_order_relaxed);
+  stats.major_faults = major_faults_.load(std::memory_order_relaxed);
+  return stats;
+}
@@ -0,0 +1,106 @@
+#ifndef RECORD_LINUX_REALTIME_H_
+#define RECORD_LINUX_REALTIME_H_
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+//  Real-time scheduling of the capture thread
+//
+//  RealtimeThread::enter() runs on the thread to promote. It asks for
+//  SCHED_FIFO or SCHED_RR directly, which needs CAP_SYS_NICE or an
+//  RLIMIT_RTPRIO, and else through RealtimeKit on the system bus (SCHED_RR
+//  only, within the RLIMIT_RTTIME it requires). It then optionally pins
+//  the thread to a set of CPUs, pre-faults its stack, and lock()
+//  keeps the buffers it touches in RAM. Whatever cannot be had is logged
+//  and skipped, the capture runs either way.
+//
+//  The thread reports after each read how much audio was already waiting
+//  (the backlog left in the server and the stream): a thread woken on time
+//  finds less than a fragment, a late one more. Together with the
+//  involuntary context switches (preemptions) and the voluntary ones that
+//  were not waits for audio (blocked on something else: a lock held by a
+//  lower priority thread, a page fault), this is the scheduling latency
+//  summary logged by leave().
+////////////////////////////////////////////////////////////////////////////////
+enum class RealtimePolicy
+{
+  kOff,
+  kFifo,
+  kRoundRobin,
+};
+
+// "off", "fifo" or "roundRobin".
+bool realtime_policy_from_name(const std::string &name, RealtimePolicy *policy);
+const char *realtime_policy_name(RealtimePolicy policy);
+
+struct RealtimeStats
+{
+  RealtimePolicy policy = RealtimePolicy::kOff; // obtained
+  int priority = 0;
+  bool rtkit = false;  // granted by RealtimeKit
+  bool pinned = false; // CPU affinity applied
+  size_t locked_bytes = 0;
+  uint64_t reads = 0;
+  int64_t max_latency_us = 0;
+  int64_t total_latency_us = 0;
+  uint64_t late_reads = 0;   // backlog above the lateness threshold
+  uint64_t preemptions = 0;  // involuntary context switches
+  uint64_t stray_blocks = 0; // voluntary switches beyond the waits for audio
+  uint64_t major_faults = 0;
+};
+
+class RealtimeThread
+{
+public:
+  // On the thread to promote. [priority] is clamped to what is allowed;
+  // [cpus] may be empty.
+  void enter(RealtimePolicy policy, int priority, const std::vector<int> &cpus);
+  // Locks [bytes] at [data] in RAM until leave(). Needs the memlock limit.
+  void lock(const void *data, size_t bytes);
+  // Unlocks, logs the summary and returns to SCHED_OTHER.
+  void leave();
+
+  // After each read: [backlog_us] of audio already waiting, [late_us] the
+  // backlog considered late, [audio_waits] times the read blocked for audio
+  // in total so far.
+  void sample(int64_t backlog_us, int64_t late_us, uint64_t audio_waits);
+  // After a deliberate wait (parked while paused or warm): those switches
+  // are not counted.
+  void rebase(uint64_t audio_waits);
+
+  // Snapshot, from any thread.
+  RealtimeStats stats() const;
+
+private:
+  bool make_realtime_direct(int policy, int priority);
+  bool make_realtime_rtkit(int priority);
+
+  // Thread only
+  bool active_ = false; // promoted by enter()
+  std::vector<std::pair<const void *, size_t>> locked_;
+  long last_nvcsw_ = 0;
+  long last_nivcsw_ = 0;
+  long last_majflt_ = 0;
+  uint64_t last_audio_waits_ = 0;
+  int64_t last_warning_us_ = 0;
+
+  // Written by the thread, read by stats(); no lock for the thread to wait on
+  std::atomic<int> policy_{(int)RealtimePolicy::kOff};
+  std::atomic<int> priority_{0};
+  std::atomic<bool> rtkit_{false};
+  std::atomic<bool> pinned_{false};
+  std::atomic<size_t> locked_bytes_{0};
+  std::atomic<uint64_t> reads_{0};
+  std::atomic<int64_t> max_latency_us_{0};
+  std::atomic<int64_t> total_latency_us_{0};
+  std::atomic<uint64_t> late_reads_{0};
+  std::atomic<uint64_t> preemptions_{0};
+  std::atomic<uint64_t> stray_blocks_{0};
+  std::atomic<uint64_t> major_faults_{0};
+};
+
+#endif // RECORD_LINUX_REALTIME_H_
@@ -0,0 +1,326 @@
+#include "record_resampler.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define RECORD_RESAMPLER_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define RECORD_RESAMPLER_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+  struct QualityPreset
+  {
+    const char *name;
+    // Zero crossings of the sinc on each side of the center.
+    double zero_crossings;
+    // Passband edge, relative to the lower Nyquist frequency.
+    double rolloff;
+    // Kaiser window shape: beta = 0.1102 (A - 8.7) for a stopband
+    // attenuation of A dB (A > 50), so A = beta / 0.1102 + 8.7.
+    double kaiser_beta;
+  };
+
+  const QualityPreset kPresets[] = {
+      {"low", 8.0, 0.80, 5.0},
+      {"medium", 16.0, 0.90, 8.6},
+      {"high", 32.0, 0.95, 10.0},
+      {"best", 64.0, 0.97, 12.0},
+  };
+
+  // Phases are padded with zero taps to a multiple of this.
+  const size_t kTapAlign = 8;
+
+  uint32_t gcd(uint32_t a, uint32_t b)
+  {
+    while (b != 0)
+    {
+      const uint32_t t = a % b;
+      a = b;
+      b = t;
+    }
+    return a;
+  }
+
+  // Zeroth order modified Bessel function of the first kind.
+  double bessel_i0(double x)
+  {
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 64; k++)
+    {
+      term *= (x / (2.0 * k)) * (x / (2.0 * k));
+      sum += term;
+      if (term < sum * 1e-12)
+        break;
+    }
+    return sum;
+  }
+
+  // ---------------------------------------------------------------------------
+  // Dot products over [n] floats, n a multiple of kTapAlign
+  // ---------------------------------------------------------------------------
+  typedef float (*DotKernel)(const float *a, const float *b, size_t n);
+
+  float dot_scalar(const float *a, const float *b, size_t n)
+  {
+    float acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    for (size_t k = 0; k < n; k += 4)
+    {
+      acc[0] += a[k] * b[k];
+      acc[1] += a[k + 1] * b[k + 1];
+      acc[2] += a[k + 2] * b[k + 2];
+      acc[3] += a[k + 3] * b[k + 3];
+    }
+    return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+  }
+
+#if RECORD_RESAMPLER_X86
+  __attribute__((target("sse"))) float dot_sse(const float *a, const float *b, size_t n)
+  {
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    for (size_t k = 0; k < n; k += 8)
+    {
+      acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + k), _mm_loadu_ps(b + k)));
+      acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + k + 4), _mm_loadu_ps(b + k + 4)));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, _mm_add_ps(acc0, acc1));
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+  }
+
+  __attribute__((target("avx2,fma"))) float dot_avx2(const float *a, const float *b, size_t n)
+  {
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    size_t k = 0;
+    for (; k + 16 <= n; k += 16)
+    {
+      acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + k), _mm256_loadu_ps(b + k), acc0);
+      acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + k + 8), _mm256_loadu_ps(b + k + 8), acc1);
+    }
+    if (k < n)
+      acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + k), _mm256_loadu_ps(b + k), acc0);
+    const __m256 acc = _mm256_add_ps(acc0, acc1);
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+  }
+#endif // RECORD_RESAMPLER_X86
+
+#if RECORD_RESAMPLER_NEON
+  float dot_neon(const float *a, const float *b, size_t n)
+  {
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+    for (size_t k = 0; k < n; k += 8)
+    {
+      acc0 = vfmaq_f32(acc0, vld1q_f32(a + k), vld1q_f32(b + k));
+      acc1 = vfmaq_f32(acc1, vld1q_f32(a + k + 4), vld1q_f32(b + k + 4));
+    }
+    return vaddvq_f32(vaddq_f32(acc0, acc1));
+  }
+#endif // RECORD_RESAMPLER_NEON
+
+  DotKernel select_dot()
+  {
+#if RECORD_RESAMPLER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+      return dot_avx2;
+    if (__builtin_cpu_supports("sse"))
+      return dot_sse;
+#elif RECORD_RESAMPLER_NEON
+    return dot_neon;
+#endif
+    return dot_scalar;
+  }
+
+  float dot(const float *a, const float *b, size_t n)
+  {
+    static const DotKernel kernel = select_dot();
+    return kernel(a, b, n);
+  }
+}
+
+bool resampler_quality_from_name(const std::string &name, ResamplerQuality *quality)
+{
+  for (size_t i = 0; i < sizeof(kPresets) / sizeof(kPresets[0]); i++)
+  {
+    if (name == kPresets[i].name)
+    {
+      *quality = (ResamplerQuality)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+const char *resampler_quality_name(ResamplerQuality quality)
+{
+  return kPresets[(size_t)quality].name;
+}
+
+ResamplerDesign resampler_design(ResamplerQuality quality)
+{
+  const QualityPreset &preset = kPresets[(size_t)quality];
+  ResamplerDesign design;
+  design.attenuation_db = preset.kaiser_beta / 0.1102 + 8.7;
+  // Kaiser's length estimate, solved for the transition width around the
+  // cutoff: the filter spans 2 * zero_crossings / rolloff input periods.
+  const double transition =
+      preset.rolloff * (design.attenuation_db - 7.95) / (14.36 * preset.zero_crossings);
+  design.passband = preset.rolloff - transition / 2.0;
+  design.stopband = preset.rolloff + transition / 2.0;
+  design.ripple_db = 20.0 * log10(1.0 + pow(10.0, -design.attenuation_db / 20.0));
+  return design;
+}
+
+void Resampler::configure(uint32_t in_rate, uint32_t out_rate, size_t channels,
+                          ResamplerQuality quality)
+{
+  channels_ = channels;
+  const uint32_t g = gcd(in_rate, out_rate);
+  up_ = out_rate / g;
+  down_ = in_rate / g;
+  history_.assign(channels, std::vector<float>());
+  planes_.assign(channels, nullptr);
+
+  if (passthrough())
+  {
+    half_ = 0;
+    taps_ = 0;
+    filter_.clear();
+    reset();
+    return;
+  }
+
+  const QualityPreset &preset = kPresets[(size_t)quality];
+
+  // Cutoff in cycles per input sample (times 2), lowered for decimation.
+  const double cutoff = preset.rolloff * std::min(1.0, (double)up_ / (double)down_);
+  half_ = (size_t)ceil(preset.zero_crossings / cutoff);
+  taps_ = (2 * half_ + kTapAlign - 1) / kTapAlign * kTapAlign;
+
+  // Phase p evaluates the filter at fraction p / up_ past the input frame
+  // of tap half_ - 1. Taps past 2 * half_ are padding and stay 0.
+  const double i0_beta = bessel_i0(preset.kaiser_beta);
+  filter_.assign((size_t)up_ * taps_, 0.0f);
+  std::vector<double> h(taps_);
+  for (uint32_t p = 0; p < up_; p++)
+  {
+    const double frac = (double)p / (double)up_;
+    float *phase = &filter_[(size_t)p * taps_];
+    double sum = 0.0;
+    for (size_t k = 0; k < taps_; k++)
+    {
+      h[k] = 0.0;
+      const double t = frac - ((double)k - (double)half_ + 1.0);
+      const double x = t / (double)half_;
+      if (x <= -1.0 || x >= 1.0)
+        continue;
+      const double arg = M_PI * cutoff * t;
+      const double sinc = t == 0.0 ? 1.0 : sin(arg) / arg;
+      const double window = bessel_i0(preset.kaiser_beta * sqrt(1.0 - x * x)) / i0_beta;
+      h[k] = cutoff * sinc * window;
+      sum += h[k];
+    }
+    // Unity gain at DC for every phase.
+    for (size_t k = 0; k < taps_; k++)
+      phase[k] = (float)(h[k] / sum);
+  }
+
+  reset();
+}
+
+void Resampler::reset()
+{
+  // Input before the first frame is silence.
+  const size_t lead = half_ > 0 ? half_ - 1 : 0;
+  for (std::vector<float> &history : history_)
+    history.assign(lead, 0.0f);
+  position_ = 0;
+  phase_ = 0;
+  input_frames_ = 0;
+  output_frames_ = 0;
+}
+
+void Resampler::run(std::vector<float> *out, uint64_t limit)
+{
+  const size_t C = channels_;
+  const size_t available = history_.empty() ? 0 : history_[0].size();
+
+  // Output frames ready with the current history.
+  size_t count = 0;
+  if (position_ + taps_ <= available)
+  {
+    const uint64_t span = (uint64_t)(available - taps_ - position_) * up_ + (up_ - 1 - phase_);
+    count = (size_t)std::min<uint64_t>(span / down_ + 1, limit - output_frames_);
+  }
+
+  size_t o = out->size();
+  out->resize(o + count * C);
+  float *dst = out->data();
+  for (size_t i = 0; i < count; i++)
+  {
+    const float *phase = &filter_[(size_t)phase_ * taps_];
+    for (size_t c = 0; c < C; c++)
+      dst[o++] = dot(phase, &history_[c][position_], taps_);
+
+    phase_ += down_;
+    position_ += phase_ / up_;
+    phase_ %= up_;
+  }
+  output_frames_ += count;
+
+  // Drop the input no longer reachable by the filter.
+  const size_t consumed = std::min(position_, available);
+  for (std::vector<float> &history : history_)
+    history.erase(history.begin(), history.begin() + consumed);
+  position_ -= consumed;
+}
+
+void Resampler::process(const float *in, size_t frames, std::vector<float> *out)
+{
+  process(in, SampleFormat::kF32, frames, out);
+}
+
+void Resampler::process(const void *in, SampleFormat format, size_t frames, std::vector<float> *out)
+{
+  const size_t C = channels_;
+  if (passthrough())
+  {
+    const size_t start = out->size();
+    out->resize(start + frames * C);
+    convert_samples(in, format, out->data() + start, SampleFormat::kF32, frames * C);
+    return;
+  }
+
+  for (size_t c = 0; c < C; c++)
+  {
+    std::vector<float> &history = history_[c];
+    const size_t start = history.size();
+    history.resize(start + frames);
+    planes_[c] = history.data() + start;
+  }
+  deinterleave_to_f32(in, format, C, planes_.data(), frames);
+  input_frames_ += frames;
+  run(out, UINT64_MAX);
+}
+
+void Resampler::flush(std::vector<float> *out)
+{
+  if (passthrough())
+    return;
+
+  for (std::vector<float> &history : history_)
+    history.resize(history.size() + taps_, 0.0f);
+  run(out, (input_frames_ * up_ + down_ - 1) / down_);
+  reset();
+}
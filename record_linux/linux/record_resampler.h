@@ -0,0 +1,89 @@
+#ifndef RECORD_LINUX_RESAMPLER_H_
+#define RECORD_LINUX_RESAMPLER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "record_format.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//  Sample rate conversion
+//
+//  Polyphase windowed-sinc (Kaiser) resampler for a rational ratio
+//  out_rate / in_rate = up / down. Each output frame is the dot product of
+//  one filter phase with the surrounding input, so the cost per output
+//  frame is taps() per channel, whatever the ratio. The output timeline
+//  starts with the input's: flush() drains the filter so that exactly
+//  ceil(input frames * up / down) frames come out.
+//
+//  Quality presets trade filter length for stopband attenuation and
+//  transition width. Phases are padded to a multiple of 8 taps for the
+//  SSE, AVX2/FMA or NEON dot product, picked from the running CPU.
+////////////////////////////////////////////////////////////////////////////////
+enum class ResamplerQuality
+{
+  kLow,    // 8 zero crossings, ~54 dB
+  kMedium, // 16 zero crossings, ~86 dB
+  kHigh,   // 32 zero crossings, ~99 dB
+  kBest,   // 64 zero crossings, ~117 dB
+};
+
+// "low", "medium", "high" or "best".
+bool resampler_quality_from_name(const std::string &name, ResamplerQuality *quality);
+const char *resampler_quality_name(ResamplerQuality quality);
+
+// What a preset is designed for, from Kaiser's estimates for its window and
+// length. Edges are fractions of the lower Nyquist frequency: flat within
+// [ripple_db] up to [passband], attenuated by [attenuation_db] from
+// [stopband] on. Above 1, the top of the band takes some aliasing.
+// run_resampler_benchmark() measures the actual response against it.
+struct ResamplerDesign
+{
+  double passband;
+  double stopband;
+  double attenuation_db;
+  double ripple_db;
+};
+
+ResamplerDesign resampler_design(ResamplerQuality quality);
+
+class Resampler
+{
+public:
+  void configure(uint32_t in_rate, uint32_t out_rate, size_t channels,
+                 ResamplerQuality quality = ResamplerQuality::kMedium);
+  void reset();
+
+  bool passthrough() const { return up_ == down_; }
+  size_t taps() const { return taps_; }
+
+  // Appends the output for [frames] interleaved input frames to [out].
+  void process(const float *in, size_t frames, std::vector<float> *out);
+
+  // Same, from interleaved samples in [format].
+  void process(const void *in, SampleFormat format, size_t frames, std::vector<float> *out);
+
+  // Appends the remaining output, then resets.
+  void flush(std::vector<float> *out);
+
+private:
+  void run(std::vector<float> *out, uint64_t limit);
+
+  size_t channels_ = 0;
+  uint32_t up_ = 1;
+  uint32_t down_ = 1;
+  size_t half_ = 0;
+  size_t taps_ = 0;
+  std::vector<float> filter_; // up_ phases of taps_ coefficients
+
+  std::vector<std::vector<float>> history_; // planar input
+  std::vector<float *> planes_;             // where process() appends
+  size_t position_ = 0; // first tap of the next output frame, in history_
+  uint32_t phase_ = 0;
+  uint64_t input_frames_ = 0;
+  uint64_t output_frames_ = 0;
+};
+
+#endif // RECORD_LINUX_RESAMPLER_H_
@@ -0,0 +1,102 @@
+#include "record_state.h"
+
+#include <climits>
+#include <errno.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace
+{
+  // The futex is the word itself; std::atomic<uint32_t> has its layout.
+  static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex word size");
+
+  long futex(const std::atomic<uint32_t> *word, int op, uint32_t value,
+             const struct timespec *timeout = nullptr)
+  {
+    return syscall(SYS_futex, (uint32_t *)word, op, value, timeout, nullptr, 0);
+  }
+
+  int64_t monotonic_us()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+  }
+}
+
+bool RecorderState::transition(uint32_t from, State to, uint32_t set, uint32_t clear,
+                               uint32_t *previous)
+{
+  uint32_t word = word_.load(std::memory_order_acquire);
+  while (true)
+  {
+    if ((from & mask(state_of(word))) == 0)
+    {
+      if (previous)
+        *previous = word;
+      return false;
+    }
+    const uint32_t next = (((word & ~kStateBits) | set) & ~clear) | to;
+    if (word_.compare_exchange_weak(word, next, std::memory_order_acq_rel,
+                                    std::memory_order_acquire))
+      break;
+  }
+  if (previous)
+    *previous = word;
+  wake();
+  return true;
+}
+
+uint32_t RecorderState::update_flags(uint32_t set, uint32_t clear)
+{
+  set &= ~kStateBits;
+  clear &= ~kStateBits;
+  uint32_t word = word_.load(std::memory_order_acquire);
+  while (!word_.compare_exchange_weak(word, (word | set) & ~clear, std::memory_order_acq_rel,
+                                      std::memory_order_acquire))
+  {
+  }
+  wake();
+  return word;
+}
+
+void RecorderState::reset()
+{
+  word_.store(kIdle, std::memory_order_release);
+  wake();
+}
+
+void RecorderState::wait(uint32_t word) const
+{
+  // Returns early on a change (EAGAIN), a wake or a signal; callers reload.
+  while (word_.load(std::memory_order_acquire) == word)
+  {
+    if (futex(&word_, FUTEX_WAIT_PRIVATE, word) < 0 && errno != EAGAIN && errno != EINTR)
+      break;
+  }
+}
+
+bool RecorderState::wait_for(uint32_t word, int64_t timeout_us) const
+{
+  // FUTEX_WAIT takes a relative timeout, recomputed after an early return.
+  const int64_t deadline_us = monotonic_us() + timeout_us;
+  while (word_.load(std::memory_order_acquire) == word)
+  {
+    const int64_t left_us = deadline_us - monotonic_us();
+    if (left_us <= 0)
+      return false;
+    struct timespec timeout;
+    timeout.tv_sec = left_us / 1000000;
+    timeout.tv_nsec = (left_us % 1000000) * 1000;
+    if (futex(&word_, FUTEX_WAIT_PRIVATE, word, &timeout) < 0 && errno != EAGAIN && errno != EINTR)
+      return false;
+  }
+  return true;
+}
+
+void RecorderState::wake()
+{
+  futex(&word_, FUTEX_WAKE_PRIVATE, INT_MAX);
+}
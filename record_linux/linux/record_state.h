@@ -0,0 +1,77 @@
+#ifndef RECORD_LINUX_STATE_H_
+#define RECORD_LINUX_STATE_H_
+
+#include <atomic>
+#include <stdint.h>
+
+////////////////////////////////////////////////////////////////////////////////
+//  Recorder state word
+//
+//  The session state and the capture flags share one 32-bit atomic word, so
+//  the capture thread reads everything it needs with a single load and
+//  never takes a lock. Control calls move between states with
+//  compare-and-swap and return without waiting on the capture thread:
+//
+//    idle -> starting -> recording <-> pausing -> paused -> recording
+//    starting -> idle (failed start)
+//    recording, pausing, paused -> stopping -> idle
+//
+//  pausing is acknowledged by the capture thread (-> paused) once the read
+//  in flight is done; it then parks on the word (futex) until the next
+//  change. Every change wakes it. Between sessions, a warm capture thread
+//  parks the same way.
+////////////////////////////////////////////////////////////////////////////////
+class RecorderState
+{
+public:
+  enum State : uint32_t
+  {
+    kIdle,
+    kStarting,
+    kRecording,
+    kPausing,
+    kPaused,
+    kStopping,
+  };
+
+  // Flags, independent of the state
+  static const uint32_t kArmed = 1u << 8;   // capturing into pre-roll between sessions
+  static const uint32_t kVox = 1u << 9;     // armed, takes started and stopped on level
+  static const uint32_t kStream = 1u << 10; // session delivers a stream, not a file
+  static const uint32_t kWarm = 1u << 11;   // connected and corked between sessions
+  static const uint32_t kFailed = 1u << 12; // capture stream lost, nothing more is read
+
+  static uint32_t mask(State state) { return 1u << state; }
+  static State state_of(uint32_t word) { return (State)(word & kStateBits); }
+
+  uint32_t load() const { return word_.load(std::memory_order_acquire); }
+  State state() const { return state_of(load()); }
+  bool has(uint32_t flag) const { return (load() & flag) != 0; }
+
+  // Moves to [to] when the current state is in [from] (a union of mask()),
+  // setting then clearing the given flags in the same step.
+  // Returns false and leaves the word alone otherwise. *previous receives
+  // the word before the attempt either way.
+  bool transition(uint32_t from, State to, uint32_t set = 0, uint32_t clear = 0,
+                  uint32_t *previous = nullptr);
+
+  // Changes flags only. Returns the previous word.
+  uint32_t update_flags(uint32_t set, uint32_t clear);
+
+  // Back to idle with no flags.
+  void reset();
+
+  // Blocks while the word still equals [word].
+  void wait(uint32_t word) const;
+  // Likewise for at most [timeout_us]. Returns false when it timed out.
+  bool wait_for(uint32_t word, int64_t timeout_us) const;
+
+private:
+  static const uint32_t kStateBits = 0xFF;
+
+  void wake();
+
+  std::atomic<uint32_t> word_{kIdle};
+};
+
+#endif // RECORD_LINUX_STATE_H_
@@ -0,0 +1,390 @@
+#include "record_vad.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+  // Speech band used for spectral flatness.
+  const float kBandLowHz = 250.0f;
+  const float kBandHighHz = 4000.0f;
+
+  // A frame is speech when it stands out of the noise floor and is not
+  // noise-like (flat spectrum or excessive zero crossings).
+  const float kSpeechAboveFloorDb = 9.0f;
+  const float kLoudAboveFloorDb = 18.0f;
+  const float kSilenceDb = -65.0f;
+  const float kMaxFlatness = 0.45f;
+  const float kMaxZeroCrossingRate = 0.45f;
+
+  const float kFloorRiseDbPerSec = 1.0f;
+  const float kFloorFall = 0.5f;
+
+  const uint32_t kOnsetMs = 20;
+}
+
+// ---------------------------------------------------------------------------
+// VoiceDetector
+// ---------------------------------------------------------------------------
+void VoiceDetector::configure(uint32_t sample_rate)
+{
+  sample_rate_ = sample_rate;
+  frame_size_ = sample_rate >= 32000 ? 512 : 256;
+
+  const float bin_hz = (float)sample_rate / (float)frame_size_;
+  band_lo_ = std::max<size_t>(1, (size_t)(kBandLowHz / bin_hz));
+  band_hi_ = std::min<size_t>(frame_size_ / 2, (size_t)(kBandHighHz / bin_hz));
+  if (band_hi_ <= band_lo_)
+    band_hi_ = band_lo_ + 1;
+
+  floor_rise_db_ = kFloorRiseDbPerSec * (float)frame_size_ / (float)sample_rate;
+
+  fft_.configure(frame_size_);
+  window_.resize(frame_size_);
+  for (size_t n = 0; n < frame_size_; n++)
+    window_[n] = (float)(0.5 - 0.5 * cos(2.0 * M_PI * (double)n / (double)frame_size_));
+  frame_.assign(frame_size_, 0.0f);
+  re_.assign(frame_size_ / 2 + 1, 0.0f);
+  im_.assign(frame_size_ / 2 + 1, 0.0f);
+  reset();
+}
+
+void VoiceDetector::reset()
+{
+  floor_db_ = kSilenceDb;
+  has_floor_ = false;
+}
+
+bool VoiceDetector::is_speech(const float *x)
+{
+  const size_t N = frame_size_;
+
+  float energy = 0.0f;
+  size_t crossings = 0;
+  for (size_t n = 0; n < N; n++)
+  {
+    energy += x[n] * x[n];
+    if (n > 0 && ((x[n] >= 0.0f) != (x[n - 1] >= 0.0f)))
+      crossings++;
+  }
+  const float energy_db = 10.0f * log10f(energy / (float)N + 1e-12f);
+  const float zcr = (float)crossings / (float)N;
+
+  // Noise floor: follows drops quickly, rises slowly.
+  if (!has_floor_)
+  {
+    floor_db_ = energy_db;
+    has_floor_ = true;
+  }
+  else if (energy_db < floor_db_)
+  {
+    floor_db_ += (energy_db - floor_db_) * kFloorFall;
+  }
+  else
+  {
+    floor_db_ += floor_rise_db_;
+  }
+
+  const float above = energy_db - floor_db_;
+  if (energy_db < kSilenceDb || above < kSpeechAboveFloorDb)
+    return false;
+  if (zcr > kMaxZeroCrossingRate)
+    return false;
+  if (above >= kLoudAboveFloorDb)
+    return true;
+
+  // Spectral flatness: geometric over arithmetic mean of the band power.
+  float *__restrict f = frame_.data();
+  const float *__restrict w = window_.data();
+  for (size_t n = 0; n < N; n++)
+    f[n] = x[n] * w[n];
+  fft_.forward(f, re_.data(), im_.data());
+
+  float log_sum = 0.0f;
+  float sum = 0.0f;
+  for (size_t k = band_lo_; k < band_hi_; k++)
+  {
+    const float p = re_[k] * re_[k] + im_[k] * im_[k] + 1e-12f;
+    log_sum += logf(p);
+    sum += p;
+  }
+  const float count = (float)(band_hi_ - band_lo_);
+  const float flatness = expf(log_sum / count) / (sum / count);
+
+  return flatness < kMaxFlatness;
+}
+
+// ---------------------------------------------------------------------------
+// VoiceGate
+// ---------------------------------------------------------------------------
+void VoiceGate::configure(uint32_t sample_rate, size_t channels, size_t max_chunk_frames,
+                          bool gate, uint32_t hangover_ms, uint32_t pre_roll_ms)
+{
+  sample_rate_ = sample_rate;
+  channels_ = channels;
+  gate_ = gate;
+
+  detector_.configure(sample_rate);
+  const size_t frame = detector_.frame_size();
+  const size_t ms_frames = sample_rate / 1000;
+
+  onset_frames_ = std::max<size_t>(1, (kOnsetMs * ms_frames + frame - 1) / frame);
+  hangover_frames_ = std::max<size_t>(1, (hangover_ms * ms_frames + frame - 1) / frame);
+
+  mono_.assign(frame, 0.0f);
+
+  if (gate_)
+  {
+    // The ring also holds the frames needed to confirm the onset.
+    ring_capacity_ = pre_roll_ms * ms_frames + onset_frames_ * frame;
+    ring_.assign(ring_capacity_ * channels_, 0);
+    out_.assign((ring_capacity_ + max_chunk_frames) * channels_, 0);
+  }
+  else
+  {
+    ring_capacity_ = 0;
+    ring_.clear();
+    out_.clear();
+  }
+
+  segments_.clear();
+  segments_.reserve(1024);
+  reset(0);
+}
+
+void VoiceGate::reset(int64_t start_time_us)
+{
+  detector_.reset();
+  mono_fill_ = 0;
+  speech_ = false;
+  voiced_run_ = 0;
+  silent_run_ = 0;
+  analysis_start_ = 0;
+  ring_head_ = 0;
+  ring_count_ = 0;
+  out_frames_ = 0;
+  capture_frames_ = 0;
+  output_frames_ = 0;
+  start_time_us_ = start_time_us;
+  segments_.clear();
+  event_count_ = 0;
+}
+
+int64_t VoiceGate::capture_time_us(uint64_t capture_frame) const
+{
+  return start_time_us_ + (int64_t)(capture_frame * 1000000ull / sample_rate_);
+}
+
+bool VoiceGate::capture_frame_of(uint64_t output_frame, uint64_t *capture_frame) const
+{
+  // Recent frames are asked for: search from the end.
+  for (size_t i = segments_.size(); i-- > 0;)
+  {
+    const VadSegment &s = segments_[i];
+    if (output_frame >= s.output_frame && output_frame < s.output_frame + s.frames)
+    {
+      *capture_frame = s.capture_frame + (output_frame - s.output_frame);
+      return true;
+    }
+    if (output_frame >= s.output_frame + s.frames)
+      break;
+  }
+  return false;
+}
+
+void VoiceGate::push_ring(const int16_t *samples, size_t frames)
+{
+  const size_t C = channels_;
+  for (size_t f = 0; f < frames; f++)
+  {
+    size_t slot;
+    if (ring_count_ < ring_capacity_)
+    {
+      slot = (ring_head_ + ring_count_) % ring_capacity_;
+      ring_count_++;
+    }
+    else
+    {
+      slot = ring_head_;
+      ring_head_ = (ring_head_ + 1) % ring_capacity_;
+    }
+    memcpy(&ring_[slot * C], samples + f * C, C * sizeof(int16_t));
+  }
+}
+
+void VoiceGate::emit(const int16_t *samples, size_t frames, uint64_t capture_frame)
+{
+  const size_t capacity = out_.size() / channels_;
+  frames = std::min(frames, capacity - out_frames_);
+  if (frames == 0)
+    return;
+
+  memcpy(&out_[out_frames_ * channels_], samples, frames * channels_ * sizeof(int16_t));
+
+  VadSegment *last = segments_.empty() ? nullptr : &segments_.back();
+  if (last && last->capture_frame + last->frames == capture_frame &&
+      last->output_frame + last->frames == output_frames_)
+  {
+    last->frames += frames;
+  }
+  else
+  {
+    segments_.push_back(VadSegment{capture_frame, output_frames_, frames});
+  }
+
+  out_frames_ += frames;
+  output_frames_ += frames;
+}
+
+void VoiceGate::add_event(bool speech, uint64_t capture_frame)
+{
+  if (event_count_ >= kMaxEvents)
+    return;
+
+  VadEvent &event = events_[event_count_++];
+  event.speech = speech;
+  event.capture_frame = capture_frame;
+  event.output_frame = gate_ ? output_frames_ : capture_frame;
+}
+
+size_t VoiceGate::process(const int16_t *samples, size_t frames, const int16_t **out)
+{
+  const size_t C = channels_;
+  const size_t N = detector_.frame_size();
+  const float scale = 1.0f / (32768.0f * (float)C);
+
+  event_count_ = 0;
+  out_frames_ = 0;
+
+  size_t done = 0;
+  while (done < frames)
+  {
+    const size_t n = std::min(N - mono_fill_, frames - done);
+    const int16_t *piece = samples + done * C;
+    const uint64_t piece_pos = capture_frames_ + done;
+
+    float *__restrict mono = &mono_[mono_fill_];
+    for (size_t f = 0; f < n; f++)
+    {
+      int32_t sum = 0;
+      for (size_t c = 0; c < C; c++)
+        sum += piece[f * C + c];
+      mono[f] = (float)sum * scale;
+    }
+
+    if (gate_)
+    {
+      if (speech_)
+        emit(piece, n, piece_pos);
+      else
+        push_ring(piece, n);
+    }
+
+    mono_fill_ += n;
+    done += n;
+
+    if (mono_fill_ < N)
+      continue;
+
+    mono_fill_ = 0;
+    analysis_start_ += N;
+
+    if (detector_.is_speech(mono_.data()))
+    {
+      voiced_run_++;
+      silent_run_ = 0;
+    }
+    else
+    {
+      silent_run_++;
+      voiced_run_ = 0;
+    }
+
+    if (!speech_ && voiced_run_ >= onset_frames_)
+    {
+      speech_ = true;
+      const uint64_t onset = analysis_start_ - onset_frames_ * N;
+
+      if (gate_)
+      {
+        // Flush pre-roll and onset frames, oldest first.
+        const uint64_t ring_pos = piece_pos + n - ring_count_;
+        const uint64_t onset_output = output_frames_ + (onset - std::min(onset, ring_pos));
+        size_t pos = 0;
+        while (ring_count_ > 0)
+        {
+          const size_t run = std::min(ring_count_, ring_capacity_ - ring_head_);
+          emit(&ring_[ring_head_ * C], run, ring_pos + pos);
+          pos += run;
+          ring_head_ = (ring_head_ + run) % ring_capacity_;
+          ring_count_ -= run;
+        }
+        ring_head_ = 0;
+
+        add_event(true, onset);
+        events_[event_count_ - 1].output_frame = onset_output;
+      }
+      else
+      {
+        add_event(true, onset);
+      }
+    }
+    else if (speech_ && silent_run_ >= hangover_frames_)
+    {
+      speech_ = false;
+      add_event(false, analysis_start_);
+    }
+  }
+
+  capture_frames_ += frames;
+
+  if (!gate_)
+  {
+    output_frames_ += frames;
+    *out = samples;
+    return frames;
+  }
+
+  *out = out_.data();
+  return out_frames_;
+}
+
+void VoiceGate::pass_through(uint64_t frames)
+{
+  if (frames == 0)
+    return;
+
+  segments_.push_back(VadSegment{capture_frames_, output_frames_, frames});
+  capture_frames_ += frames;
+  output_frames_ += frames;
+  analysis_start_ += frames;
+}
+
+bool VoiceGate::write_timing_map(const char *path) const
+{
+  FILE *file = fopen(path, "w");
+  if (!file)
+    return false;
+
+  fprintf(file, "{\n");
+  fprintf(file, "  \"sampleRate\": %u,\n", sample_rate_);
+  fprintf(file, "  \"startTimeUs\": %" PRId64 ",\n", start_time_us_);
+  fprintf(file, "  \"captureFrames\": %" PRIu64 ",\n", capture_frames_);
+  fprintf(file, "  \"outputFrames\": %" PRIu64 ",\n", output_frames_);
+  fprintf(file, "  \"segments\": [");
+  for (size_t i = 0; i < segments_.size(); i++)
+  {
+    const VadSegment &s = segments_[i];
+    fprintf(file,
+            "%s\n    {\"captureFrame\": %" PRIu64 ", \"outputFrame\": %" PRIu64
+            ", \"frames\": %" PRIu64 ", \"timeUs\": %" PRId64 "}",
+            i == 0 ? "" : ",", s.capture_frame, s.output_frame, s.frames,
+            capture_time_us(s.capture_frame));
+  }
+  fprintf(file, "\n  ]\n}\n");
+
+  return fclose(file) == 0;
+}
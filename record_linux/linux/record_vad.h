@@ -0,0 +1,139 @@
+#ifndef RECORD_LINUX_VAD_H_
+#define RECORD_LINUX_VAD_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "record_fft.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//  Voice activity detection
+//
+//  VoiceDetector classifies fixed analysis frames (~10 ms) of the mono mix
+//  from three cheap features: energy above an adaptive noise floor, zero
+//  crossing rate and spectral flatness in the speech band.
+//
+//  VoiceGate runs the detector over captured chunks, applies onset/hangover
+//  smoothing and, when gating, only lets speech (plus pre-roll) through.
+//  It records which capture frames ended up in the output so that trimmed
+//  audio can be mapped back to capture time.
+////////////////////////////////////////////////////////////////////////////////
+
+class VoiceDetector
+{
+public:
+  void configure(uint32_t sample_rate);
+  void reset();
+
+  size_t frame_size() const { return frame_size_; }
+
+  // Classifies one analysis frame of frame_size() mono samples.
+  bool is_speech(const float *frame);
+
+private:
+  uint32_t sample_rate_ = 0;
+  size_t frame_size_ = 0;
+  size_t band_lo_ = 0;
+  size_t band_hi_ = 0;
+  float floor_db_ = 0.0f;
+  float floor_rise_db_ = 0.0f; // per frame
+  bool has_floor_ = false;
+
+  RealFft fft_;
+  std::vector<float> window_;
+  std::vector<float> frame_;
+  std::vector<float> re_, im_;
+};
+
+struct VadEvent
+{
+  bool speech;            // start (true) or end (false) of speech
+  uint64_t capture_frame; // position in the captured audio
+  uint64_t output_frame;  // position in the (possibly trimmed) output
+};
+
+// One run of captured frames kept in the output.
+struct VadSegment
+{
+  uint64_t capture_frame;
+  uint64_t output_frame;
+  uint64_t frames;
+};
+
+class VoiceGate
+{
+public:
+  static const size_t kMaxEvents = 32;
+
+  // gate: drop non-speech audio from the output. Otherwise only events
+  // are produced and audio passes through untouched.
+  void configure(uint32_t sample_rate, size_t channels, size_t max_chunk_frames,
+                 bool gate, uint32_t hangover_ms, uint32_t pre_roll_ms);
+
+  // start_time_us: wall clock (g_get_real_time) of the first captured frame.
+  void reset(int64_t start_time_us);
+
+  // Returns the number of frames to forward to the sinks, pointed by *out
+  // (either [samples] or an internal buffer valid until the next call).
+  size_t process(const int16_t *samples, size_t frames, const int16_t **out);
+
+  // Accounts for [frames] forwarded to the sinks without analysis
+  // (pre-roll history), kept as-is in the timing map.
+  void pass_through(uint64_t frames);
+
+  // Events raised by the last process() call.
+  size_t event_count() const { return event_count_; }
+  const VadEvent &event(size_t i) const { return events_[i]; }
+
+  bool in_speech() const { return speech_; }
+  uint64_t output_frames() const { return output_frames_; }
+  uint64_t capture_frames() const { return capture_frames_; }
+
+  // Capture frame -> wall clock, in microseconds.
+  int64_t capture_time_us(uint64_t capture_frame) const;
+  // Output frame -> capture frame, false when not in the timing map.
+  bool capture_frame_of(uint64_t output_frame, uint64_t *capture_frame) const;
+
+  // JSON timing map of the kept segments.
+  bool write_timing_map(const char *path) const;
+
+private:
+  void push_ring(const int16_t *samples, size_t frames);
+  void emit(const int16_t *samples, size_t frames, uint64_t capture_frame);
+  void add_event(bool speech, uint64_t capture_frame);
+
+  uint32_t sample_rate_ = 0;
+  size_t channels_ = 0;
+  bool gate_ = false;
+  size_t onset_frames_ = 0;    // analysis frames needed to start
+  size_t hangover_frames_ = 0; // analysis frames of silence needed to stop
+
+  VoiceDetector detector_;
+  std::vector<float> mono_;  // analysis frame being filled
+  size_t mono_fill_ = 0;
+
+  bool speech_ = false;
+  size_t voiced_run_ = 0;
+  size_t silent_run_ = 0;
+  uint64_t analysis_start_ = 0; // capture frame of the current analysis frame
+
+  // Pre-roll ring, interleaved frames.
+  std::vector<int16_t> ring_;
+  size_t ring_capacity_ = 0;
+  size_t ring_head_ = 0; // oldest frame
+  size_t ring_count_ = 0;
+
+  std::vector<int16_t> out_;
+  size_t out_frames_ = 0;
+
+  uint64_t capture_frames_ = 0;
+  uint64_t output_frames_ = 0;
+  int64_t start_time_us_ = 0;
+
+  std::vector<VadSegment> segments_;
+  VadEvent events_[kMaxEvents];
+  size_t event_count_ = 0;
+};
+
+#endif // RECORD_LINUX_VAD_H_
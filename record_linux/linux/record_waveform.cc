@@ -0,0 +1,178 @@
+#include "record_waveform.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+uint32_t WaveformPyramid::frames_per_bucket(size_t level)
+{
+  uint32_t frames = kBaseFramesPerBucket;
+  for (size_t i = 0; i < level; i++)
+    frames *= kLevelFactor;
+  return frames;
+}
+
+void WaveformPyramid::configure(size_t channels, uint32_t sample_rate, size_t reserve_seconds)
+{
+  channels_ = channels;
+  sample_rate_ = sample_rate;
+
+  for (size_t l = 0; l < kLevelCount; l++)
+  {
+    const uint64_t frames = (uint64_t)sample_rate * reserve_seconds;
+    const size_t count = (size_t)(frames / frames_per_bucket(l)) + 1;
+    levels_[l].buckets.clear();
+    levels_[l].buckets.reserve(count * channels_);
+    levels_[l].acc.resize(channels_);
+  }
+  reset();
+}
+
+void WaveformPyramid::reset()
+{
+  total_frames_ = 0;
+  for (size_t l = 0; l < kLevelCount; l++)
+  {
+    Level &level = levels_[l];
+    level.buckets.clear();
+    level.filled = 0;
+    level.published = 0;
+    for (Accumulator &a : level.acc)
+    {
+      a.min = INT16_MAX;
+      a.max = INT16_MIN;
+      a.sum_sq = 0.0;
+      a.frames = 0;
+    }
+  }
+}
+
+void WaveformPyramid::add_s16(const int16_t *samples, size_t frames)
+{
+  const size_t C = channels_;
+  const uint32_t base = kBaseFramesPerBucket;
+  Level &level = levels_[0];
+
+  size_t done = 0;
+  while (done < frames)
+  {
+    const size_t n = std::min<size_t>(base - level.filled, frames - done);
+
+    for (size_t c = 0; c < C; c++)
+    {
+      const int16_t *s = samples + done * C + c;
+      int16_t mn = level.acc[c].min;
+      int16_t mx = level.acc[c].max;
+      int64_t sq = 0;
+      for (size_t f = 0; f < n; f++)
+      {
+        const int16_t v = s[f * C];
+        mn = std::min(mn, v);
+        mx = std::max(mx, v);
+        sq += (int32_t)v * v;
+      }
+      level.acc[c].min = mn;
+      level.acc[c].max = mx;
+      level.acc[c].sum_sq += (double)sq;
+      level.acc[c].frames += n;
+    }
+
+    level.filled += (uint32_t)n;
+    done += n;
+    total_frames_ += n;
+
+    if (level.filled == base)
+      close_bucket(0);
+  }
+}
+
+void WaveformPyramid::close_bucket(size_t l)
+{
+  Level &level = levels_[l];
+  const bool has_parent = l + 1 < kLevelCount;
+
+  for (size_t c = 0; c < channels_; c++)
+  {
+    Accumulator &a = level.acc[c];
+    if (a.frames == 0)
+      continue;
+
+    WaveformBucket bucket;
+    bucket.min = a.min;
+    bucket.max = a.max;
+    bucket.rms = (int16_t)std::min(32767.0, sqrt(a.sum_sq / (double)a.frames));
+    level.buckets.push_back(bucket);
+
+    if (has_parent)
+    {
+      Accumulator &p = levels_[l + 1].acc[c];
+      p.min = std::min(p.min, a.min);
+      p.max = std::max(p.max, a.max);
+      p.sum_sq += a.sum_sq;
+      p.frames += a.frames;
+    }
+
+    a.min = INT16_MAX;
+    a.max = INT16_MIN;
+    a.sum_sq = 0.0;
+    a.frames = 0;
+  }
+  level.filled = 0;
+
+  if (has_parent && ++levels_[l + 1].filled == kLevelFactor)
+    close_bucket(l + 1);
+}
+
+void WaveformPyramid::flush()
+{
+  // From the finest level up, so that partial children feed their parents.
+  for (size_t l = 0; l < kLevelCount; l++)
+  {
+    if (!levels_[l].acc.empty() && levels_[l].acc[0].frames > 0)
+      close_bucket(l);
+  }
+}
+
+void WaveformPyramid::mark_published()
+{
+  for (size_t l = 0; l < kLevelCount; l++)
+    levels_[l].published = bucket_count(l);
+}
+
+static bool write_all(FILE *file, const void *data, size_t size)
+{
+  return size == 0 || fwrite(data, 1, size, file) == size;
+}
+
+bool WaveformPyramid::write_sidecar(const char *path) const
+{
+  FILE *file = fopen(path, "wb");
+  if (!file)
+    return false;
+
+  const uint16_t version = 1;
+  const uint16_t channels = (uint16_t)channels_;
+  const uint32_t level_count = kLevelCount;
+
+  bool ok = write_all(file, "RLPK", 4) &&
+            write_all(file, &version, sizeof(version)) &&
+            write_all(file, &channels, sizeof(channels)) &&
+            write_all(file, &sample_rate_, sizeof(sample_rate_)) &&
+            write_all(file, &total_frames_, sizeof(total_frames_)) &&
+            write_all(file, &level_count, sizeof(level_count));
+
+  for (size_t l = 0; ok && l < kLevelCount; l++)
+  {
+    const uint32_t frames = frames_per_bucket(l);
+    const uint64_t count = bucket_count(l);
+    ok = write_all(file, &frames, sizeof(frames)) &&
+         write_all(file, &count, sizeof(count));
+  }
+
+  for (size_t l = 0; ok && l < kLevelCount; l++)
+  {
+    ok = write_all(file, buckets(l), levels_[l].buckets.size() * sizeof(WaveformBucket));
+  }
+
+  return fclose(file) == 0 && ok;
+}
@@ -0,0 +1,93 @@
+#ifndef RECORD_LINUX_WAVEFORM_H_
+#define RECORD_LINUX_WAVEFORM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+//  Multi-resolution min/max/RMS waveform pyramid
+//
+//  Built incrementally from captured frames: level 0 buckets summarize 256
+//  frames, each next level summarizes 16 buckets of the previous one
+//  (4096, then 65536 frames). Drawing a waveform then only reads the level
+//  closest to the pixel density instead of the whole recording.
+//
+//  Sidecar file layout (little endian), written by write_sidecar():
+//    char     magic[4]        "RLPK"
+//    uint16   version         1
+//    uint16   channels
+//    uint32   sample_rate
+//    uint64   total_frames
+//    uint32   level_count
+//    level_count x { uint32 frames_per_bucket, uint64 bucket_count }
+//    level_count x bucket_count x channels x WaveformBucket
+//  The last bucket of each level may cover fewer frames.
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma pack(push, 1)
+struct WaveformBucket
+{
+  int16_t min;
+  int16_t max;
+  int16_t rms;
+};
+#pragma pack(pop)
+
+class WaveformPyramid
+{
+public:
+  static const size_t kLevelCount = 3;
+  static const uint32_t kLevelFactor = 16;
+  static const uint32_t kBaseFramesPerBucket = 256;
+
+  // Reserves storage for [reserve_seconds] of audio. Longer recordings grow
+  // the storage geometrically.
+  void configure(size_t channels, uint32_t sample_rate, size_t reserve_seconds);
+  void reset();
+
+  void add_s16(const int16_t *samples, size_t frames);
+
+  // Closes partial buckets at the end of the recording.
+  void flush();
+
+  static uint32_t frames_per_bucket(size_t level);
+  size_t channels() const { return channels_; }
+  uint64_t total_frames() const { return total_frames_; }
+
+  // Buckets of [level], channels interleaved.
+  size_t bucket_count(size_t level) const { return levels_[level].buckets.size() / channels_; }
+  const WaveformBucket *buckets(size_t level) const { return levels_[level].buckets.data(); }
+
+  // Live updates: buckets completed since the last mark_published().
+  size_t published(size_t level) const { return levels_[level].published; }
+  void mark_published();
+
+  bool write_sidecar(const char *path) const;
+
+private:
+  struct Accumulator
+  {
+    int16_t min;
+    int16_t max;
+    double sum_sq;
+    uint64_t frames;
+  };
+
+  struct Level
+  {
+    std::vector<WaveformBucket> buckets;
+    std::vector<Accumulator> acc; // per channel
+    uint32_t filled = 0;           // frames (level 0) or child buckets
+    size_t published = 0;
+  };
+
+  void close_bucket(size_t level);
+
+  size_t channels_ = 0;
+  uint32_t sample_rate_ = 0;
+  uint64_t total_frames_ = 0;
+  Level levels_[kLevelCount];
+};
+
+#endif // RECORD_LINUX_WAVEFORM_H_
@@ -0,0 +1,446 @@
+#include "record_writer.h"
+#include "record_adpcm.h"
+#include "record_flac.h"
+#include "record_g711.h"
+#ifdef RECORD_LINUX_HAVE_OPUS
+#include "record_opus.h"
+#endif
+
+#include <algorithm>
+#include <cstring>
+
+const char *const kEncoderImaAdpcm = "imaAdpcm";
+const char *const kEncoderMuLaw = "muLaw";
+const char *const kEncoderALaw = "aLaw";
+
+std::unique_ptr<WavCodec> wav_codec_create(const std::string &encoder)
+{
+  if (encoder == kEncoderImaAdpcm)
+    return std::unique_ptr<WavCodec>(new ImaAdpcmCodec());
+  if (encoder == kEncoderMuLaw)
+    return std::unique_ptr<WavCodec>(new G711Codec(G711Codec::kMuLaw));
+  if (encoder == kEncoderALaw)
+    return std::unique_ptr<WavCodec>(new G711Codec(G711Codec::kALaw));
+  return nullptr;
+}
+
+static bool is_wav_codec(const std::string &encoder)
+{
+  return encoder == kEncoderImaAdpcm || encoder == kEncoderMuLaw || encoder == kEncoderALaw;
+}
+
+bool file_writer_supported(const std::string &encoder)
+{
+#ifdef RECORD_LINUX_HAVE_OPUS
+  if (encoder == "opus")
+    return true;
+#endif
+  return encoder == "wav" || encoder == "flac" || is_wav_codec(encoder);
+}
+
+FileWriter *file_writer_create(const EncoderSettings &settings)
+{
+  if (settings.encoder == "flac")
+    return new FlacWriter(settings.flac_level);
+  if (is_wav_codec(settings.encoder))
+    return new WavCodecWriter(wav_codec_create(settings.encoder));
+#ifdef RECORD_LINUX_HAVE_OPUS
+  if (settings.encoder == "opus")
+    return new OggOpusWriter(settings.bit_rate);
+#endif
+  return new WavWriter(settings.sample_format, settings.dither);
+}
+
+bool stream_encoder_supported(const std::string &encoder)
+{
+#ifdef RECORD_LINUX_HAVE_OPUS
+  if (encoder == "opus")
+    return true;
+#endif
+  return encoder == "pcm16bits" || is_wav_codec(encoder);
+}
+
+StreamEncoder *stream_encoder_create(const EncoderSettings &settings)
+{
+  if (is_wav_codec(settings.encoder))
+    return new WavCodecStream(wav_codec_create(settings.encoder));
+#ifdef RECORD_LINUX_HAVE_OPUS
+  if (settings.encoder == "opus")
+    return new OpusStreamEncoder(settings.bit_rate, settings.ogg_framing);
+#endif
+  (void)settings;
+  return nullptr;
+}
+
+// ---------------------------------------------------------------------------
+// WavWriter
+// ---------------------------------------------------------------------------
+WavWriter::WavWriter(SampleFormat format, DitherMode dither)
+    : format_(format), dither_mode_(dither)
+{
+}
+
+WavWriter::~WavWriter()
+{
+  close();
+}
+
+bool WavWriter::open(const char *path, uint32_t sample_rate, uint16_t channels)
+{
+  file_ = fopen(path, "wb");
+  if (!file_)
+    return false;
+
+  memcpy(header_.riff, "RIFF", 4);
+  memcpy(header_.wave, "WAVE", 4);
+  memcpy(header_.fmt_chunk_marker, "fmt ", 4);
+  memcpy(header_.data_chunk_header, "data", 4);
+
+  header_.overall_size = 0;
+  header_.length_of_fmt = 16;
+  header_.format_type = format_ == SampleFormat::kF32 ? 3 : 1; // IEEE float : PCM
+  header_.channels = channels;
+  header_.sample_rate = sample_rate;
+  header_.bits_per_sample = (uint16_t)(sample_format_bytes(format_) * 8);
+  header_.byterate = header_.sample_rate * header_.channels * (header_.bits_per_sample / 8);
+  header_.block_align = header_.channels * (header_.bits_per_sample / 8);
+  header_.data_size = 0;
+
+  data_bytes_ = 0;
+  frames_ = 0;
+  dither_.configure(dither_mode_, channels);
+
+  fwrite(&header_, sizeof(header_), 1, file_);
+  fflush(file_);
+  return true;
+}
+
+void WavWriter::write_s16(const int16_t *samples, size_t frames)
+{
+  if (!file_ || frames == 0)
+    return;
+
+  const size_t bytes = frames * header_.block_align;
+  if (format_ == SampleFormat::kS16)
+  {
+    fwrite(samples, 1, bytes, file_);
+  }
+  else
+  {
+    const size_t sample_bytes = sample_format_bytes(format_);
+    converted_.resize(kConvertSamples * sample_bytes);
+    size_t remaining = frames * header_.channels;
+    while (remaining > 0)
+    {
+      const size_t n = remaining < kConvertSamples ? remaining : kConvertSamples;
+      dither_.convert(samples, SampleFormat::kS16, converted_.data(), format_, n);
+      fwrite(converted_.data(), sample_bytes, n, file_);
+      samples += n;
+      remaining -= n;
+    }
+  }
+  data_bytes_ += bytes;
+  frames_ += frames;
+}
+
+bool WavWriter::close()
+{
+  if (!file_)
+    return false;
+
+  header_.data_size = (uint32_t)data_bytes_;
+  header_.overall_size = (uint32_t)(data_bytes_ + sizeof(WavHeader) - 8);
+
+  fseek(file_, 0, SEEK_SET);
+  fwrite(&header_, sizeof(header_), 1, file_);
+
+  const bool ok = fclose(file_) == 0;
+  file_ = nullptr;
+  return ok;
+}
+
+// ---------------------------------------------------------------------------
+// WavCodecWriter
+// ---------------------------------------------------------------------------
+WavCodecWriter::WavCodecWriter(std::unique_ptr<WavCodec> codec)
+    : codec_(std::move(codec))
+{
+}
+
+WavCodecWriter::~WavCodecWriter()
+{
+  close();
+}
+
+bool WavCodecWriter::open(const char *path, uint32_t sample_rate, uint16_t channels)
+{
+  file_ = fopen(path, "wb");
+  if (!file_)
+    return false;
+
+  sample_rate_ = sample_rate;
+  channels_ = channels;
+  codec_->configure(sample_rate, channels);
+  data_bytes_ = 0;
+  frames_ = 0;
+
+  write_header();
+  fflush(file_);
+  return true;
+}
+
+// RIFF, "fmt " with the codec fields, "fact" (frame count), "data" header.
+// Same size every time, rewritten in place by close().
+void WavCodecWriter::write_header()
+{
+  const WavCodecFormat format = codec_->format();
+  const uint32_t fmt_size = 16 + (uint32_t)format.extra.size();
+  const uint32_t header_size = 12 + (8 + fmt_size) + (8 + 4) + 8;
+  const uint32_t data_size = (uint32_t)data_bytes_;
+  const uint32_t riff_size = header_size - 8 + data_size + (data_size & 1);
+
+  std::vector<uint8_t> header;
+  auto put = [&header](const void *data, size_t size)
+  {
+    header.insert(header.end(), (const uint8_t *)data, (const uint8_t *)data + size);
+  };
+  const uint32_t fact_size = 4;
+  const uint32_t frames = (uint32_t)frames_;
+
+  put("RIFF", 4);
+  put(&riff_size, 4);
+  put("WAVE", 4);
+  put("fmt ", 4);
+  put(&fmt_size, 4);
+  put(&format.format_tag, 2);
+  put(&channels_, 2);
+  put(&sample_rate_, 4);
+  put(&format.byte_rate, 4);
+  put(&format.block_align, 2);
+  put(&format.bits_per_sample, 2);
+  put(format.extra.data(), format.extra.size());
+  put("fact", 4);
+  put(&fact_size, 4);
+  put(&frames, 4);
+  put("data", 4);
+  put(&data_size, 4);
+
+  fwrite(header.data(), 1, header.size(), file_);
+}
+
+void WavCodecWriter::write_s16(const int16_t *samples, size_t frames)
+{
+  if (!file_ || frames == 0)
+    return;
+
+  encoded_.clear();
+  codec_->encode(samples, frames, &encoded_);
+  fwrite(encoded_.data(), 1, encoded_.size(), file_);
+  data_bytes_ += encoded_.size();
+  frames_ += frames;
+}
+
+bool WavCodecWriter::close()
+{
+  if (!file_)
+    return false;
+
+  encoded_.clear();
+  codec_->flush(&encoded_);
+  fwrite(encoded_.data(), 1, encoded_.size(), file_);
+  data_bytes_ += encoded_.size();
+
+  // Chunks are padded to an even size.
+  if (data_bytes_ & 1)
+    fputc(0, file_);
+
+  fseek(file_, 0, SEEK_SET);
+  write_header();
+
+  const bool ok = fclose(file_) == 0;
+  file_ = nullptr;
+  return ok;
+}
+
+// ---------------------------------------------------------------------------
+// WavCodecStream
+// ---------------------------------------------------------------------------
+WavCodecStream::WavCodecStream(std::unique_ptr<WavCodec> codec)
+    : codec_(std::move(codec))
+{
+}
+
+bool WavCodecStream::open(uint32_t sample_rate, uint16_t channels, Output output)
+{
+  codec_->configure(sample_rate, channels);
+  output_ = output;
+  sample_rate_ = sample_rate;
+  emitted_ = 0;
+  return true;
+}
+
+void WavCodecStream::write_s16(const int16_t *samples, size_t frames)
+{
+  emit(codec_->encode(samples, frames, &encoded_));
+}
+
+void WavCodecStream::close()
+{
+  emit(codec_->flush(&encoded_));
+}
+
+void WavCodecStream::emit(size_t frames)
+{
+  if (encoded_.empty() || !output_)
+    return;
+
+  const int64_t pts_us = (int64_t)(emitted_ * 1000000 / sample_rate_);
+  emitted_ += frames;
+  const int64_t end_us = (int64_t)(emitted_ * 1000000 / sample_rate_);
+  output_(new std::vector<uint8_t>(std::move(encoded_)), pts_us, end_us - pts_us);
+  encoded_.clear();
+}
+
+// ---------------------------------------------------------------------------
+// MultiWriter
+// ---------------------------------------------------------------------------
+MultiWriter::MultiWriter(std::unique_ptr<FileWriter> primary, std::vector<Output> extras)
+{
+  workers_.emplace_back(new Worker());
+  workers_.back()->writer = std::move(primary);
+  for (Output &output : extras)
+  {
+    workers_.emplace_back(new Worker());
+    workers_.back()->writer = std::move(output.writer);
+    workers_.back()->path = output.path;
+  }
+}
+
+MultiWriter::~MultiWriter()
+{
+  close();
+}
+
+bool MultiWriter::open(const char *path, uint32_t sample_rate, uint16_t channels)
+{
+  workers_[0]->path = path;
+  for (size_t i = 0; i < workers_.size(); i++)
+  {
+    if (!workers_[i]->writer->open(workers_[i]->path.c_str(), sample_rate, channels))
+    {
+      // No partial set of outputs left behind
+      for (size_t j = 0; j < i; j++)
+      {
+        workers_[j]->writer->close();
+        remove(workers_[j]->path.c_str());
+      }
+      return false;
+    }
+  }
+
+  channels_ = channels;
+  frames_ = 0;
+  lost_frames_ = 0;
+  closing_ = false;
+  chunks_.clear();
+  free_.clear();
+  current_ = nullptr;
+  for (size_t i = 0; i < kChunks; i++)
+  {
+    chunks_.emplace_back(new Chunk());
+    chunks_.back()->samples.resize(kChunkFrames * channels);
+    free_.push_back(chunks_.back().get());
+  }
+  for (std::unique_ptr<Worker> &worker : workers_)
+  {
+    Worker *w = worker.get();
+    w->thread = std::thread([this, w]()
+                            { run(w); });
+  }
+  return true;
+}
+
+void MultiWriter::write_s16(const int16_t *samples, size_t frames)
+{
+  if (frames == 0 || workers_.empty() || !workers_[0]->thread.joinable())
+    return;
+
+  frames_ += frames;
+  while (frames > 0)
+  {
+    if (!current_)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (free_.empty())
+      {
+        lost_frames_ += frames;
+        return;
+      }
+      current_ = free_.back();
+      free_.pop_back();
+      current_->frames = 0;
+    }
+
+    const size_t n = std::min(frames, kChunkFrames - current_->frames);
+    memcpy(&current_->samples[current_->frames * channels_], samples,
+           n * channels_ * sizeof(int16_t));
+    current_->frames += n;
+    samples += n * channels_;
+    frames -= n;
+
+    if (current_->frames == kChunkFrames)
+      submit_current();
+  }
+}
+
+void MultiWriter::submit_current()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    current_->pending = workers_.size();
+    for (std::unique_ptr<Worker> &worker : workers_)
+      worker->queue.push_back(current_);
+  }
+  current_ = nullptr;
+  cond_.notify_all();
+}
+
+void MultiWriter::run(Worker *worker)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;)
+  {
+    cond_.wait(lock, [this, worker]()
+               { return closing_ || !worker->queue.empty(); });
+    if (worker->queue.empty())
+      return; // closing, all written
+
+    Chunk *chunk = worker->queue.front();
+    worker->queue.pop_front();
+    lock.unlock();
+    worker->writer->write_s16(chunk->samples.data(), chunk->frames);
+    lock.lock();
+    if (--chunk->pending == 0)
+      free_.push_back(chunk);
+  }
+}
+
+bool MultiWriter::close()
+{
+  if (current_ && current_->frames > 0 && workers_[0]->thread.joinable())
+    submit_current();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closing_ = true;
+  }
+  cond_.notify_all();
+
+  bool ok = true;
+  for (std::unique_ptr<Worker> &worker : workers_)
+  {
+    if (worker->thread.joinable())
+      worker->thread.join();
+    ok = worker->writer->close() && ok;
+  }
+  return ok && lost_frames_ == 0;
+}
@@ -0,0 +1,278 @@
+#ifndef RECORD_LINUX_WRITER_H_
+#define RECORD_LINUX_WRITER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "record_dither.h"
+#include "record_format.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//  Audio file writers
+//
+//  A FileWriter receives the captured interleaved S16 frames of a session
+//  from the capture thread and produces the file in its container/codec.
+//  write_s16() must stay cheap: writers doing real encoding work hand it to
+//  a worker thread. close() completes the file (headers, seek data) and may
+//  block until pending work is done.
+////////////////////////////////////////////////////////////////////////////////
+
+class FileWriter
+{
+public:
+  virtual ~FileWriter() {}
+
+  virtual bool open(const char *path, uint32_t sample_rate, uint16_t channels) = 0;
+  virtual void write_s16(const int16_t *samples, size_t frames) = 0;
+  virtual bool close() = 0;
+
+  // Frames received so far.
+  virtual uint64_t frames() const = 0;
+};
+
+// Compressed stream mode: encodes the captured S16 frames and hands the
+// payload to [Output] with its presentation time on the session timeline
+// (which can start below 0 by the codec delay) and duration. Like
+// FileWriter, write_s16() is called from the capture thread and must stay
+// cheap. Output may run on a worker thread; it takes ownership of [data].
+class StreamEncoder
+{
+public:
+  typedef std::function<void(std::vector<uint8_t> *data, int64_t pts_us, int64_t duration_us)> Output;
+
+  virtual ~StreamEncoder() {}
+
+  virtual bool open(uint32_t sample_rate, uint16_t channels, Output output) = 0;
+  virtual void write_s16(const int16_t *samples, size_t frames) = 0;
+
+  // Emits the remaining payload (from the calling thread).
+  virtual void close() = 0;
+};
+
+// Encoder part of the session config.
+struct EncoderSettings
+{
+  std::string encoder = "wav"; // AudioEncoder name
+  int bit_rate = 128000;
+  int flac_level = 5;       // 0 (fastest) - 8 (smallest)
+  bool ogg_framing = false; // stream mode
+  SampleFormat sample_format = SampleFormat::kS16; // WAV
+  DitherMode dither = DitherMode::kTpdf;           // WAV narrower than S16
+};
+
+// Encoder names of the Linux only codecs (LinuxRecordConfig.codec).
+// Stored in WAV files, streamed raw.
+extern const char *const kEncoderImaAdpcm;
+extern const char *const kEncoderMuLaw;
+extern const char *const kEncoderALaw;
+
+// Whether [encoder] (AudioEncoder name) has a file writer.
+bool file_writer_supported(const std::string &encoder);
+
+// Writer for [settings], falling back to WAV for unsupported encoders.
+FileWriter *file_writer_create(const EncoderSettings &settings);
+
+// Writes one capture to several files, each writer running on its own
+// worker thread. Captured frames are copied once into a chunk shared by
+// all workers and recycled when the last one is done with it. The chunks
+// are allocated by open() and filled before they are queued: frames
+// finding none free (workers too far behind) are dropped and counted by
+// lost_frames(), and close() then returns false.
+class MultiWriter : public FileWriter
+{
+public:
+  struct Output
+  {
+    std::unique_ptr<FileWriter> writer;
+    std::string path;
+  };
+
+  // [primary] is opened at the path given to open(), [extras] at theirs.
+  MultiWriter(std::unique_ptr<FileWriter> primary, std::vector<Output> extras);
+  ~MultiWriter() override;
+
+  bool open(const char *path, uint32_t sample_rate, uint16_t channels) override;
+  void write_s16(const int16_t *samples, size_t frames) override;
+  bool close() override;
+  uint64_t frames() const override { return frames_; }
+
+  uint64_t lost_frames() const { return lost_frames_; }
+
+private:
+  // Up to ~5.5 s of backlog at 48 kHz.
+  static const size_t kChunks = 64;
+  static const size_t kChunkFrames = 4096;
+
+  struct Chunk
+  {
+    std::vector<int16_t> samples;
+    size_t frames = 0;
+    size_t pending = 0; // workers yet to write it
+  };
+
+  struct Worker
+  {
+    std::unique_ptr<FileWriter> writer;
+    std::string path;
+    std::deque<Chunk *> queue;
+    std::thread thread;
+  };
+
+  void run(Worker *worker);
+  void submit_current();
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  uint16_t channels_ = 0;
+  uint64_t frames_ = 0;
+  uint64_t lost_frames_ = 0;
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::vector<std::unique_ptr<Chunk>> chunks_; // the kChunks allocated
+  std::vector<Chunk *> free_;
+  Chunk *current_ = nullptr; // being filled by write_s16()
+  bool closing_ = false;
+};
+
+// Whether stream mode can deliver [encoder]. "pcm16bits" is sent as is.
+bool stream_encoder_supported(const std::string &encoder);
+
+// Stream encoder for [settings], nullptr for raw PCM.
+StreamEncoder *stream_encoder_create(const EncoderSettings &settings);
+
+////////////////////////////////////////////////////////////////////////////////
+//  WAV (RIFF, integer PCM or IEEE float)
+////////////////////////////////////////////////////////////////////////////////
+#pragma pack(push, 1)
+typedef struct
+{
+  char riff[4];
+  uint32_t overall_size;
+  char wave[4];
+  char fmt_chunk_marker[4];
+  uint32_t length_of_fmt;
+  uint16_t format_type;
+  uint16_t channels;
+  uint32_t sample_rate;
+  uint32_t byterate;
+  uint16_t block_align;
+  uint16_t bits_per_sample;
+  char data_chunk_header[4];
+  uint32_t data_size;
+} WavHeader;
+#pragma pack(pop)
+
+class WavWriter : public FileWriter
+{
+public:
+  explicit WavWriter(SampleFormat format = SampleFormat::kS16,
+                     DitherMode dither = DitherMode::kTpdf);
+  ~WavWriter() override;
+
+  bool open(const char *path, uint32_t sample_rate, uint16_t channels) override;
+  void write_s16(const int16_t *samples, size_t frames) override;
+  bool close() override;
+  uint64_t frames() const override { return frames_; }
+
+private:
+  // Samples converted per fwrite() when the format is not S16.
+  static const size_t kConvertSamples = 4096;
+
+  SampleFormat format_;
+  DitherMode dither_mode_;
+  Ditherer dither_;
+  std::vector<uint8_t> converted_;
+  FILE *file_ = nullptr;
+  WavHeader header_;
+  uint64_t data_bytes_ = 0;
+  uint64_t frames_ = 0;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//  WAV codecs (G.711, IMA ADPCM)
+//
+//  Codecs cheap enough to run inline on the capture thread. Each is written
+//  to WAV with its own "fmt " fields and a "fact" chunk (WavCodecWriter),
+//  or streamed as its raw units with their timestamps (WavCodecStream).
+////////////////////////////////////////////////////////////////////////////////
+struct WavCodecFormat
+{
+  uint16_t format_tag = 0;
+  uint16_t block_align = 0;
+  uint16_t bits_per_sample = 0;
+  uint32_t byte_rate = 0;
+  std::vector<uint8_t> extra; // cbSize and the codec specific fields
+};
+
+class WavCodec
+{
+public:
+  virtual ~WavCodec() {}
+
+  virtual void configure(uint32_t sample_rate, uint16_t channels) = 0;
+  virtual WavCodecFormat format() const = 0;
+
+  // Appends the complete units encoded from [frames] interleaved frames to
+  // [out] (buffering the rest). Returns the number of frames they hold.
+  virtual size_t encode(const int16_t *samples, size_t frames, std::vector<uint8_t> *out) = 0;
+
+  // Appends the buffered frames as a last, padded, unit. Returns the
+  // number of frames added.
+  virtual size_t flush(std::vector<uint8_t> *out) = 0;
+};
+
+// Creates the codec of [encoder], nullptr if it is not a WAV codec.
+std::unique_ptr<WavCodec> wav_codec_create(const std::string &encoder);
+
+class WavCodecWriter : public FileWriter
+{
+public:
+  explicit WavCodecWriter(std::unique_ptr<WavCodec> codec);
+  ~WavCodecWriter() override;
+
+  bool open(const char *path, uint32_t sample_rate, uint16_t channels) override;
+  void write_s16(const int16_t *samples, size_t frames) override;
+  bool close() override;
+  uint64_t frames() const override { return frames_; }
+
+private:
+  void write_header();
+
+  std::unique_ptr<WavCodec> codec_;
+  FILE *file_ = nullptr;
+  uint32_t sample_rate_ = 0;
+  uint16_t channels_ = 0;
+  std::vector<uint8_t> encoded_;
+  uint64_t data_bytes_ = 0;
+  uint64_t frames_ = 0;
+};
+
+class WavCodecStream : public StreamEncoder
+{
+public:
+  explicit WavCodecStream(std::unique_ptr<WavCodec> codec);
+
+  bool open(uint32_t sample_rate, uint16_t channels, Output output) override;
+  void write_s16(const int16_t *samples, size_t frames) override;
+  void close() override;
+
+private:
+  void emit(size_t frames);
+
+  std::unique_ptr<WavCodec> codec_;
+  Output output_;
+  uint32_t sample_rate_ = 0;
+  std::vector<uint8_t> encoded_;
+  uint64_t emitted_ = 0; // frames
+};
+
+#endif // RECORD_LINUX_WRITER_H_
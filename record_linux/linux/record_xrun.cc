@@ -0,0 +1,61 @@
+#include "record_xrun.h"
+
+#include <algorithm>
+
+namespace
+{
+  const int64_t kWindowUs = 1000000;
+}
+
+void XrunDetector::configure(uint32_t rate, size_t tolerance_frames)
+{
+  rate_ = rate;
+  tolerance_ = (int64_t)tolerance_frames;
+  started_ = false;
+}
+
+uint64_t XrunDetector::update(int64_t now_us, size_t frames, size_t backlog_frames)
+{
+  if (rate_ == 0)
+    return 0;
+
+  const bool first = !started_;
+  if (first)
+  {
+    started_ = true;
+    settled_ = false;
+    start_us_ = now_us;
+    delivered_ = 0;
+    window_end_us_ = now_us + kWindowUs;
+  }
+  delivered_ += (int64_t)frames;
+
+  const int64_t produced = (now_us - start_us_) * (int64_t)rate_ / 1000000;
+  int64_t missing = produced - delivered_ - (int64_t)backlog_frames;
+  if (first)
+  {
+    reference_ = window_min_ = missing;
+    return 0;
+  }
+
+  // The first second only sets the reference: the first reads come as the
+  // stream starts, at any pace. A loss meanwhile is found once it is set.
+  uint64_t lost = 0;
+  if (settled_ && missing - reference_ > tolerance_)
+  {
+    lost = (uint64_t)(missing - reference_);
+    delivered_ += (int64_t)lost;
+    missing = reference_;
+  }
+
+  // Follows the drift, both ways, a second at a time.
+  window_min_ = std::min(window_min_, missing);
+  if (now_us >= window_end_us_)
+  {
+    reference_ = window_min_;
+    window_min_ = missing;
+    settled_ = true;
+    window_end_us_ = now_us + kWindowUs;
+  }
+  return lost;
+}
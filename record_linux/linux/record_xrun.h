@@ -0,0 +1,45 @@
+#ifndef RECORD_LINUX_XRUN_H_
+#define RECORD_LINUX_XRUN_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+////////////////////////////////////////////////////////////////////////////////
+//  Overrun detection
+//
+//  A record stream does not report an overrun: once its buffer on the
+//  server is full, the oldest audio is dropped and the reader never knows.
+//  It shows in the clock though. The frames the source produced since the
+//  first read, as measured on the monotonic clock, minus those delivered
+//  and those already waiting, stay within a fragment or two of a constant;
+//  audio dropped on the way makes the difference step up by as much.
+//
+//  The constant drifts with the device clock against the system one, so
+//  it is taken again as the lowest difference of each second: a step
+//  beyond [tolerance_frames] (the jitter of the deliveries) counts as lost,
+//  and is added back so that it is reported once.
+////////////////////////////////////////////////////////////////////////////////
+class XrunDetector
+{
+public:
+  void configure(uint32_t rate, size_t tolerance_frames);
+  // The next update() starts over, e.g. after the stream was corked.
+  void restart() { started_ = false; }
+
+  // [frames] just delivered at [now_us] (monotonic), [backlog_frames] more
+  // already waiting. Returns the frames lost before them.
+  uint64_t update(int64_t now_us, size_t frames, size_t backlog_frames);
+
+private:
+  uint32_t rate_ = 0;
+  int64_t tolerance_ = 0;
+  bool started_ = false;
+  bool settled_ = false; // past the first window
+  int64_t start_us_ = 0;
+  int64_t delivered_ = 0; // including the frames found lost
+  int64_t reference_ = 0; // expected difference
+  int64_t window_min_ = 0;
+  int64_t window_end_us_ = 0;
+};
+
+#endif // RECORD_LINUX_XRUN_H_
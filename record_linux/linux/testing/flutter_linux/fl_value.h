@@ -41,6 +41,10 @@ void fl_value_set_string_take(FlValue* value, const gchar* key, FlValue* item);
 FlValueType fl_value_get_type(const FlValue* self);
 const gchar* fl_value_get_string(const FlValue* self);
 gboolean fl_value_get_bool(const FlValue* self);
+int64_t fl_value_get_int(const FlValue* self);
+double fl_value_get_float(const FlValue* self);
+FlValue* fl_value_lookup_string(FlValue* self, const gchar* key);
+void fl_value_unref(FlValue* self);
 
 G_END_DECLS
 
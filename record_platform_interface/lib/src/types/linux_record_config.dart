@@ -0,0 +1,344 @@
+import 'package:record_platform_interface/src/types/types.dart';
+
+/// Linux specific configuration for recording.
+class LinuxRecordConfig {
+  /// PulseAudio source used as far-end reference when `echoCancel` is
+  /// enabled.
+  ///
+  /// This is usually the monitor of the sink playing the far-end audio.
+  /// Defaults to the monitor of the default sink (`@DEFAULT_MONITOR@`).
+  final String? echoReference;
+
+  /// Builds a min/max/RMS waveform pyramid while recording
+  /// (256, 4096 and 65536 frames per bucket).
+  ///
+  /// Updates are streamed live and, when recording to a file, the pyramid
+  /// is written next to it as `<path>.peaks` when the recording stops.
+  final bool waveformPeaks;
+
+  /// Voice activity detection behaviour.
+  ///
+  /// When [LinuxVadMode.gate] is used while recording to a file, a timing
+  /// map of the kept segments is written next to it as `<path>.vad.json`
+  /// so that the trimmed output can be aligned to wall clock time.
+  final LinuxVadMode vadMode;
+
+  /// Time of silence after speech before speech is considered ended.
+  final int vadHangoverMs;
+
+  /// Audio kept before the detected speech onset when trimming.
+  final int vadPreRollMs;
+
+  /// History kept while capture is armed with `startPreRoll`.
+  ///
+  /// The buffer is allocated once when arming.
+  final int preRollBufferMs;
+
+  /// When capture is armed, how far in the past a recording begins.
+  ///
+  /// Also kept before the triggering audio of each VOX take.
+  /// Clamped to the history available. Ignored otherwise.
+  final int preRollMs;
+
+  /// Level (dBFS) above which a VOX take starts.
+  final double voxThresholdDb;
+
+  /// Time the level must stay above [voxThresholdDb] to start a VOX take.
+  final int voxMinDurationMs;
+
+  /// Time the level must stay below [voxThresholdDb] to end a VOX take.
+  final int voxHangMs;
+
+  /// FLAC compression level, from 0 (fastest) to 8 (smallest file).
+  ///
+  /// Frames are encoded in parallel on up to 4 cores of the shared worker
+  /// pool.
+  final int flacLevel;
+
+  /// In stream mode with `AudioEncoder.opus`, deliver Ogg pages (the
+  /// concatenated stream is an Ogg/Opus file) instead of bare Opus packets.
+  final bool streamOggFraming;
+
+  /// Sample format requested from the capture device.
+  ///
+  /// Audio is processed as 16-bit PCM; wider formats keep their precision
+  /// for level metering when no audio processing is enabled.
+  final LinuxSampleFormat captureFormat;
+
+  /// Sample format of WAV files and of PCM streams.
+  ///
+  /// [LinuxSampleFormat.u8] or [LinuxSampleFormat.s16]: audio is processed
+  /// as 16-bit PCM, so starting with a wider format fails
+  /// (`format_unsupported`) rather than padding it.
+  final LinuxSampleFormat outputFormat;
+
+  /// Rate at which the device is opened, when it differs from the
+  /// requested `sampleRate`.
+  ///
+  /// Set it to a rate the device supports natively (e.g. 48000) to resample
+  /// in-process with [resamplerQuality] instead of in the sound server.
+  /// Defaults to `sampleRate`.
+  final int? captureSampleRate;
+
+  /// Quality of the in-process resampler, see [captureSampleRate].
+  final LinuxResamplerQuality resamplerQuality;
+
+  /// Maps the device channels to the recorded ones.
+  ///
+  /// One row of gains per recorded channel, one gain per device channel:
+  /// the device is opened with as many channels as a row has, and
+  /// `numChannels` is replaced by the number of rows. For example, on a
+  /// 4 channel interface, `[[0, 0, 1, 0], [1, 0, 0, 0]]` records inputs 3
+  /// and 1 as left and right, and `[[0.5, 0.5, 0, 0]]` a mono mix of the
+  /// first pair.
+  final List<List<double>>? channelMatrix;
+
+  /// Dither added when samples lose precision on the way to the output,
+  /// e.g. [captureFormat] wider than 16-bit, resampled or mixed audio,
+  /// or a [LinuxSampleFormat.u8] [outputFormat].
+  final LinuxDither dither;
+
+  /// Linux only codec, used instead of `encoder` when set.
+  ///
+  /// Files are WAV (suggested extension: `wav`), streams carry the raw
+  /// codec data, see [LinuxCodec].
+  final LinuxCodec? codec;
+
+  /// Other files written from the same capture when recording to a file,
+  /// each encoded on its own thread (e.g. a small Opus proxy of a FLAC
+  /// master).
+  ///
+  /// With VOX, their takes are numbered like the main file.
+  final List<LinuxRecordOutput> outputs;
+
+  /// How the capture is driven, see [LinuxCaptureEngine].
+  ///
+  /// Pre-roll and VOX always capture on their own thread.
+  final LinuxCaptureEngine captureEngine;
+
+  /// Real-time scheduling of the capture thread, see [LinuxRealtimePolicy].
+  ///
+  /// Granted directly with `CAP_SYS_NICE` or an `RLIMIT_RTPRIO`, else
+  /// through RealtimeKit (round robin only). The capture buffers are then
+  /// locked in RAM. Applies to [LinuxCaptureEngine.thread].
+  final LinuxRealtimePolicy realtimePolicy;
+
+  /// Real-time priority, from 1 to 99, within what is allowed.
+  final int realtimePriority;
+
+  /// CPUs the capture thread may run on, any when empty.
+  final List<int> cpuAffinity;
+
+  /// Replaces audio lost to overruns with as much silence, so that the
+  /// recording stays as long as the session and in time with it.
+  ///
+  /// Either way, each loss is reported by `RecordLinux.onDropout`.
+  final bool fillDropouts;
+
+  /// Reconnects a capture lost mid-session (sound server restarted, device
+  /// unplugged) instead of stopping it: to the session device, alternately
+  /// with [fallbackDeviceId], until it works or the session is stopped.
+  ///
+  /// The file or stream stays open, and the audio captured before the loss
+  /// is kept. The outage is reported like a dropout, filled with silence
+  /// with [fillDropouts] to keep the recording in time, and by
+  /// `RecordLinux.onCaptureRecovered`.
+  final bool reconnect;
+
+  /// Device tried when the session device cannot be reconnected, the
+  /// default source when null. See [reconnect].
+  final String? fallbackDeviceId;
+
+  const LinuxRecordConfig({
+    this.echoReference,
+    this.waveformPeaks = false,
+    this.vadMode = LinuxVadMode.disabled,
+    this.vadHangoverMs = 300,
+    this.vadPreRollMs = 200,
+    this.preRollBufferMs = 10000,
+    this.preRollMs = 0,
+    this.voxThresholdDb = -35.0,
+    this.voxMinDurationMs = 150,
+    this.voxHangMs = 2000,
+    this.flacLevel = 5,
+    this.streamOggFraming = false,
+    this.captureFormat = LinuxSampleFormat.s16,
+    this.outputFormat = LinuxSampleFormat.s16,
+    this.captureSampleRate,
+    this.resamplerQuality = LinuxResamplerQuality.medium,
+    this.channelMatrix,
+    this.dither = LinuxDither.tpdf,
+    this.codec,
+    this.outputs = const [],
+    this.captureEngine = LinuxCaptureEngine.thread,
+    this.realtimePolicy = LinuxRealtimePolicy.off,
+    this.realtimePriority = 10,
+    this.cpuAffinity = const [],
+    this.fillDropouts = false,
+    this.reconnect = false,
+    this.fallbackDeviceId,
+  });
+
+  Map<String, dynamic> toMap() {
+    return {
+      'echoReference': echoReference,
+      'waveformPeaks': waveformPeaks,
+      'vadMode': vadMode.name,
+      'vadHangoverMs': vadHangoverMs,
+      'vadPreRollMs': vadPreRollMs,
+      'preRollBufferMs': preRollBufferMs,
+      'preRollMs': preRollMs,
+      'voxThresholdDb': voxThresholdDb,
+      'voxMinDurationMs': voxMinDurationMs,
+      'voxHangMs': voxHangMs,
+      'flacLevel': flacLevel,
+      'streamOggFraming': streamOggFraming,
+      'captureFormat': captureFormat.name,
+      'outputFormat': outputFormat.name,
+      'captureSampleRate': captureSampleRate,
+      'resamplerQuality': resamplerQuality.name,
+      'channelMatrix': channelMatrix,
+      'dither': dither.name,
+      'codec': codec?.name,
+      'outputs': outputs.map((output) => output.toMap()).toList(),
+      'captureEngine': captureEngine.name,
+      'realtimePolicy': realtimePolicy.name,
+      'realtimePriority': realtimePriority,
+      'cpuAffinity': cpuAffinity,
+      'fillDropouts': fillDropouts,
+      'reconnect': reconnect,
+      'fallbackDeviceId': fallbackDeviceId,
+    };
+  }
+}
+
+/// Voice activity detection behaviour on Linux.
+enum LinuxVadMode {
+  /// No detection.
+  disabled,
+
+  /// Emits speech start/end events, audio is recorded untouched.
+  events,
+
+  /// Emits events and drops silence from the recorded file or stream.
+  gate,
+}
+
+/// Little endian PCM sample formats on Linux.
+enum LinuxSampleFormat {
+  /// Unsigned 8-bit.
+  u8,
+
+  /// Signed 16-bit.
+  s16,
+
+  /// Signed 24-bit, packed in 3 bytes.
+  s24,
+
+  /// Signed 32-bit.
+  s32,
+
+  /// 32-bit float, nominally in [-1, 1].
+  f32,
+}
+
+/// Windowed-sinc resampler presets on Linux, from cheapest to most accurate.
+enum LinuxResamplerQuality {
+  /// About 54 dB of stopband attenuation.
+  low,
+
+  /// About 86 dB.
+  medium,
+
+  /// About 99 dB.
+  high,
+
+  /// About 117 dB, with the narrowest transition band.
+  best,
+}
+
+/// Dither applied when reducing bit depth on Linux.
+enum LinuxDither {
+  /// Plain rounding.
+  none,
+
+  /// Triangular (TPDF) white noise of +/-1 LSB.
+  tpdf,
+
+  /// TPDF noise rising with frequency, less audible.
+  highpass,
+
+  /// TPDF with noise shaping, moving the noise where hearing is least
+  /// sensitive (tuned for 44.1 kHz).
+  shaped,
+}
+
+/// Lightweight codecs on Linux, cheap enough for the smallest boards.
+enum LinuxCodec {
+  /// IMA ADPCM, 4 bits per sample.
+  ///
+  /// Streams carry whole WAV blocks (a header per channel, then the
+  /// interleaved nibbles), each decodable on its own.
+  imaAdpcm,
+
+  /// G.711 mu-law, 8 bits per sample.
+  muLaw,
+
+  /// G.711 A-law, 8 bits per sample.
+  aLaw,
+}
+
+/// Capture models on Linux.
+enum LinuxCaptureEngine {
+  /// A thread per recording, blocked on its capture stream. The stream is
+  /// kept warm between recordings.
+  thread,
+
+  /// One event loop serving the capture streams of every recording in the
+  /// process, the audio being processed on a small shared worker pool.
+  /// Suited to many concurrent recordings.
+  eventLoop,
+}
+
+/// Scheduling policies of the capture thread on Linux.
+enum LinuxRealtimePolicy {
+  /// Normal time sharing.
+  off,
+
+  /// SCHED_FIFO: runs until it blocks, ahead of every normal thread.
+  fifo,
+
+  /// SCHED_RR: like [fifo], sharing time with threads of the same priority.
+  roundRobin,
+}
+
+/// Another file recorded alongside the main one on Linux.
+class LinuxRecordOutput {
+  /// Path of the file.
+  final String path;
+
+  /// Encoder of the file.
+  final AudioEncoder encoder;
+
+  /// Bit rate, for lossy encoders.
+  final int bitRate;
+
+  /// Linux only codec, used instead of [encoder] when set.
+  final LinuxCodec? codec;
+
+  const LinuxRecordOutput({
+    required this.path,
+    this.encoder = AudioEncoder.wav,
+    this.bitRate = 128000,
+    this.codec,
+  });
+
+  Map<String, dynamic> toMap() {
+    return {
+      'path': path,
+      'encoder': encoder.name,
+      'bitRate': bitRate,
+      'codec': codec?.name,
+    };
+  }
+}
@@ -60,6 +60,9 @@ class RecordConfig {
   /// iOS specific configuration.
   final IosRecordConfig iosConfig;
 
+  /// Linux specific configuration.
+  final LinuxRecordConfig linuxConfig;
+
   const RecordConfig({
     this.encoder = AudioEncoder.aacLc,
     this.bitRate = 128000,
@@ -71,6 +74,7 @@ class RecordConfig {
     this.noiseSuppress = false,
     this.androidConfig = const AndroidRecordConfig(),
     this.iosConfig = const IosRecordConfig(),
+    this.linuxConfig = const LinuxRecordConfig(),
   });
 
   Map<String, dynamic> toMap() {
@@ -85,6 +89,7 @@ class RecordConfig {
       'noiseSuppress': noiseSuppress,
       'androidConfig': androidConfig.toMap(),
       'iosConfig': iosConfig.toMap(),
+      'linuxConfig': linuxConfig.toMap(),
     };
   }
 }
@@ -3,5 +3,6 @@ export 'package:record_platform_interface/src/types/android_record_config.dart';
 export 'package:record_platform_interface/src/types/audio_encoder.dart';
 export 'package:record_platform_interface/src/types/input_device.dart';
 export 'package:record_platform_interface/src/types/ios_record_config.dart';
+export 'package:record_platform_interface/src/types/linux_record_config.dart';
 export 'package:record_platform_interface/src/types/record_config.dart';
 export 'package:record_platform_interface/src/types/record_state.dart';